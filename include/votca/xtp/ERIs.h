@@ -41,19 +41,27 @@ namespace votca { namespace xtp {
         
     public:
       
-        
+        ERIs():_threecenter_symmetrized(false),_4c_screening(1e-12){};
         
         void Initialize(AOBasis &_dftbasis, AOBasis &_auxbasis, const ub::matrix<double> &inverse_Coulomb);
         void Initialize_4c_small_molecule(AOBasis &_dftbasis); ///////////
       
         const ub::matrix<double>& getEXX() const{return _EXXs;}
+        double& getEXXsenergy(){return _EXXenergy;}
         
         const ub::matrix<double>& getERIs() const{return _ERIs;}
         double& getERIsenergy(){return _ERIsenergy;}
         
         void CalculateERIs(const ub::matrix<double> &DMAT);
+        // adds J of the density change since the last call, requires a previous
+        // CalculateERIs and falls back to it otherwise
+        void CalculateERIs_incremental(const ub::matrix<double> &DMAT, double tolerance);
         void CalculateERIs_4c_small_molecule(const ub::matrix<double> &DMAT); ///////////////////////////////////////
         void CalculateEXX_4c_small_molecule(const ub::matrix<double> &DMAT);
+        // exchange matrix K_ij=sum_kl (ik|jl) D_kl from the three-center integrals (RI-K)
+        void CalculateEXX(const ub::matrix<double> &DMAT);
+        // gradient of the RI Coulomb energy 1/2 tr(D J) with respect to the atoms (natoms x 3)
+        ub::matrix<double> CalculateGradient(const AOBasis &_dftbasis, const AOBasis &_auxbasis, const ub::matrix<double> &DMAT, int natoms);
         
         int getSize1(){return _ERIs.size1();}
         int getSize2(){return _ERIs.size2();}
@@ -64,7 +72,25 @@ namespace votca { namespace xtp {
         ub::matrix<double> _inverse_Coulomb;
         
         TCMatrix_dft _threecenter;
+        // after the first RI-K build the three-center integrals are contracted with V^-1/2,
+        // the Coulomb part then needs no metric
+        bool _threecenter_symmetrized;
+        void SymmetrizeThreecenter();
+        // I_P = sum_mn D_mn (mn|P)
+        ub::matrix<double> ContractThreecenter(const ub::matrix<double> &DMAT) const;
+        // sum_P K_P (ij|P), aux functions with |K_P| max|(ij|P)| < tolerance are skipped
+        ub::matrix<double> ContractFit(const ub::matrix<double> &K, double tolerance);
+        // largest |(ij|P)| of every aux function
+        ub::vector<double> _threecenter_max;
+        // density of the current _ERIs
+        ub::matrix<double> _dmat_last;
         FCMatrix_dft _fourcenter; ////////////////////////
+        // basis function pair (i,j), i<=j, of every packed index ij of the four-center vector
+        std::vector< std::pair<unsigned,unsigned> > _4c_pairs;
+        // Schwarz factors sqrt((ij|ij)), contributions below _4c_screening are skipped
+        ub::vector<double> _4c_schwarz;
+        double _4c_schwarzmax;
+        double _4c_screening;
        
         ub::matrix<double> _ERIs;
         ub::matrix<double> _EXXs;
@@ -27,6 +27,7 @@
 #include <boost/numeric/ublas/matrix_proxy.hpp>
 #include <boost/math/constants/constants.hpp>
 #include <votca/xtp/basisset.h>
+#include <votca/xtp/aoshellpair.h>
 #include <boost/numeric/ublas/symmetric.hpp>
 
 
@@ -44,8 +45,9 @@ class AOShell;
  */
 class AOBasis 
 {   
+    friend class AOShellPair;
 public:
-        AOBasis( ) { ; }
+        AOBasis( ) : _shellpairs_filled(false), _shellpair_nshells(0) { ; }
         ~AOBasis(); 
       
        void ReorderMOs(ub::matrix<double> &v,const std::string& start, const std::string& target ); 
@@ -60,6 +62,11 @@ public:
     
     unsigned int AOBasisSize() const {return _AOBasisSize; }
     
+    // builds the primitive pairs of all pairs of shells unless done before,
+    // call outside of parallel loops over the shells, AOShellPair computes
+    // the pairs itself as long as the table is missing
+    void PrepareShellPairs() const;
+    
     typedef std::vector< AOShell* >::const_iterator AOShellIterator;
     AOShellIterator firstShell() const{ return _aoshells.begin(); }
     AOShellIterator lastShell() const{ return _aoshells.end(); }
@@ -99,7 +106,6 @@ public:
     void addMultiplierShell(const std::string& start,const std::string& target,const std::string& shell, std::vector<int>& multiplier );  
     
     
-    
     void addTrafoCartShell( const AOShell* shell , ub::matrix_range< ub::matrix<double> >& _submatrix );
     
     int getMaxFunctions ( );
@@ -107,6 +113,17 @@ public:
 private:
     unsigned int _AOBasisSize;
     
+    void FillShellPairs() const;
+    
+    // significant primitive pairs of shells (row,col) with row>=col are stored
+    // contiguously from _shellpairs[_shellpair_offsets[row*(row+1)/2+col]] on,
+    // AOShellPair transposes them for row<col
+    mutable bool _shellpairs_filled;
+    mutable unsigned _shellpair_nshells;
+    mutable std::vector<AOPrimitivePair> _shellpairs;
+    mutable std::vector<unsigned> _shellpair_offsets;
+    mutable std::vector< ub::matrix<double> > _primitive_trafos;
+    
 };
 
 
@@ -22,6 +22,7 @@
 
 #include <votca/xtp/aobasis.h>
 #include <votca/xtp/aoshell.h>
+#include <votca/xtp/aoshellpair.h>
 #include <votca/ctp/apolarsite.h>
 #include <votca/ctp/polarseg.h>
 #include <votca/xtp/votca_config.h>
@@ -77,6 +78,15 @@ namespace votca { namespace xtp {
         
         void PrintIndexToFunction(const AOBasis& aobasis);
         
+        // adds a copy of shell moved by shift to basis, with the atom index
+        // replaced by index, start index and offset are kept
+        static const AOShell* AddDisplacedShell(AOBasis& basis, const AOShell* shell, const vec& shift, int index);
+        // adds the derivatives d/dA_direction of the functions of shell at A to
+        // basis, a shell with one l more whose trafo (getTrafo) maps onto them,
+        // all FillBlock kernels evaluate it in place of the shell
+        static const AOShell* AddDerivativeShell(AOBasis& basis, const AOShell* shell, int direction);
+        // position of the cartesian x^nx y^ny z^nz in the order of namespace Cart
+        static int getCartIndex( int nx, int ny, int nz );
         
     };
     
@@ -103,10 +113,35 @@ namespace votca { namespace xtp {
         // block fill prototype
         virtual void FillBlock(ub::matrix_range< ub::matrix<double> >& _matrix,const  AOShell* _shell_row,const AOShell* _shell_col, AOBasis* ecp = NULL) {} ;
 
+        // sum_mn D_mn M_mn of the symmetric matrix M, block by block without storing M
+        double Contract(const AOBasis& aobasis, const ub::matrix<double>& D, AOBasis* ecp = NULL);
+        // sum_mn D_mn dM_mn/dR_A (natoms x 3), FillBlock of derivative shells
+        // (AddDerivativeShell); an operator centred on operator_atom, e.g. a
+        // nuclear charge, gets the negative sum of the basis terms, otherwise
+        // M_mn is taken to depend on the distance of the functions only
+        ub::matrix<double> FillGradient(const AOBasis& aobasis, const ub::matrix<double>& D, int natoms, AOBasis* ecp = NULL, int operator_atom = -1);
+
         // ~AOMatrix(){};
     protected:
         ub::matrix<double> _aomatrix; 
         vec _gridpoint;
+        
+        // far-field expansion of external potentials: a site at distance R from
+        // the centre of a shell pair is added as S*phi + mu*grad(phi), if the
+        // squared extent of the pair is below farfield_tolerance*R^2
+        void PrepareFarField(const AOBasis& aobasis, double farfield_tolerance);
+        void ClearFarField();
+        bool IsFarField(double extent2, const vec& center, const vec& site) const;
+        void AddFarField(ub::matrix_range< ub::matrix<double> >& _matrix,const AOShell* _shell_row,const AOShell* _shell_col, const vec& center, double phi, const vec& gradphi) const;
+        // centre and squared extent of the product distribution of a shell pair,
+        // returns false if no pair of primitives overlaps
+        static bool ShellPairDistribution(const AOShell* _shell_row,const AOShell* _shell_col, vec& center, double& extent2);
+        // sum_ij D_ij M_ij over the block of a shell pair
+        double ContractBlock(const ub::matrix<double>& D, const AOShell* _shell_row, const AOShell* _shell_col, AOBasis* ecp);
+        
+        double _farfield_tolerance;
+        ub::matrix<double> _farfield_overlap;
+        std::vector< ub::matrix<double> > _farfield_dipole;
 
     };
     
@@ -175,7 +210,12 @@ namespace votca { namespace xtp {
         void FillBlock( ub::matrix_range< ub::matrix<double> >& _matrix,const AOShell* _shell_row,const AOShell* _shell_col, AOBasis* ecp);
         //void Print();
         void Fillnucpotential(const AOBasis& aobasis, std::vector<ctp::QMAtom*>& _atoms,bool _with_ecp=false );
-        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites);
+        // all charges are summed in a single pass over the shell pairs, distant ones
+        // by a far-field expansion (farfield_tolerance = 0 evaluates all exactly)
+        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites, double farfield_tolerance=0.0);
+        // gradient of tr(D V_nuc) with respect to the nuclei (natoms x 3), from the
+        // basis functions and from the nuclear charges moving
+        ub::matrix<double> NuclearGradient(const AOBasis& aobasis, std::vector<ctp::QMAtom*>& _atoms, const ub::matrix<double>& D, bool _with_ecp=false);
         ub::matrix<double> &getNuclearpotential(){ return _nuclearpotential;}
         const ub::matrix<double> &getNuclearpotential()const{ return _nuclearpotential;}
         ub::matrix<double> &getExternalpotential(){ return _externalpotential;}
@@ -184,6 +224,10 @@ namespace votca { namespace xtp {
     private:    
         ub::matrix<double> _nuclearpotential;
         ub::matrix<double> _externalpotential;
+        // point charges (bohr) of Fillnucpotential/Fillextpotential, if empty
+        // FillBlock evaluates a unit charge at _gridpoint
+        std::vector<vec> _sitepos;
+        std::vector<double> _sitecharge;
     };
     
     
@@ -193,18 +237,33 @@ namespace votca { namespace xtp {
     public:
         //block fill for overlap, implementation in aoesp.cc
         void FillBlock( ub::matrix_range< ub::matrix<double> >& _matrix,const AOShell* _shell_row,const AOShell* _shell_col, AOBasis* ecp);
+        // gradient of tr(D V_ecp) with respect to the atoms (natoms x 3), from the
+        // basis functions and from the pseudopotentials moving
+        ub::matrix<double> FillECPGradient(const AOBasis& aobasis, AOBasis& ecp, const ub::matrix<double>& D, int natoms);
 
         
         typedef boost::multi_array<double, 3> type_3D;
         
         
-        ub::matrix<double> calcVNLmatrix(int _lmax_ecp,const vec& posC, const AOGaussianPrimitive& _g_row,const AOGaussianPrimitive& _g_col,const  ub::matrix<int>& _power_ecp,const ub::matrix<double>& _gamma_ecp,const ub::matrix<double>& _pref_ecp   );
+        // T is double or carries the derivative with respect to the decay constants
+        template<class T>
+        ub::matrix<T> calcVNLmatrix(int _lmax_ecp,const vec& posC, T alpha, const vec& posA, int _lmax_row, T beta, const vec& posB, int _lmax_col,
+                const  ub::matrix<int>& _power_ecp,const ub::matrix<double>& _gamma_ecp,const ub::matrix<double>& _pref_ecp   );
         
         
         
         void getBLMCOF(int _lmax_ecp, int _lmax_dft, const vec& pos, type_3D& BLC, type_3D& C  );
-        ub::vector<double> CalcNorms( double decay,int size);
+        template<class T>
+        ub::vector<T> CalcNorms( T decay,int size);
         ub::vector<double> CalcInt_r_exp( int nmax, double decay );
+    private:
+        // d/dA_k of the functions up to l at A (decay 1, unit contractions) in
+        // the functions up to l+1 and r^2 times the functions up to l-1
+        static ub::matrix<double> getDerivativeExpansion(int _lmax, int direction);
+        // the calcVNLmatrix block of the derivative shell of _g_row, from the
+        // expansion of getDerivativeExpansion
+        ub::matrix<double> calcVNLderivative(int _lmax_ecp, const vec& posC, const AOGaussianPrimitive& _g_row, const AOGaussianPrimitive& _g_col,
+                const ub::matrix<double>& expansion, const ub::matrix<int>& _power_ecp, const ub::matrix<double>& _gamma_ecp, const ub::matrix<double>& _pref_ecp);
     };
     
 
@@ -235,7 +294,7 @@ namespace votca { namespace xtp {
         //block fill for overlap, implementation in aooverlap.cc
         void FillBlock( ub::matrix_range< ub::matrix<double> >& _matrix,const AOShell* _shell_row,const AOShell* _shell_col, AOBasis* ecp);
         
-        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites);
+        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites, double farfield_tolerance=0.0);
         ub::matrix<double> &getExternalpotential(){ return _externalpotential;}
         const ub::matrix<double> &getExternalpotential()const{ return _externalpotential;}
         
@@ -243,10 +302,9 @@ namespace votca { namespace xtp {
         
 	//        ~AOOverlap();
     private: 
-        void setAPolarSite(ctp::APolarSite* site){
-            apolarsite=site;
-        };
-        ctp::APolarSite* apolarsite;
+        // positions and dipoles (bohr) of all sites, summed in one Fill
+        std::vector<vec> _sitepos;
+        std::vector<vec> _sitedipole;
         ub::matrix<double> _externalpotential;
     };
     
@@ -256,17 +314,16 @@ namespace votca { namespace xtp {
         void FillBlock( ub::matrix_range< ub::matrix<double> >& _matrix,const AOShell* _shell_row,const AOShell* _shell_col, AOBasis* ecp);
         //void Print();
         
-        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites);
+        void Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*>& _sites, double farfield_tolerance=0.0);
         ub::matrix<double> &getExternalpotential(){ return _externalpotential;}
         const ub::matrix<double> &getExternalpotential()const{ return _externalpotential;}
         //void Print();
         
 	//        ~AOOverlap();
     private: 
-        void setAPolarSite(ctp::APolarSite* site){
-            apolarsite=site;
-        };
-        ctp::APolarSite* apolarsite;
+        // positions (bohr) and quadrupoles of all sites, summed in one Fill
+        std::vector<vec> _sitepos;
+        std::vector< std::vector<double> > _sitequadrupole;
         ub::matrix<double> _externalpotential;
     };
     
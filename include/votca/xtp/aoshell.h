@@ -84,11 +84,19 @@ public:
     int    getStartIndex() const{ return _startIndex ;}
     int    getOffset() const{ return _offset ;}
     int    getIndex() const{ return _atomindex;}
+    // basis the shell belongs to and its position in there
+    const AOBasis* getBasis() const{ return _aobasis;}
+    int    getShellIndex() const{ return _shellindex;}
     const std::string& getName() const{ return _atomname;}
     
     int getLmax(  ) const{ return _Lmax;}
     int getLmin(  ) const{ return _Lmin;}
     
+    // -1, or the direction k if the shell holds the derivatives d/dA_k of the
+    // functions of a shell with Lmax-1 at A (see AOSuperMatrix::AddDerivativeShell)
+    int getDerivative() const{ return _derivative;}
+    void setDerivative(int direction){ _derivative=direction;}
+    
     const vec& getPos() const{ return _pos; }
     double getScale() const{ return _scale; }
     
@@ -108,6 +116,18 @@ public:
     
     void EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues, const vec& grid_pos ) const;
     void EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues,ub::matrix_range<ub::matrix<double> >& AODervalues, const vec& grid_pos ) const;
+    
+    // batched versions for many points given as separate x, y, z arrays; point p
+    // adds to row p of AOvalues and to rows 3p, 3p+1, 3p+2 of AODervalues
+    void EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues, const std::vector<double>& x,
+            const std::vector<double>& y, const std::vector<double>& z ) const;
+    void EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues,ub::matrix_range<ub::matrix<double> >& AODervalues,
+            const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z ) const;
+    // second derivatives for the same points, point p adds d_j d_x, d_j d_y and
+    // d_j d_z of the functions to row 3p+j of AOHessx, AOHessy and AOHessz
+    void EvalAOhessian(ub::matrix_range<ub::matrix<double> >& AOHessx, ub::matrix_range<ub::matrix<double> >& AOHessy,
+            ub::matrix_range<ub::matrix<double> >& AOHessz,
+            const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z ) const;
 
     // iterator over pairs (decay constant; contraction coefficient)
     typedef std::vector< AOGaussianPrimitive >::const_iterator GaussianIterator;
@@ -138,7 +158,8 @@ private:
             int offset, vec pos, string atomname, int atomindex, AOBasis* aobasis = NULL )
             : _type(type),_Lmax(Lmax),_Lmin(Lmin), _scale(scale), _numFunc(numFunc),
                     _startIndex(startIndex), _offset(offset), _pos(pos) , 
-                    _atomname(atomname), _atomindex(atomindex) { ; }
+                    _atomname(atomname), _atomindex(atomindex),
+                    _aobasis(aobasis), _shellindex(-1), _derivative(-1) { ; }
     
     // only class Element can destruct shells
             ~AOShell(){};
@@ -157,12 +178,20 @@ private:
     vec _pos;
     string _atomname;
     int _atomindex;
+    AOBasis* _aobasis;
+    int _shellindex;
+    int _derivative;
      
 
     
     // vector of pairs of decay constants and contraction coefficients
     std::vector< AOGaussianPrimitive > _gaussians;
     
+    // function-major buffers (function f of point p at f*npoints+p)
+    template<bool gradient>
+    void EvalAObatch(unsigned npoints, const double* x, const double* y, const double* z,
+            double* values, double* gradx, double* grady, double* gradz) const;
+    
 };
 
     
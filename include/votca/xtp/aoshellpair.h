@@ -0,0 +1,94 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __XTP_AOSHELLPAIR__H
+#define	__XTP_AOSHELLPAIR__H
+
+#include <boost/numeric/ublas/matrix.hpp>
+#include <votca/xtp/aoshell.h>
+
+
+namespace votca { namespace xtp {
+namespace ub = boost::numeric::ublas;
+
+// product of two primitive Gaussians: a*|r-A|^2 + b*|r-B|^2 = (a+b)*|r-P|^2 + exparg
+struct AOPrimitivePair
+{
+    const AOGaussianPrimitive* row;
+    const AOGaussianPrimitive* col;
+    // cartesian -> spherical transformation including contractions, see AOSuperMatrix::getTrafo
+    const ub::matrix<double>* trafo_row;
+    const ub::matrix<double>* trafo_col;
+    double decay_row;
+    double decay_col;
+    double fak;     // 1/(2(a+b))
+    double fak2;    // 1/(a+b)
+    double exparg;  // ab/(a+b)*|A-B|^2
+    vec P;          // (a*A + b*B)/(a+b)
+};
+
+/*
+ * Primitive pairs of two shells which survive the screening, in the order
+ * of the double loop over the Gaussians of the row and the column shell.
+ * For shells of an AOBasis with a prepared table (see PrepareShellPairs)
+ * this is a view into the table, or a transposed copy of the pairs of
+ * (col,row) for row<col. For all other shells (e.g. displaced copies) the
+ * pairs are computed on construction.
+ */
+class AOShellPair
+{
+public:
+    AOShellPair(const AOShell* shell_row, const AOShell* shell_col);
+
+    typedef const AOPrimitivePair* PrimitiveIterator;
+    PrimitiveIterator begin() const { return _begin; }
+    PrimitiveIterator end() const { return _end; }
+    bool empty() const { return _begin == _end; }
+
+    // pairs with exp(-exparg) below exp(-exparg_max) are skipped by all kernels
+    static const double exparg_max;
+
+    // transformation matrices of all Gaussians of a shell
+    static void FillTrafos(const AOShell* shell, std::vector< ub::matrix<double> >& trafos);
+
+    // appends the significant pairs, trafos_row/trafos_col point to the
+    // transformation matrices of the first Gaussian of each shell
+    static void FillPrimitivePairs(const AOShell* shell_row, const AOShell* shell_col,
+            const ub::matrix<double>* trafos_row, const ub::matrix<double>* trafos_col,
+            std::vector<AOPrimitivePair>& pairs);
+
+private:
+    // the view may point into _pairs
+    AOShellPair(const AOShellPair&);
+    AOShellPair& operator=(const AOShellPair&);
+
+    // pairs of (col,row) from the table in the order of (row,col)
+    static void Transpose(const AOPrimitivePair* first, const AOPrimitivePair* last,
+            const AOShell* shell_row, const AOShell* shell_col, std::vector<AOPrimitivePair>& pairs);
+
+    PrimitiveIterator _begin;
+    PrimitiveIterator _end;
+    std::vector< ub::matrix<double> > _trafos;
+    std::vector<AOPrimitivePair> _pairs;
+};
+
+
+}}
+
+#endif	/* AOSHELLPAIR_H */
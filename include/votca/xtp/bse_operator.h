@@ -0,0 +1,126 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _VOTCA_XTP_BSE_OPERATOR_H
+#define _VOTCA_XTP_BSE_OPERATOR_H
+
+#include <votca/xtp/davidsonsolver.h>
+#include <votca/xtp/orbitals.h>
+#include <votca/xtp/threecenters.h>
+
+namespace votca {
+namespace xtp {
+namespace ub = boost::numeric::ublas;
+
+/**
+ * \brief TDA BSE Hamiltonian H = K_d + xfactor * K_x applied to vectors
+ *
+ * Works on the direct (including the QP part) and exchange blocks of
+ * the electron-hole interaction without forming their sum. Triplets use
+ * the direct block only, singlets K_d + 2 K_x.
+ */
+class BSEOperator : public MatrixFreeOperator {
+ public:
+  BSEOperator(const ub::matrix<real_gwbse>& eh_d)
+      : _eh_d(&eh_d), _eh_x(NULL), _xfactor(0.0){};
+
+  BSEOperator(const ub::matrix<real_gwbse>& eh_d,
+              const ub::matrix<real_gwbse>& eh_x, double xfactor)
+      : _eh_d(&eh_d), _eh_x(&eh_x), _xfactor(xfactor){};
+
+  int size() const { return _eh_d->size1(); }
+
+  ub::vector<double> diagonal() const;
+
+  ub::matrix<double> matmul(const ub::matrix<double>& X) const;
+
+ private:
+  const ub::matrix<real_gwbse>* _eh_d;
+  const ub::matrix<real_gwbse>* _eh_x;
+  double _xfactor;
+};
+
+/**
+ * \brief BSE Hamiltonian applied on the fly from the three-center integrals
+ *
+ * Evaluates qp * H_qp + d * K_d + d2 * K_d2 + x * K_x times a block of
+ * vectors directly from the PPM transformed Mmn and the PPM weights, so
+ * neither the e-h interaction matrices nor the (v*v) x gwbasis and
+ * gwbasis x (c*c) intermediates of the dense setup are formed. Besides Mmn
+ * the memory is O(bse_size * number of vectors). Out of core Mmn is loaded
+ * in tiles of levels within its RAM budget in every application. The
+ * operator only holds references, so copies with different factors are
+ * cheap.
+ */
+class BSEDirectOperator : public MatrixFreeOperator {
+ public:
+  BSEDirectOperator(const TCMatrix& Mmn, const ub::vector<double>& ppm_weight,
+                    const ub::matrix<double>& Hqp, unsigned vmin,
+                    unsigned vtotal, unsigned cmin, unsigned ctotal);
+
+  /// prefactors of QP, direct, RARC direct and exchange part
+  void setFactors(double qp, double d, double d2, double x) {
+    _qpfactor = qp;
+    _dfactor = d;
+    _d2factor = d2;
+    _xfactor = x;
+  }
+
+  int size() const { return _vtotal * _ctotal; }
+
+  ub::vector<double> diagonal() const;
+
+  ub::matrix<double> matmul(const ub::matrix<double>& X) const {
+    return matmul(X, _qpfactor, _dfactor, _d2factor, _xfactor);
+  }
+
+  /// applies only the parts of the Hamiltonian with nonzero prefactor
+  ub::matrix<double> matmul(const ub::matrix<double>& X, double qp, double d,
+                            double d2, double x) const;
+
+ private:
+  const TCMatrix* _Mmn;
+  unsigned _vmin;
+  unsigned _vtotal;
+  unsigned _cmin;
+  unsigned _ctotal;
+  unsigned _gwsize;
+
+  // 1 - PPM weight for each (PPM transformed) GW basis function
+  ub::vector<double> _screening;
+  // occupied and virtual blocks of the QP Hamiltonian
+  ub::matrix<double> _Hqp_v;
+  ub::matrix<double> _Hqp_c;
+
+  double _qpfactor;
+  double _dfactor;
+  double _d2factor;
+  double _xfactor;
+
+  // number of occupied or virtual levels loaded at the same time
+  unsigned TileSize() const;
+  void Add_direct(const ub::matrix<double>& X, ub::matrix<double>& Yv,
+                  double d, double d2) const;
+  void Add_exchange(const ub::matrix<double>& X, ub::matrix<double>& Y,
+                    double x) const;
+};
+}
+}
+
+#endif /* _VOTCA_XTP_BSE_OPERATOR_H */
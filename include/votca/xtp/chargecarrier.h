@@ -57,7 +57,6 @@ namespace votca { namespace xtp {
                     ~Chargecarrier(){};
                     bool hasNode(){return (node!=NULL);}
                     void updateLifetime(double dt) { lifetime+=dt;}
-                    void updateOccupationtime(double dt) { node->occupationtime+=dt;}
                     void updateSteps(unsigned t) { steps+=t;}
                     void resetCarrier() { lifetime=0;steps=0; dr_travelled=tools::vec(0.0,0.0,0.0);}
                     const double& getLifetime(){return lifetime;}
@@ -67,11 +66,10 @@ namespace votca { namespace xtp {
                     tools::vec getCurrentPosition(){return node->position;}
                     double getCurrentEscapeRate(){return node->escape_rate;}
                     GNode * getCurrentNode(){return node;}
-                    void settoNote(GNode *newnode){node=newnode;
-                        node->occupied=true;}
+                    // occupation is tracked by the calculator, so the graph stays read-only
+                    void settoNote(GNode *newnode){node=newnode;}
 
                     void jumpfromCurrentNodetoNode(GNode *newnode){
-                        node->occupied=false;
                         settoNote(newnode);
                     }
                     int id;
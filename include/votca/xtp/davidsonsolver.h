@@ -0,0 +1,124 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _VOTCA_XTP_DAVIDSONSOLVER_H
+#define _VOTCA_XTP_DAVIDSONSOLVER_H
+
+#include <boost/numeric/ublas/matrix.hpp>
+#include <boost/numeric/ublas/vector.hpp>
+#include <votca/ctp/logger.h>
+
+namespace votca {
+namespace xtp {
+namespace ub = boost::numeric::ublas;
+
+/**
+ * \brief Symmetric linear operator which is only known through its action
+ *
+ * Iterative eigensolvers only need the diagonal of the operator (for
+ * preconditioning) and products with a block of column vectors.
+ */
+class MatrixFreeOperator {
+ public:
+  virtual ~MatrixFreeOperator(){};
+
+  virtual int size() const = 0;
+
+  virtual ub::vector<double> diagonal() const = 0;
+
+  /// returns A*X, X holds one vector per column
+  virtual ub::matrix<double> matmul(const ub::matrix<double>& X) const = 0;
+};
+
+/**
+ * \brief Block Davidson solver for the lowest eigenpairs of a symmetric
+ * operator
+ *
+ * The search space is expanded with diagonally preconditioned residuals of
+ * the unconverged Ritz pairs and collapsed onto the current Ritz vectors
+ * once it exceeds the maximum size.
+ *
+ *  E. R. Davidson, J. Comput. Phys. 17, 87 (1975)
+ *
+ * SolveBTDA treats the full (non-Hermitian) BSE from products with A+B and
+ * A-B only, using one search space for X+Y and X-Y.
+ *
+ *  R. E. Stratmann, G. E. Scuseria, M. J. Frisch,
+ *  J. Chem. Phys. 109, 8218 (1998)
+ */
+class DavidsonSolver {
+ public:
+  DavidsonSolver(ctp::Logger* log)
+      : _pLog(log),
+        _tolerance(1e-5),
+        _max_iterations(50),
+        _max_search_space(0),
+        _iterations(0){};
+
+  /// convergence threshold on the residual norm of each Ritz pair [Hartree]
+  void setTolerance(double tolerance) { _tolerance = tolerance; }
+  void setMaxIterations(int iterations) { _max_iterations = iterations; }
+  /// 0 selects a size based on the number of requested eigenpairs
+  void setMaxSearchSpace(int size) { _max_search_space = size; }
+  /// start vectors, one per column, instead of unit vectors; with at least
+  /// neigen columns Solve refines them even for small problems
+  void setInitialGuess(const ub::matrix<double>& guess) { _guess = guess; }
+
+  /// returns true if all neigen eigenpairs converged
+  bool Solve(const MatrixFreeOperator& A, int neigen);
+
+  /// lowest positive excitations of [[A,B],[-B,-A]], both A+B and A-B
+  /// positive definite; X is returned in eigenvectors(), Y in
+  /// eigenvectors_AR() with X^T X - Y^T Y = 1
+  bool SolveBTDA(const MatrixFreeOperator& ApB, const MatrixFreeOperator& AmB,
+                 int neigen);
+
+  const ub::vector<double>& eigenvalues() const { return _eigenvalues; }
+  const ub::matrix<double>& eigenvectors() const { return _eigenvectors; }
+  const ub::matrix<double>& eigenvectors_AR() const {
+    return _eigenvectors_AR;
+  }
+  int getIterations() const { return _iterations; }
+
+ private:
+  ctp::Logger* _pLog;
+  double _tolerance;
+  int _max_iterations;
+  int _max_search_space;
+  int _iterations;
+
+  ub::matrix<double> _guess;
+  ub::vector<double> _eigenvalues;
+  ub::matrix<double> _eigenvectors;
+  ub::matrix<double> _eigenvectors_AR;
+
+  void SolveDense(const MatrixFreeOperator& A, int neigen);
+  void SolveReducedBTDA(const ub::matrix<double>& P, const ub::matrix<double>& M,
+                        int neigen, ub::vector<double>& omega,
+                        ub::matrix<double>& U_plus,
+                        ub::matrix<double>& U_minus) const;
+  ub::matrix<double> InitialGuess(const ub::vector<double>& diag,
+                                  int nguess) const;
+  int OrthogonalizeAndAppend(ub::matrix<double>& V,
+                             ub::matrix<double>& newvectors) const;
+};
+}
+}
+
+#endif /* _VOTCA_XTP_DAVIDSONSOLVER_H */
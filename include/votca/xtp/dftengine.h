@@ -34,6 +34,8 @@
 #include <votca/xtp/diis.h>
 #include <votca/xtp/mixing.h>
 #include <votca/ctp/logger.h>
+#include <map>
+#include <mutex>
 
 namespace votca {
     namespace xtp {
@@ -54,6 +56,8 @@ namespace votca {
                 _addexternalsites = false;
                 _do_externalfield = false;
                 guess_set = false;
+                _invariants_set = false;
+                _ScaHFX = 0.0;
             };
 
             ~DFTENGINE() {
@@ -74,6 +78,11 @@ namespace votca {
                 _pLog = pLog;
             }
 
+            // overrides the openmp option, e.g. for concurrent force tasks
+            void setThreads(int threads) {
+                _openmp_threads = threads;
+            }
+
             void ConfigureExternalGrid(string grid_name_ext) {
                 _grid_name_ext = grid_name_ext;
                 _do_externalfield = true;
@@ -111,6 +120,9 @@ namespace votca {
 
             bool Evaluate(Orbitals* _orbitals);
             void Prepare(Orbitals* _orbitals);
+            // nuclear gradient of the converged ground state energy in Hartree/bohr,
+            // one row per atom of the DFT calculation
+            ub::matrix<double> EvaluateGradient(Orbitals* _orbitals);
 
             std::string GetDFTBasisName() {
                 return _dftbasis_name;
@@ -122,11 +134,19 @@ namespace votca {
 
             void ConfigOrbfile(Orbitals* _orbitals);
             void SetupInvariantMatrices();
+            void SetupExternalMatrices();
+            std::size_t InvariantKey() const;
+            double AddExactExchange(ub::matrix<double>& H);
             ub::matrix<double> AtomicGuess(Orbitals* _orbitals);
+            std::string AtomicDensityKey(const std::string& element) const;
+            bool LoadAtomicDensity(const std::string& key, unsigned size, ub::matrix<double>& dmat);
+            void StoreAtomicDensity(const std::string& key, const ub::matrix<double>& dmat);
             ub::matrix<double> DensityMatrix_unres(const ub::matrix<double>& MOs, int numofelec);
             ub::matrix<double> DensityMatrix_frac(const ub::matrix<double>& MOs, const ub::vector<double>& MOEnergies, int numofelec);
+            ub::matrix<double> DensityMatrix_lastMOs();
             string Choosesmallgrid(string largegrid);
             void NuclearRepulsion();
+            ub::matrix<double> NuclearRepulsionGradient();
             double ExternalRepulsion(ctp::Topology* top = NULL);
             double ExternalGridRepulsion(std::vector<double> externalpotential_nuc);
             ub::matrix<double> AverageShells(const ub::matrix<double>& dmat, AOBasis& dftbasis);
@@ -167,6 +187,13 @@ namespace votca {
             bool _use_small_grid;
             NumericalIntegration _gridIntegration;
             NumericalIntegration _gridIntegration_small;
+            // incremental Fock build: J and Vxc from the density change, rebuilt
+            // from the full density every _fock_rebuild iterations
+            bool _incremental_fock;
+            int _fock_rebuild;
+            double _incremental_tolerance;
+            // MM sites farther than this criterion enter by a far-field expansion, 0 is exact
+            double _farfield_tolerance;
             //used to store Vxc after final iteration
 
             //numerical integration externalfield;
@@ -188,6 +215,11 @@ namespace votca {
             AOQuadrupole_Potential _dftAOQuadrupole_Potential;
             bool _with_guess;
             string _initial_guess;
+            // converged atomic densities of the atomic guess, shared by all engines
+            // of the process and optionally kept in _atomic_density_dir
+            static std::map<std::string, ub::matrix<double> > _atomic_densities;
+            static std::mutex _atomic_densities_mutex;
+            std::string _atomic_density_dir;
             double E_nucnuc;
 
             // COnvergence 
@@ -223,10 +255,16 @@ namespace votca {
 
             // exchange and correlation
             std::string _xc_functional_name;
+            // fraction of exact exchange of hybrid functionals
+            double _ScaHFX;
 
 
-            ub::matrix<double> last_dmat;
+            // occupied MOs of the last converged run, guess for the next one
+            ub::matrix<double> last_mos;
             bool guess_set;
+            // geometry and basis sets the invariant matrices were computed for
+            std::size_t _invariant_key;
+            bool _invariants_set;
         };
 
 
@@ -45,6 +45,11 @@ public:
     Diis() {_maxerrorindex=0;
                 _maxerror=0.0; };
    ~Diis() {
+     Reset();
+   }
+
+   // forgets the stored Fock matrices, e.g. before a new SCF with another Hamiltonian
+   void Reset() {
      for (std::vector< ub::matrix<double>* >::iterator it = _mathist.begin() ; it !=_mathist.end(); ++it){
          delete *it;
      }
@@ -62,7 +67,9 @@ public:
          delete *it;
      }
     _Diis_Bs.clear(); 
-    
+    _totE.clear();
+    _maxerrorindex=0;
+    _maxerror=0.0;
    }
    
    void Configure(bool usediis,bool noisy, unsigned histlength, bool maxout, string diismethod, double adiis_start,double diis_start,double levelshift,double levelshiftend,unsigned nocclevels){
@@ -43,7 +43,7 @@ namespace votca {
         public:
 
             Forces(GWBSEENGINE& gwbse_engine, QMPackage* qmpackage, vector<ctp::Segment*> segments, Orbitals* orbitals)
-            : _gwbse_engine(gwbse_engine), _qmpackage(qmpackage), _segments(segments), _orbitals(orbitals), _remove_total_force(false), _remove_CoM_force(false) {
+            : _gwbse_engine(gwbse_engine), _qmpackage(qmpackage), _segments(segments), _orbitals(orbitals), _remove_total_force(false), _remove_CoM_force(false), _check_numerical(false), _tasks(1) {
             };
 
             ~Forces() {
@@ -61,6 +61,11 @@ namespace votca {
                 _pLog = pLog;
             }
 
+            // options of the DFT package, needed to run displacements concurrently
+            void setPackageOptions(const Property& package_options) {
+                _package_options = package_options;
+            }
+
             void SetSpinType(const string spin_type) {
                 _spin_type = spin_type;
             };
@@ -105,11 +110,23 @@ namespace votca {
             Orbitals* _orbitals;
             bool _remove_total_force;
             bool _remove_CoM_force;
+            bool _check_numerical;
 
             ub::matrix<double> _forces;
 
             Property _force_options;
 
+            // concurrent displacements, each with its own QMPackage and run directory
+            int _tasks;
+            int _task_threads;
+            string _task_dir;
+            Property _package_options;
+
+            void NumForceParallel(double energy, bool central);
+            void AnalyticForce();
+            void CheckAnalyticForce(double energy);
+            double DisplacedEnergy(int _i_atom, int _i_cart, double _sign);
+
             void RemoveTotalForce();
             void RemoveCoMForce();
             ub::vector<double> TotalForce();
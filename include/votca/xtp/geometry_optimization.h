@@ -54,6 +54,10 @@ namespace votca {
                 _pLog = pLog;
             }
 
+            void setPackageOptions(const Property& package_options) {
+                _package_options = package_options;
+            }
+
             void Evaluate();
 
 
@@ -78,6 +82,7 @@ namespace votca {
 
             Property _optimizer_options;
             Property _force_options;
+            Property _package_options;
 
             ctp::Logger *_pLog;
         };
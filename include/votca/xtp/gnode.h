@@ -30,14 +30,12 @@ namespace votca { namespace xtp {
 class GNode
 {
     public:
-        GNode():occupied(false),occupationtime(0.0),escape_rate(0.0),hasdecay(false){};
+        GNode():escape_rate(0.0),hasdecay(false){};
         
         ~GNode(){};
 
         int id;
-        bool occupied;
         bool injectable;
-        double occupationtime;
         double escape_rate;
         bool hasdecay;
         tools::vec position;
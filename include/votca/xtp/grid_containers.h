@@ -57,6 +57,7 @@ namespace votca { namespace xtp {
             struct integration_grid {
                 tools::vec grid_pos;
                 double grid_weight;
+                int grid_atom; // atom the point belongs to, it moves with it
             };
             
             
@@ -40,6 +40,8 @@ namespace votca { namespace xtp {
             
             const std::vector<double>& getGridWeights() const{return weights;}
             
+            const std::vector<int>& getGridAtoms() const{return atoms;}
+            
             const std::vector<const AOShell* >& getShells() const{return significant_shells;}
             
             const std::vector<ub::range>& getAOranges() const{return aoranges;}
@@ -54,9 +56,11 @@ namespace votca { namespace xtp {
             void addGridBox(const GridBox& box){
                 const std::vector<tools::vec>& p=box.getGridPoints();
                 const std::vector<double>& w=box.getGridWeights();
+                const std::vector<int>& a=box.getGridAtoms();
                 for (unsigned i=0;i<w.size();++i){
                     grid_pos.push_back(p[i]);
                     weights.push_back(w[i]);
+                    atoms.push_back(a[i]);
                 }
                 return;
             }
@@ -64,6 +68,7 @@ namespace votca { namespace xtp {
             void addGridPoint(const GridContainers::integration_grid& point){
                 grid_pos.push_back(point.grid_pos);
                 weights.push_back(point.grid_weight);
+                atoms.push_back(point.grid_atom);
             };
             
             void addShell(const AOShell* shell){
@@ -118,6 +123,7 @@ namespace votca { namespace xtp {
                 std::vector< tools::vec > grid_pos;
                 std::vector<const AOShell* > significant_shells;
                 std::vector< double > weights;
+                std::vector< int > atoms;
                 std::vector< double > densities;
                 std::vector< ub::matrix<double> > dens_grad;
                 
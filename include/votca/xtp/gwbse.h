@@ -37,12 +37,15 @@
 #include <boost/numeric/ublas/operation.hpp>
 #include <boost/numeric/ublas/vector.hpp>
 #include <votca/tools/linalg.h>
+#include <votca/xtp/davidsonsolver.h>
 #include <votca/xtp/votca_config.h>
 
 namespace votca {
 namespace xtp {
 namespace ub = boost::numeric::ublas;
 
+class BSEDirectOperator;
+
 /**
 * \brief Electronic excitations from GW-BSE
 *
@@ -72,7 +75,8 @@ class GWBSE {
         _bse_singlet_coefficients(orbitals->BSESingletCoefficients()),
         _bse_singlet_coefficients_AR(orbitals->BSESingletCoefficientsAR()),
         _bse_triplet_energies(orbitals->BSETripletEnergies()),
-        _bse_triplet_coefficients(orbitals->BSETripletCoefficients()){};
+        _bse_triplet_coefficients(orbitals->BSETripletCoefficients()),
+        _bse_operator(NULL){};
 
   ~GWBSE(){};
 
@@ -87,12 +91,40 @@ class GWBSE {
 
   void setLogger(ctp::Logger* pLog) { _pLog = pLog; }
 
+  // overrides the openmp option, call after Initialize
+  void setThreads(int threads) { _openmp_threads = threads; }
+
+  // BSE eigenvectors of a similar geometry as start for the Davidson solver
+  void setBSEGuess(const ub::matrix<real_gwbse>& singlets,
+                   const ub::matrix<real_gwbse>& triplets) {
+    _bse_singlet_guess = singlets;
+    _bse_triplet_guess = triplets;
+  }
+
   bool Evaluate();
 
   // interfaces for options getting/setting
 
   void addoutput(Property* _summary);
 
+  // three-center checkpoint file, false if it is missing or unreadable, in
+  // which case _overlap and _overlap_cholesky_inverse are left untouched
+  static bool ReadThreecenterFile(const std::string& filename, TCMatrix& _Mmn,
+                                  ub::matrix<double>& _overlap,
+                                  ub::matrix<double>& _overlap_cholesky_inverse,
+                                  ctp::Logger* log);
+  static void WriteThreecenterFile(
+      const std::string& filename, const TCMatrix& _Mmn,
+      const ub::matrix<double>& _overlap,
+      const ub::matrix<double>& _overlap_cholesky_inverse, ctp::Logger* log);
+
+  // adds the RPA polarizability of the transitions in the columns of Mstack,
+  // with energy differences deltaE, to epsilon at every screening frequency
+  static void RPA_add_transitions(std::vector<ub::matrix<double> >& epsilon,
+                                  const ub::matrix<double>& Mstack,
+                                  const ub::vector<double>& deltaE,
+                                  const ub::matrix<double>& screening_freqs);
+
  private:
   ctp::Logger* _pLog;
 
@@ -121,6 +153,38 @@ class GWBSE {
 
   int _openmp_threads;
 
+  // pivoted Cholesky compression of the GW basis, 0 switches it off
+  double _compression_tolerance;
+  int Compress_threecenters(TCMatrix& _Mmn,
+                            const ub::matrix<double>& _overlap_cholesky_inverse);
+
+  // RAM budget in MB for the three-center integrals, 0 keeps them in memory
+  double _ram_budget;
+  std::string _scratch_dir;
+  // part of _ram_budget for a matrix of levels x columns while all
+  // three-center matrices of the GW stage exist
+  double RamShare(unsigned levels, unsigned columns) const;
+  // working memory in MB for the flattened double copies of Mmn levels in
+  // sigma_diag and sigma_offdiag, also in core
+  double _sigma_work_mb;
+
+  // checkpoints of the three-center and QP stages, keyed by a hash of their
+  // inputs, an empty directory switches them off
+  std::string _checkpoint_dir;
+  std::size_t _threecenter_key;
+  std::size_t _qp_key;
+  void CheckpointKeys(const std::vector<ctp::QMAtom*>& _atoms);
+  std::string CheckpointFile(const std::string& stage, std::size_t key) const;
+  bool ReadThreecenterCheckpoint(TCMatrix& _Mmn, ub::matrix<double>& _overlap,
+                                 ub::matrix<double>& _overlap_cholesky_inverse);
+  void WriteThreecenterCheckpoint(
+      const TCMatrix& _Mmn, const ub::matrix<double>& _overlap,
+      const ub::matrix<double>& _overlap_cholesky_inverse) const;
+  bool ReadQPCheckpoint(TCMatrix& _Mmn);
+  void WriteQPCheckpoint(const TCMatrix& _Mmn) const;
+
+  void GWA_calculate(const std::vector<ctp::QMAtom*>& _atoms, TCMatrix& _Mmn);
+
   // fragment definitions
   int _fragA;
   int _fragB;
@@ -129,6 +193,17 @@ class GWBSE {
   bool _do_full_BSE;
   bool _ignore_corelevels;
 
+  // iterative eigensolver for the lowest TDA excitations
+  bool _do_davidson;
+  double _davidson_tolerance;
+  int _davidson_maxiter;
+  ub::matrix<double> _bse_singlet_guess;
+  ub::matrix<double> _bse_triplet_guess;
+  // apply the BSE Hamiltonian from Mmn without setting up _eh_d and _eh_x
+  bool _do_matrixfree;
+  // single precision BSE setup and diagonalization, refined in double
+  bool _do_mixed_precision;
+
   std::string _outParent;
   std::string _outMonDir;
 
@@ -183,14 +258,9 @@ class GWBSE {
   // imaginary part)
   ub::matrix<double> _screening_freq;
   void symmetrize_threecenters(TCMatrix& _Mmn, ub::matrix<double>& _coulomb);
+  // all screening frequencies in one pass over _Mmn_RPA
   void RPA_calculate_epsilon(const TCMatrix& _Mmn_RPA);
 
-  ub::matrix<double> RPA_real(const TCMatrix& _Mmn_RPA,
-                              const double screening_freq);
-
-  ub::matrix<double> RPA_imaginary(const TCMatrix& _Mmn_RPA,
-                                   const double screening_freq);
-
   void RPA_prepare_threecenters(TCMatrix& _Mmn_RPA, const TCMatrix& _Mmn_full);
 
   // PPM related variables and functions
@@ -205,11 +275,25 @@ class GWBSE {
   ub::symmetric_matrix<double> _sigma_x;  // exchange term
   ub::symmetric_matrix<double> _sigma_c;  // correlation term
 
-  void sigma_prepare_threecenters(TCMatrix& _Mmn);
+  // PPM transformed levels of _Mmn, both may be the same object
+  void sigma_prepare_threecenters(TCMatrix& _Mmn_sigma, const TCMatrix& _Mmn);
 
   void sigma_diag(const TCMatrix& _Mmn);
   void sigma_offdiag(const TCMatrix& _Mmn);
 
+  // GW functions with PPM weight above 1e-9 and their PPM parameters,
+  // stored contiguously for the sigma_c kernels
+  std::vector<unsigned> _ppm_active;
+  std::vector<double> _ppm_active_freq;
+  std::vector<double> _ppm_active_fac;
+  void sigma_filter_ppm();
+  ub::matrix<double> sigma_ppm_rows(const ub::matrix<real_gwbse>& Mmn) const;
+  void sigma_c_factors(double qp_energy, const ub::vector<double>& energies,
+                       ub::matrix<double>& factors) const;
+  void sigma_c_offdiag_rows(const TCMatrix& _Mmn, unsigned _start,
+                            unsigned _end, ub::matrix<double>& M,
+                            ub::matrix<double>& A) const;
+
   // QP variables and functions
   ub::vector<double> _qp_energies;
   ub::matrix<double> _vxc;
@@ -237,11 +321,30 @@ class GWBSE {
   void BSE_x_setup(TCMatrix& _Mmn);
   void BSE_d_setup(TCMatrix& _Mmn);
   void BSE_d2_setup(TCMatrix& _Mmn);
+  // T is the precision of the intermediates, float in mixed precision
+  template <typename T>
+  void BSE_d_setup_storage(TCMatrix& _Mmn);
+  template <typename T>
+  void BSE_d2_setup_storage(TCMatrix& _Mmn);
   void BSE_qp_setup();
   void BSE_Add_qp2H(ub::matrix<real_gwbse>& qp);
   void BSE_solve_triplets();
   void BSE_solve_singlets();
   void BSE_solve_singlets_BTDA();
+  // false if not converged, energies and coefficients are left untouched
+  bool BSE_solve_davidson(const MatrixFreeOperator& H,
+                          const ub::matrix<double>& guess,
+                          ub::vector<real_gwbse>& energies,
+                          ub::matrix<real_gwbse>& coefficients);
+  // diagonalizes and frees _bse_float, false if the refinement of the
+  // eigenpairs with H does not converge
+  bool BSE_solve_mixed(ub::matrix<float>& _bse_float,
+                       const MatrixFreeOperator& H,
+                       ub::vector<real_gwbse>& energies,
+                       ub::matrix<real_gwbse>& coefficients);
+  void BSE_solve_matrixfree(const TCMatrix& _Mmn);
+  // only set while the matrix-free BSE is solved and analyzed
+  const BSEDirectOperator* _bse_operator;
 
   void Solve_nonhermitian(ub::matrix<double>& H, ub::matrix<double>& L);
   std::vector<int> _index2v;
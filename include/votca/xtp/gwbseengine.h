@@ -46,7 +46,7 @@ namespace votca {
         class GWBSEENGINE {
         public:
 
-            GWBSEENGINE() {
+            GWBSEENGINE() : _openmp_threads(0) {
             };
 
             ~GWBSEENGINE() {
@@ -74,6 +74,11 @@ namespace votca {
             void setRedirectLogger(bool redirect_logger) {
                 _redirect_logger = redirect_logger;
             };
+
+            // threads of GW-BSE, 0 keeps the openmp option of gwbse
+            void setThreads(int threads) {
+                _openmp_threads = threads;
+            };
             
             
             Property ReportSummary(){ return _summary;};
@@ -90,6 +95,8 @@ namespace votca {
             bool _do_dft_parse;
             bool _do_gwbse;
             bool _redirect_logger;
+            int _openmp_threads;
+            bool _do_warmstart;
 
             // DFT log and MO file names
             string _MO_file; // file containing the MOs from qmpackage...
@@ -103,7 +110,15 @@ namespace votca {
             Property _gwbse_options;
             Property _summary;
 
+            // results of the previous call, guess for the next geometry
+            ub::matrix<double> _reference_mos;
+            ub::vector<double> _reference_mo_energies;
+            int _reference_electrons;
+            ub::matrix<real_gwbse> _reference_singlets;
+            ub::matrix<real_gwbse> _reference_triplets;
+
             void SaveRedirectedLogger(ctp::Logger* pLog);
+            void AlignMOPhases(Orbitals* _orbitals);
 
 
 
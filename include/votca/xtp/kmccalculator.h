@@ -36,6 +36,7 @@
 #include <votca/tools/globals.h>
 #include <votca/tools/random2.h>
 #include <votca/xtp/chargecarrier.h>
+#include <votca/xtp/ratetree.h>
 
 #include <votca/xtp/gnode.h>
 #include <votca/ctp/qmcalculator.h>
@@ -72,18 +73,30 @@ protected:
             void InitialRates();
             
             double Promotetime(double cumulated_rate);
-            void ResetForbiddenlist(std::vector<int> &forbiddenid);
-            void AddtoForbiddenlist(int id, std::vector<int> &forbiddenid);
-            bool CheckForbidden(int id,const std::vector<int> &forbiddenlist);
-            bool CheckSurrounded(GNode* node,const std::vector<int> &forbiddendests);
+            
+            // rejection-free event selection, only hops to free nodes are
+            // considered, InitEventSelection once the carriers are placed
+            void InitEventSelection();
+            double CumulatedRate() const { return _carriertree.Total(); }
             GLink* ChooseHoppingDest(GNode* node);
-            Chargecarrier* ChooseAffectedCarrier(double cumulated_rate);
+            Chargecarrier* ChooseAffectedCarrier();
+            void MoveCarrier(Chargecarrier* carrier, GNode* newnode);
+            
             
+            bool Occupied(const GNode* node) const { return _carrierofnode[node->id] >= 0; }
             
             void RandomlyCreateCharges();
             void RandomlyAssignCarriertoSite(Chargecarrier* Charge);
             void AddtoJumplengthdistro(const GLink* event, double dt);
             void PrintJumplengthdistro();
+            
+            // independent replicas share the graph but have their own carriers, 
+            // occupations and random numbers
+            void InitReplica();
+            void ReleaseReplica();
+            void PrintJumplengthdistro(const std::vector<KMCCalculator*>& replicas);
+            static void MeanAndError(const std::vector<double>& values, double& mean, double& error);
+            
             std::vector<GNode*> _nodes;
             std::vector< Chargecarrier* > _carriers;
             tools::Random2 * _RandomVariable;
@@ -103,6 +116,20 @@ protected:
             
             double _temperature;
             std::string _rates;
+            unsigned _replicas;
+            
+            // index in _carriers of the carrier on a node, -1 if the node is free
+            std::vector<int> _carrierofnode;
+            std::vector<double> _occupationtime;
+            
+private:
+            void UpdateIncomingEvents(GNode* node);
+            // for each node the rates of its events, zero if the destination is occupied
+            std::vector<RateTree> _eventtrees;
+            // for each carrier the sum of the rates in the tree of its node
+            RateTree _carriertree;
+            // (node, event) pairs with the node as destination
+            std::vector< std::vector< std::pair<int,int> > > _incomingevents;
 };
 
 
@@ -46,7 +46,7 @@ namespace votca { namespace xtp {
         class NumericalIntegration {
         public: 
             
-            NumericalIntegration():density_set(false),setXC(false) {};
+            NumericalIntegration():_evaluated_boxes(0),density_set(false),setXC(false) {};
             
             
             ~NumericalIntegration(){};
@@ -72,6 +72,14 @@ namespace votca { namespace xtp {
            
            
             ub::matrix<double> IntegrateVXC (const ub::matrix<double>& _density_matrix);
+            // as IntegrateVXC, boxes whose density block changed by at most tolerance
+            // since their last evaluation here reuse that contribution
+            ub::matrix<double> IntegrateVXC_incremental (const ub::matrix<double>& _density_matrix, double tolerance);
+            // number of boxes evaluated in the last IntegrateVXC_incremental
+            unsigned getEvaluatedBoxes() const{return _evaluated_boxes;}
+            // gradient of E_xc with respect to the atoms (natoms x 3), the grid points
+            // move with their atoms and the derivatives of the partition weights are included
+            ub::matrix<double> IntegrateVXCGradient (const ub::matrix<double>& _density_matrix, int natoms);
             
            
             
@@ -85,15 +93,25 @@ namespace votca { namespace xtp {
            void FindSignificantShells();
             
            void EvaluateXC(const double rho,const ub::matrix<double>& grad_rho,double& f_xc, double& df_drho, double& df_dsigma);
+           // contribution of one box to Vxc (not yet symmetrized), returns its E_xc
+           double IntegrateVXCBox(const GridBox& box, const ub::matrix<double>& DMAT_here, ub::matrix<double>& Vxc_here);
           
            
            
            double erf1c(double x);
            double erfcc(double x);
+           // derivatives of erf1c and erfcc with respect to x
+           double derf1c(double x);
+           double derfcc(double x);
            std::vector<double> SSWpartition(int igrid, int ncenters ,  std::vector< std::vector<double> >& rq );
+           // derivatives of the partition weight of a point of atom owner with respect to
+           // all atom positions divided by the weight, the point moves with its atom
+           std::vector<vec> SSWpartitionGradient(const vec& point, int owner);
            void SortGridpointsintoBlocks(std::vector< std::vector< GridContainers::integration_grid > >& grid);
             
             std::vector<double> Rij;
+            // atom positions of the grid in Bohr
+            std::vector<vec> _atom_pos;
             AOBasis* _basis;
 
             double  _totalgridsize;
@@ -110,6 +128,11 @@ namespace votca { namespace xtp {
             
             
             double EXC;
+            // density blocks, Vxc and E_xc contributions of the boxes for IntegrateVXC_incremental
+            std::vector< ub::matrix<double> > _box_dmat;
+            std::vector< ub::matrix<double> > _box_vxc;
+            std::vector<double> _box_exc;
+            unsigned _evaluated_boxes;
             bool density_set;
             bool setXC;
             
@@ -70,6 +70,7 @@ private:
     ctp::Ewald3DnD *_cape;
     
     DFTENGINE dftengine;
+    Orbitals orb_iter_input;
     
     void SetupPolarSiteGrids( const std::vector< const vec *>& gridpoints,const std::vector< ctp::QMAtom* >& atoms);
     
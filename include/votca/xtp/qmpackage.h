@@ -65,6 +65,12 @@ namespace votca {
 
             virtual bool setMultipoleBackground( std::vector<ctp::PolarSeg*> PolarSegments) = 0;
 
+            /// nuclear gradient of the last ground state calculation in Hartree/bohr,
+            /// false if the package does not provide one
+            virtual bool Gradient(Orbitals*, ub::matrix<double>&) {
+                return false;
+            }
+
             virtual void CleanUp() = 0;
 
             void setRunDir(std::string run_dir) {
@@ -107,7 +113,7 @@ namespace votca {
                 _spin = spin;
             }
 
-            void setThreads(const int threads) {
+            virtual void setThreads(const int threads) {
                 _threads = threads;
             }
 
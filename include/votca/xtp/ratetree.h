@@ -0,0 +1,68 @@
+/*
+ * Copyright 2009-2017 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _VOTCA_KMC_RATETREE_H
+#define _VOTCA_KMC_RATETREE_H
+
+#include <vector>
+
+namespace votca {
+namespace xtp {
+
+/**
+ * \brief Binary indexed (Fenwick) tree over non-negative rates
+ *
+ * Changing a rate, the total rate and choosing an entry with probability
+ * proportional to its rate all take O(log N). The partial sums are rebuilt
+ * from the rates from time to time, so round-off from many incremental
+ * updates does not accumulate.
+ */
+class RateTree {
+ public:
+  RateTree() : _total(0.0), _maxtotal(0.0), _highbit(1), _updates(0){};
+
+  /// n entries, all with rate 0
+  void Resize(unsigned n);
+
+  unsigned size() const { return _rates.size(); }
+
+  void setRate(unsigned i, double rate);
+
+  double getRate(unsigned i) const { return _rates[i]; }
+
+  double Total() const { return _total; }
+
+  /// entry i with sum_{j<i} rate_j <= u < sum_{j<=i} rate_j, u in [0,Total()),
+  /// throws if no entry has a rate
+  unsigned Choose(double u) const;
+
+  void Rebuild();
+
+ private:
+  std::vector<double> _rates;
+  // _tree[k] holds the sum of the rates k-lowbit(k) ... k-1
+  std::vector<double> _tree;
+  double _total;
+  // largest total since the last rebuild, scale of the round-off in _total
+  double _maxtotal;
+  unsigned _highbit;
+  unsigned long _updates;
+};
+}
+}
+
+#endif  // _VOTCA_KMC_RATETREE_H
@@ -27,6 +27,8 @@
 //openmp 
 #include <votca/xtp/votca_config.h>
 #include <votca/xtp/orbitals.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -66,15 +68,33 @@ namespace votca { namespace xtp {
     
     void Cleanup();
     
-    int getSize(){return _matrix.size();}
+    int getSize()const{return _matrix.size1();}
     
-    std::vector< ub::symmetric_matrix<double> >& getData(){return  _matrix;}
-    ub::symmetric_matrix<double>& getDatamatrix( int i ){return  _matrix[i];}
-    const ub::symmetric_matrix<double>& getDatamatrix( int i )const{return  _matrix[i];}
-    private:
-        std::vector< ub::symmetric_matrix<double> > _matrix;
+    // (ij|P) are only kept for the pairs i>=j of significant DFT shell pairs, row P
+    // of the data holds all pairs of one aux function, the aux functions of a shell
+    // are consecutive rows
+    int getPairSize()const{return _pairs.size();}
+    unsigned getDFTSize()const{return _dftsize;}
+    const std::vector< std::pair<unsigned,unsigned> >& getPairs()const{return _pairs;}
+    
+    ub::matrix<double>& getData(){return  _matrix;}
+    const ub::matrix<double>& getData()const{return  _matrix;}
+    // full (ij|P) matrix of aux function P, screened pairs are zero
+    ub::matrix<double> getDatamatrix( int i )const;
     
-        void FillBlock(const AOShell* _shell,const AOBasis& dftbasis) ; 
+    // sum_mnP D_mn c_P d(mn|P)/dR_A for the atoms A (natoms x 3), from the
+    // integral blocks of derivative shells of the DFT basis, the aux function
+    // follows from translational invariance
+    ub::matrix<double> FillGradient(const AOBasis& auxbasis, const AOBasis& dftbasis, const ub::matrix<double>& D, const ub::vector<double>& c, int natoms);
+    private:
+        ub::matrix<double> _matrix;
+        std::vector< std::pair<unsigned,unsigned> > _pairs;
+        unsigned _dftsize;
+        
+        // overlap of the most diffuse primitives of the two shells above 1e-10
+        static bool SignificantPair(const AOShell* _shell_row, const AOShell* _shell_col);
+        void FillBlock(const AOShell* _shell, const std::vector< std::pair<const AOShell*,const AOShell*> >& shellpairs, const std::vector<unsigned>& offsets) ; 
+        double ContractBlock(const AOShell* _shell, const AOShell* _shell_row, const AOShell* _shell_col, const ub::matrix<double>& D, const ub::vector<double>& c);
         
     };
 
@@ -130,40 +150,70 @@ namespace votca { namespace xtp {
         void set_ntot( int i ) { ntotal = i ;}
         
 
-        void Initialize ( int _basissize, int mmin, int mmax, int nmin, int nmax){
-
-            // here as storage indices starting from zero
-            set_mmin( mmin  );
-            set_mmax( mmax  );
-            set_nmin( nmin  );
-            set_nmax( nmax  );
-            set_mtot( mmax - mmin +1 );
-            set_ntot( nmax - nmin +1 );
-            basissize=_basissize;
-
-            
-            // vector has mtotal elements
-            _matrix.resize( this->get_mtot() );
-            
-            // each element is a gwabasis-by-n matrix, initialize to zero
-            for ( int i = 0; i < this->get_mtot() ; i++){
-                _matrix[i] = ub::zero_matrix<real_gwbse>(basissize,ntotal);
-            }
+        TCMatrix():_ram_budget(0.0),_outofcore(false){};
+        
+        /// levels are kept in a memory-mapped file in scratchdir if all of them
+        /// need more than ram_budget MB, has to be called before Initialize
+        void SetScratch(const std::string& scratchdir, double ram_budget){
+            _scratchdir=scratchdir;
+            _ram_budget=ram_budget;
+        }
         
+        /// changes the budget of the loaded levels, e.g. once other matrices
+        /// sharing the same budget are freed, the storage is not changed
+        void SetRamBudget(double ram_budget){
+            _ram_budget=ram_budget;
         }
+        
+        bool OutOfCore() const{return _outofcore;}
+        
+        /// number of levels which fit into the RAM budget at the same time
+        int TileSize() const;
+        
+        /// levels start to end-1 become accessible via operator[], only needed out of core
+        void Load(int start, int end) const;
+        /// frees levels start to end-1 without writing them back
+        void Release(int start, int end) const;
+        /// writes levels start to end-1 back to the scratch file and frees them
+        void Store(int start, int end);
+
+        void Initialize ( int _basissize, int mmin, int mmax, int nmin, int nmax);
 
         void Prune ( int _basissize, int min, int max);
         void Print( std::string _ident);       
         void Fill(const AOBasis& gwbasis,const AOBasis& dftbasis, const ub::matrix<double>& _dft_orbitals );
         
         void Symmetrize( const ub::matrix<double>& coulomb  );
+        
+        /// replaces each level by transformation*level, the GW basis size becomes transformation.size1()
+        void Transform( const ub::matrix<double>& transformation );
+        
+        /// sum over all levels of level*level^T, gwbasis-by-gwbasis
+        ub::matrix<double> GramMatrix() const;
+        
+        /// dimensions and all levels, not to be used after Prune
+        void Write(boost::archive::binary_oarchive& ar) const;
+        /// initializes from the output of Write, SetScratch is respected
+        void Read(boost::archive::binary_iarchive& ar);
    
         void Cleanup();
         
     private:
         
-        // store vector of matrices
-        std::vector< ub::matrix<real_gwbse> > _matrix;
+        // store vector of matrices, out of core only the loaded levels are filled
+        mutable std::vector< ub::matrix<real_gwbse> > _matrix;
+        
+        std::string _scratchdir;
+        double _ram_budget;
+        bool _outofcore;
+        // scratch file mapping, each level is a row-major basissize-by-_filecols block
+        boost::shared_ptr<boost::interprocess::mapped_region> _region;
+        int _filecols;
+        // number of columns which are loaded, less than _filecols after Prune
+        int _loadcols;
+        real_gwbse* Level(int i) const{
+            return static_cast<real_gwbse*>(_region->get_address())+static_cast<size_t>(i)*basissize*_filecols;
+        }
         
         // band summation indices
         int mmin;
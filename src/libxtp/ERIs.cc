@@ -33,6 +33,9 @@ namespace votca {
     void ERIs::Initialize(AOBasis &_dftbasis, AOBasis &_auxbasis,const ub::matrix<double> &inverse_Coulomb) {
 
            _inverse_Coulomb=inverse_Coulomb;
+           _threecenter_symmetrized=false;
+           _threecenter_max.resize(0);
+           _dmat_last.resize(0,0);
            
             _threecenter.Fill( _auxbasis, _dftbasis );
           
@@ -46,106 +49,196 @@ namespace votca {
 
           _fourcenter.Fill_4c_small_molecule( _dftbasis );
 
+          // basis function pairs i<=j in the order of the packed four-center vector
+          const unsigned dftBasisSize = _dftbasis.AOBasisSize();
+          _4c_pairs.clear();
+          for (unsigned _i = 0; _i < dftBasisSize; _i++) {
+            for (unsigned _j = _i; _j < dftBasisSize; _j++) {
+              _4c_pairs.push_back(std::pair<unsigned, unsigned>(_i, _j));
+            }
+          }
+
+          // Schwarz bounds sqrt((ij|ij)) from the diagonal of the packed vector
+          const ub::vector<double>& _4c_vector = _fourcenter.get_4c_vector();
+          const unsigned vectorSize = _4c_pairs.size();
+          _4c_schwarz = ub::vector<double>(vectorSize);
+          _4c_schwarzmax = 0.0;
+          for (unsigned _ij = 0; _ij < vectorSize; _ij++) {
+            _4c_schwarz(_ij) = std::sqrt(std::abs(_4c_vector(vectorSize * _ij - (_ij * (_ij + 1)) / 2 + _ij)));
+            _4c_schwarzmax = std::max(_4c_schwarzmax, _4c_schwarz(_ij));
+          }
+
           return;
         }
 
         
         
-        void ERIs::CalculateERIs (const ub::matrix<double> &DMAT){
-
-            //cout << _auxAOcoulomb.Matrix()<<endl;
-            //cout << "inverse Coulomb"<< endl;
-            //cout << _inverse_Coulomb<<endl;
+        ub::matrix<double> ERIs::ContractThreecenter(const ub::matrix<double> &DMAT) const{
+            // D_ij of the stored pairs, offdiagonal ones count twice
+            const std::vector< std::pair<unsigned,unsigned> >& pairs=_threecenter.getPairs();
+            ub::vector<double> dmat_packed=ub::vector<double>(pairs.size());
+            for ( unsigned _ij=0; _ij<pairs.size();_ij++){
+                const double factor=(pairs[_ij].first==pairs[_ij].second) ? 1.0 : 2.0;
+                dmat_packed(_ij)=factor*DMAT(pairs[_ij].first,pairs[_ij].second);
+            }
             
-            _ERIs=ub::zero_matrix<double>(DMAT.size1());
-           
-            const ub::symmetric_matrix<double> dmat_symm=DMAT;
-        
-            const ub::vector<double>& dmatasarray=DMAT.data();
-          
+            const ub::matrix<double>& threecenter=_threecenter.getData();
             ub::matrix<double> Itilde=ub::matrix<double>(_threecenter.getSize(),1);
-            //cout << _threecenter.getSize() << " Size-Threecenter"<<endl;
-            //check Efficiency !!!! someday 
             #pragma omp parallel for
             for ( int _i=0; _i<_threecenter.getSize();_i++){
-                const ub::symmetric_matrix<double> &threecenter=_threecenter.getDatamatrix(_i);
-                // Trace over prod::DMAT,I(l)=componentwise product over 
-                double trace=0;
-                for ( unsigned _j=0; _j<dmat_symm.size1();_j++){
-                    trace+=dmat_symm(_j,_j)*threecenter(_j,_j);
-                    for(unsigned _k=0;_k<_j;_k++){
-                    trace+=2*dmat_symm(_j,_k)*threecenter(_j,_k);
-                    }
+                Itilde(_i,0)=ub::inner_prod(ub::row(threecenter,_i),dmat_packed);
+            }
+            return Itilde;
+        }
+        
+        
+        ub::matrix<double> ERIs::ContractFit(const ub::matrix<double> &K, double tolerance){
+            const ub::matrix<double>& threecenter=_threecenter.getData();
+            // largest |(ij|P)| of every aux function, bounds its contribution
+            if(tolerance>0.0 && int(_threecenter_max.size())!=_threecenter.getSize()){
+                _threecenter_max=ub::vector<double>(_threecenter.getSize());
+                #pragma omp parallel for
+                for ( int _i=0; _i<_threecenter.getSize();_i++){
+                    _threecenter_max(_i)=ub::norm_inf(ub::row(threecenter,_i));
                 }
-                Itilde(_i,0)=trace;
             }
-            //cout << "Itilde " <<Itilde << endl;
-            const ub::matrix<double>K=ub::prod(_inverse_Coulomb,Itilde);
-            //cout << "K " << K << endl;
             
             unsigned nthreads = 1;
             #ifdef _OPENMP
                nthreads = omp_get_max_threads();
             #endif
-               std::vector<ub::matrix<double> >ERIS_thread;
+               std::vector<ub::vector<double> >ERIS_thread;
                
                for(unsigned i=0;i<nthreads;++i){
-                   ub::matrix<double> thread=ub::zero_matrix<double>(_ERIs.size1());
-                   ERIS_thread.push_back(thread);
+                   ERIS_thread.push_back(ub::zero_vector<double>(_threecenter.getPairSize()));
                }
             
+            // J_ij = sum_P K_P (ij|P) for the stored pairs, one row of the
+            // three-center data per aux function
             #pragma omp parallel for
             for (unsigned thread=0;thread<nthreads;++thread){
                 for ( unsigned _i = thread; _i < K.size1(); _i+=nthreads){
-
-                ERIS_thread[thread]+=_threecenter.getDatamatrix(_i)*K(_i,0);    
-                //cout << "I " << _threecenter.getDatamatrix(_i) << endl;
-                //cout<< "ERIs " <<_ERIs<< endl;
+                    if(tolerance>0.0 && std::abs(K(_i,0))*_threecenter_max(_i)<tolerance){
+                        continue;
+                    }
+                ub::noalias(ERIS_thread[thread])+=K(_i,0)*ub::row(threecenter,_i);
                 }
             }
-            for (unsigned thread=0;thread<nthreads;++thread){
-                _ERIs+=ERIS_thread[thread];
-            }    
+            for (unsigned thread=1;thread<nthreads;++thread){
+                ERIS_thread[0]+=ERIS_thread[thread];
+            }
+            
+            const std::vector< std::pair<unsigned,unsigned> >& pairs=_threecenter.getPairs();
+            const unsigned size=_threecenter.getDFTSize();
+            ub::matrix<double> result=ub::zero_matrix<double>(size);
+            for ( unsigned _ij=0; _ij<pairs.size();_ij++){
+                result(pairs[_ij].first,pairs[_ij].second)=ERIS_thread[0](_ij);
+                result(pairs[_ij].second,pairs[_ij].first)=ERIS_thread[0](_ij);
+            }
+            return result;
+        }
+        
+        
+        void ERIs::CalculateERIs (const ub::matrix<double> &DMAT){
+
+            //cout << _auxAOcoulomb.Matrix()<<endl;
+            //cout << "inverse Coulomb"<< endl;
+            //cout << _inverse_Coulomb<<endl;
+        
+            const ub::vector<double>& dmatasarray=DMAT.data();
+          
+            const ub::matrix<double> Itilde=ContractThreecenter(DMAT);
+            //cout << "Itilde " <<Itilde << endl;
+            const ub::matrix<double>K=(_threecenter_symmetrized) ? Itilde : ub::prod(_inverse_Coulomb,Itilde);
+            //cout << "K " << K << endl;
+            
+            _ERIs=ContractFit(K,0.0);
+            _dmat_last=DMAT;
             
             CalculateEnergy(dmatasarray);
             return;
         }
+        
+        
+        /*
+         * J is linear in the density, only the change since the last call is
+         * contracted. Aux functions whose contribution to the change stays below
+         * tolerance are skipped, the neglected parts add up until the next
+         * call of CalculateERIs.
+         */
+        void ERIs::CalculateERIs_incremental(const ub::matrix<double> &DMAT, double tolerance){
+            if(_dmat_last.size1()!=DMAT.size1() || _ERIs.size1()!=DMAT.size1()){
+                CalculateERIs(DMAT);
+                return;
+            }
+            const ub::matrix<double> delta=DMAT-_dmat_last;
+            const ub::matrix<double> Itilde=ContractThreecenter(delta);
+            const ub::matrix<double>K=(_threecenter_symmetrized) ? Itilde : ub::prod(_inverse_Coulomb,Itilde);
+            
+            _ERIs+=ContractFit(K,tolerance);
+            _dmat_last=DMAT;
+            
+            CalculateEnergy(DMAT.data());
+            return;
+        }
 
 
 
 
         void ERIs::CalculateERIs_4c_small_molecule(const ub::matrix<double> &DMAT) {
 
-          _ERIs = ub::zero_matrix<double>(DMAT.size1(), DMAT.size2());
           const ub::vector<double> dmatasarray = DMAT.data();
           const ub::vector<double>& _4c_vector = _fourcenter.get_4c_vector();
 
-          int dftBasisSize = DMAT.size1();
-          int vectorSize = (dftBasisSize*(dftBasisSize+1))/2;
-          #pragma omp parallel for
-          for (unsigned _i = 0; _i < DMAT.size1(); _i++) {
-            unsigned sum_i = (_i*(_i+1))/2;
-            for (unsigned _j = _i; _j < DMAT.size2(); _j++) {
-              unsigned _index_ij = DMAT.size2() * _i - sum_i + _j;
-              unsigned _index_ij_kl_a = vectorSize * _index_ij - (_index_ij*(_index_ij+1))/2;
-              for (unsigned _k = 0; _k < DMAT.size1(); _k++) {
-                unsigned sum_k = (_k*(_k+1))/2;
-                for (unsigned _l = _k; _l < DMAT.size2(); _l++) {
-                  unsigned _index_kl = DMAT.size2() * _k - sum_k + _l;
-
-                  unsigned _index_ij_kl = _index_ij_kl_a + _index_kl;
-                  if (_index_ij > _index_kl) _index_ij_kl = vectorSize * _index_kl - (_index_kl*(_index_kl+1))/2 + _index_ij;
-
-                  if (_l == _k) {
-                    _ERIs(_i, _j) += DMAT(_k, _l) * _4c_vector(_index_ij_kl);
-                  } else {
-                    _ERIs(_i, _j) += 2. * DMAT(_k, _l) * _4c_vector(_index_ij_kl);
-                  }
+          const int vectorSize = _4c_pairs.size();
+          // D_kl for every packed index kl with k<l counted twice, (ij|kl)=(ij|lk)
+          ub::vector<double> dmat_packed = ub::vector<double>(vectorSize);
+          double dmax = 0.0;
+          for (int _kl = 0; _kl < vectorSize; _kl++) {
+            const std::pair<unsigned, unsigned>& kl = _4c_pairs[_kl];
+            dmat_packed(_kl) = (kl.first == kl.second) ? DMAT(kl.first, kl.second) : 2. * DMAT(kl.first, kl.second);
+            dmax = std::max(dmax, std::abs(dmat_packed(_kl)));
+          }
+
+          unsigned nthreads = 1;
+          #ifdef _OPENMP
+            nthreads = omp_get_max_threads();
+          #endif
+          std::vector<ub::vector<double> > ERIs_thread;
+          for (unsigned i = 0; i < nthreads; ++i) {
+            ERIs_thread.push_back(ub::zero_vector<double>(vectorSize));
+          }
 
-                }
-              }
-              _ERIs(_j, _i) = _ERIs(_i, _j);
+          // every stored quartet ij<=kl is read once and contributes to J_ij and J_kl,
+          // a row ij of the packed vector is contiguous in memory
+          #pragma omp parallel for schedule(dynamic)
+          for (int _ij = 0; _ij < vectorSize; _ij++) {
+            // (ij|kl) <= sqrt((ij|ij)) sqrt((kl|kl)) bounds the whole row
+            if (_4c_schwarz(_ij) * _4c_schwarzmax * dmax < _4c_screening) continue;
+            unsigned thread = 0;
+            #ifdef _OPENMP
+              thread = omp_get_thread_num();
+            #endif
+            ub::vector<double>& ERIs = ERIs_thread[thread];
+            const double* row = &_4c_vector(0) + vectorSize * _ij - (_ij * (_ij + 1)) / 2;
+            const double d_ij = dmat_packed(_ij);
+            double eri_ij = row[_ij] * d_ij;
+            for (int _kl = _ij + 1; _kl < vectorSize; _kl++) {
+              eri_ij += row[_kl] * dmat_packed(_kl);
+              ERIs(_kl) += row[_kl] * d_ij;
             }
+            ERIs(_ij) += eri_ij;
+          }
+
+          _ERIs = ub::zero_matrix<double>(DMAT.size1(), DMAT.size2());
+          for (int _ij = 0; _ij < vectorSize; _ij++) {
+            double eri = 0.0;
+            for (unsigned thread = 0; thread < nthreads; ++thread) {
+              eri += ERIs_thread[thread](_ij);
+            }
+            const std::pair<unsigned, unsigned>& ij = _4c_pairs[_ij];
+            _ERIs(ij.first, ij.second) = eri;
+            _ERIs(ij.second, ij.first) = eri;
           }
 
           CalculateEnergy(dmatasarray);
@@ -155,43 +248,175 @@ namespace votca {
         
         void ERIs::CalculateEXX_4c_small_molecule(const ub::matrix<double> &DMAT) {
 
-          _EXXs = ub::zero_matrix<double>(DMAT.size1(), DMAT.size2());
           const ub::vector<double> dmatasarray = DMAT.data();
           const ub::vector<double>& _4c_vector = _fourcenter.get_4c_vector();
 
-          int dftBasisSize = DMAT.size1();
-          int vectorSize = (dftBasisSize*(dftBasisSize+1))/2;
-          #pragma omp parallel for
-          for (unsigned _i = 0; _i < DMAT.size1(); _i++) {
-            unsigned sum_i = (_i*(_i+1))/2;
-            for (unsigned _j = _i; _j < DMAT.size2(); _j++) {
-              unsigned _index_ij = DMAT.size2() * _i - sum_i + _j;
-              unsigned _index_ij_kl_a = vectorSize * _index_ij - (_index_ij*(_index_ij+1))/2;
-              for (unsigned _k = 0; _k < DMAT.size1(); _k++) {
-                unsigned sum_k = (_k*(_k+1))/2;
-                for (unsigned _l = _k; _l < DMAT.size2(); _l++) {
-                  unsigned _index_kl = DMAT.size2() * _k - sum_k + _l;
-
-                  unsigned _index_ij_kl = _index_ij_kl_a + _index_kl;
-                  if (_index_ij > _index_kl) _index_ij_kl = vectorSize * _index_kl - (_index_kl*(_index_kl+1))/2 + _index_ij;
-
-                  if (_l == _k) {
-                    _EXXs(_i, _l) += DMAT(_j, _k) * _4c_vector(_index_ij_kl);
-                  } else {
-                    _EXXs(_i, _l) += 2. * DMAT(_j, _k) * _4c_vector(_index_ij_kl);
-                  }
+          const int vectorSize = _4c_pairs.size();
+          double dmax = 0.0;
+          for (unsigned _i = 0; _i < dmatasarray.size(); _i++) {
+            dmax = std::max(dmax, std::abs(dmatasarray(_i)));
+          }
+
+          unsigned nthreads = 1;
+          #ifdef _OPENMP
+            nthreads = omp_get_max_threads();
+          #endif
+          std::vector<ub::matrix<double> > EXX_thread;
+          for (unsigned i = 0; i < nthreads; ++i) {
+            EXX_thread.push_back(ub::zero_matrix<double>(DMAT.size1(), DMAT.size2()));
+          }
 
-                }
-              }
-              _EXXs(_j, _i) = _EXXs(_i, _j);
+          // K_il = sum_jk (ij|kl) D_jk, each stored quartet (ab|cd) stands for up to eight
+          // equivalent ones, weighted by its degeneracy. Four of them are added here, 
+          // the other four are their transposes and follow from symmetrizing K.
+          #pragma omp parallel for schedule(dynamic)
+          for (int _ij = 0; _ij < vectorSize; _ij++) {
+            const double bound_ij = _4c_schwarz(_ij) * dmax;
+            if (bound_ij * _4c_schwarzmax < _4c_screening) continue;
+            unsigned thread = 0;
+            #ifdef _OPENMP
+              thread = omp_get_thread_num();
+            #endif
+            ub::matrix<double>& EXX = EXX_thread[thread];
+            const double* row = &_4c_vector(0) + vectorSize * _ij - (_ij * (_ij + 1)) / 2;
+            const unsigned _a = _4c_pairs[_ij].first;
+            const unsigned _b = _4c_pairs[_ij].second;
+            const double deg_ab = (_a == _b) ? 0.25 : 0.5;
+            for (int _kl = _ij; _kl < vectorSize; _kl++) {
+              if (bound_ij * _4c_schwarz(_kl) < _4c_screening) continue;
+              const unsigned _c = _4c_pairs[_kl].first;
+              const unsigned _d = _4c_pairs[_kl].second;
+              double value = row[_kl] * deg_ab;
+              if (_c != _d) value *= 2.;
+              if (_kl != _ij) value *= 2.;
+              EXX(_a, _c) += DMAT(_b, _d) * value;
+              EXX(_b, _d) += DMAT(_a, _c) * value;
+              EXX(_a, _d) += DMAT(_b, _c) * value;
+              EXX(_b, _c) += DMAT(_a, _d) * value;
             }
           }
 
+          ub::matrix<double> EXX = EXX_thread[0];
+          for (unsigned thread = 1; thread < nthreads; ++thread) {
+            EXX += EXX_thread[thread];
+          }
+          _EXXs = 0.5 * (EXX + ub::trans(EXX));
+
           CalculateEXXEnergy(dmatasarray);
           return;
         }
         
         
+        void ERIs::SymmetrizeThreecenter(){
+            // V^-1/2 from the (truncated) inverse Coulomb metric
+            ub::vector<double> eigenvalues;
+            ub::matrix<double> eigenvectors;
+            linalg_eigenvalues(_inverse_Coulomb, eigenvalues, eigenvectors);
+            ub::matrix<double> _temp=ub::trans(eigenvectors);
+            for (unsigned _i = 0; _i < eigenvalues.size(); _i++) {
+                const double factor=(eigenvalues(_i)>0.0) ? std::sqrt(eigenvalues(_i)) : 0.0;
+                ub::row(_temp,_i)*=factor;
+            }
+            const ub::matrix<double> Vminushalf=ub::prod(eigenvectors,_temp);
+            _inverse_Coulomb.resize(0,0);
+            
+            // B^P_ij = sum_Q V^-1/2_PQ (ij|Q), in blocks of stored pairs
+            ub::matrix<double>& threecenter=_threecenter.getData();
+            const int auxsize=_threecenter.getSize();
+            const int pairsize=_threecenter.getPairSize();
+            const int blocksize=64;
+            #pragma omp parallel for schedule(dynamic)
+            for (int _start = 0; _start < pairsize; _start+=blocksize) {
+                const ub::range pairs=ub::range(_start,std::min(_start+blocksize,pairsize));
+                const ub::matrix<double> block=ub::project(threecenter,ub::range(0,auxsize),pairs);
+                ub::project(threecenter,ub::range(0,auxsize),pairs)=ub::prod(Vminushalf,block);
+            }
+            _threecenter_symmetrized=true;
+            _threecenter_max.resize(0);
+            return;
+        }
+        
+        
+        void ERIs::CalculateEXX(const ub::matrix<double> &DMAT) {
+            
+            if(!_threecenter_symmetrized){
+                SymmetrizeThreecenter();
+            }
+            const ub::vector<double>& dmatasarray=DMAT.data();
+            
+            // D=Y s Y^T with s the signs of the nonzero eigenvalues of D, for a density matrix 
+            // Y has roughly as many columns as there are occupied orbitals
+            ub::vector<double> eigenvalues;
+            ub::matrix<double> eigenvectors;
+            linalg_eigenvalues(DMAT, eigenvalues, eigenvectors);
+            std::vector<unsigned> columns;
+            for (unsigned _i = 0; _i < eigenvalues.size(); _i++) {
+                if (std::abs(eigenvalues(_i)) > 1e-10) {
+                    columns.push_back(_i);
+                }
+            }
+            ub::matrix<double> Y=ub::matrix<double>(DMAT.size1(),columns.size());
+            std::vector<unsigned> negative;
+            for (unsigned _i = 0; _i < columns.size(); _i++) {
+                ub::column(Y,_i)=std::sqrt(std::abs(eigenvalues(columns[_i])))*ub::column(eigenvectors,columns[_i]);
+                if (eigenvalues(columns[_i]) < 0.0) {
+                    negative.push_back(_i);
+                }
+            }
+            
+            // K = sum_P (B^P Y) s (B^P Y)^T
+            unsigned nthreads = 1;
+            #ifdef _OPENMP
+               nthreads = omp_get_max_threads();
+            #endif
+            std::vector<ub::matrix<double> >EXX_thread;
+            for(unsigned i=0;i<nthreads;++i){
+                ub::matrix<double> thread=ub::zero_matrix<double>(DMAT.size1());
+                EXX_thread.push_back(thread);
+            }
+            
+            #pragma omp parallel for
+            for (unsigned thread=0;thread<nthreads;++thread){
+                for ( int _i = thread; _i < _threecenter.getSize(); _i+=nthreads){
+                    const ub::matrix<double> threecenter=_threecenter.getDatamatrix(_i);
+                    const ub::matrix<double> T=ub::prod(threecenter,Y);
+                    ub::matrix<double> Ts=T;
+                    for (unsigned _j = 0; _j < negative.size(); _j++) {
+                        ub::column(Ts,negative[_j])*=-1.0;
+                    }
+                    ub::noalias(EXX_thread[thread])+=ub::prod(T,ub::trans(Ts));
+                }
+            }
+            _EXXs=ub::zero_matrix<double>(DMAT.size1());
+            for (unsigned thread=0;thread<nthreads;++thread){
+                _EXXs+=EXX_thread[thread];
+            }
+            
+            CalculateEXXEnergy(dmatasarray);
+            return;
+        }
+
+        
+        
+        /*
+         * With the fit coefficients c = V^-1 I the RI Coulomb energy is
+         * 1/2 I^T V^-1 I, its derivative sum_mnP D_mn c_P d(mn|P) - 1/2 c^T dV c
+         */
+        ub::matrix<double> ERIs::CalculateGradient(const AOBasis &_dftbasis, const AOBasis &_auxbasis, const ub::matrix<double> &DMAT, int natoms){
+            if(_threecenter_symmetrized){
+                throw std::runtime_error("ERIs::CalculateGradient: three-center integrals are already contracted with V^-1/2");
+            }
+            const ub::matrix<double> Itilde=ContractThreecenter(DMAT);
+            const ub::matrix<double> K=ub::prod(_inverse_Coulomb,Itilde);
+            const ub::vector<double> c=ub::column(K,0);
+            
+            ub::matrix<double> gradient=_threecenter.FillGradient(_auxbasis,_dftbasis,DMAT,c,natoms);
+            AOCoulomb _auxAOcoulomb;
+            gradient-=0.5*_auxAOcoulomb.FillGradient(_auxbasis,ub::outer_prod(c,c),natoms);
+            return gradient;
+        }
+        
+        
         
         
          void ERIs::CalculateEnergy(const ub::vector<double> &dmatasarray){
@@ -32,6 +32,7 @@ namespace votca { namespace xtp {
 AOShell* AOBasis::addShell( string shellType,int Lmax,int Lmin, double shellScale, int shellFunc, int startIndex, int offset, vec pos, string name, int index )
     {
         AOShell* aoshell = new AOShell( shellType,Lmax,Lmin, shellScale, shellFunc, startIndex, offset, pos, name, index, this );
+        aoshell->_shellindex = _aoshells.size();
         _aoshells.push_back(aoshell);
         return aoshell;
         }
@@ -513,6 +514,51 @@ void AOBasis::AOBasisFill(BasisSet* bs , vector<ctp::QMAtom* > _atoms, int _frag
        } else {
            _AOBasisFragB = _AOBasisSize - _AOBasisFragA;
        }
+       // the pair table is built on first use, aux and ECP bases never need it
+       _shellpairs_filled = false;
+       _shellpair_nshells = 0;
+       _shellpairs.clear();
+       _shellpair_offsets.clear();
+       _primitive_trafos.clear();
+       return;
+}
+
+
+
+void AOBasis::PrepareShellPairs() const {
+       #pragma omp critical (aobasis_shellpairs)
+       {
+       if (!_shellpairs_filled) FillShellPairs();
+       }
+       return;
+}
+
+
+
+// shells added later (e.g. displaced ones) are not in the table, AOShellPair computes their pairs itself
+void AOBasis::FillShellPairs() const {
+
+       _shellpair_nshells = _aoshells.size();
+       _primitive_trafos.clear();
+       std::vector<unsigned> _first_trafo;
+       _first_trafo.reserve(_shellpair_nshells);
+       for (unsigned _i = 0; _i < _shellpair_nshells; _i++) {
+           _first_trafo.push_back(_primitive_trafos.size());
+           AOShellPair::FillTrafos(_aoshells[_i], _primitive_trafos);
+       }
+
+       _shellpairs.clear();
+       _shellpair_offsets.clear();
+       _shellpair_offsets.reserve(_shellpair_nshells * (_shellpair_nshells + 1) / 2 + 1);
+       for (unsigned _row = 0; _row < _shellpair_nshells; _row++) {
+           for (unsigned _col = 0; _col <= _row; _col++) {
+               _shellpair_offsets.push_back(_shellpairs.size());
+               AOShellPair::FillPrimitivePairs(_aoshells[_row], _aoshells[_col], _primitive_trafos.data() + _first_trafo[_row],
+                       _primitive_trafos.data() + _first_trafo[_col], _shellpairs);
+           }
+       }
+       _shellpair_offsets.push_back(_shellpairs.size());
+       _shellpairs_filled = true;
        return;
 }
 
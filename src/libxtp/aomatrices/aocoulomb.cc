@@ -669,6 +669,19 @@ if (_lmax_col > 5) {
                 }
             }
 
+            if (_shell_row->getDerivative() >= 0 || _shell_col->getDerivative() >= 0) {
+                // the trafos of derivative shells contain the derivative, the
+                // factors below only hold for plain shells
+                const ub::matrix<double> _cou_der = ub::prod(getTrafo(*itr), _coumat);
+                const ub::matrix<double> _cou_der_sph = ub::prod(_cou_der, ub::trans(getTrafo(*itc)));
+                for (unsigned i = 0; i < _matrix.size1(); i++) {
+                    for (unsigned j = 0; j < _matrix.size2(); j++) {
+                        _matrix(i, j) += _cou_der_sph(i + _shell_row->getOffset(), j + _shell_col->getOffset());
+                    }
+                }
+                continue;
+            }
+
             ub::matrix<double> _cou_tmp = ub::zero_matrix<double>(_ntrafo_row, _ncols);
             
             
@@ -66,8 +66,6 @@ namespace votca { namespace xtp {
          // get shell positions
         const vec& _pos_row = _shell_row->getPos();
         const vec& _pos_col = _shell_col->getPos();
-        const vec  _diff    = _pos_row - _pos_col;
-        double _distsq = (_diff*_diff); 
 
 
 
@@ -120,38 +118,28 @@ namespace votca { namespace xtp {
         std::vector<double> _pmc(3,0.0);
         
         
-        // iterate over Gaussians in this _shell_row
-        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr){
-            // iterate over Gaussians in this _shell_col
-            // get decay constant
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc){
-                //get decay constant
-                const double _decay_col = itc->getDecay();
-        
-       
-                const double _fak  = 0.5/(_decay_row + _decay_col);
-                const double _fak2 = 2.0 * _fak;
-
-                double _exparg = _fak2 * _decay_row * _decay_col *_distsq;
-                // check if distance between postions is big, then skip step   
-       
-                if ( _exparg > 30.0 ) { continue; }
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double _fak  = itp->fak;
+            const double _fak2 = itp->fak2;
+            const double _exparg = itp->exparg;
         
 
 
-        const double PmA0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-        const double PmA1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-        const double PmA2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+        const double PmA0 = itp->P.getX() - _pos_row.getX();
+        const double PmA1 = itp->P.getY() - _pos_row.getY();
+        const double PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-        const double PmB0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-        const double PmB1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-        const double PmB2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();        
+        const double PmB0 = itp->P.getX() - _pos_col.getX();
+        const double PmB1 = itp->P.getY() - _pos_col.getY();
+        const double PmB2 = itp->P.getZ() - _pos_col.getZ();        
                 
-        _pmc[0] = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _center[0];
-        _pmc[1] = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _center[1];
-        _pmc[2] = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _center[2];
+        _pmc[0] = itp->P.getX() - _center[0];
+        _pmc[1] = itp->P.getY() - _center[1];
+        _pmc[2] = itp->P.getZ() - _center[2];
         
         
         
@@ -159,7 +147,7 @@ namespace votca { namespace xtp {
         
         
         // calculate s-s- overlap matrix element
-        _ol(0,0) = pow(4.0*_decay_row*_decay_col,0.75) * pow(_fak2,1.5)*exp(-_fak2 * _decay_row * _decay_col *_distsq); // s-s element
+        _ol(0,0) = pow(4.0*_decay_row*_decay_col,0.75) * pow(_fak2,1.5)*exp(-_exparg); // s-s element
 
         // s-s dipole moment integrals
         for ( int _i_comp = 0 ; _i_comp < 3; _i_comp++ ){
@@ -576,8 +564,8 @@ if (_lmax_col > 3) {
 
        
         
-        ub::matrix<double> _trafo_row = getTrafo(*itr);
-        ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));       
+        const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+        ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);       
         //ub::matrix<double> _trafo_col_tposed = ub::trans( _trafo_col );
 
         // cartesian -> spherical
@@ -597,8 +585,7 @@ if (_lmax_col > 3) {
         }
         
         _ol.clear();
-            }// _shell_col Gaussians
-        }// _shell_row Gaussians
+            } // primitive pairs
     }
     
   
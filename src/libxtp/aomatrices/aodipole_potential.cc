@@ -43,14 +43,6 @@ namespace votca { namespace xtp {
 
         const double pi = boost::math::constants::pi<double>();
 
-        // Get components of dipole vector somehow
-        
-        vec dipole=-(apolarsite->getU1()+apolarsite->getQ1())*tools::conv::nm2bohr;
-       
-        double d_0 = dipole.getX();
-        double d_1 = dipole.getY();
-        double d_2 = dipole.getZ();
-
         // cout << _gridpoint << endl;
         // shell info, only lmax tells how far to go
         int _lmax_row = _shell_row->getLmax();
@@ -115,43 +107,66 @@ namespace votca { namespace xtp {
         // get shell positions
         const vec& _pos_row = _shell_row->getPos();
         const vec& _pos_col = _shell_col->getPos();
-        const vec  _diff    = _pos_row - _pos_col;
-        // initialize some helper
-      
-        double _distsq = _diff*_diff; 
         
+        vec _center;
+        double _extent2;
+        if ( !ShellPairDistribution(_shell_row, _shell_col, _center, _extent2) ) { return; }
+        // split the sites into those evaluated exactly and distant ones, which
+        // enter by the potential and its gradient at the pair centre
+        std::vector<vec> _nearpos;
+        std::vector<vec> _neardipole;
+        double _phi = 0.0;
+        vec _gradphi = vec(0.0, 0.0, 0.0);
+        bool _has_farfield = false;
+        for ( unsigned _site = 0; _site < _sitepos.size(); _site++ ) {
+            if ( IsFarField(_extent2, _center, _sitepos[_site]) ) {
+                const vec& _d = _sitedipole[_site];
+                const vec _R = _center - _sitepos[_site];
+                const double _Rinv = 1.0 / abs(_R);
+                const double _Rinv3 = _Rinv * _Rinv * _Rinv;
+                const double _dR = _d * _R;
+                _phi += _dR * _Rinv3;
+                _gradphi += _Rinv3 * _d - ( 3.0 * _dR * _Rinv3 * _Rinv * _Rinv ) * _R;
+                _has_farfield = true;
+            } else {
+                _nearpos.push_back(_sitepos[_site]);
+                _neardipole.push_back(_sitedipole[_site]);
+            }
+        }
+        if ( _has_farfield ) { AddFarField(_matrix, _shell_row, _shell_col, _center, _phi, _gradphi); }
+        if ( _nearpos.empty() ) { return; }
         
-        // iterate over Gaussians in this _shell_row
-        for (AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr) {
-            // iterate over Gaussians in this _shell_col
-            // get decay constant
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc) {
-                //get decay constant
-                const double _decay_col = itc->getDecay();
-
-                const double zeta = _decay_row + _decay_col;
-                const double _fak  = 0.5/zeta;
-                const double _fak2 = 2.0 * _fak;
-                const double xi = _decay_row * _decay_col * _fak2;
-
-                double _exparg = xi *_distsq;
-                // check if distance between postions is big, then skip step   
-                if ( _exparg > 30.0 ) { continue; }
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double zeta = _decay_row + _decay_col;
+            const double _fak  = itp->fak;
+            const double _fak2 = itp->fak2;
+            const double _exparg = itp->exparg;
 
         // some helpers
-        double PmA0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-        double PmA1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-        double PmA2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+        double PmA0 = itp->P.getX() - _pos_row.getX();
+        double PmA1 = itp->P.getY() - _pos_row.getY();
+        double PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-        double PmB0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-        double PmB1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-        double PmB2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();
+        double PmB0 = itp->P.getX() - _pos_col.getX();
+        double PmB1 = itp->P.getY() - _pos_col.getY();
+        double PmB2 = itp->P.getZ() - _pos_col.getZ();
 
-        double PmC0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _gridpoint.getX();
-        double PmC1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _gridpoint.getY();
-        double PmC2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _gridpoint.getZ();
+        dip = ub::zero_matrix<double>(_nrows,_ncols);
+        
+        // all sites are summed in the cartesian block, transformed only once
+        for ( unsigned _site = 0; _site < _nearpos.size(); _site++ ) {
+        
+        const double d_0 = _neardipole[_site].getX();
+        const double d_1 = _neardipole[_site].getY();
+        const double d_2 = _neardipole[_site].getZ();
+
+        double PmC0 = itp->P.getX() - _nearpos[_site].getX();
+        double PmC1 = itp->P.getY() - _nearpos[_site].getY();
+        double PmC2 = itp->P.getZ() - _nearpos[_site].getZ();
 
         const double _U = zeta*(PmC0*PmC0+PmC1*PmC1+PmC2*PmC2);
 
@@ -767,13 +782,15 @@ if (_lmax_col > 3) {
 
 for (int _i = 0; _i < _nrows; _i++) {
   for (int _j = 0; _j < _ncols; _j++) {
-    dip(_i,_j) = d_0 * dip4[_i][_j][0][0] + d_1 * dip4[_i][_j][1][0] + d_2 * dip4[_i][_j][2][0];
+    dip(_i,_j) += d_0 * dip4[_i][_j][0][0] + d_1 * dip4[_i][_j][1][0] + d_2 * dip4[_i][_j][2][0];
   }
 }                         
 
+        }// sites
+
         
-        ub::matrix<double> _trafo_row = getTrafo(*itr);
-        ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));      
+        const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+        ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);      
              
         ub::matrix<double> _dip_tmp = ub::prod( _trafo_row, dip );
         ub::matrix<double> _dip_sph = ub::prod( _dip_tmp, _trafo_col_tposed );
@@ -785,25 +802,32 @@ for (int _i = 0; _i < _nrows; _i++) {
             }
         }
         
-            }// _shell_col Gaussians
-        }// _shell_row Gaussians
+            } // primitive pairs
         }
 
-        void AODipole_Potential::Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*> & _sites) {
+        void AODipole_Potential::Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*> & _sites, double farfield_tolerance) {
 
-            _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+            _sitepos.clear();
+            _sitedipole.clear();
             for (unsigned int i = 0; i < _sites.size(); i++) {
                 for (ctp::PolarSeg::const_iterator it = _sites[i]->begin(); it < _sites[i]->end(); ++it) {
 
                     if ((*it)->getRank() > 0 || (*it)->IsPolarizable()) {
-                        vec positionofsite = (*it)->getPos() * tools::conv::nm2bohr;
-                        _aomatrix = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
-                        setAPolarSite((*it));
-                        Fill(aobasis, positionofsite);
-                        _externalpotential += _aomatrix;
+                        _sitepos.push_back((*it)->getPos() * tools::conv::nm2bohr);
+                        _sitedipole.push_back(-((*it)->getU1()+(*it)->getQ1())*tools::conv::nm2bohr);
                     }
                 }
             }
+            if ( _sitepos.empty() ) {
+                _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+                return;
+            }
+            PrepareFarField(aobasis, farfield_tolerance);
+            Fill(aobasis);
+            _externalpotential = _aomatrix;
+            ClearFarField();
+            _sitepos.clear();
+            _sitedipole.clear();
             return;
         }
 
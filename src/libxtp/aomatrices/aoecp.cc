@@ -42,6 +42,33 @@ namespace votca { namespace xtp {
     namespace ub = boost::numeric::ublas;
     using namespace votca::tools;
 
+namespace {
+    // a value and its derivative with respect to one decay constant, calcVNLmatrix
+    // carries it through for the r^2 functions of the ECP gradient
+    struct DecayDual {
+        double v;
+        double d;
+        DecayDual(double value = 0.0, double derivative = 0.0) : v(value), d(derivative) {}
+        DecayDual& operator+=(const DecayDual& b) { v += b.v; d += b.d; return *this; }
+    };
+    DecayDual operator-(const DecayDual& a) { return DecayDual(-a.v, -a.d); }
+    DecayDual operator+(const DecayDual& a, const DecayDual& b) { return DecayDual(a.v + b.v, a.d + b.d); }
+    DecayDual operator-(const DecayDual& a, const DecayDual& b) { return DecayDual(a.v - b.v, a.d - b.d); }
+    DecayDual operator*(const DecayDual& a, const DecayDual& b) { return DecayDual(a.v * b.v, a.d * b.v + a.v * b.d); }
+    DecayDual operator/(const DecayDual& a, const DecayDual& b) { return DecayDual(a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v)); }
+    bool operator!=(const DecayDual& a, const DecayDual& b) { return a.v != b.v || a.d != b.d; }
+    // the cutoffs of the series only look at the values
+    bool operator<(const DecayDual& a, const DecayDual& b) { return a.v < b.v; }
+    bool operator<=(const DecayDual& a, const DecayDual& b) { return a.v <= b.v; }
+    bool operator>(const DecayDual& a, const DecayDual& b) { return a.v > b.v; }
+    DecayDual exp(const DecayDual& a) { const double e = std::exp(a.v); return DecayDual(e, e * a.d); }
+    DecayDual sqrt(const DecayDual& a) { const double r = std::sqrt(a.v); return DecayDual(r, 0.5 * a.d / r); }
+    DecayDual pow(const DecayDual& a, double n) { const double p = std::pow(a.v, n); return DecayDual(p, n * p / a.v * a.d); }
+    using std::exp;
+    using std::sqrt;
+    using std::pow;
+}
+
 
     void AOECP::FillBlock(ub::matrix_range< ub::matrix<double> >& _matrix, const AOShell* _shell_row, const AOShell* _shell_col, AOBasis* ecp) {
 
@@ -62,13 +89,56 @@ namespace votca { namespace xtp {
             // get shell positions       
     
             int _lmax_row = _shell_row->getLmax();
-            std::vector<double> _contractions_row_full((_lmax_row + 1)*(_lmax_row + 1));
+            std::vector<double> _contractions_row_full((_lmax_row + 1)*(_lmax_row + 1), 1.0);
 
 
             int _lmax_col = _shell_col->getLmax();
-            std::vector<double> _contractions_col_full((_lmax_col + 1)*(_lmax_col + 1));
+            std::vector<double> _contractions_col_full((_lmax_col + 1)*(_lmax_col + 1), 1.0);
+
+            // a derivative shell carries its contractions in the expansion
+            const bool _deriv_row = (_shell_row->getDerivative() >= 0);
+            const bool _deriv_col = (_shell_col->getDerivative() >= 0);
+            ub::matrix<double> _expansion;
+            if (_deriv_row) {
+                _expansion = getDerivativeExpansion(_lmax_row - 1, _shell_row->getDerivative());
+            } else if (_deriv_col) {
+                _expansion = getDerivativeExpansion(_lmax_col - 1, _shell_col->getDerivative());
+            }
+
+
 
+            // collect the non-local parts of the pseudopotential of each atom,
+            // 4 fit components, non-local ECPs l = 0, 1, 2, 3, 4
+            std::vector<vec> _ecp_pos;
+            std::vector<int> _ecp_lmax;
+            std::vector< ub::matrix<int> > _ecp_power;
+            std::vector< ub::matrix<double> > _ecp_decay;
+            std::vector< ub::matrix<double> > _ecp_coef;
+            int _atomidx = -1;
+            for (AOBasis::AOShellIterator _ecp = ecp->firstShell(); _ecp != ecp->lastShell(); ++_ecp) {
 
+                const AOShell* _shell_ecp = ecp->getShell(_ecp);
+                const int _ecp_l = _shell_ecp->getOffset(); //  angular momentum l is stored in offset for ECP
+
+                // only do the non-local parts
+                if (_ecp_l >= _shell_ecp->getNumFunc()) continue;
+
+                if (_shell_ecp->getIndex() != _atomidx) {
+                    _atomidx = _shell_ecp->getIndex();
+                    _ecp_pos.push_back(_shell_ecp->getPos());
+                    _ecp_lmax.push_back(_shell_ecp->getNumFunc() - 1);
+                    _ecp_power.push_back(ub::zero_matrix<int>(4, 5));
+                    _ecp_decay.push_back(ub::zero_matrix<double>(4, 5));
+                    _ecp_coef.push_back(ub::zero_matrix<double>(4, 5));
+                }
+                int i_fit = 0;
+                for (AOShell::GaussianIterator itecp = _shell_ecp->firstGaussian(); itecp != _shell_ecp->lastGaussian(); ++itecp) {
+                    _ecp_power.back()(i_fit, _ecp_l) = itecp->getPower();
+                    _ecp_decay.back()(i_fit, _ecp_l) = itecp->getDecay();
+                    _ecp_coef.back()(i_fit, _ecp_l) = itecp->getContraction()[0];
+                    i_fit++;
+                }
+            }
 
             const vec& _pos_row = _shell_row->getPos();
             const vec& _pos_col = _shell_col->getPos();
@@ -87,7 +157,7 @@ namespace votca { namespace xtp {
 
                 const std::vector<double>& _contractions_row = itr->getContraction();
                 // shitty magic
-                for (int L = 0; L <= _lmax_row; L++) {
+                for (int L = 0; L <= _lmax_row && !_deriv_row; L++) {
                     for (int M = L*L; M < (L + 1)*(L + 1); M++) {
                         _contractions_row_full[M] = _contractions_row[L];
                     }
@@ -110,86 +180,34 @@ namespace votca { namespace xtp {
                     }
 
                     const std::vector<double>& _contractions_col = itc->getContraction();
-                    for (int L = 0; L <= _lmax_col; L++) {
+                    for (int L = 0; L <= _lmax_col && !_deriv_col; L++) {
                         for (int M = L * L; M < (L + 1)*(L + 1); M++) {
                             _contractions_col_full[M] = _contractions_col[L];
                         }
                     }
                     // for each atom and its pseudopotential, get a matrix
-                    int _atomidx = 0;
-
-                    ub::matrix<int> _power_matrix = ub::zero_matrix<int>(4, 5); // 4 fit components, non-local ECPs l = 0, 1, 2, 3, 4
-                    ub::matrix<double> _decay_matrix = ub::zero_matrix<double>(4, 5);
-                    ub::matrix<double> _coef_matrix  = ub::zero_matrix<double>(4, 5);
-
-                    AOBasis::AOShellIterator final_iter = ecp->lastShell();
-                    --final_iter;
-                    vec _ecp_eval_pos = vec(0.0);
-                    int _lmax_ecp = 0;
-                    for (AOBasis::AOShellIterator _ecp = ecp->firstShell(); _ecp != ecp->lastShell(); ++_ecp) {
-
-                        const AOShell* _shell_ecp = ecp->getShell(_ecp);
-                        const vec& _ecp_pos = _shell_ecp->getPos();
-
-                        int this_atom = _shell_ecp->getIndex();
-
-                        const int _ecp_l = _shell_ecp->getOffset(); //  angular momentum l is stored in offset for ECP
-
-                        // only do the non-local parts
-                        if (_ecp_l < _shell_ecp->getNumFunc()) {
-                            int _lmax_ecp_old = _lmax_ecp;
-                            _lmax_ecp = _shell_ecp->getNumFunc() - 1;
-                            int i_fit = -1;
-                            for (AOShell::GaussianIterator itecp = _shell_ecp->firstGaussian(); itecp != _shell_ecp->lastGaussian(); ++itecp) {
-                                i_fit++;
-
-                                // get info for this angular momentum shell
-                                const int _power_ecp = itecp->getPower();
-                                const double _decay_ecp = itecp->getDecay();
-                                const double _contraction_ecp = itecp->getContraction()[0];
-
-                                // collect atom ECP
-                                if (this_atom == _atomidx) {
-                                    _ecp_eval_pos = _ecp_pos;
-                                    _power_matrix(i_fit, _ecp_l ) = _power_ecp;
-                                    _decay_matrix(i_fit, _ecp_l ) = _decay_ecp;
-                                    _coef_matrix(i_fit, _ecp_l )  = _contraction_ecp;
-                                }
-                                
-                                if ((this_atom != _atomidx ) || ( _ecp == final_iter)) {
-                                    if (this_atom != _atomidx) {
-                                       _lmax_ecp = _lmax_ecp_old;
-                                    }
-
-                                    // evaluate collected data, returns a (10x10) matrix of already normalized matrix elements
-                                    ub::matrix<double> VNL_ECP = calcVNLmatrix(_lmax_ecp, _ecp_eval_pos, *itr, *itc,  _power_matrix ,_decay_matrix, _coef_matrix);
-
-                                    // consider contractions
-                                    // cut out block that is needed. sum
-                                    //                                   cout << "_matrix.size1,2()   " << _matrix.size1() << "    " << _matrix.size2() << endl;
-                                    for ( unsigned i = 0; i < _matrix.size1(); i++ ) {
-                                        for (unsigned j = 0; j < _matrix.size2(); j++) {
-                                            _matrix(i,j) += VNL_ECP(i+_shell_row->getOffset(),j+_shell_col->getOffset()) * _contractions_row_full[i+_shell_row->getOffset()]* _contractions_col_full[j+_shell_col->getOffset()];
-                                        }
-                                    }
-
-
-                                    // reset atom ECP containers
-                                    _power_matrix = ub::zero_matrix<int>(4, 5); // 4 fit components, non-local ECPs l = 0, 1, 2, 3, 4
-                                    _decay_matrix = ub::zero_matrix<double>(4, 5);
-                                    _coef_matrix  = ub::zero_matrix<double>(4, 5);
-                                    _atomidx++;
-                                    i_fit = 0;
-                                    //cout << "setting new matrix " << i_fit << " l " << _ecp_l << " alpha  " << _decay_ecp <<  " pref " << _contraction_ecp << endl;
-                                    _power_matrix(i_fit, _ecp_l ) = _power_ecp;
-                                    _decay_matrix(i_fit, _ecp_l ) = _decay_ecp;
-                                    _coef_matrix(i_fit, _ecp_l )  = _contraction_ecp;
-                                } // evaluate if new atom is found
+                    for (unsigned _atom = 0; _atom < _ecp_pos.size(); _atom++) {
+
+                        // evaluate collected data, returns a (10x10) matrix of already normalized matrix elements
+                        ub::matrix<double> VNL_ECP;
+                        if (_deriv_row) {
+                            VNL_ECP = calcVNLderivative(_ecp_lmax[_atom], _ecp_pos[_atom], *itr, *itc, _expansion, _ecp_power[_atom], _ecp_decay[_atom], _ecp_coef[_atom]);
+                        } else if (_deriv_col) {
+                            VNL_ECP = ub::trans(calcVNLderivative(_ecp_lmax[_atom], _ecp_pos[_atom], *itc, *itr, _expansion, _ecp_power[_atom], _ecp_decay[_atom], _ecp_coef[_atom]));
+                        } else {
+                            VNL_ECP = calcVNLmatrix<double>(_ecp_lmax[_atom], _ecp_pos[_atom], _decay_row, _pos_row, _lmax_row,
+                                    _decay_col, _pos_col, _lmax_col, _ecp_power[_atom], _ecp_decay[_atom], _ecp_coef[_atom]);
+                        }
 
-                            } // all Gaussians in ecp_shell
-                        } // only for non local parts
+                        // consider contractions
+                        // cut out block that is needed. sum
+                        for ( unsigned i = 0; i < _matrix.size1(); i++ ) {
+                            for (unsigned j = 0; j < _matrix.size2(); j++) {
+                                _matrix(i,j) += VNL_ECP(i+_shell_row->getOffset(),j+_shell_col->getOffset()) * _contractions_row_full[i+_shell_row->getOffset()]* _contractions_col_full[j+_shell_col->getOffset()];
+                            }
+                        }
 
-                    } // all ecp_shells
+                    } // all atoms with ECP
                   
                 }// _shell_col Gaussians
             }// _shell_row Gaussians
@@ -197,7 +215,136 @@ namespace votca { namespace xtp {
             return;
         }
 
-        ub::matrix<double> AOECP::calcVNLmatrix(int _lmax_ecp, const vec& posC, const AOGaussianPrimitive& _g_row, const AOGaussianPrimitive& _g_col,const ub::matrix<int>& _power_ecp, const ub::matrix<double>& _gamma_ecp,const ub::matrix<double>& _pref_ecp) {
+        ub::matrix<double> AOECP::FillECPGradient(const AOBasis& aobasis, AOBasis& ecp, const ub::matrix<double>& D, int natoms) {
+
+            // the derivative shells raise l by one, calcVNLmatrix stops at G
+            // functions and at F functions for ECPs with l = 4
+            int _lmax_dft = 0;
+            for (AOBasis::AOShellIterator _row = aobasis.firstShell(); _row != aobasis.lastShell(); ++_row) {
+                _lmax_dft = std::max(_lmax_dft, aobasis.getShell(_row)->getLmax());
+            }
+            int _lmax_ecp = 0;
+            for (AOBasis::AOShellIterator _ecp = ecp.firstShell(); _ecp != ecp.lastShell(); ++_ecp) {
+                _lmax_ecp = std::max(_lmax_ecp, ecp.getShell(_ecp)->getNumFunc() - 1);
+            }
+            if (_lmax_dft > 3 || (_lmax_dft == 3 && _lmax_ecp > 3)) {
+                throw std::runtime_error("AOECP::FillECPGradient: ECP gradients support S, P, D, F functions with ECPs up to l = 3 and S, P, D functions with l = 4");
+            }
+
+            // ECP shells are numbered without the atoms lacking an ECP, the
+            // atom follows from the basis functions at the same position
+            std::vector<int> _ecp_atom;
+            for (AOBasis::AOShellIterator _ecp = ecp.firstShell(); _ecp != ecp.lastShell(); ++_ecp) {
+                const vec& _ecp_pos = ecp.getShell(_ecp)->getPos();
+                int _atom = -1;
+                for (AOBasis::AOShellIterator _row = aobasis.firstShell(); _row != aobasis.lastShell(); ++_row) {
+                    const vec _dist = aobasis.getShell(_row)->getPos() - _ecp_pos;
+                    if (_dist * _dist < 1e-12) {
+                        _atom = aobasis.getShell(_row)->getIndex();
+                        break;
+                    }
+                }
+                if (_atom < 0) {
+                    throw std::runtime_error("AOECP::FillECPGradient: no basis functions at the position of an ECP");
+                }
+                _ecp_atom.push_back(_atom);
+            }
+
+            // one pseudopotential at a time, FillBlock evaluates an ECP basis
+            // with a single atom of index 0, the pseudopotential itself follows
+            // from translational invariance
+            ub::matrix<double> _gradient = ub::zero_matrix<double>(natoms, 3);
+            unsigned _first = 0;
+            while (_first < ecp.getNumofShells()) {
+                unsigned _last = _first;
+                AOBasis _ecp_single;
+                while (_last < ecp.getNumofShells() && ecp.getShell(_last)->getIndex() == ecp.getShell(_first)->getIndex()) {
+                    AddDisplacedShell(_ecp_single, ecp.getShell(_last), vec(0.0), 0);
+                    _last++;
+                }
+                _gradient += FillGradient(aobasis, D, natoms, &_ecp_single, _ecp_atom[_first]);
+                _first = _last;
+            }
+            return _gradient;
+        }
+
+
+        ub::matrix<double> AOECP::getDerivativeExpansion(int _lmax, int direction) {
+            // unit contractions and decay constant, calcVNLderivative scales
+            // the coefficients to the primitive
+            AOBasis _shells;
+            AOShell* _derivative = _shells.addShell("", _lmax + 1, 0, 1.0, (_lmax + 1) * (_lmax + 1), 0, 0, vec(0.0), "", 0);
+            _derivative->addGaussian(1.0, std::vector<double>(_lmax + 1, 1.0));
+            _derivative->setDerivative(direction);
+            AOShell* _functions = _shells.addShell("", _lmax + 1, 0, 1.0, (_lmax + 2) * (_lmax + 2), 0, 0, vec(0.0), "", 0);
+            _functions->addGaussian(1.0, std::vector<double>(_lmax + 2, 1.0));
+            const ub::matrix<double> _trafo_der = getTrafo(*_derivative->firstGaussian());
+            const ub::matrix<double> _trafo = getTrafo(*_functions->firstGaussian());
+
+            // the functions up to l+1 and r^2 times the functions up to l-1
+            // span the derivatives of the functions up to l
+            const int _nfunc = _trafo.size1();
+            const int _ncart = _trafo.size2();
+            ub::matrix<double> _span = ub::zero_matrix<double>(_nfunc + _lmax * _lmax, _ncart);
+            ub::project(_span, ub::range(0, _nfunc), ub::range(0, _ncart)) = _trafo;
+            int _cart = 0;
+            for (int _l = 0; _l < _lmax; _l++) {
+                for (int _nx = _l; _nx >= 0; _nx--) {
+                    for (int _ny = _l - _nx; _ny >= 0; _ny--) {
+                        const int _nz = _l - _nx - _ny;
+                        for (int _j = 0; _j < _lmax * _lmax; _j++) {
+                            _span(_nfunc + _j, getCartIndex(_nx + 2, _ny, _nz)) += _trafo(_j, _cart);
+                            _span(_nfunc + _j, getCartIndex(_nx, _ny + 2, _nz)) += _trafo(_j, _cart);
+                            _span(_nfunc + _j, getCartIndex(_nx, _ny, _nz + 2)) += _trafo(_j, _cart);
+                        }
+                        _cart++;
+                    }
+                }
+            }
+            const ub::matrix<double> _overlap = ub::prod(_span, ub::trans(_span));
+            ub::matrix<double> _overlap_inverse;
+            linalg_invert(_overlap, _overlap_inverse);
+            const ub::matrix<double> _projection = ub::prod(_trafo_der, ub::trans(_span));
+            return ub::prod(_projection, _overlap_inverse);
+        }
+
+
+        ub::matrix<double> AOECP::calcVNLderivative(int _lmax_ecp, const vec& posC, const AOGaussianPrimitive& _g_row, const AOGaussianPrimitive& _g_col,
+                const ub::matrix<double>& expansion, const ub::matrix<int>& _power_ecp, const ub::matrix<double>& _gamma_ecp, const ub::matrix<double>& _pref_ecp) {
+            const AOShell* _shell_row = _g_row.getShell();
+            const int _lmax = _shell_row->getLmax() - 1;
+            const double _alpha = _g_row.getDecay();
+            const int _nfunc = (_lmax + 2) * (_lmax + 2);
+
+            // matrix elements of the functions up to l+1 and their derivatives
+            // with respect to alpha, which give the r^2 functions
+            const ub::matrix<DecayDual> _vnl = calcVNLmatrix<DecayDual>(_lmax_ecp, posC, DecayDual(_alpha, 1.0), _shell_row->getPos(), _lmax + 1,
+                    DecayDual(_g_col.getDecay()), _g_col.getShell()->getPos(), _g_col.getShell()->getLmax(), _power_ecp, _gamma_ecp, _pref_ecp);
+            const double _sqrt_alpha = sqrt(_alpha);
+            ub::matrix<double> _functions = ub::zero_matrix<double>(_nfunc + _lmax * _lmax, _vnl.size2());
+            for (unsigned j = 0; j < _vnl.size2(); j++) {
+                for (int i = 0; i < _nfunc; i++) {
+                    _functions(i, j) = _sqrt_alpha * _vnl(i, j).v;
+                }
+                // r^2 exp(-alpha r^2) = -d/dalpha exp(-alpha r^2), the norm
+                // alpha^(3/4+l/2) is not differentiated
+                for (int i = 0; i < _lmax * _lmax; i++) {
+                    const int _l = int(sqrt(i + 0.5));
+                    _functions(_nfunc + i, j) = _sqrt_alpha * _alpha * (-_vnl(i, j).d + (0.75 + 0.5 * _l) / _alpha * _vnl(i, j).v);
+                }
+            }
+            ub::matrix<double> _derivative = ub::prod(expansion, _functions);
+            const std::vector<double>& _contractions = _g_row.getContraction();
+            for (unsigned i = 0; i < _derivative.size1(); i++) {
+                ub::row(_derivative, i) *= _contractions[int(sqrt(i + 0.5))];
+            }
+            return _derivative;
+        }
+
+
+template<class T>
+                ub::matrix<T> AOECP::calcVNLmatrix(int _lmax_ecp, const vec& posC, T alpha, const vec& posA, int _lmax_row, T beta, const vec& posB, int _lmax_col,
+                const ub::matrix<int>& _power_ecp, const ub::matrix<double>& _gamma_ecp,const ub::matrix<double>& _pref_ecp) {
 
             /* calculate the contribution of the nonlocal 
              *     ECP of atom at posC with 
@@ -219,12 +366,6 @@ namespace votca { namespace xtp {
             double SQ5 = sqrt(5.);
             double SQ7 = sqrt(7.);
 
-            double alpha = _g_row.getDecay();
-            double beta = _g_col.getDecay();
-            const vec& posA = _g_row.getShell()->getPos();
-            const vec& posB = _g_col.getShell()->getPos();
-            int _lmax_row = _g_row.getShell()->getLmax();
-            int _lmax_col = _g_col.getShell()->getLmax();
             int _lmin = std::min({_lmax_row, _lmax_col, _lmax_ecp});
             int _lmax = std::max({_lmax_row, _lmax_col, _lmax_ecp});
             int _nsph_row = (_lmax_row + 1) * (_lmax_row + 1);
@@ -240,7 +381,7 @@ namespace votca { namespace xtp {
             if (BVS2 > 0.01) INULL++;
 
 
-            ub::matrix<double> matrix = ub::zero_matrix<double>(_nsph_row,_nsph_col);
+            ub::matrix<T> matrix = ub::zero_matrix<T>(_nsph_row,_nsph_col);
             const int nnonsep = _gamma_ecp.size1();
             int nmax;
             if (INULL == 0) {
@@ -250,7 +391,7 @@ namespace votca { namespace xtp {
             } else {
                 nmax = NMAX + 2 * _lmax;
             }
-            ub::matrix<double> XI = ub::zero_matrix<double>(_lmax_ecp + 1, nmax + 1);
+            ub::matrix<T> XI = ub::zero_matrix<T>(_lmax_ecp + 1, nmax + 1);
 
             double f_even_r0 = .5 * SQPI;
             double f_even_r1 = .5;
@@ -274,7 +415,7 @@ namespace votca { namespace xtp {
 
                         for (int I = 0; I < nnonsep; I++) {
                         int power = _power_ecp(I, L);
-                        double DLI = (alpha + beta + _gamma_ecp(I, L));
+                        T DLI = (alpha + beta + _gamma_ecp(I, L));
                             if (power == 2) {
                                 XI(L, N) += f_even_r2 * _pref_ecp(I, L) / pow(DLI, DFAK_r2); // r^2 terms
                             } else if (power == 0) {
@@ -300,16 +441,16 @@ namespace votca { namespace xtp {
             // some limit determinations
 
 
-            double G1 = 1.;
+            T G1 = 1.;
             double AVSSQ = 0.;
             int NMAX1 = 0;
             if (AVS2 > 0.01) {
 
                 G1 = exp(-alpha * AVS2);
                 AVSSQ = sqrt(AVS2);
-                double AMAX = 0.0;  
-                double fak = 2.0 * alpha * AVSSQ;
-                double Pow = 1.;
+                T AMAX = 0.0;  
+                T fak = 2.0 * alpha * AVSSQ;
+                T Pow = 1.;
                 double factorialNN = 1;
                 for (int NN = 0; NN <= NMAX; NN++ ) {
 
@@ -317,11 +458,12 @@ namespace votca { namespace xtp {
                         Pow = Pow * fak;
                         factorialNN = factorialNN * NN;
                     }
-                    double AF = G1 * Pow / factorialNN;
+                    T AF = G1 * Pow / factorialNN;
                     if ((NN % 2) == 0) {
                         int ii = NN + 2 * _lmax;
+                        // XI only has the rows of the ECP channels
 
-                        switch (_lmax) {
+                        switch (_lmax_ecp) {
                             case 0:
                                 AMAX = AF * XI(0, ii);
                                 break;
@@ -349,16 +491,16 @@ namespace votca { namespace xtp {
             }
 
             // same story for B
-            double G2 = 1.;
+            T G2 = 1.;
             double BVSSQ = 0.;
             int NMAX2 = 0;
             if (BVS2 > 0.01) {
 
                 G2 = exp(-beta * BVS2);
                 BVSSQ = sqrt(BVS2);
-                double BMAX = 0.0;  
-                double fak = 2.0 * beta * BVSSQ;
-                double Pow = 1.;
+                T BMAX = 0.0;  
+                T fak = 2.0 * beta * BVSSQ;
+                T Pow = 1.;
                 double factorialNN = 1;
                 for (int NN = 0; NN <= NMAX; NN++) {
 
@@ -366,11 +508,11 @@ namespace votca { namespace xtp {
                        Pow = Pow * fak;
                        factorialNN = factorialNN * NN;
                     }
-                    double BF = G2 * Pow / factorialNN;
+                    T BF = G2 * Pow / factorialNN;
                     if ((NN % 2) == 0) {
                         int ii = NN + 2 * _lmax;
 
-                        switch (_lmax) {
+                        switch (_lmax_ecp) {
                             case 0:
                                 BMAX = BF * XI(0, ii);
                                 break;
@@ -397,7 +539,7 @@ namespace votca { namespace xtp {
 
             }
 
-            double GAUSS = G1 * G2;
+            T GAUSS = G1 * G2;
 
 
 
@@ -524,7 +666,7 @@ namespace votca { namespace xtp {
                         }
 
                         if (_lmin_dft_ecp > 2) {
-                            COEF[3][3][4][i4] = NG*1.75 * (50./FN7 - 30./FN5 + 9./FN3);   //  (1/33) * ( 33 * M0 + 44 * M2 + 54 * M4 + 100 * M6 )
+                            COEF[3][3][4][i4] = NG*1.75 * (25./FN7 - 30./FN5 + 9./FN3);   //  (1/33) * ( 33 * M0 + 44 * M2 + 54 * M4 + 100 * M6 )
                             COEFF = NG*1.3125 * (-25./FN7 + 35./FN5 - 11./FN3 + 1./FN1);  //  (1/11) * ( 11 * M0 + 11 * M2 + 3 * M4 - 25 * M6 )
                             COEF[3][3][3][i4] = COEFF;
                             COEF[3][3][5][i4] = COEFF;
@@ -576,7 +718,7 @@ namespace votca { namespace xtp {
                             COEFF = NU*.1875*SQ7 * (175./FN8 - 255./FN6 + 105./FN4 - 9./FN2);        //  ( SQ(7)/1001 ) * ( 572 * M1 + 546 * M3 + 660 * M5 + 1225 * M7)
                             COEF[3][4][4][i4] = COEFF;
                             COEF[4][3][4][i4] = COEFF;
-                            COEFF = NU*1.875*SQ3*SQ5*SQ7 * (-35./FN8 + 57./FN6 - 25./FN4 + 3./FN2);  //  ( SQ(105))/1001 ) * ( 143 * M1 + 91 * M3 + 11 * M5 - 245 * M7)
+                            COEFF = NU*.1875*SQ3*SQ5*SQ7 * (-35./FN8 + 57./FN6 - 25./FN4 + 3./FN2);  //  ( SQ(105))/1001 ) * ( 143 * M1 + 91 * M3 + 11 * M5 - 245 * M7)
                             COEF[3][4][3][i4] = COEFF;
                             COEF[3][4][5][i4] = COEFF;
                             COEF[4][3][3][i4] = COEFF;
@@ -618,6 +760,7 @@ namespace votca { namespace xtp {
 
             typedef boost::multi_array_types::extent_range range;
             typedef type_3D::index index;
+            typedef boost::multi_array<T, 3> type_3T;
             type_3D::extent_gen extents3D;
 
 
@@ -629,7 +772,7 @@ namespace votca { namespace xtp {
                     for (int i = 0; i < _nsph_row; i++) {
                         for (int j = 0; j < _nsph_col; j++) {
                             for (index L = 0; L <= _lmin; L++) {
-                                double XI_L = XI(L, L + L);
+                                T XI_L = XI(L, L + L);
                                 for (index M = 4 - L; M <= 4 + L; M++) {
                                     matrix(i,j) += BLMA[i][L][M] * BLMB[j][L][M] * XI_L;
                                 }
@@ -643,16 +786,16 @@ namespace votca { namespace xtp {
                 case 1:  //  AVSSQ <= 0.1
                 {
 
-                    type_3D SUMCI3;
+                    type_3T SUMCI3;
                     SUMCI3.resize(extents3D[range(0, 5)][range(0, 5)][range(0, 9)]);
                     for (index L = 0; L <= _lmax_ecp; L++) {
                         for (index L2 = 0; L2 <= _lmax_col; L2++) {
                             int range_M2 = std::min(L2, L);
                             for (index M2 = 4 - range_M2; M2 <= 4 + range_M2; M2++) {
 
-                                double VAR2 = 0.0;
-                                double fak = 2.0 * beta * BVSSQ;
-                                double pow = 1;
+                                T VAR2 = 0.0;
+                                T fak = 2.0 * beta * BVSSQ;
+                                T pow = 1;
                                 double factorialNN = 1;
 
                                 for (int NN = 0; NN <= NMAX2; NN++) {
@@ -662,7 +805,7 @@ namespace votca { namespace xtp {
                                         factorialNN = factorialNN * NN;
                                     }
 
-                                    double XDUM = COEF[L][L2][M2][NN] * pow / factorialNN;
+                                    T XDUM = COEF[L][L2][M2][NN] * pow / factorialNN;
                                     VAR2 += XDUM * XI(L, NN + L + L2);
 
                                 }
@@ -697,16 +840,16 @@ namespace votca { namespace xtp {
                 case 2:  //  BVSSQ <= 0.1
                 {
 
-                    type_3D SUMCI3;
+                    type_3T SUMCI3;
                     SUMCI3.resize(extents3D[range(0, 5)][range(0, 5)][range(0, 9)]);
                     for (index L = 0; L <= _lmax_ecp; L++) {
                         for (index L1 = 0; L1 <= _lmax_row; L1++) {
                             int range_M1 = std::min(L1, L);
                             for (index M1 = 4 - range_M1; M1 <= 4 + range_M1; M1++) {
 
-                                double VAR1 = 0.0;
-                                double fak = 2.0 * alpha * AVSSQ;
-                                double pow = 1;
+                                T VAR1 = 0.0;
+                                T fak = 2.0 * alpha * AVSSQ;
+                                T pow = 1;
                                 double factorialN = 1;
 
                                 for (int N = 0; N <= NMAX1; N++) {
@@ -716,7 +859,7 @@ namespace votca { namespace xtp {
                                         factorialN = factorialN * N;
                                     }
 
-                                    double XDUM = COEF[L][L1][M1][N] * pow / factorialN;
+                                    T XDUM = COEF[L][L1][M1][N] * pow / factorialN;
                                     VAR1 += XDUM * XI(L, N + L1 + L);
 
                                 }
@@ -767,8 +910,8 @@ namespace votca { namespace xtp {
                         }
                     }
 
-                    typedef boost::multi_array<double, 5> type_5D;
-                    type_5D::extent_gen extents5D;
+                    typedef boost::multi_array<T, 5> type_5D;
+                    typename type_5D::extent_gen extents5D;
                     type_5D SUMCI;
                     SUMCI.resize(extents5D[range(0, 5)][range(0, 5)][range(0, 5)][range(0, 9)][range(0, 9)]);
                     for (index L = 0; L <= _lmax_ecp; L++) {
@@ -781,8 +924,8 @@ namespace votca { namespace xtp {
 
                                         SUMCI[L][L1][L2][M1][M2]  = 0.0;
 
-                                        double fak1 = 2.0 * alpha * AVSSQ;
-                                        double pow1 = 1;
+                                        T fak1 = 2.0 * alpha * AVSSQ;
+                                        T pow1 = 1;
                                         double factorialN = 1;
 
                                         for (int N = 0; N <= NMAX1; N++ ) {
@@ -792,10 +935,10 @@ namespace votca { namespace xtp {
                                             factorialN = factorialN*N;
                                             }
 
-                                            double VAR1 = COEF[L][L1][M1][N] * pow1 / factorialN;
-                                            double VAR2 = 0.0;
-                                            double fak2 = 2.0 * beta * BVSSQ;
-                                            double pow2 = 1;
+                                            T VAR1 = COEF[L][L1][M1][N] * pow1 / factorialN;
+                                            T VAR2 = 0.0;
+                                            T fak2 = 2.0 * beta * BVSSQ;
+                                            T pow2 = 1;
                                             double factorialNN = 1;
 
                                             for (int NN = 0; NN <= NMAX2; NN++) {
@@ -804,7 +947,7 @@ namespace votca { namespace xtp {
                                                     pow2 = pow2 * fak2;
                                                     factorialNN = factorialNN * NN;
                                                 }
-                                                double XDUM = COEF[L][L2][M2][NN] * pow2 / factorialNN;
+                                                T XDUM = COEF[L][L2][M2][NN] * pow2 / factorialNN;
                                                 VAR2  += XDUM * XI(L,N+NN+L1+L2);
 
                                             }
@@ -851,8 +994,8 @@ namespace votca { namespace xtp {
 
 
             // GET TRAFO HERE ALREADY
-            ub::vector<double> NormA = CalcNorms(alpha, _nsph_row);
-            ub::vector<double> NormB = CalcNorms(beta, _nsph_col);
+            ub::vector<T> NormA = CalcNorms<T>(alpha, _nsph_row);
+            ub::vector<T> NormB = CalcNorms<T>(beta, _nsph_col);
 
             for (int i = 0; i < _nsph_row; i++) {
                 for (int j = 0; j < _nsph_col; j++) {
@@ -867,14 +1010,15 @@ namespace votca { namespace xtp {
         }
 
 
-        ub::vector<double> AOECP::CalcNorms(double decay, int size) {
-            ub::vector<double> Norms = ub::vector<double>(size);
+        template<class T>
+        ub::vector<T> AOECP::CalcNorms(T decay, int size) {
+            ub::vector<T> Norms = ub::vector<T>(size);
             const double PI = boost::math::constants::pi<double>();
             double SQ2, SQ3, SQ5;
 
-            double Norm_S = pow(2.0 * decay / PI, 0.75);
-            double Norm_P=0.0;
-            double Norm_D=0.0;
+            T Norm_S = pow(2.0 * decay / PI, 0.75);
+            T Norm_P=0.0;
+            T Norm_D=0.0;
             Norms[0] = Norm_S;  //  Y 00
 
             if (size > 1) {
@@ -886,7 +1030,7 @@ namespace votca { namespace xtp {
 
             if (size > 4) {
                 SQ3 = sqrt(3.);
-                double Norm_D = 4.00 * decay * Norm_S;
+                Norm_D = 4.00 * decay * Norm_S;
                 Norms[4] = .5 * Norm_D / SQ3;  //  Y 20
                 Norms[5] = Norm_D;             //  Y 2-1
                 Norms[6] = Norm_D;             //  Y 21
@@ -897,9 +1041,9 @@ namespace votca { namespace xtp {
             if (size > 9) {
                 SQ2 = sqrt(2.);
                 SQ5 = sqrt(5.);
-                double Norm_F = 4.00 * decay * Norm_P;
-                double Norm_F_1 = .5 * Norm_F / (SQ2 * SQ5);
-                double Norm_F_3 = .5 * Norm_F / (SQ2 * SQ3);
+                T Norm_F = 4.00 * decay * Norm_P;
+                T Norm_F_1 = .5 * Norm_F / (SQ2 * SQ5);
+                T Norm_F_3 = .5 * Norm_F / (SQ2 * SQ3);
                 Norms[9] =  .5 * Norm_F / (SQ3 * SQ5);  //  Y 30
                 Norms[10] = Norm_F_1;                   //  Y 3-1
                 Norms[11] = Norm_F_1;                   //  Y 31
@@ -911,11 +1055,11 @@ namespace votca { namespace xtp {
 
             if (size > 16) {
                 double SQ7 = sqrt(7.);
-                double Norm_G = 4.00 * decay * Norm_D;
-                double Norm_G_1 = .5 * Norm_G / (SQ2 * SQ3 * SQ7);
-                double Norm_G_m2 = .5 * Norm_G / (SQ3 * SQ7);
-                double Norm_G_3 = .5 * Norm_G / (SQ2 * SQ3);
-                double Norm_G_m4 = .5 * Norm_G / SQ3;
+                T Norm_G = 4.00 * decay * Norm_D;
+                T Norm_G_1 = .5 * Norm_G / (SQ2 * SQ3 * SQ7);
+                T Norm_G_m2 = .5 * Norm_G / (SQ3 * SQ7);
+                T Norm_G_3 = .5 * Norm_G / (SQ2 * SQ3);
+                T Norm_G_m4 = .5 * Norm_G / SQ3;
                 Norms[16] =  .125 * Norm_G / (SQ3 * SQ5 * SQ7);  //  Y 40
                 Norms[17] = Norm_G_1;                            //  Y 4-1
                 Norms[18] = Norm_G_1;                            //  Y 41
@@ -1110,11 +1254,11 @@ namespace votca { namespace xtp {
                 double XG_m4 = 4. * SQPI / (3. * SQ5 * SQ7);
                 double XG_p4 = 4. * XG_m4;
 
-                BLM[16][0][4] = (35. * BVS_ZZ - 30. * BVS_ZZ * BVS_RR + 3. * BVS_RR * BVS_RR) * XS;  //  Y 40
+                BLM[16][0][4] = (35. * BVS_ZZ * BVS_ZZ - 30. * BVS_ZZ * BVS_RR + 3. * BVS_RR * BVS_RR) * XS;  //  Y 40
                 BLM[16][1][3] = 12. * (5. * BVS_ZZ - BVS_RR) * BVS_Y * XP;
                 BLM[16][1][4] = 16. * (3. * BVS_RR - 5. * BVS_ZZ) * BVS_Z * XP;
                 BLM[16][1][5] = 12. * (5. * BVS_ZZ - BVS_RR) * BVS_X * XP;
-                BLM[16][2][2] = -24. * BVS_XY * XD;
+                BLM[16][2][2] = 24. * BVS_XY * XD;
                 BLM[16][2][3] = -96. * BVS_YZ * XD;
                 BLM[16][2][4] = 12. * (3. * BVS_ZZ - BVS_RR) * XD_0;
                 BLM[16][2][5] = -96. * BVS_XZ * XD;
@@ -1141,7 +1285,7 @@ namespace votca { namespace xtp {
 
                 BLM[18][0][4] = (7. * BVS_ZZ - 3. * BVS_RR) * BVS_XZ * XS;  //  Y 41
                 BLM[18][1][3] = 6. * BVS_XY * BVS_Z * XP;
-                BLM[18][1][4] = 3. * (BVS_RR - 5. * BVS_ZZ) * BVS_Y * XP;
+                BLM[18][1][4] = 3. * (BVS_RR - 5. * BVS_ZZ) * BVS_X * XP;
                 BLM[18][1][5] = (9. * BVS_XX + 3. * BVS_YY - 4. * BVS_ZZ) * BVS_Z * XP;
                 BLM[18][2][2] = -6. * BVS_YZ * XD;
                 BLM[18][2][3] = -6. * BVS_XY * XD;
@@ -1180,7 +1324,7 @@ namespace votca { namespace xtp {
                 BLM[20][3][1] = BVS_Y * XF_3;
                 BLM[20][3][3] = 3. * BVS_Y * XF_1;
                 BLM[20][3][5] = -3. * BVS_X * XF_1;
-                BLM[20][3][6] = -12. * BVS_Z * XF_m2;
+                BLM[20][3][6] = -12. * BVS_Z * XF_p2;
                 BLM[20][3][7] = BVS_X * XF_3;
                 BLM[20][4][6] = XG_p2;
 
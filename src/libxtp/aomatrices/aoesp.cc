@@ -114,31 +114,45 @@ namespace votca { namespace xtp {
         // get shell positions
         const vec& _pos_row = _shell_row->getPos();
         const vec& _pos_col = _shell_col->getPos();
-        const vec  _diff    = _pos_row - _pos_col;
-        // initialize some helper
-      
-        double _distsq = (_diff*_diff); 
         
+        // charges evaluated exactly, a unit charge at _gridpoint for a single Fill
+        std::vector<vec> _nearpos;
+        std::vector<double> _nearcharge;
+        if ( _sitepos.empty() ) {
+            _nearpos.push_back(_gridpoint);
+            _nearcharge.push_back(1.0);
+        } else {
+            vec _center;
+            double _extent2;
+            if ( !ShellPairDistribution(_shell_row, _shell_col, _center, _extent2) ) { return; }
+            // potential and its gradient at the pair centre from all distant charges
+            double _phi = 0.0;
+            vec _gradphi = vec(0.0, 0.0, 0.0);
+            bool _has_farfield = false;
+            for ( unsigned _site = 0; _site < _sitepos.size(); _site++ ) {
+                if ( IsFarField(_extent2, _center, _sitepos[_site]) ) {
+                    const vec _R = _center - _sitepos[_site];
+                    const double _Rinv = 1.0 / abs(_R);
+                    _phi += _sitecharge[_site] * _Rinv;
+                    _gradphi -= ( _sitecharge[_site] * _Rinv * _Rinv * _Rinv ) * _R;
+                    _has_farfield = true;
+                } else {
+                    _nearpos.push_back(_sitepos[_site]);
+                    _nearcharge.push_back(_sitecharge[_site]);
+                }
+            }
+            if ( _has_farfield ) { AddFarField(_matrix, _shell_row, _shell_col, _center, _phi, _gradphi); }
+            if ( _nearpos.empty() ) { return; }
+        }
          
-        // iterate over Gaussians in this _shell_row
-        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr){
-            // iterate over Gaussians in this _shell_col
-            // get decay constant
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc){
-                //get decay constant
-                const double _decay_col = itc->getDecay();
-        
-                const double _fak  = 0.5/(_decay_row + _decay_col);
-                const double _fak2 = 2.0 * _fak;
-                
-                
-                double _exparg = _fak2 * _decay_row * _decay_col *_distsq;
-        
-       // check if distance between postions is big, then skip step   
-       
-                if ( _exparg > 30.0 ) { continue; }
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double _fak  = itp->fak;
+            const double _fak2 = itp->fak2;
+            const double _exparg = itp->exparg;
         
         // some helpers
        
@@ -146,17 +160,22 @@ namespace votca { namespace xtp {
 
         const double zeta = _decay_row + _decay_col;
 
-        double PmA0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-        double PmA1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-        double PmA2 = _fak2*(_decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+        double PmA0 = itp->P.getX() - _pos_row.getX();
+        double PmA1 = itp->P.getY() - _pos_row.getY();
+        double PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-        double PmB0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-        double PmB1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-        double PmB2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();
+        double PmB0 = itp->P.getX() - _pos_col.getX();
+        double PmB1 = itp->P.getY() - _pos_col.getY();
+        double PmB2 = itp->P.getZ() - _pos_col.getZ();
+        
+        nuc = ub::zero_matrix<double>(_nrows,_ncols);
+        
+        // all charges are summed in the cartesian block, transformed only once
+        for ( unsigned _site = 0; _site < _nearpos.size(); _site++ ) {
         
-        double PmC0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _gridpoint.getX();
-        double PmC1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _gridpoint.getY();
-        double PmC2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _gridpoint.getZ();
+        double PmC0 = itp->P.getX() - _nearpos[_site].getX();
+        double PmC1 = itp->P.getY() - _nearpos[_site].getY();
+        double PmC2 = itp->P.getZ() - _nearpos[_site].getZ();
         
         
         const double _U = zeta*(PmC0*PmC0+PmC1*PmC1+PmC2*PmC2);
@@ -168,7 +187,6 @@ namespace votca { namespace xtp {
         
         // (s-s element normiert )
         double _prefactor = 2*sqrt(1.0/pi)*pow(4.0*_decay_row*_decay_col,0.75) * _fak2 * exp(-_exparg);
-        nuc(Cart::s,Cart::s)   = _prefactor * _FmU[0];
         
         typedef boost::multi_array<double, 3> ma_type;
                          ma_type nuc3(boost::extents[_nrows][_ncols][_lsum+1]);
@@ -419,15 +437,17 @@ if (_lmax_col > 3) {
                          
          for (int i = 0; i < _nrows; i++) {
             for (int j = 0; j < _ncols; j++) {
-               nuc(i,j) = nuc3[i][j][0];
+               nuc(i,j) += _nearcharge[_site] * nuc3[i][j][0];
             }
          }                
+        
+        }// sites
 
         
        
         
-        ub::matrix<double> _trafo_row = getTrafo(*itr);
-        ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));      
+        const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+        ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);      
              
         ub::matrix<double> _nuc_tmp = ub::prod( _trafo_row, nuc );
         
@@ -441,8 +461,7 @@ if (_lmax_col > 3) {
         }
         
       
-            }// _shell_col Gaussians
-        }// _shell_row Gaussians
+            } // primitive pairs
          return;
     }
     
@@ -450,36 +469,79 @@ if (_lmax_col > 3) {
 
     void AOESP::Fillnucpotential(const AOBasis& aobasis, std::vector<ctp::QMAtom*>& _atoms, bool _with_ecp) {
             Elements _elements;
-            _nuclearpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
-
+            _sitepos.clear();
+            _sitecharge.clear();
             for (unsigned j = 0; j < _atoms.size(); j++) {
-                vec positionofatom = tools::conv::ang2bohr*_atoms[j]->getPos();
-
                 double Znuc = 0.0;
                 if (_with_ecp) {
                     Znuc = _elements.getNucCrgECP(_atoms[j]->type);
                 } else {
                     Znuc = _elements.getNucCrg(_atoms[j]->type);
                 }
-                _aomatrix = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
-                Fill(aobasis, positionofatom);
-                _nuclearpotential -= (Znuc) * _aomatrix;        
+                _sitepos.push_back(tools::conv::ang2bohr*_atoms[j]->getPos());
+                _sitecharge.push_back(Znuc);
             }
+            if ( _sitepos.empty() ) {
+                _nuclearpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+                return;
+            }
+            // nuclei are close to the basis functions, always evaluated exactly
+            ClearFarField();
+            Fill(aobasis);
+            _nuclearpotential = -_aomatrix;
+            _sitepos.clear();
+            _sitecharge.clear();
             return;
         }
 
-        void AOESP::Fillextpotential(const AOBasis& aobasis,const std::vector<ctp::PolarSeg*> & _sites) {
-            
-            _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+        ub::matrix<double> AOESP::NuclearGradient(const AOBasis& aobasis, std::vector<ctp::QMAtom*>& _atoms, const ub::matrix<double>& D, bool _with_ecp) {
+            Elements _elements;
+            std::vector<vec> _nucpos;
+            std::vector<double> _nuccharge;
+            for (unsigned j = 0; j < _atoms.size(); j++) {
+                if (_with_ecp) {
+                    _nuccharge.push_back(_elements.getNucCrgECP(_atoms[j]->type));
+                } else {
+                    _nuccharge.push_back(_elements.getNucCrg(_atoms[j]->type));
+                }
+                _nucpos.push_back(tools::conv::ang2bohr*_atoms[j]->getPos());
+            }
+            ClearFarField();
 
+            // one nucleus at a time, its Hellmann-Feynman term follows from
+            // the derivatives of the basis functions by translational invariance
+            ub::matrix<double> _gradient = ub::zero_matrix<double>(_atoms.size(), 3);
+            for (unsigned j = 0; j < _atoms.size(); j++) {
+                _sitepos.assign(1, _nucpos[j]);
+                _sitecharge.assign(1, _nuccharge[j]);
+                _gradient -= FillGradient(aobasis, D, _atoms.size(), NULL, j);
+            }
+            _sitepos.clear();
+            _sitecharge.clear();
+            return _gradient;
+        }
+        
+                void AOESP::Fillextpotential(const AOBasis& aobasis,const std::vector<ctp::PolarSeg*> & _sites, double farfield_tolerance) {
+            
+            _sitepos.clear();
+            _sitecharge.clear();
             for (unsigned int i = 0; i < _sites.size(); i++) {
                 for (ctp::PolarSeg::const_iterator it = _sites[i]->begin(); it < _sites[i]->end(); ++it) {
-                    vec positionofsite = (*it)->getPos() * tools::conv::nm2bohr;
-                    _aomatrix = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
-                    Fill(aobasis, positionofsite);
-                    _externalpotential -= (*it)->getQ00() * _aomatrix;
+                    if ( (*it)->getQ00() == 0.0 ) continue;
+                    _sitepos.push_back((*it)->getPos() * tools::conv::nm2bohr);
+                    _sitecharge.push_back((*it)->getQ00());
                 }
             }
+            if ( _sitepos.empty() ) {
+                _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+                return;
+            }
+            PrepareFarField(aobasis, farfield_tolerance);
+            Fill(aobasis);
+            _externalpotential = -_aomatrix;
+            ClearFarField();
+            _sitepos.clear();
+            _sitecharge.clear();
             return;
         }    
     
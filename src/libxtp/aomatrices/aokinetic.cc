@@ -103,39 +103,26 @@ namespace votca { namespace xtp {
         //cout << "col shell is " << _shell_col->getSize() << " -fold contracted!" << endl;
         
        
-        // iterate over Gaussians in this _shell_row
-        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr){
-            // iterate over Gaussians in this _shell_col
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc){
-           
-            
-           
-
-            // get decay constants 
-            const double _decay_col = itc->getDecay();
-            
-            // some helpers
-            const double _fak  = 0.5/(_decay_row + _decay_col);
-            const double rzeta = 2.0 * _fak;
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double _fak  = itp->fak;
+            const double rzeta = itp->fak2;
             
             const double xi=rzeta* _decay_row * _decay_col;
-            
-            
-            // check if distance between postions is big, then skip step   
-            double _exparg = xi *_distsq;
-	    if ( _exparg > 30.0 ) { continue; }
+            const double _exparg = itp->exparg;
             
     
             
-            const double PmA0 = rzeta*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-            const double PmA1 = rzeta*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-            const double PmA2 = rzeta*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+            const double PmA0 = itp->P.getX() - _pos_row.getX();
+            const double PmA1 = itp->P.getY() - _pos_row.getY();
+            const double PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-            const double PmB0 = rzeta*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-            const double PmB1 = rzeta*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-            const double PmB2 = rzeta*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();
+            const double PmB0 = itp->P.getX() - _pos_col.getX();
+            const double PmB1 = itp->P.getY() - _pos_col.getY();
+            const double PmB2 = itp->P.getZ() - _pos_col.getZ();
         
              const double xi2 = 2.*xi; //////////////
              const double _fak_a = rzeta * _decay_col; /////////////
@@ -536,8 +523,8 @@ if (_lmax_col > 3) {
 } // end if (_lmax_col > 3)
 
                 // normalization and cartesian -> spherical factors
-            ub::matrix<double> _trafo_row = getTrafo(*itr);
-            ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));      
+            const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+            ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);      
 
              ub::matrix<double> kin_tmp = ub::prod( _trafo_row, kin );
              ub::matrix<double> kin_sph = ub::prod( kin_tmp, _trafo_col_tposed );
@@ -552,8 +539,7 @@ if (_lmax_col > 3) {
         
         
         
-                }//col
-            }//row
+                } // primitive pairs
  return;
         }
     }
@@ -24,6 +24,8 @@
 #include <votca/xtp/aobasis.h>
 
 #include <vector>
+#include <limits>
+#include <algorithm>
 
 
 
@@ -45,8 +47,9 @@ namespace votca { namespace xtp {
     void AOMatrix::Fill(const AOBasis& aobasis,vec r, AOBasis* ecp ) {
         _aomatrix = ub::zero_matrix<double>(aobasis.AOBasisSize());
         _gridpoint = r;
-        // loop row
-        #pragma omp parallel for
+        aobasis.PrepareShellPairs();
+        // loop row, rows further down have more blocks
+        #pragma omp parallel for schedule(dynamic)
         for (unsigned _row = 0; _row <  aobasis.getNumofShells() ; _row++ ){
        
             const AOShell* _shell_row = aobasis.getShell( _row );
@@ -99,12 +102,187 @@ namespace votca { namespace xtp {
     }
     
     
+    const AOShell* AOSuperMatrix::AddDisplacedShell(AOBasis& basis, const AOShell* shell, const vec& shift, int index) {
+        AOShell* _displaced = basis.addShell(shell->getType(), shell->getLmax(), shell->getLmin(), shell->getScale(),
+                shell->getNumFunc(), shell->getStartIndex(), shell->getOffset(), shell->getPos() + shift, shell->getName(), index);
+        for ( AOShell::GaussianIterator itr = shell->firstGaussian(); itr != shell->lastGaussian(); ++itr){
+            _displaced->addGaussian(itr->getPower(), itr->getDecay(), itr->getContraction());
+        }
+        _displaced->CalcMinDecay();
+        return _displaced;
+    }
+    
+    
+    const AOShell* AOSuperMatrix::AddDerivativeShell(AOBasis& basis, const AOShell* shell, int direction) {
+        AOShell* _derivative = basis.addShell(shell->getType(), shell->getLmax()+1, shell->getLmin(), shell->getScale(),
+                shell->getNumFunc(), shell->getStartIndex(), shell->getOffset(), shell->getPos(), shell->getName(), shell->getIndex());
+        for ( AOShell::GaussianIterator itr = shell->firstGaussian(); itr != shell->lastGaussian(); ++itr){
+            _derivative->addGaussian(itr->getPower(), itr->getDecay(), itr->getContraction());
+        }
+        _derivative->CalcMinDecay();
+        _derivative->setDerivative(direction);
+        return _derivative;
+    }
+    
+    
+    double AOMatrix::ContractBlock(const ub::matrix<double>& D, const AOShell* _shell_row, const AOShell* _shell_col, AOBasis* ecp) {
+        const int _row_start = _shell_row->getStartIndex();
+        const int _col_start = _shell_col->getStartIndex();
+        ub::matrix<double> _block = ub::zero_matrix<double>(_shell_row->getNumFunc(), _shell_col->getNumFunc());
+        ub::matrix_range< ub::matrix<double> > _submatrix = ub::subrange(_block, 0, _block.size1(), 0, _block.size2());
+        FillBlock( _submatrix, _shell_row, _shell_col, ecp );
+        double _trace = 0.0;
+        for ( unsigned i = 0; i < _block.size1(); i++ ) {
+            for ( unsigned j = 0; j < _block.size2(); j++ ) {
+                _trace += D(_row_start + i, _col_start + j) * _block(i, j);
+            }
+        }
+        return _trace;
+    }
+    
+    
+    double AOMatrix::Contract(const AOBasis& aobasis, const ub::matrix<double>& D, AOBasis* ecp) {
+        double _trace = 0.0;
+        aobasis.PrepareShellPairs();
+        #pragma omp parallel for schedule(dynamic) reduction(+:_trace)
+        for (unsigned _row = 0; _row <  aobasis.getNumofShells() ; _row++ ){
+            const AOShell* _shell_row = aobasis.getShell( _row );
+            for ( unsigned _col = 0; _col <= _row ; _col++ ){
+                const AOShell* _shell_col = aobasis.getShell( _col );
+                // blocks below the diagonal stand for their transposed counterparts, too
+                const double _weight = ( _row == _col ) ? 1.0 : 2.0;
+                _trace += _weight * ContractBlock(D, _shell_row, _shell_col, ecp);
+            }
+        }
+        return _trace;
+    }
+    
+    
+    ub::matrix<double> AOMatrix::FillGradient(const AOBasis& aobasis, const ub::matrix<double>& D, int natoms, AOBasis* ecp, int operator_atom) {
+        ub::matrix<double> _gradient = ub::zero_matrix<double>(natoms, 3);
+        aobasis.PrepareShellPairs();
+        // derivatives of all shells in x, y, z
+        AOBasis _derivatives;
+        std::vector<const AOShell*> _deriv;
+        for (unsigned _row = 0; _row <  aobasis.getNumofShells() ; _row++ ){
+            for ( int _k = 0; _k < 3; _k++ ) {
+                _deriv.push_back(AddDerivativeShell(_derivatives, aobasis.getShell( _row ), _k));
+            }
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (unsigned _row = 0; _row <  aobasis.getNumofShells() ; _row++ ){
+            const AOShell* _shell_row = aobasis.getShell( _row );
+            const int _atom_row = _shell_row->getIndex();
+            ub::matrix<double> _gradient_row = ub::zero_matrix<double>(natoms, 3);
+            for ( unsigned _col = 0; _col <= _row ; _col++ ){
+                const AOShell* _shell_col = aobasis.getShell( _col );
+                const int _atom_col = _shell_col->getIndex();
+                // without an operator centre the block only depends on the distance
+                if ( operator_atom < 0 && _atom_row == _atom_col ) continue;
+                const double _weight = ( _row == _col ) ? 1.0 : 2.0;
+                for ( int _k = 0; _k < 3; _k++ ) {
+                    const double _drow = _weight * ContractBlock(D, _deriv[3*_row+_k], _shell_col, ecp);
+                    double _dcol;
+                    if ( operator_atom < 0 ) {
+                        _dcol = -_drow;
+                    } else if ( _row == _col ) {
+                        _dcol = _drow;
+                    } else {
+                        _dcol = _weight * ContractBlock(D, _shell_row, _deriv[3*_col+_k], ecp);
+                    }
+                    _gradient_row(_atom_row, _k) += _drow;
+                    _gradient_row(_atom_col, _k) += _dcol;
+                    // the matrix elements are invariant under moving all three centres
+                    if ( operator_atom >= 0 ) {
+                        _gradient_row(operator_atom, _k) -= _drow + _dcol;
+                    }
+                }
+            }
+            #pragma omp critical
+            {
+                _gradient += _gradient_row;
+            }
+        }
+        return _gradient;
+    }
+    
+    
+    void AOMatrix::PrepareFarField(const AOBasis& aobasis, double farfield_tolerance) {
+        _farfield_tolerance = farfield_tolerance;
+        if ( _farfield_tolerance <= 0.0 ){
+            ClearFarField();
+            return;
+        }
+        AOOverlap _overlap;
+        _overlap.Fill(aobasis);
+        _farfield_overlap = _overlap.Matrix();
+        AODipole _dipole;
+        _dipole.Fill(aobasis);
+        _farfield_dipole = _dipole.Matrix();
+        return;
+    }
+    
+    
+    void AOMatrix::ClearFarField() {
+        _farfield_overlap.resize(0, 0);
+        _farfield_dipole.clear();
+        return;
+    }
+    
+    
+    bool AOMatrix::IsFarField(double extent2, const vec& center, const vec& site) const {
+        if ( _farfield_overlap.size1() == 0 ) return false;
+        const vec _dist = center - site;
+        // the quadrupole term neglected in AddFarField is ~ extent2/R^2 relative to the monopole
+        return ( extent2 < _farfield_tolerance * (_dist*_dist) );
+    }
+    
+    
+    bool AOMatrix::ShellPairDistribution(const AOShell* _shell_row, const AOShell* _shell_col, vec& center, double& extent2) {
+        const vec _diff = _shell_row->getPos() - _shell_col->getPos();
+        const double _distsq = _diff*_diff;
+        double _decay_row = std::numeric_limits<double>::max();
+        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr){
+            _decay_row = std::min(_decay_row, itr->getDecay());
+        }
+        double _decay_col = std::numeric_limits<double>::max();
+        for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc){
+            _decay_col = std::min(_decay_col, itc->getDecay());
+        }
+        const double zeta = _decay_row + _decay_col;
+        // the most diffuse primitives overlap least, FillBlocks skip primitive pairs beyond 30.0
+        if ( _decay_row * _decay_col / zeta * _distsq > 30.0 ) return false;
+        // all product centres lie between the two shells, the most diffuse pair is the widest
+        center = 0.5 * ( _shell_row->getPos() + _shell_col->getPos() );
+        extent2 = 0.25 * _distsq + 1.5 / zeta;
+        return true;
+    }
+    
+    
+    void AOMatrix::AddFarField(ub::matrix_range< ub::matrix<double> >& _matrix, const AOShell* _shell_row, const AOShell* _shell_col, const vec& center, double phi, const vec& gradphi) const {
+        const int _row_start = _shell_row->getStartIndex();
+        const int _col_start = _shell_col->getStartIndex();
+        for ( unsigned i = 0; i < _matrix.size1(); i++ ) {
+            for ( unsigned j = 0; j < _matrix.size2(); j++ ) {
+                const double _S = _farfield_overlap(_row_start+i, _col_start+j);
+                // dipole of the pair with respect to center
+                const double _mu_x = _farfield_dipole[0](_row_start+i, _col_start+j) - center.getX() * _S;
+                const double _mu_y = _farfield_dipole[1](_row_start+i, _col_start+j) - center.getY() * _S;
+                const double _mu_z = _farfield_dipole[2](_row_start+i, _col_start+j) - center.getZ() * _S;
+                _matrix(i,j) += phi * _S + _mu_x * gradphi.getX() + _mu_y * gradphi.getY() + _mu_z * gradphi.getZ();
+            }
+        }
+        return;
+    }
+    
+    
     void AOMatrix3D::Fill(const AOBasis& aobasis ) {
         // cout << "I'm supposed to fill out the AO overlap matrix" << endl;
         _aomatrix.resize(3);
         for (int i = 0; i < 3 ; i++){
           _aomatrix[ i ] = ub::zero_matrix<double>(aobasis.AOBasisSize());
         }
+        aobasis.PrepareShellPairs();
         
         // loop row
         #pragma omp parallel for
@@ -182,7 +360,8 @@ namespace votca { namespace xtp {
          const AOShell* shell=gaussian.getShell();
          const int ntrafo = shell->getNumFunc() + shell->getOffset();
          const double _decay=gaussian.getDecay();
-         const int _lmax=shell->getLmax();
+         // a derivative shell carries the functions of its parent one l lower
+         const int _lmax=( shell->getDerivative() < 0 ) ? shell->getLmax() : shell->getLmax()-1;
          const int n=getBlockSize( _lmax );
          ub::matrix<double> _trafo=ub::zero_matrix<double>(ntrafo,n); 
          const std::vector<double>& contractions=gaussian.getContraction();
@@ -451,9 +630,40 @@ namespace votca { namespace xtp {
           _trafo(48,Cart::xxyyyy) = 15.*factor_6;
           _trafo(48,Cart::yyyyyy) = -factor_6;
         }
+        
+        if ( shell->getDerivative() >= 0 ){
+            // d/dA_k of a cartesian Gaussian of exponent a at A with power n_k:
+            // 2a times power n_k+1 minus n_k times power n_k-1
+            const int _k = shell->getDerivative();
+            ub::matrix<double> _deriv = ub::zero_matrix<double>(n, getBlockSize( _lmax+1 ));
+            int _index = 0;
+            for ( int _l = 0; _l <= _lmax; _l++ ){
+                for ( int _nx = _l; _nx >= 0; _nx-- ){
+                    for ( int _ny = _l-_nx; _ny >= 0; _ny-- ){
+                        int _n[3] = { _nx, _ny, _l-_nx-_ny };
+                        _n[_k]++;
+                        _deriv(_index, getCartIndex( _n[0], _n[1], _n[2] )) += 2.0*_decay;
+                        _n[_k] -= 2;
+                        if ( _n[_k] >= 0 ){
+                            _deriv(_index, getCartIndex( _n[0], _n[1], _n[2] )) -= _n[_k]+1;
+                        }
+                        _index++;
+                    }
+                }
+            }
+            return ub::prod( _trafo, _deriv );
+        }
         return _trafo;
        }
        
+       
+    int AOSuperMatrix::getCartIndex( int nx, int ny, int nz ){
+        // within one l the powers of x and then of y decrease, see namespace Cart
+        const int _l = nx + ny + nz;
+        const int _offset = ( _l == 0 ) ? 0 : getBlockSize( _l-1 );
+        return _offset + (_l-nx)*(_l-nx+1)/2 + (_l-nx-ny);
+    }
+       
     
 
     std::vector<double> AOMatrix::XIntegrate(int _n, double _T  ){
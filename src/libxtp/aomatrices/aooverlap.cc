@@ -57,11 +57,9 @@ namespace votca { namespace xtp {
         // get shell positions
         const vec& _pos_row = _shell_row->getPos();
         const vec& _pos_col = _shell_col->getPos();
-        const vec  _diff    = _pos_row - _pos_col;
         std::vector<double> _pma (3,0.0);
         std::vector<double> _pmb (3,0.0);
           
-        double _distsq = (_diff*_diff);   
  int n_orbitals[] = {1, 4, 10, 20, 35, 56, 84};
 
  int nx[] = { 0,
@@ -116,36 +114,26 @@ namespace votca { namespace xtp {
 
 
 
-        // iterate over Gaussians in this _shell_row
-        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr){
-            // iterate over Gaussians in this _shell_col
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc){
-           
-    
-            // get decay constants 
-            const double _decay_col = itc->getDecay();
-            
-            // some helpers
-            const double _fak  = 0.5/(_decay_row + _decay_col);
-            const double _fak2 = 2.0 * _fak;
-            
-            // check if distance between postions is big, then skip step   
-            double _exparg = _fak2 * _decay_row * _decay_col *_distsq;
-            if ( _exparg > 30.0 ) { continue; }
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double _fak  = itp->fak;
+            const double _fak2 = itp->fak2;
+            const double _exparg = itp->exparg;
              // initialize local matrix block for unnormalized cartesians
             ub::matrix<double> _ol = ub::zero_matrix<double>(_nrows,_ncols);
         
 
             
-            const double PmA0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-            const double  PmA1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-            const double  PmA2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+            const double PmA0 = itp->P.getX() - _pos_row.getX();
+            const double  PmA1 = itp->P.getY() - _pos_row.getY();
+            const double  PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-            const double PmB0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-            const double PmB1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-            const double PmB2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();
+            const double PmB0 = itp->P.getX() - _pos_col.getX();
+            const double PmB1 = itp->P.getY() - _pos_col.getY();
+            const double PmB2 = itp->P.getZ() - _pos_col.getZ();
             
 
         
@@ -560,8 +548,8 @@ if (_lmax_col > 5) {
 
         //cout << "Done with unnormalized matrix " << endl;
         
-        ub::matrix<double> _trafo_row = getTrafo(*itr);
-        ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));      
+        const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+        ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);      
 
         // cartesian -> spherical
              
@@ -576,8 +564,7 @@ if (_lmax_col > 5) {
         
         
         _ol.clear();
-            } // _shell_col Gaussians
-        } // _shell_row Gaussians
+            } // primitive pairs
     }
     
   
@@ -45,23 +45,6 @@ namespace votca { namespace xtp {
 
         
         
-        std::vector<double> quadrople=apolarsite->getQ2();
-        
-        double ang22bohr2=tools::conv::ang2bohr*tools::conv::ang2bohr;
-        for(std::vector<double>::iterator it=quadrople.begin();it<quadrople.end();++it){
-            (*it)=ang22bohr2*(*it);
-        }
-        // I am not sure the order definition or anything is correct apolarsite object orders them as Q20, Q21c, Q21s, Q22c, Q22s
-        
-        // q_01 etc are cartesian tensor multipole moments according to https://en.wikipedia.org/wiki/Quadrupole
-        // so transform apolarsite into cartesian and then multiply by 2 (difference stone definition/wiki definition)
-        // not sure about unit conversion
-        double q_01 = sqrt(3)*quadrople[4];
-        double q_02 = sqrt(3)*quadrople[1];
-        double q_12 = sqrt(3)*quadrople[2];
-        double q_00 = -quadrople[0]+sqrt(3)*quadrople[3];
-        double q_11 = -quadrople[0]-sqrt(3)*quadrople[3]; // tensor is traceless, q_22 = - (q_00 + q_11)
-
         // cout << _gridpoint << endl;
         // shell info, only lmax tells how far to go
         int _lmax_row = _shell_row->getLmax();
@@ -126,43 +109,73 @@ namespace votca { namespace xtp {
         // get shell positions
         const vec& _pos_row = _shell_row->getPos();
         const vec& _pos_col = _shell_col->getPos();
-        const vec  _diff    = _pos_row - _pos_col;
-        // initialize some helper
-      
-        double _distsq = (_diff*_diff); 
         
+        vec _center;
+        double _extent2;
+        if ( !ShellPairDistribution(_shell_row, _shell_col, _center, _extent2) ) { return; }
+        // split the sites into those evaluated exactly and distant ones, which
+        // enter by the potential and its gradient at the pair centre
+        std::vector<vec> _nearpos;
+        std::vector< std::vector<double> > _nearquadrupole;
+        double _phi = 0.0;
+        vec _gradphi = vec(0.0, 0.0, 0.0);
+        bool _has_farfield = false;
+        for ( unsigned _site = 0; _site < _sitepos.size(); _site++ ) {
+            if ( IsFarField(_extent2, _center, _sitepos[_site]) ) {
+                // potential R.Q.R/R^5 with the traceless Q built from q_01, q_02, q_12, q_00, q_11 below
+                const std::vector<double>& _q = _sitequadrupole[_site];
+                const vec _R = _center - _sitepos[_site];
+                const vec _QR = 0.5 * vec( _q[3]*_R.getX() + _q[0]*_R.getY() + _q[1]*_R.getZ(),
+                                           _q[0]*_R.getX() + _q[4]*_R.getY() + _q[2]*_R.getZ(),
+                                           _q[1]*_R.getX() + _q[2]*_R.getY() - (_q[3]+_q[4])*_R.getZ() );
+                const double _Rinv = 1.0 / abs(_R);
+                const double _Rinv2 = _Rinv * _Rinv;
+                const double _Rinv5 = _Rinv2 * _Rinv2 * _Rinv;
+                const double _RQR = _R * _QR;
+                _phi += _RQR * _Rinv5;
+                _gradphi += ( 2.0 * _Rinv5 ) * _QR - ( 5.0 * _RQR * _Rinv5 * _Rinv2 ) * _R;
+                _has_farfield = true;
+            } else {
+                _nearpos.push_back(_sitepos[_site]);
+                _nearquadrupole.push_back(_sitequadrupole[_site]);
+            }
+        }
+        if ( _has_farfield ) { AddFarField(_matrix, _shell_row, _shell_col, _center, _phi, _gradphi); }
+        if ( _nearpos.empty() ) { return; }
      
-        // iterate over Gaussians in this _shell_row
-        for ( AOShell::GaussianIterator itr = _shell_row->firstGaussian(); itr != _shell_row->lastGaussian(); ++itr) {
-            // iterate over Gaussians in this _shell_col
-            // get decay constant
-            const double _decay_row = itr->getDecay();
-            
-            for ( AOShell::GaussianIterator itc = _shell_col->firstGaussian(); itc != _shell_col->lastGaussian(); ++itc) {
-                //get decay constant
-                const double _decay_col = itc->getDecay();
-
-                const double zeta = _decay_row + _decay_col;
-                const double _fak  = 0.5/zeta;
-                const double _fak2 = 2.0 * _fak;
-                const double xi = _decay_row * _decay_col * _fak2;
-
-                double _exparg = xi *_distsq;
-                // check if distance between postions is big, then skip step   
-                if ( _exparg > 30.0 ) { continue; }
+        // primitive pairs which survive the screening, precomputed per basis
+        const AOShellPair _shellpair(_shell_row, _shell_col);
+        for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+            const double _decay_row = itp->decay_row;
+            const double _decay_col = itp->decay_col;
+            const double zeta = _decay_row + _decay_col;
+            const double _fak  = itp->fak;
+            const double _fak2 = itp->fak2;
+            const double _exparg = itp->exparg;
 
         // some helpers
-        double PmA0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_row.getX();
-        double PmA1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_row.getY();
-        double PmA2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_row.getZ();
+        double PmA0 = itp->P.getX() - _pos_row.getX();
+        double PmA1 = itp->P.getY() - _pos_row.getY();
+        double PmA2 = itp->P.getZ() - _pos_row.getZ();
 
-        double PmB0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _pos_col.getX();
-        double PmB1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _pos_col.getY();
-        double PmB2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _pos_col.getZ();
+        double PmB0 = itp->P.getX() - _pos_col.getX();
+        double PmB1 = itp->P.getY() - _pos_col.getY();
+        double PmB2 = itp->P.getZ() - _pos_col.getZ();
 
-        double PmC0 = _fak2*( _decay_row * _pos_row.getX() + _decay_col * _pos_col.getX() ) - _gridpoint.getX();
-        double PmC1 = _fak2*( _decay_row * _pos_row.getY() + _decay_col * _pos_col.getY() ) - _gridpoint.getY();
-        double PmC2 = _fak2*( _decay_row * _pos_row.getZ() + _decay_col * _pos_col.getZ() ) - _gridpoint.getZ();
+        quad = ub::zero_matrix<double>(_nrows,_ncols);
+        
+        // all sites are summed in the cartesian block, transformed only once
+        for ( unsigned _site = 0; _site < _nearpos.size(); _site++ ) {
+        
+        const double q_01 = _nearquadrupole[_site][0];
+        const double q_02 = _nearquadrupole[_site][1];
+        const double q_12 = _nearquadrupole[_site][2];
+        const double q_00 = _nearquadrupole[_site][3];
+        const double q_11 = _nearquadrupole[_site][4];
+
+        double PmC0 = itp->P.getX() - _nearpos[_site].getX();
+        double PmC1 = itp->P.getY() - _nearpos[_site].getY();
+        double PmC2 = itp->P.getZ() - _nearpos[_site].getZ();
 
         const double _U = zeta*(PmC0*PmC0+PmC1*PmC1+PmC2*PmC2);
 
@@ -1123,11 +1136,13 @@ if (_lmax_col > 3) {
 
 for (int _i = 0; _i < _nrows; _i++) {
   for (int _j = 0; _j < _ncols; _j++) {
-    quad(_i,_j) = q_01 * quad4[_i][_j][0][0] + q_02 * quad4[_i][_j][1][0] + q_12 * quad4[_i][_j][2][0]
+    quad(_i,_j) += q_01 * quad4[_i][_j][0][0] + q_02 * quad4[_i][_j][1][0] + q_12 * quad4[_i][_j][2][0]
                   + .5 * ( q_00 * quad4[_i][_j][3][0] + q_11 * quad4[_i][_j][4][0] );
   }
 }                         
 
+        }// sites
+
 
         
         
@@ -1135,8 +1150,8 @@ for (int _i = 0; _i < _nrows; _i++) {
         
         //cout << "Done with unnormalized matrix " << endl;
         
-        ub::matrix<double> _trafo_row = getTrafo(*itr);
-        ub::matrix<double> _trafo_col_tposed = ub::trans(getTrafo(*itc));      
+        const ub::matrix<double>& _trafo_row = *itp->trafo_row;
+        ub::matrix<double> _trafo_col_tposed = ub::trans(*itp->trafo_col);      
              
         ub::matrix<double> _quad_tmp = ub::prod( _trafo_row, quad );
         ub::matrix<double> _quad_sph = ub::prod( _quad_tmp, _trafo_col_tposed );
@@ -1148,26 +1163,49 @@ for (int _i = 0; _i < _nrows; _i++) {
             }
         }
         
-            }// _shell_col Gaussians
-        }// _shell_row Gaussians
+            } // primitive pairs
     }
 
-        void AOQuadrupole_Potential::Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*> & _sites) {
+        void AOQuadrupole_Potential::Fillextpotential(const AOBasis& aobasis, const std::vector<ctp::PolarSeg*> & _sites, double farfield_tolerance) {
 
-            _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+            _sitepos.clear();
+            _sitequadrupole.clear();
+            const double ang22bohr2=tools::conv::ang2bohr*tools::conv::ang2bohr;
             for (unsigned int i = 0; i < _sites.size(); i++) {
                 for (ctp::PolarSeg::const_iterator it = _sites[i]->begin(); it < _sites[i]->end(); ++it) {
 
                     if ((*it)->getRank() > 1) {
-                        vec positionofsite = (*it)->getPos() * tools::conv::nm2bohr;
-                        _aomatrix = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
-                        setAPolarSite((*it));
-                        Fill(aobasis, positionofsite);
-                        _externalpotential += _aomatrix;
+                        std::vector<double> quadrople=(*it)->getQ2();
+                        for(std::vector<double>::iterator qt=quadrople.begin();qt<quadrople.end();++qt){
+                            (*qt)=ang22bohr2*(*qt);
+                        }
+                        // I am not sure the order definition or anything is correct apolarsite object orders them as Q20, Q21c, Q21s, Q22c, Q22s
+        
+                        // q_01 etc are cartesian tensor multipole moments according to https://en.wikipedia.org/wiki/Quadrupole
+                        // so transform apolarsite into cartesian and then multiply by 2 (difference stone definition/wiki definition)
+                        // not sure about unit conversion
+                        // stored as q_01, q_02, q_12, q_00, q_11, tensor is traceless, q_22 = - (q_00 + q_11)
+                        std::vector<double> cartesian(5);
+                        cartesian[0] = sqrt(3)*quadrople[4];
+                        cartesian[1] = sqrt(3)*quadrople[1];
+                        cartesian[2] = sqrt(3)*quadrople[2];
+                        cartesian[3] = -quadrople[0]+sqrt(3)*quadrople[3];
+                        cartesian[4] = -quadrople[0]-sqrt(3)*quadrople[3];
+                        _sitepos.push_back((*it)->getPos() * tools::conv::nm2bohr);
+                        _sitequadrupole.push_back(cartesian);
                     }
                 }
             }
-
+            if ( _sitepos.empty() ) {
+                _externalpotential = ub::zero_matrix<double>(aobasis.AOBasisSize(), aobasis.AOBasisSize());
+                return;
+            }
+            PrepareFarField(aobasis, farfield_tolerance);
+            Fill(aobasis);
+            _externalpotential = _aomatrix;
+            ClearFarField();
+            _sitepos.clear();
+            _sitequadrupole.clear();
             return;
         }
 
@@ -18,6 +18,7 @@
  */
 #include "votca/xtp/aobasis.h"
 #include "votca/xtp/aoshell.h"
+#include <algorithm>
 
 
 namespace votca { namespace xtp {
@@ -391,4 +392,431 @@ void AOShell::EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues, const
 
 
 
+namespace {
+    // adds one contracted function P(x,y,z)*exp(-alpha r^2) and its gradient
+    // (dP - 2 alpha r P) exp(-alpha r^2) for one point
+    template<bool gradient>
+    inline void AddAOfunction(double* values, double* gradx, double* grady, double* gradz, unsigned p,
+            double e, double twoalpha, double x, double y, double z,
+            double P, double dPx, double dPy, double dPz) {
+        values[p] += P * e;
+        if (gradient) {
+            gradx[p] += (dPx - twoalpha * x * P) * e;
+            grady[p] += (dPy - twoalpha * y * P) * e;
+            gradz[p] += (dPz - twoalpha * z * P) * e;
+        }
+        return;
+    }
+}
+
+
+template<bool gradient>
+void AOShell::EvalAObatch(unsigned npoints, const double* x, const double* y, const double* z,
+        double* values, double* gradx, double* grady, double* gradz) const {
+
+    std::vector<double> cx(npoints);
+    std::vector<double> cy(npoints);
+    std::vector<double> cz(npoints);
+    std::vector<double> distsq(npoints);
+    std::vector<double> expo(npoints);
+    const double px = _pos.getX();
+    const double py = _pos.getY();
+    const double pz = _pos.getZ();
+    #pragma omp simd
+    for (unsigned p = 0; p < npoints; p++) {
+        cx[p] = x[p] - px;
+        cy[p] = y[p] - py;
+        cz[p] = z[p] - pz;
+        distsq[p] = cx[p] * cx[p] + cy[p] * cy[p] + cz[p] * cz[p];
+    }
+
+    // the shell type is resolved once per batch, the point loops are branch free
+    for (GaussianIterator itr = firstGaussian(); itr != lastGaussian(); ++itr) {
+        const double alpha = itr->getDecay();
+        const double twoalpha = 2.0 * alpha;
+        const std::vector<double>& _contractions = itr->getContraction();
+        const double powfactor = itr->getPowfactor();
+        #pragma omp simd
+        for (unsigned p = 0; p < npoints; p++) {
+            expo[p] = powfactor * exp(-alpha * distsq[p]);
+        }
+
+        unsigned _i_func = 0;
+        for (unsigned i = 0; i < _type.length(); ++i) {
+            const char single_shell = _type[i];
+            double* v = values + _i_func*npoints;
+            double* gx = gradx + _i_func*npoints;
+            double* gy = grady + _i_func*npoints;
+            double* gz = gradz + _i_func*npoints;
+            
+            if (single_shell == 'S') {
+                const double factor = _contractions[0];
+                #pragma omp simd
+                for (unsigned p = 0; p < npoints; p++) {
+                    AddAOfunction<gradient>(v, gx, gy, gz, p, expo[p], twoalpha, cx[p], cy[p], cz[p], factor, 0., 0., 0.);
+                }
+                _i_func++;
+            }
+            else if (single_shell == 'P') {
+                const double factor = 2. * sqrt(alpha) * _contractions[1];
+                #pragma omp simd
+                for (unsigned p = 0; p < npoints; p++) {
+                    const double e = expo[p];
+                    const double X = cx[p], Y = cy[p], Z = cz[p];
+                    AddAOfunction<gradient>(v, gx, gy, gz, p, e, twoalpha, X, Y, Z, factor*Z, 0., 0., factor); // Y 1,0
+                    AddAOfunction<gradient>(v+npoints, gx+npoints, gy+npoints, gz+npoints, p, e, twoalpha, X, Y, Z, factor*Y, 0., factor, 0.); // Y 1,-1
+                    AddAOfunction<gradient>(v+2*npoints, gx+2*npoints, gy+2*npoints, gz+2*npoints, p, e, twoalpha, X, Y, Z, factor*X, factor, 0., 0.); // Y 1,1
+                }
+                _i_func += 3;
+            }
+            else if (single_shell == 'D') {
+                const double factor = 2. * alpha * _contractions[2];
+                const double factor_1 = factor / sqrt(3.);
+                #pragma omp simd
+                for (unsigned p = 0; p < npoints; p++) {
+                    const double e = expo[p];
+                    const double X = cx[p], Y = cy[p], Z = cz[p];
+                    const double r2 = distsq[p];
+                    unsigned f = 0;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_1*(3.*Z*Z - r2), factor_1*(-2.*X), factor_1*(-2.*Y), factor_1*(4.*Z)); // Y 2,0
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            2.*factor*Y*Z, 0., 2.*factor*Z, 2.*factor*Y); // Y 2,-1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            2.*factor*X*Z, 2.*factor*Z, 0., 2.*factor*X); // Y 2,1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            2.*factor*X*Y, 2.*factor*Y, 2.*factor*X, 0.); // Y 2,-2
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor*(X*X - Y*Y), factor*2.*X, factor*(-2.*Y), 0.); // Y 2,2
+                }
+                _i_func += 5;
+            }
+            else if (single_shell == 'F') {
+                const double factor = 2. * pow(alpha, 1.5) * _contractions[3];
+                const double factor_1 = factor * 2. / sqrt(15.);
+                const double factor_2 = factor * sqrt(2.) / sqrt(5.);
+                const double factor_3 = factor * sqrt(2.) / sqrt(3.);
+                #pragma omp simd
+                for (unsigned p = 0; p < npoints; p++) {
+                    const double e = expo[p];
+                    const double X = cx[p], Y = cy[p], Z = cz[p];
+                    const double r2 = distsq[p];
+                    const double xx = X*X, xy = X*Y, xz = X*Z, yy = Y*Y, yz = Y*Z, zz = Z*Z;
+                    unsigned f = 0;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_1*Z*(5.*zz - 3.*r2), factor_1*(-6.*xz), factor_1*(-6.*yz), factor_1*3.*(3.*zz - r2)); // Y 3,0
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_2*Y*(5.*zz - r2), factor_2*(-2.*xy), factor_2*(4.*zz - xx - 3.*yy), factor_2*(8.*yz)); // Y 3,-1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_2*X*(5.*zz - r2), factor_2*(4.*zz - yy - 3.*xx), factor_2*(-2.*xy), factor_2*(8.*xz)); // Y 3,1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            4.*factor*X*Y*Z, 4.*factor*yz, 4.*factor*xz, 4.*factor*xy); // Y 3,-2
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            2.*factor*Z*(xx - yy), 2.*factor*(2.*xz), 2.*factor*(-2.*yz), 2.*factor*(xx - yy)); // Y 3,2
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_3*Y*(3.*xx - yy), factor_3*(6.*xy), factor_3*(3.*(xx - yy)), 0.); // Y 3,-3
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_3*X*(xx - 3.*yy), factor_3*(3.*(xx - yy)), factor_3*(-6.*xy), 0.); // Y 3,3
+                }
+                _i_func += 7;
+            }
+            else if (single_shell == 'G') {
+                const double factor = 2. / sqrt(3.) * alpha * alpha * _contractions[4];
+                const double factor_1 = factor / sqrt(35.);
+                const double factor_2 = factor * 4. / sqrt(14.);
+                const double factor_3 = factor * 2. / sqrt(7.);
+                const double factor_4 = factor * 2. * sqrt(2.);
+                #pragma omp simd
+                for (unsigned p = 0; p < npoints; p++) {
+                    const double e = expo[p];
+                    const double X = cx[p], Y = cy[p], Z = cz[p];
+                    const double r2 = distsq[p];
+                    const double xx = X*X, xy = X*Y, xz = X*Z, yy = Y*Y, yz = Y*Z, zz = Z*Z;
+                    unsigned f = 0;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_1*(35.*zz*zz - 30.*zz*r2 + 3.*r2*r2), factor_1*12.*X*(r2 - 5.*zz),
+                            factor_1*12.*Y*(r2 - 5.*zz), factor_1*16.*Z*(5.*zz - 3.*r2)); // Y 4,0
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_2*yz*(7.*zz - 3.*r2), factor_2*(-6.*X*yz),
+                            factor_2*Z*(4.*zz - 3.*xx - 9.*yy), factor_2*3.*Y*(5.*zz - r2)); // Y 4,-1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_2*xz*(7.*zz - 3.*r2), factor_2*Z*(4.*zz - 9.*xx - 3.*yy),
+                            factor_2*(-6.*Y*xz), factor_2*3.*X*(5.*zz - r2)); // Y 4,1
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            2.*factor_3*xy*(7.*zz - r2), 2.*factor_3*Y*(6.*zz - 3.*xx - yy),
+                            2.*factor_3*X*(6.*zz - xx - 3.*yy), 2.*factor_3*12.*Z*xy); // Y 4,-2
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_3*(xx - yy)*(7.*zz - r2), factor_3*4.*X*(3.*zz - xx),
+                            factor_3*4.*Y*(yy - 3.*zz), factor_3*12.*Z*(xx - yy)); // Y 4,2
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_4*yz*(3.*xx - yy), factor_4*6.*X*yz,
+                            factor_4*3.*Z*(xx - yy), factor_4*Y*(3.*xx - yy)); // Y 4,-3
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor_4*xz*(xx - 3.*yy), factor_4*3.*Z*(xx - yy),
+                            factor_4*(-6.*Y*xz), factor_4*X*(xx - 3.*yy)); // Y 4,3
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            4.*factor*xy*(xx - yy), 4.*factor*Y*(3.*xx - yy),
+                            4.*factor*X*(xx - 3.*yy), 0.); // Y 4,-4
+                    f += npoints;
+                    AddAOfunction<gradient>(v+f, gx+f, gy+f, gz+f, p, e, twoalpha, X, Y, Z,
+                            factor*(xx*xx - 6.*xx*yy + yy*yy), factor*4.*X*(xx - 3.*yy),
+                            factor*4.*Y*(yy - 3.*xx), 0.); // Y 4,4
+                }
+                _i_func += 9;
+            }
+            else if (single_shell == 'H') {
+                cerr << "H functions not implemented in AOeval at the moment!" << endl;
+                exit(1);
+            }
+            else {
+                cerr << "Single shell type" << single_shell << " not known " << endl;
+                exit(1);
+            }
+        }
+    } // contractions
+    return;
+}
+
+
+void AOShell::EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues, ub::matrix_range<ub::matrix<double> >& gradAOvalues,
+        const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z) const {
+    const unsigned npoints = x.size();
+    const unsigned nfunc = _numFunc;
+    if (npoints == 0) return;
+    std::vector<double> values(nfunc * npoints, 0.0);
+    std::vector<double> gradx(nfunc * npoints, 0.0);
+    std::vector<double> grady(nfunc * npoints, 0.0);
+    std::vector<double> gradz(nfunc * npoints, 0.0);
+    EvalAObatch<true>(npoints, &x[0], &y[0], &z[0], &values[0], &gradx[0], &grady[0], &gradz[0]);
+    
+    for (unsigned p = 0; p < npoints; p++) {
+        for (unsigned f = 0; f < nfunc; f++) {
+            AOvalues(p, f) += values[f * npoints + p];
+            gradAOvalues(3 * p, f) += gradx[f * npoints + p];
+            gradAOvalues(3 * p + 1, f) += grady[f * npoints + p];
+            gradAOvalues(3 * p + 2, f) += gradz[f * npoints + p];
+        }
+    }
+    return;
+}
+
+
+void AOShell::EvalAOspace(ub::matrix_range<ub::matrix<double> >& AOvalues,
+        const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z) const {
+    const unsigned npoints = x.size();
+    const unsigned nfunc = _numFunc;
+    if (npoints == 0) return;
+    std::vector<double> values(nfunc * npoints, 0.0);
+    // gradient buffers are not touched in this instantiation
+    EvalAObatch<false>(npoints, &x[0], &y[0], &z[0], &values[0], &values[0], &values[0], &values[0]);
+    
+    for (unsigned p = 0; p < npoints; p++) {
+        for (unsigned f = 0; f < nfunc; f++) {
+            AOvalues(p, f) += values[f * npoints + p];
+        }
+    }
+    return;
+}
+
+
+namespace {
+    // term c x^nx y^ny z^nz of the polynomial part of function f of a shell
+    struct Monomial {
+        unsigned f;
+        double c;
+        int n[3];
+    };
+
+    inline void addMonomial(std::vector<Monomial>& terms, unsigned f, double c, int nx, int ny, int nz) {
+        Monomial m;
+        m.f = f;
+        m.c = c;
+        m.n[0] = nx;
+        m.n[1] = ny;
+        m.n[2] = nz;
+        terms.push_back(m);
+        return;
+    }
+
+    // the polynomial parts of EvalAObatch for one primitive, expanded in monomials
+    void ShellMonomials(const string& type, double alpha, const std::vector<double>& contractions, std::vector<Monomial>& terms) {
+        terms.clear();
+        unsigned f = 0;
+        for (unsigned i = 0; i < type.length(); ++i) {
+            const char single_shell = type[i];
+            if (single_shell == 'S') {
+                addMonomial(terms, f, contractions[0], 0, 0, 0);
+                f++;
+            } else if (single_shell == 'P') {
+                const double factor = 2. * sqrt(alpha) * contractions[1];
+                addMonomial(terms, f, factor, 0, 0, 1); // Y 1,0
+                addMonomial(terms, f + 1, factor, 0, 1, 0); // Y 1,-1
+                addMonomial(terms, f + 2, factor, 1, 0, 0); // Y 1,1
+                f += 3;
+            } else if (single_shell == 'D') {
+                const double factor = 2. * alpha * contractions[2];
+                const double factor_1 = factor / sqrt(3.);
+                addMonomial(terms, f, -factor_1, 2, 0, 0); // Y 2,0
+                addMonomial(terms, f, -factor_1, 0, 2, 0);
+                addMonomial(terms, f, 2. * factor_1, 0, 0, 2);
+                addMonomial(terms, f + 1, 2. * factor, 0, 1, 1); // Y 2,-1
+                addMonomial(terms, f + 2, 2. * factor, 1, 0, 1); // Y 2,1
+                addMonomial(terms, f + 3, 2. * factor, 1, 1, 0); // Y 2,-2
+                addMonomial(terms, f + 4, factor, 2, 0, 0); // Y 2,2
+                addMonomial(terms, f + 4, -factor, 0, 2, 0);
+                f += 5;
+            } else if (single_shell == 'F') {
+                const double factor = 2. * pow(alpha, 1.5) * contractions[3];
+                const double factor_1 = factor * 2. / sqrt(15.);
+                const double factor_2 = factor * sqrt(2.) / sqrt(5.);
+                const double factor_3 = factor * sqrt(2.) / sqrt(3.);
+                addMonomial(terms, f, 2. * factor_1, 0, 0, 3); // Y 3,0
+                addMonomial(terms, f, -3. * factor_1, 2, 0, 1);
+                addMonomial(terms, f, -3. * factor_1, 0, 2, 1);
+                addMonomial(terms, f + 1, 4. * factor_2, 0, 1, 2); // Y 3,-1
+                addMonomial(terms, f + 1, -factor_2, 2, 1, 0);
+                addMonomial(terms, f + 1, -factor_2, 0, 3, 0);
+                addMonomial(terms, f + 2, 4. * factor_2, 1, 0, 2); // Y 3,1
+                addMonomial(terms, f + 2, -factor_2, 3, 0, 0);
+                addMonomial(terms, f + 2, -factor_2, 1, 2, 0);
+                addMonomial(terms, f + 3, 4. * factor, 1, 1, 1); // Y 3,-2
+                addMonomial(terms, f + 4, 2. * factor, 2, 0, 1); // Y 3,2
+                addMonomial(terms, f + 4, -2. * factor, 0, 2, 1);
+                addMonomial(terms, f + 5, 3. * factor_3, 2, 1, 0); // Y 3,-3
+                addMonomial(terms, f + 5, -factor_3, 0, 3, 0);
+                addMonomial(terms, f + 6, factor_3, 3, 0, 0); // Y 3,3
+                addMonomial(terms, f + 6, -3. * factor_3, 1, 2, 0);
+                f += 7;
+            } else if (single_shell == 'G') {
+                const double factor = 2. / sqrt(3.) * alpha * alpha * contractions[4];
+                const double factor_1 = factor / sqrt(35.);
+                const double factor_2 = factor * 4. / sqrt(14.);
+                const double factor_3 = factor * 2. / sqrt(7.);
+                const double factor_4 = factor * 2. * sqrt(2.);
+                addMonomial(terms, f, 3. * factor_1, 4, 0, 0); // Y 4,0
+                addMonomial(terms, f, 3. * factor_1, 0, 4, 0);
+                addMonomial(terms, f, 8. * factor_1, 0, 0, 4);
+                addMonomial(terms, f, 6. * factor_1, 2, 2, 0);
+                addMonomial(terms, f, -24. * factor_1, 2, 0, 2);
+                addMonomial(terms, f, -24. * factor_1, 0, 2, 2);
+                addMonomial(terms, f + 1, 4. * factor_2, 0, 1, 3); // Y 4,-1
+                addMonomial(terms, f + 1, -3. * factor_2, 2, 1, 1);
+                addMonomial(terms, f + 1, -3. * factor_2, 0, 3, 1);
+                addMonomial(terms, f + 2, 4. * factor_2, 1, 0, 3); // Y 4,1
+                addMonomial(terms, f + 2, -3. * factor_2, 3, 0, 1);
+                addMonomial(terms, f + 2, -3. * factor_2, 1, 2, 1);
+                addMonomial(terms, f + 3, 12. * factor_3, 1, 1, 2); // Y 4,-2
+                addMonomial(terms, f + 3, -2. * factor_3, 3, 1, 0);
+                addMonomial(terms, f + 3, -2. * factor_3, 1, 3, 0);
+                addMonomial(terms, f + 4, 6. * factor_3, 2, 0, 2); // Y 4,2
+                addMonomial(terms, f + 4, -factor_3, 4, 0, 0);
+                addMonomial(terms, f + 4, -6. * factor_3, 0, 2, 2);
+                addMonomial(terms, f + 4, factor_3, 0, 4, 0);
+                addMonomial(terms, f + 5, 3. * factor_4, 2, 1, 1); // Y 4,-3
+                addMonomial(terms, f + 5, -factor_4, 0, 3, 1);
+                addMonomial(terms, f + 6, factor_4, 3, 0, 1); // Y 4,3
+                addMonomial(terms, f + 6, -3. * factor_4, 1, 2, 1);
+                addMonomial(terms, f + 7, 4. * factor, 3, 1, 0); // Y 4,-4
+                addMonomial(terms, f + 7, -4. * factor, 1, 3, 0);
+                addMonomial(terms, f + 8, factor, 4, 0, 0); // Y 4,4
+                addMonomial(terms, f + 8, -6. * factor, 2, 2, 0);
+                addMonomial(terms, f + 8, factor, 0, 4, 0);
+                f += 9;
+            } else {
+                cerr << "Single shell type" << single_shell << " not known in EvalAOhessian" << endl;
+                exit(1);
+            }
+        }
+        return;
+    }
+
+    // d^(d0+d1+d2) / dx^d0 dy^d1 dz^d2 of a monomial at X
+    inline double derivMonomial(const Monomial& m, const double* X, const int* d) {
+        double result = m.c;
+        for (unsigned i = 0; i < 3; i++) {
+            if (d[i] > m.n[i]) return 0.0;
+            for (int k = 0; k < d[i]; k++) {
+                result *= m.n[i] - k;
+            }
+            for (int k = d[i]; k < m.n[i]; k++) {
+                result *= X[i];
+            }
+        }
+        return result;
+    }
+}
+
+
+/*
+ * With the polynomial part P of a function and e = exp(-alpha r^2)
+ * d_j d_k (P e) = (d_j d_k P - 2 alpha (delta_jk P + x_k d_j P + x_j d_k P) + 4 alpha^2 x_j x_k P) e
+ */
+void AOShell::EvalAOhessian(ub::matrix_range<ub::matrix<double> >& AOHessx, ub::matrix_range<ub::matrix<double> >& AOHessy,
+        ub::matrix_range<ub::matrix<double> >& AOHessz,
+        const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z) const {
+    const unsigned npoints = x.size();
+    const unsigned nfunc = _numFunc;
+    ub::matrix_range<ub::matrix<double> >* hess[3] = {&AOHessx, &AOHessy, &AOHessz};
+    std::vector<Monomial> terms;
+    std::vector<double> P(nfunc);
+    std::vector<double> dP(3 * nfunc);
+    std::vector<double> ddP(9 * nfunc);
+    for (GaussianIterator itr = firstGaussian(); itr != lastGaussian(); ++itr) {
+        const double alpha = itr->getDecay();
+        const double powfactor = itr->getPowfactor();
+        ShellMonomials(_type, alpha, itr->getContraction(), terms);
+        for (unsigned p = 0; p < npoints; p++) {
+            const double X[3] = {x[p] - _pos.getX(), y[p] - _pos.getY(), z[p] - _pos.getZ()};
+            const double e = powfactor * exp(-alpha * (X[0] * X[0] + X[1] * X[1] + X[2] * X[2]));
+            std::fill(P.begin(), P.end(), 0.0);
+            std::fill(dP.begin(), dP.end(), 0.0);
+            std::fill(ddP.begin(), ddP.end(), 0.0);
+            for (const Monomial& m : terms) {
+                int d[3] = {0, 0, 0};
+                P[m.f] += derivMonomial(m, X, d);
+                for (unsigned j = 0; j < 3; j++) {
+                    d[j]++;
+                    dP[3 * m.f + j] += derivMonomial(m, X, d);
+                    for (unsigned k = 0; k < 3; k++) {
+                        d[k]++;
+                        ddP[9 * m.f + 3 * j + k] += derivMonomial(m, X, d);
+                        d[k]--;
+                    }
+                    d[j]--;
+                }
+            }
+            for (unsigned f = 0; f < nfunc; f++) {
+                for (unsigned k = 0; k < 3; k++) {
+                    for (unsigned j = 0; j < 3; j++) {
+                        double h = ddP[9 * f + 3 * j + k]
+                                - 2. * alpha * (X[k] * dP[3 * f + j] + X[j] * dP[3 * f + k])
+                                + 4. * alpha * alpha * X[j] * X[k] * P[f];
+                        if (j == k) h -= 2. * alpha * P[f];
+                        (*hess[k])(3 * p + j, f) += h * e;
+                    }
+                }
+            }
+        }
+    }
+    return;
+}
+
+
 }}
@@ -0,0 +1,138 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "votca/xtp/aoshellpair.h"
+#include "votca/xtp/aobasis.h"
+#include "votca/xtp/aomatrix.h"
+#include <algorithm>
+
+
+namespace votca { namespace xtp {
+
+
+const double AOShellPair::exparg_max = 30.0;
+
+
+
+AOShellPair::AOShellPair(const AOShell* shell_row, const AOShell* shell_col) {
+
+        const AOBasis* _basis = shell_row->getBasis();
+        const int _row = shell_row->getShellIndex();
+        const int _col = shell_col->getShellIndex();
+        if (_basis != NULL && _basis == shell_col->getBasis() && _basis->_shellpairs_filled
+                && _row >= 0 && _row < static_cast<int>(_basis->_shellpair_nshells)
+                && _col >= 0 && _col < static_cast<int>(_basis->_shellpair_nshells)) {
+            const unsigned _lower = std::max(_row, _col);
+            const unsigned _index = _lower * (_lower + 1) / 2 + std::min(_row, _col);
+            const AOPrimitivePair* _first = _basis->_shellpairs.data() + _basis->_shellpair_offsets[_index];
+            const AOPrimitivePair* _last = _basis->_shellpairs.data() + _basis->_shellpair_offsets[_index + 1];
+            if (_row >= _col) {
+                _begin = _first;
+                _end = _last;
+            } else {
+                Transpose(_first, _last, shell_row, shell_col, _pairs);
+                _begin = _pairs.data();
+                _end = _pairs.data() + _pairs.size();
+            }
+            return;
+        }
+
+        // trafos must not move anymore once the pairs point to them
+        _trafos.reserve(shell_row->getSize() + shell_col->getSize());
+        FillTrafos(shell_row, _trafos);
+        FillTrafos(shell_col, _trafos);
+        FillPrimitivePairs(shell_row, shell_col, _trafos.data(), _trafos.data() + shell_row->getSize(), _pairs);
+        _begin = _pairs.data();
+        _end = _pairs.data() + _pairs.size();
+}
+
+
+
+void AOShellPair::FillTrafos(const AOShell* shell, std::vector< ub::matrix<double> >& trafos) {
+        for (AOShell::GaussianIterator itr = shell->firstGaussian(); itr != shell->lastGaussian(); ++itr) {
+            trafos.push_back(AOSuperMatrix::getTrafo(*itr));
+        }
+        return;
+}
+
+
+
+namespace {
+    bool RowGaussianBefore(const AOPrimitivePair& a, const AOPrimitivePair& b) {
+        return a.row < b.row;
+    }
+}
+
+
+
+void AOShellPair::Transpose(const AOPrimitivePair* first, const AOPrimitivePair* last,
+        const AOShell* shell_row, const AOShell* shell_col, std::vector<AOPrimitivePair>& pairs) {
+
+        const vec _diff = shell_row->getPos() - shell_col->getPos();
+        const double _distsq = _diff * _diff;
+        pairs.assign(first, last);
+        for (std::vector<AOPrimitivePair>::iterator itp = pairs.begin(); itp != pairs.end(); ++itp) {
+            std::swap(itp->row, itp->col);
+            std::swap(itp->trafo_row, itp->trafo_col);
+            std::swap(itp->decay_row, itp->decay_col);
+            // same evaluation order as in FillPrimitivePairs, fak, fak2 and P are symmetric
+            itp->exparg = itp->fak2 * itp->decay_row * itp->decay_col * _distsq;
+        }
+        // stored by Gaussians of the column shell first, within one Gaussian of
+        // the row shell the order of the column Gaussians is kept
+        std::stable_sort(pairs.begin(), pairs.end(), RowGaussianBefore);
+        return;
+}
+
+
+
+void AOShellPair::FillPrimitivePairs(const AOShell* shell_row, const AOShell* shell_col,
+        const ub::matrix<double>* trafos_row, const ub::matrix<double>* trafos_col,
+        std::vector<AOPrimitivePair>& pairs) {
+
+        const vec& _pos_row = shell_row->getPos();
+        const vec& _pos_col = shell_col->getPos();
+        const vec _diff = _pos_row - _pos_col;
+        const double _distsq = _diff * _diff;
+
+        const ub::matrix<double>* _trafo_row = trafos_row;
+        for (AOShell::GaussianIterator itr = shell_row->firstGaussian(); itr != shell_row->lastGaussian(); ++itr, ++_trafo_row) {
+            const double _decay_row = itr->getDecay();
+            const ub::matrix<double>* _trafo_col = trafos_col;
+            for (AOShell::GaussianIterator itc = shell_col->firstGaussian(); itc != shell_col->lastGaussian(); ++itc, ++_trafo_col) {
+                const double _decay_col = itc->getDecay();
+                AOPrimitivePair _pair;
+                _pair.fak2 = 1.0 / (_decay_row + _decay_col);
+                _pair.exparg = _pair.fak2 * _decay_row * _decay_col * _distsq;
+                if (_pair.exparg > exparg_max) continue;
+                _pair.row = &(*itr);
+                _pair.col = &(*itc);
+                _pair.trafo_row = _trafo_row;
+                _pair.trafo_col = _trafo_col;
+                _pair.decay_row = _decay_row;
+                _pair.decay_col = _decay_col;
+                _pair.fak = 0.5 * _pair.fak2;
+                _pair.P = _pair.fak2 * (_decay_row * _pos_row + _decay_col * _pos_col);
+                pairs.push_back(_pair);
+            }
+        }
+        return;
+}
+
+
+}}
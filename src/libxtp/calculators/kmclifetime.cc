@@ -22,6 +22,7 @@
 #include <boost/format.hpp>
 #include <votca/ctp/topology.h>
 #include <locale>
+#include <omp.h>
 
 
 using namespace std;
@@ -72,6 +73,11 @@ namespace votca {
         dolengthdistributon=true;
     }
     
+    _replicas = options->ifExistsReturnElseReturnDefault<unsigned>(key+".replicas",1);
+    if(_replicas < 1){
+        _replicas = 1;
+    }
+    
     return;
     }
 
@@ -121,35 +127,75 @@ namespace votca {
             throw runtime_error("ERROR in kmclifetime: specified number of charges is greater than the number of nodes. This conflicts with single occupation.");
         }
 
+        // Injection
+        cout << endl << "injection method: " << _injectionmethod << endl;
+
+        time_t now = time(0);
+        tm* localtm = localtime(&now);
+        cout << "Run started at " << asctime(localtm) << endl;
+
+        if (_replicas > 1) {
+            RunReplicas(top, realtime_start);
+            return;
+        }
+
+        Simulate(realtime_start);
+        double simtime=_simtime;
+        unsigned long step=_step;
+        unsigned insertioncount=_insertioncount;
+        double avlifetime=_avlifetime;
+        double meanfreepath=_meanfreepath;
+        tools::vec difflength=_difflength;
+
+        cout<<endl;
+        cout << "Total runtime:\t\t\t\t\t"<< simtime << " s"<< endl;
+        cout << "Total KMC steps:\t\t\t\t"<< step << endl;
+        cout << "Average lifetime:\t\t\t\t"<<avlifetime/insertioncount<< " s"<<endl;
+        cout << "Mean freepath\t l=<|r_x-r_o|> :\t\t"<<(meanfreepath/insertioncount)<< " nm"<<endl;
+        cout << "Average diffusionlength\t d=sqrt(<(r_x-r_o)^2>)\t"<<sqrt(abs(difflength)/insertioncount)<< " nm"<<endl;
+        cout<<endl;
+
+        PrintJumplengthdistro();
+        
+        vector< ctp::Segment* >& seg = top->Segments();
+
+        for (unsigned i = 0; i < seg.size(); i++) {
+            double occupationprobability=_occupationtime[i] / simtime;
+            seg[i]->setOcc(occupationprobability,_carriertype);
+        }
+        return;
+    }
+
+
+
+    void  KMCLifetime::Simulate(int realtime_start) {
+
         fstream traj;
         fstream energyfile;
 
-        cout << "Writing trajectory to " <<  _trajectoryfile << "." << endl; 
-        traj.open ( _trajectoryfile.c_str(), fstream::out);
-        traj << "#Simtime [s]\t Insertion\t Carrier ID\t Lifetime[s]\tSteps\t Last Segment\t x_travelled[nm]\t y_travelled[nm]\t z_travelled[nm]"<<endl;
+        // replicas write no files
+        bool writeoutput=(_replicas == 1);
+        bool do_carrierenergy=(_do_carrierenergy && writeoutput);
+        if(writeoutput){
+            cout << "Writing trajectory to " <<  _trajectoryfile << "." << endl; 
+            traj.open ( _trajectoryfile.c_str(), fstream::out);
+            traj << "#Simtime [s]\t Insertion\t Carrier ID\t Lifetime[s]\tSteps\t Last Segment\t x_travelled[nm]\t y_travelled[nm]\t z_travelled[nm]"<<endl;
+        }
 
-        if(_do_carrierenergy){
+        if(do_carrierenergy){
 
             cout << "Tracking the energy of one charge carrier and exponential average with alpha=" << _alpha << " to "<<_energy_outputfile << endl;
             energyfile.open(_energy_outputfile.c_str(),fstream::out);
             energyfile << "Simtime [s]\tSteps\tCarrier ID\tEnergy_a="<<_alpha<<"[eV]"<<endl;
         }
 
-        // Injection
-        cout << endl << "injection method: " << _injectionmethod << endl;
-
         RandomlyCreateCharges();
 
         unsigned insertioncount = 0;
         unsigned long step=0;
         double simtime=0.0;
 
-        std::vector<int> forbiddennodes;
-        std::vector<int> forbiddendests;
-
-        time_t now = time(0);
-        tm* localtm = localtime(&now);
-        cout << "Run started at " << asctime(localtm) << endl;
+        InitEventSelection();
 
         double avlifetime=0.0;
         double meanfreepath=0.0;
@@ -165,18 +211,15 @@ namespace votca {
             }
 
      
-            double cumulated_rate = 0;
-
-            for (unsigned int i = 0; i < _carriers.size(); i++) {
-                cumulated_rate += _carriers[i]->getCurrentEscapeRate();
-            }
-            if (cumulated_rate == 0) { // this should not happen: no possible jumps defined for a node
-                throw runtime_error("ERROR in kmclifetime: Incorrect rates in the database file. All the escape rates for the current setting are 0.");
+            // only hops to unoccupied nodes and decays contribute
+            double cumulated_rate = CumulatedRate();
+            if (cumulated_rate <= 0) { // this should not happen: no possible jumps defined for a node
+                throw runtime_error("ERROR in kmclifetime: Incorrect rates in the database file. All the escape rates to unoccupied nodes for the current setting are 0.");
             }
             // go forward in time
             double dt=Promotetime(cumulated_rate);
 
-            if(_do_carrierenergy){
+            if(do_carrierenergy){
                 bool print=false;
                 if (_carriers[0]->id>carrieridold){
                     avgenergy=_carriers[0]->getCurrentEnergy();
@@ -197,102 +240,139 @@ namespace votca {
             for (unsigned int i = 0; i < _carriers.size(); i++) {
                 _carriers[i]->updateLifetime(dt);
                 _carriers[i]->updateSteps(1);
-                _carriers[i]->updateOccupationtime(dt);
+                _occupationtime[_carriers[i]->getCurrentNodeId()]+=dt;
             }
 
-            ResetForbiddenlist(forbiddennodes);
-            bool secondlevel=true;
-            while (secondlevel){
-
-                // determine which carrier will escape
-                GNode* newnode=NULL;
-                Chargecarrier* affectedcarrier=ChooseAffectedCarrier(cumulated_rate);
+            // determine which carrier will escape and where it will jump to
+            Chargecarrier* affectedcarrier=ChooseAffectedCarrier();
+            GLink* event=ChooseHoppingDest(affectedcarrier->getCurrentNode());
 
-               
+            if (event->decayevent){
 
-                if (CheckForbidden(affectedcarrier->getCurrentNodeId(), forbiddennodes)) {
-                    continue;
+                avlifetime+=affectedcarrier->getLifetime();
+                meanfreepath+=tools::abs(affectedcarrier->dr_travelled);
+                difflength+=tools::elementwiseproduct(affectedcarrier->dr_travelled,affectedcarrier->dr_travelled);
+                if(writeoutput){
+                    traj << simtime<<"\t"<<insertioncount<< "\t"<< affectedcarrier->id<<"\t"<< affectedcarrier->getLifetime()<<"\t"<<affectedcarrier->getSteps()<<"\t"<< affectedcarrier->getCurrentNodeId()+1<<"\t"<<affectedcarrier->dr_travelled.getX()<<"\t"<<affectedcarrier->dr_travelled.getY()<<"\t"<<affectedcarrier->dr_travelled.getZ()<<endl;
+                }
+                if( tools::globals::verbose &&(_insertions<1500 ||insertioncount% (_insertions/1000)==0 || insertioncount<0.001*_insertions)){
+                    std::cout << "\rInsertion " << insertioncount+1<<" of "<<_insertions;
+                    std::cout << std::flush;
                 }
+                RandomlyAssignCarriertoSite(affectedcarrier);
+                affectedcarrier->resetCarrier();
+                insertioncount++;
+                affectedcarrier->id=_numberofcharges-1+insertioncount;
+            }
+            else{
+                MoveCarrier(affectedcarrier,_nodes[event->destination]);
+                affectedcarrier->dr_travelled += event->dr;
+                AddtoJumplengthdistro(event,dt);
+            }
+        }
+
+        traj.close();
+        if(do_carrierenergy){
+            energyfile.close();
+        }
+        
+        _simtime=simtime;
+        _step=step;
+        _insertioncount=insertioncount;
+        _avlifetime=avlifetime;
+        _meanfreepath=meanfreepath;
+        _difflength=difflength;
+        return;
+    }
+
+
+
+    void KMCLifetime::RunReplicas(ctp::Topology *top, int realtime_start) {
+
+        cout << "running " << _replicas << " independent replicas, no trajectory is written." << endl;
 
-                // determine where it will jump to
-                ResetForbiddenlist(forbiddendests);
-
-                while (true) {
-                    // LEVEL 2
-
-                    newnode = NULL;
-                    GLink* event=ChooseHoppingDest(affectedcarrier->getCurrentNode());
-
-                    if (event->decayevent){
-                       
-                        avlifetime+=affectedcarrier->getLifetime();
-                        meanfreepath+=tools::abs(affectedcarrier->dr_travelled);
-                        difflength+=tools::elementwiseproduct(affectedcarrier->dr_travelled,affectedcarrier->dr_travelled);
-                        traj << simtime<<"\t"<<insertioncount<< "\t"<< affectedcarrier->id<<"\t"<< affectedcarrier->getLifetime()<<"\t"<<affectedcarrier->getSteps()<<"\t"<< affectedcarrier->getCurrentNodeId()+1<<"\t"<<affectedcarrier->dr_travelled.getX()<<"\t"<<affectedcarrier->dr_travelled.getY()<<"\t"<<affectedcarrier->dr_travelled.getZ()<<endl;
-                        if( tools::globals::verbose &&(_insertions<1500 ||insertioncount% (_insertions/1000)==0 || insertioncount<0.001*_insertions)){
-                            std::cout << "\rInsertion " << insertioncount+1<<" of "<<_insertions;
-                            std::cout << std::flush;
-                        }
-                        RandomlyAssignCarriertoSite(affectedcarrier);
-                        affectedcarrier->resetCarrier();
-                        insertioncount++;
-                        affectedcarrier->id=_numberofcharges-1+insertioncount;
-                        secondlevel=false;
-                        break;
-                            }
-                    else{
-                    newnode = _nodes[event->destination];
-                    }
-
-                    // check after the event if this was allowed
-                    if (CheckForbidden(newnode->id, forbiddendests)) {
-                        continue;
-                    }
-
-                    // if the new segment is unoccupied: jump; if not: add to forbidden list and choose new hopping destination
-                    if (newnode->occupied) {
-                        if (CheckSurrounded(affectedcarrier->getCurrentNode(), forbiddendests)) {     
-                            AddtoForbiddenlist(affectedcarrier->getCurrentNodeId(), forbiddennodes);
-                            break; // select new escape node (ends level 2 but without setting level1step to 1)
-                        }
-                        AddtoForbiddenlist(newnode->id, forbiddendests);
-                        continue; // select new destination
-                    } else {
-                        affectedcarrier->jumpfromCurrentNodetoNode(newnode);
-                        affectedcarrier->dr_travelled += event->dr;
-                        AddtoJumplengthdistro(event,dt);
-                        secondlevel=false;
-
-                        break; // this ends LEVEL 2 , so that the time is updated and the next MC step started
-                    }
-
-
-                    // END LEVEL 2
+        // the replicas share the graph, seeds are drawn one after another from the master seed
+        std::vector<KMCLifetime*> replicas;
+        for (unsigned r = 0; r < _replicas; r++) {
+            KMCLifetime* replica=new KMCLifetime(*this);
+            replica->InitReplica();
+            replicas.push_back(replica);
+        }
+
+        if ( _nThreads > 0 ) omp_set_num_threads(_nThreads);
+        std::string errormessage;
+        #pragma omp parallel for schedule(dynamic)
+        for (unsigned r = 0; r < _replicas; r++) {
+            try {
+                replicas[r]->Simulate(realtime_start);
+            } catch (std::exception& e) {
+                #pragma omp critical
+                {
+                    errormessage=e.what();
                 }
-                // END LEVEL 1
             }
         }
 
+        if (errormessage.empty()) {
+            MergeReplicas(top, replicas);
+        }
+        for (unsigned r = 0; r < _replicas; r++) {
+            replicas[r]->ReleaseReplica();
+            delete replicas[r];
+        }
+        if (!errormessage.empty()) {
+            throw runtime_error(errormessage);
+        }
+        return;
+    }
+
+
+
+    void KMCLifetime::MergeReplicas(ctp::Topology *top, const std::vector<KMCLifetime*>& replicas) {
+
+        unsigned long steps=0;
+        unsigned insertions=0;
+        std::vector<double> simtimes;
+        std::vector<double> lifetimes;
+        std::vector<double> freepaths;
+        std::vector<double> difflengths;
+        std::vector<double> occupationprobabilities(_nodes.size(),0.0);
 
+        for (unsigned r = 0; r < replicas.size(); r++) {
+            const KMCLifetime* replica=replicas[r];
+            steps+=replica->_step;
+            insertions+=replica->_insertioncount;
+            simtimes.push_back(replica->_simtime);
+            lifetimes.push_back(replica->_avlifetime/replica->_insertioncount);
+            freepaths.push_back(replica->_meanfreepath/replica->_insertioncount);
+            difflengths.push_back(sqrt(abs(replica->_difflength)/replica->_insertioncount));
+            for (unsigned i = 0; i < _nodes.size(); i++) {
+                occupationprobabilities[i]+=replica->_occupationtime[i]/replica->_simtime/double(replicas.size());
+            }
+        }
+
+        double mean=0.0;
+        double error=0.0;
         cout<<endl;
-        cout << "Total runtime:\t\t\t\t\t"<< simtime << " s"<< endl;
-        cout << "Total KMC steps:\t\t\t\t"<< step << endl;
-        cout << "Average lifetime:\t\t\t\t"<<avlifetime/insertioncount<< " s"<<endl;
-        cout << "Mean freepath\t l=<|r_x-r_o|> :\t\t"<<(meanfreepath/insertioncount)<< " nm"<<endl;
-        cout << "Average diffusionlength\t d=sqrt(<(r_x-r_o)^2>)\t"<<sqrt(abs(difflength)/insertioncount)<< " nm"<<endl;
+        cout << "Replicas:\t\t\t\t\t"<< replicas.size() << ", averages are given with their standard error"<< endl;
+        MeanAndError(simtimes,mean,error);
+        cout << "Runtime per replica:\t\t\t\t"<< mean << " s"<< endl;
+        cout << "Total KMC steps:\t\t\t\t"<< steps << endl;
+        cout << "Total insertions:\t\t\t\t"<< insertions << endl;
+        MeanAndError(lifetimes,mean,error);
+        cout << "Average lifetime:\t\t\t\t"<< mean << " +/- " << error << " s"<<endl;
+        MeanAndError(freepaths,mean,error);
+        cout << "Mean freepath\t l=<|r_x-r_o|> :\t\t"<< mean << " +/- " << error << " nm"<<endl;
+        MeanAndError(difflengths,mean,error);
+        cout << "Average diffusionlength\t d=sqrt(<(r_x-r_o)^2>)\t"<< mean << " +/- " << error << " nm"<<endl;
         cout<<endl;
 
-        PrintJumplengthdistro();
-        
+        PrintJumplengthdistro(std::vector<KMCCalculator*>(replicas.begin(),replicas.end()));
+
         vector< ctp::Segment* >& seg = top->Segments();
 
         for (unsigned i = 0; i < seg.size(); i++) {
-            double occupationprobability=_nodes[i]->occupationtime / simtime;
-            seg[i]->setOcc(occupationprobability,_carriertype);
-        }
-        traj.close();
-        if(_do_carrierenergy){
-            energyfile.close();
+            seg[i]->setOcc(occupationprobabilities[i],_carriertype);
         }
         return;
     }
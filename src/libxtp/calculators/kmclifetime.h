@@ -53,6 +53,9 @@ private:
             
 	    
             void  RunVSSM(ctp::Topology *top);
+            void  Simulate(int realtime_start);
+            void  RunReplicas(ctp::Topology *top, int realtime_start);
+            void  MergeReplicas(ctp::Topology *top, const std::vector<KMCLifetime*>& replicas);
             
             
             void ReadLifetimeFile( string filename);
@@ -69,6 +72,14 @@ private:
             string _trajectoryfile;
             string _outputfile;
             string _filename;
+            
+            // results of Simulate
+            double _simtime;
+            unsigned long _step;
+            unsigned _insertioncount;
+            double _avlifetime;
+            double _meanfreepath;
+            tools::vec _difflength;
 };
 
 
@@ -22,6 +22,7 @@
 #include <boost/format.hpp>
 #include <votca/ctp/topology.h>
 #include <locale>
+#include <omp.h>
 
 
 using namespace std;
@@ -67,6 +68,11 @@ void KMCMultiple::Initialize(tools::Property *options){
         if(lengthdistribution>0){
             dolengthdistributon=true;
         }
+        
+        _replicas = options->ifExistsReturnElseReturnDefault<unsigned>(key+".replicas",1);
+        if(_replicas < 1){
+            _replicas = 1;
+        }
 
         return;
 }      
@@ -81,9 +87,7 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
     cout << "number of charges: " << _numberofcharges << endl;
     cout << "number of nodes: " << _nodes.size() << endl;
     
-    bool checkifoutput=(_outputtime != 0);
-    double nexttrajoutput=0;
-//    double nexttrajoutput=_runtime;
+    bool checkifoutput=(_outputtime != 0 && _replicas == 1);
     unsigned long maxsteps=_runtime;
     unsigned long outputstep=_outputtime;
     bool stopontime=false;
@@ -116,6 +120,101 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
         throw runtime_error("ERROR in kmcmultiple: specified number of charges is greater than the number of nodes. This conflicts with single occupation.");
     }
 
+    if(_replicas > 1){
+        RunReplicas(top, realtime_start);
+        return;
+    }
+    
+    Simulate(realtime_start);
+    double simtime=_simtime;
+    unsigned long step=_step;
+    double absolute_field = tools::abs(_field);
+    
+    vector< ctp::Segment* >& seg = top->Segments();
+    for (unsigned i = 0; i < seg.size(); i++) {
+            double occupationprobability=_occupationtime[i] / simtime;
+            seg[i]->setOcc(occupationprobability,_carriertype);
+        }
+
+    cout << endl << "finished KMC simulation after " << step << " steps." << endl;
+    cout << "simulated time " << simtime << " seconds." << endl;
+    cout << "runtime: ";
+    cout << endl << endl;
+    
+    tools::vec avg_dr_travelled = tools::vec (0,0,0);
+    for(unsigned int i=0; i<_numberofcharges; i++){
+        cout << std::scientific << "    charge " << i+1 << ": " << _carriers[i]->dr_travelled/simtime << endl;
+        avg_dr_travelled += _carriers[i]->dr_travelled;
+    }
+    avg_dr_travelled /= _numberofcharges;
+    
+    tools::vec avgvelocity = avg_dr_travelled/simtime; 
+    cout << std::scientific << "  Overall average velocity (nm/s): " << avgvelocity << endl;
+
+    cout << endl << "Distances travelled (nm): " << endl;
+    for(unsigned int i=0; i<_numberofcharges; i++){
+        cout << std::scientific << "    charge " << i+1 << ": " << _carriers[i]->dr_travelled << endl;
+    }
+    
+    // calculate mobilities
+   
+    if (absolute_field != 0){
+        double average_mobility = 0;
+        cout << endl << "Mobilities (nm^2/Vs): " << endl;
+        for(unsigned int i=0; i<_numberofcharges; i++){
+            tools::vec velocity = _carriers[i]->dr_travelled/simtime;
+            cout << std::scientific << "    charge " << i+1 << ": mu=" << (velocity*_field)/(absolute_field*absolute_field) << endl;
+            average_mobility += (velocity*_field) /(absolute_field*absolute_field);
+        }
+        average_mobility /= _numberofcharges;
+        cout << std::scientific << "  Overall average mobility in field direction <mu>=" << average_mobility << " nm^2/Vs  " << endl;
+      }
+    cout << endl;
+    
+    // calculate diffusion tensor
+    tools::matrix avgdiffusiontensor=_diffusiontensor;
+    cout<<endl<<"Diffusion tensor averaged over all carriers (nm^2/s):" << endl << avgdiffusiontensor << endl;
+    
+  
+
+    tools::matrix::eigensystem_t diff_tensor_eigensystem;
+    cout<<endl<<"Eigenvalues: "<<endl<<endl;
+    avgdiffusiontensor.SolveEigensystem(diff_tensor_eigensystem);
+    for(int i=0; i<=2; i++)
+    {
+        cout<<"Eigenvalue: "<<diff_tensor_eigensystem.eigenvalues[i]<<endl<<"Eigenvector: ";
+               
+        cout<<diff_tensor_eigensystem.eigenvecs[i].x()<<"   ";
+        cout<<diff_tensor_eigensystem.eigenvecs[i].y()<<"   ";
+        cout<<diff_tensor_eigensystem.eigenvecs[i].z()<<endl<<endl;
+    }
+    
+    // calculate average mobility from the Einstein relation
+    if (absolute_field == 0){
+        cout << "The following value is calculated using the Einstein relation and assuming an isotropic medium" << endl;
+       double avgD  = 1./3. * (diff_tensor_eigensystem.eigenvalues[0] + diff_tensor_eigensystem.eigenvalues[1] + diff_tensor_eigensystem.eigenvalues[2] );
+       double average_mobility = std::abs(avgD / tools::conv::kB / _temperature);
+       cout << std::scientific << "  Overall average mobility <mu>=" << average_mobility << " nm^2/Vs "  << endl;
+    }
+    
+  PrintJumplengthdistro();
+    
+
+    
+    return;
+}
+
+
+
+
+void KMCMultiple::Simulate(int realtime_start)
+{
+    bool checkifoutput=(_outputtime != 0);
+    double nexttrajoutput=0;
+    unsigned long maxsteps=_runtime;
+    unsigned long outputstep=_outputtime;
+    bool stopontime=(_runtime <= 100);
+    
     fstream traj;
     fstream tfile;
     
@@ -165,8 +264,9 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
         }
     }
   
-    vector<int> forbiddennodes;
-    vector<int> forbiddendests;
+    InitEventSelection();
+    // occupation times are accumulated when a carrier leaves a node
+    vector<double> lastjumptime(_numberofcharges,0.0);
     
     tools::matrix avgdiffusiontensor;
     avgdiffusiontensor.ZeroMatrix();
@@ -183,14 +283,11 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
             break;
         }
         
-        double cumulated_rate = 0;
-        for(unsigned int i=0; i<_numberofcharges; i++)
-        {
-            cumulated_rate += _carriers[i]->getCurrentEscapeRate();
-        }
-        if(cumulated_rate == 0)
+        // only hops to unoccupied nodes contribute
+        double cumulated_rate = CumulatedRate();
+        if(cumulated_rate <= 0)
         {   // this should not happen: no possible jumps defined for a node
-            throw runtime_error("ERROR in kmcmultiple: Incorrect rates in the database file. All the escape rates for the current setting are 0.");
+            throw runtime_error("ERROR in kmcmultiple: Incorrect rates in the database file. All the escape rates to unoccupied nodes for the current setting are 0.");
         }
         
         double dt =Promotetime(cumulated_rate);
@@ -199,83 +296,19 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
         step++;
         if(tools::globals::verbose) {cout << "simtime += " << dt << endl << endl;}
         
+        // determine which electron will escape and where it will jump to
+        Chargecarrier* affectedcarrier=ChooseAffectedCarrier();
+        if(tools::globals::verbose) {cout << "There are " <<affectedcarrier->getCurrentNode()->events.size() << " possible jumps for this charge:"; }
+        GLink* event=ChooseHoppingDest(affectedcarrier->getCurrentNode());
+        GNode* newnode = _nodes[event->destination];
+        if(tools::globals::verbose) {cout << endl << "Selected jump: " << newnode->id+1 << endl; }
         
-        for(unsigned int i=0; i<_numberofcharges; i++)
-        {
-            _carriers[i]->updateOccupationtime(dt);
-        }
-
-        
-        ResetForbiddenlist(forbiddennodes);
-        bool level1step = true;
-        while(level1step){
-
-            // determine which electron will escape
-            
-            GNode* newnode= NULL;
-            Chargecarrier* affectedcarrier=ChooseAffectedCarrier(cumulated_rate); 
-            
-            if(CheckForbidden(affectedcarrier->getCurrentNodeId(), forbiddennodes)) {continue;}
-            
-            // determine where it will jump to
-            ResetForbiddenlist(forbiddendests);
-            while(true){
-            // LEVEL 2
-                if(tools::globals::verbose) {cout << "There are " <<affectedcarrier->getCurrentNode()->events.size() << " possible jumps for this charge:"; }
-              
-
-                GLink* event=ChooseHoppingDest(affectedcarrier->getCurrentNode());
-                newnode = _nodes[event->destination];
-                if(newnode==affectedcarrier->getCurrentNode()){
-                    cout<<event->dr<<endl;
-                }
-
-                if(newnode == NULL){
-                    if(tools::globals::verbose) {
-                        cout << endl << "Node " << affectedcarrier->getCurrentNodeId()+1  << " is SURROUNDED by forbidden destinations and zero rates. "
-                                "Adding it to the list of forbidden nodes. After that: selection of a new escape node." << endl; 
-                    }
-                    AddtoForbiddenlist(affectedcarrier->getCurrentNodeId(), forbiddennodes);
-                    break; // select new escape node (ends level 2 but without setting level1step to 1)
-                }
-                if(tools::globals::verbose) {cout << endl << "Selected jump: " << newnode->id+1 << endl; }
-                
-                // check after the event if this was allowed
-                if(CheckForbidden(newnode->id, forbiddendests)){
-                    if(tools::globals::verbose) {cout << "Node " << newnode->id+1  << " is FORBIDDEN. Now selection new hopping destination." << endl; }
-                    continue;
-                }
-
-                // if the new segment is unoccupied: jump; if not: add to forbidden list and choose new hopping destination
-                if(newnode->occupied){
-                    if(CheckSurrounded(affectedcarrier->getCurrentNode(), forbiddendests)){
-                        if(tools::globals::verbose) {
-                            cout << "Node " << affectedcarrier->getCurrentNodeId()+1  << " is SURROUNDED by forbidden destinations. "
-                                    "Adding it to the list of forbidden nodes. After that: selection of a new escape node." << endl; 
-                        }
-                        AddtoForbiddenlist(affectedcarrier->getCurrentNodeId(), forbiddennodes);
-                        break; // select new escape node (ends level 2 but without setting level1step to 1)
-                    }
-                    if(tools::globals::verbose) {cout << "Selected segment: " << newnode->id+1 << " is already OCCUPIED. Added to forbidden list." << endl << endl;}
-                    AddtoForbiddenlist(newnode->id, forbiddendests);
-                    if(tools::globals::verbose) {cout << "Now choosing different hopping destination." << endl; }
-                    continue; // select new destination
-                }
-                else{
-                    affectedcarrier->jumpfromCurrentNodetoNode(newnode);
-                    affectedcarrier->dr_travelled +=event->dr;
-                    AddtoJumplengthdistro(event,dt);
-                    level1step = false;
-                    if(tools::globals::verbose) {cout << "Charge has jumped to segment: " << newnode->id+1 << "." << endl;}
-                    
-                    break; // this ends LEVEL 2 , so that the time is updated and the next MC step started
-                }
-
-                if(tools::globals::verbose) {cout << "." << endl;}
-            // END LEVEL 2
-            }
-        // END LEVEL 1
-        }    
+        _occupationtime[affectedcarrier->getCurrentNodeId()]+=simtime-lastjumptime[affectedcarrier->id];
+        lastjumptime[affectedcarrier->id]=simtime;
+        MoveCarrier(affectedcarrier,newnode);
+        affectedcarrier->dr_travelled +=event->dr;
+        AddtoJumplengthdistro(event,dt);
+        if(tools::globals::verbose) {cout << "Charge has jumped to segment: " << newnode->id+1 << "." << endl;}
               
         //outputstuff
         
@@ -333,63 +366,149 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
       
     }//KMC 
     
-    
-    
     if(checkifoutput)
     {   
         traj.close();
         tfile.close();
     }
+    
+    for(unsigned int i=0; i<_numberofcharges; i++){
+        _occupationtime[_carriers[i]->getCurrentNodeId()]+=simtime-lastjumptime[i];
+    }
+    
+    _simtime=simtime;
+    _step=step;
+    unsigned long diffusionsteps=step/diffusionresolution;
+    avgdiffusiontensor /= (diffusionsteps*2*simtime*_numberofcharges);
+    _diffusiontensor=avgdiffusiontensor;
+    return;
+}
+
 
+
+void KMCMultiple::RunReplicas(ctp::Topology *top, int realtime_start)
+{
+    cout << "running " << _replicas << " independent replicas, no trajectory is written." << endl;
     
-    vector< ctp::Segment* >& seg = top->Segments();
-    for (unsigned i = 0; i < seg.size(); i++) {
-            double occupationprobability=_nodes[i]->occupationtime / simtime;
-            seg[i]->setOcc(occupationprobability,_carriertype);
+    // the replicas share the graph, seeds are drawn one after another from the master seed
+    std::vector<KMCMultiple*> replicas;
+    for(unsigned r=0; r<_replicas; r++){
+        KMCMultiple* replica=new KMCMultiple(*this);
+        replica->InitReplica();
+        replica->_outputtime=0;
+        replicas.push_back(replica);
+    }
+    
+    if ( _nThreads > 0 ) omp_set_num_threads(_nThreads);
+    std::string errormessage;
+    #pragma omp parallel for schedule(dynamic)
+    for(unsigned r=0; r<_replicas; r++){
+        try{
+            replicas[r]->Simulate(realtime_start);
+        }
+        catch(std::exception& e){
+            #pragma omp critical
+            {
+                errormessage=e.what();
+            }
         }
+    }
+    
+    if(errormessage.empty()){
+        MergeReplicas(top, replicas);
+    }
+    for(unsigned r=0; r<_replicas; r++){
+        replicas[r]->ReleaseReplica();
+        delete replicas[r];
+    }
+    if(!errormessage.empty()){
+        throw runtime_error(errormessage);
+    }
+    return;
+}
 
-    cout << endl << "finished KMC simulation after " << step << " steps." << endl;
-    cout << "simulated time " << simtime << " seconds." << endl;
-    cout << "runtime: ";
-    cout << endl << endl;
+
+
+void KMCMultiple::MergeReplicas(ctp::Topology *top, const std::vector<KMCMultiple*>& replicas)
+{
+    double absolute_field = tools::abs(_field);
+    unsigned long steps=0;
+    std::vector<double> simtimes;
+    std::vector<double> mobilities;
+    std::vector<double> einsteinmobilities;
+    std::vector< std::vector<double> > velocities(3);
+    std::vector< std::vector<double> > diffusiontensors(9);
+    std::vector<double> occupationprobabilities(_nodes.size(),0.0);
     
-    tools::vec avg_dr_travelled = tools::vec (0,0,0);
-    for(unsigned int i=0; i<_numberofcharges; i++){
-        cout << std::scientific << "    charge " << i+1 << ": " << _carriers[i]->dr_travelled/simtime << endl;
-        avg_dr_travelled += _carriers[i]->dr_travelled;
+    for(unsigned r=0; r<replicas.size(); r++){
+        const KMCMultiple* replica=replicas[r];
+        steps+=replica->_step;
+        simtimes.push_back(replica->_simtime);
+        
+        tools::vec avg_dr_travelled = tools::vec (0,0,0);
+        for(unsigned int i=0; i<_numberofcharges; i++){
+            avg_dr_travelled += replica->_carriers[i]->dr_travelled;
+        }
+        avg_dr_travelled /= _numberofcharges;
+        tools::vec avgvelocity = avg_dr_travelled/replica->_simtime;
+        velocities[0].push_back(avgvelocity.getX());
+        velocities[1].push_back(avgvelocity.getY());
+        velocities[2].push_back(avgvelocity.getZ());
+        if(absolute_field != 0){
+            mobilities.push_back((avgvelocity*_field)/(absolute_field*absolute_field));
+        }
+        
+        double trace=0.0;
+        for(int i=0; i<3; i++){
+            trace+=replica->_diffusiontensor.get(i,i);
+            for(int j=0; j<3; j++){
+                diffusiontensors[3*i+j].push_back(replica->_diffusiontensor.get(i,j));
+            }
+        }
+        // the Einstein relation uses the average of the eigenvalues, i.e. a third of the trace
+        einsteinmobilities.push_back(std::abs(trace/3.0 / tools::conv::kB / _temperature));
+        
+        for(unsigned i=0; i<_nodes.size(); i++){
+            occupationprobabilities[i]+=replica->_occupationtime[i]/replica->_simtime/double(replicas.size());
+        }
     }
-    avg_dr_travelled /= _numberofcharges;
     
-    tools::vec avgvelocity = avg_dr_travelled/simtime; 
-    cout << std::scientific << "  Overall average velocity (nm/s): " << avgvelocity << endl;
-
-    cout << endl << "Distances travelled (nm): " << endl;
-    for(unsigned int i=0; i<_numberofcharges; i++){
-        cout << std::scientific << "    charge " << i+1 << ": " << _carriers[i]->dr_travelled << endl;
+    vector< ctp::Segment* >& seg = top->Segments();
+    for (unsigned i = 0; i < seg.size(); i++) {
+        seg[i]->setOcc(occupationprobabilities[i],_carriertype);
     }
     
-    // calculate mobilities
-   
+    double mean=0.0;
+    double error=0.0;
+    cout << endl << "finished " << replicas.size() << " KMC replicas after " << steps << " steps in total." << endl;
+    MeanAndError(simtimes,mean,error);
+    cout << "simulated time per replica " << mean << " seconds." << endl;
+    cout << "Averages over the replicas are given with their standard error." << endl << endl;
+    
+    cout << std::scientific << "  Overall average velocity (nm/s): ";
+    for(int i=0; i<3; i++){
+        MeanAndError(velocities[i],mean,error);
+        cout << mean << " +/- " << error << "   ";
+    }
+    cout << endl;
+    
     if (absolute_field != 0){
-        double average_mobility = 0;
-        cout << endl << "Mobilities (nm^2/Vs): " << endl;
-        for(unsigned int i=0; i<_numberofcharges; i++){
-            tools::vec velocity = _carriers[i]->dr_travelled/simtime;
-            cout << std::scientific << "    charge " << i+1 << ": mu=" << (velocity*_field)/(absolute_field*absolute_field) << endl;
-            average_mobility += (velocity*_field) /(absolute_field*absolute_field);
-        }
-        average_mobility /= _numberofcharges;
-        cout << std::scientific << "  Overall average mobility in field direction <mu>=" << average_mobility << " nm^2/Vs  " << endl;
-      }
+        MeanAndError(mobilities,mean,error);
+        cout << std::scientific << "  Overall average mobility in field direction <mu>=" << mean << " +/- " << error << " nm^2/Vs  " << endl;
+    }
     cout << endl;
     
-    // calculate diffusion tensor
-    unsigned long diffusionsteps=step/diffusionresolution;
-    avgdiffusiontensor /= (diffusionsteps*2*simtime*_numberofcharges);
-    cout<<endl<<"Diffusion tensor averaged over all carriers (nm^2/s):" << endl << avgdiffusiontensor << endl;
+    tools::matrix avgdiffusiontensor;
+    cout<<endl<<"Diffusion tensor averaged over all carriers and replicas (nm^2/s):" << endl;
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++){
+            MeanAndError(diffusiontensors[3*i+j],mean,error);
+            avgdiffusiontensor.set(i,j,mean);
+            cout << mean << " +/- " << error << "   ";
+        }
+        cout << endl;
+    }
     
-  
-
     tools::matrix::eigensystem_t diff_tensor_eigensystem;
     cout<<endl<<"Eigenvalues: "<<endl<<endl;
     avgdiffusiontensor.SolveEigensystem(diff_tensor_eigensystem);
@@ -402,24 +521,18 @@ void KMCMultiple::RunVSSM(ctp::Topology *top)
         cout<<diff_tensor_eigensystem.eigenvecs[i].z()<<endl<<endl;
     }
     
-    // calculate average mobility from the Einstein relation
     if (absolute_field == 0){
         cout << "The following value is calculated using the Einstein relation and assuming an isotropic medium" << endl;
-       double avgD  = 1./3. * (diff_tensor_eigensystem.eigenvalues[0] + diff_tensor_eigensystem.eigenvalues[1] + diff_tensor_eigensystem.eigenvalues[2] );
-       double average_mobility = std::abs(avgD / tools::conv::kB / _temperature);
-       cout << std::scientific << "  Overall average mobility <mu>=" << average_mobility << " nm^2/Vs "  << endl;
+        MeanAndError(einsteinmobilities,mean,error);
+        cout << std::scientific << "  Overall average mobility <mu>=" << mean << " +/- " << error << " nm^2/Vs "  << endl;
     }
     
-  PrintJumplengthdistro();
-    
-
-    
+    PrintJumplengthdistro(std::vector<KMCCalculator*>(replicas.begin(),replicas.end()));
     return;
 }
 
 
 
-
 bool KMCMultiple::EvaluateFrame(ctp::Topology *top){
 
     std::cout << "-----------------------------------" << std::endl;      
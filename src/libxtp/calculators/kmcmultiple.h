@@ -53,11 +53,19 @@ public:
 private:
             
             void  RunVSSM(ctp::Topology *top);
+            void  Simulate(int realtime_start);
+            void  RunReplicas(ctp::Topology *top, int realtime_start);
+            void  MergeReplicas(ctp::Topology *top, const std::vector<KMCMultiple*>& replicas);
             double _runtime;
             double _outputtime;
             std::string _trajectoryfile;
             std::string _timefile;
             double _maxrealtime;
+            
+            // results of Simulate
+            double _simtime;
+            unsigned long _step;
+            tools::matrix _diffusiontensor;
            
 };
 
@@ -27,6 +27,9 @@
 #include <votca/tools/property.h>
 #include <boost/progress.hpp>
 #include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <cmath>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -69,8 +72,21 @@ private:
     bool                              _generate_from_file;
     bool                              _generate_unsafe;
     bool                              _do_bridging;
+    bool                              _use_celllist;
     std::list<ctp::QMNBList::SuperExchangeType*>        _superexchange;
 
+    // linked-cell grid over the periodic box, each cell is at least
+    // _cellsize wide, so all neighbours of a segment are in adjacent cells
+    double                            _cellsize;
+    int                               _ncells[3];
+    std::vector<int>                  _cellofseg;
+    std::vector<int>                  _cellstart;
+    std::vector<int>                  _cellsegs;
+
+    void BuildCells(const tools::matrix& box, const std::vector< ctp::Segment* >& segs, double rsearch);
+    void CellCandidates(int segindex, std::vector<int>& candidates) const;
+    bool IsNeighbor(ctp::Topology *top, ctp::Segment *seg1, ctp::Segment *seg2, double cutoff) const;
+
 };
     
 
@@ -157,9 +173,122 @@ void Neighborlist::Initialize(tools::Property *options) {
     else{
        _do_bridging=false; 
     }
+    
+    // the O(N^2) loop over all segment pairs is kept for comparison
+    _use_celllist = options->ifExistsReturnElseReturnDefault<bool>(key+".celllist", true);
             
 }
 
+
+void Neighborlist::BuildCells(const tools::matrix& box, const std::vector< ctp::Segment* >& segs, double rsearch) {
+
+    const tools::vec a = box.getCol(0);
+    const tools::vec b = box.getCol(1);
+    const tools::vec c = box.getCol(2);
+    const tools::vec bc = b^c;
+    const tools::vec ca = c^a;
+    const tools::vec ab = a^b;
+    const double volume = a*bc;
+    
+    // number of cells along each box vector from the distance between opposite faces
+    const double width[3] = { volume/abs(bc), volume/abs(ca), volume/abs(ab) };
+    for (int k = 0; k < 3; k++) {
+        _ncells[k] = std::max(1, int(width[k]/rsearch));
+    }
+    _cellsize = rsearch;
+    const int ncells = _ncells[0]*_ncells[1]*_ncells[2];
+    
+    _cellofseg.resize(segs.size());
+    std::vector<int> count(ncells, 0);
+    for (unsigned i = 0; i < segs.size(); i++) {
+        const tools::vec& r = segs[i]->getPos();
+        const double frac[3] = { (r*bc)/volume, (r*ca)/volume, (r*ab)/volume };
+        int index[3];
+        for (int k = 0; k < 3; k++) {
+            // wrap back into the box
+            double f = frac[k] - std::floor(frac[k]);
+            index[k] = std::min(_ncells[k]-1, int(f*_ncells[k]));
+        }
+        _cellofseg[i] = (index[0]*_ncells[1] + index[1])*_ncells[2] + index[2];
+        count[_cellofseg[i]]++;
+    }
+    
+    // segments sorted by cell, cell n holds _cellsegs[_cellstart[n]] ... _cellsegs[_cellstart[n+1]-1]
+    _cellstart.assign(ncells+1, 0);
+    for (int n = 0; n < ncells; n++) {
+        _cellstart[n+1] = _cellstart[n] + count[n];
+    }
+    _cellsegs.resize(segs.size());
+    std::vector<int> fill(_cellstart.begin(), _cellstart.end()-1);
+    for (unsigned i = 0; i < segs.size(); i++) {
+        _cellsegs[fill[_cellofseg[i]]++] = i;
+    }
+    return;
+}
+
+
+void Neighborlist::CellCandidates(int segindex, std::vector<int>& candidates) const {
+    
+    candidates.clear();
+    const int cell = _cellofseg[segindex];
+    const int index[3] = { cell/(_ncells[1]*_ncells[2]), (cell/_ncells[2])%_ncells[1], cell%_ncells[2] };
+    
+    // adjacent cells with periodic wrap, with less than three cells along a
+    // direction every cell is adjacent and must only be visited once
+    std::vector<int> adjacent[3];
+    for (int k = 0; k < 3; k++) {
+        if (_ncells[k] < 3) {
+            for (int n = 0; n < _ncells[k]; n++) adjacent[k].push_back(n);
+        } else {
+            for (int d = -1; d <= 1; d++) adjacent[k].push_back((index[k]+d+_ncells[k])%_ncells[k]);
+        }
+    }
+    
+    for (unsigned i = 0; i < adjacent[0].size(); i++) {
+        for (unsigned j = 0; j < adjacent[1].size(); j++) {
+            for (unsigned k = 0; k < adjacent[2].size(); k++) {
+                const int n = (adjacent[0][i]*_ncells[1] + adjacent[1][j])*_ncells[2] + adjacent[2][k];
+                for (int m = _cellstart[n]; m < _cellstart[n+1]; m++) {
+                    // every pair only once, in the order of the segment list
+                    if (_cellsegs[m] > segindex) candidates.push_back(_cellsegs[m]);
+                }
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    return;
+}
+
+
+bool Neighborlist::IsNeighbor(ctp::Topology *top, ctp::Segment *seg1, ctp::Segment *seg2, double cutoff) const {
+
+    double cutoff2=cutoff*cutoff;
+    tools::vec segdistance=top->PbShortestConnect(seg1->getPos(),seg2->getPos());
+    double segdistance2=segdistance*segdistance;
+    double outside=cutoff+seg1->getApproxSize()+seg2->getApproxSize();
+
+    if(segdistance2<cutoff2){
+        return true;
+    }
+    else if(segdistance2>(outside*outside)){
+        return false;
+    }
+    for (std::vector< ctp::Fragment* > ::iterator fragit1 = seg1->Fragments().begin();
+            fragit1 < seg1->Fragments().end();
+            fragit1++) {
+        const tools::vec& r1 = (*fragit1)->getPos();
+        for (std::vector< ctp::Fragment* > ::iterator fragit2 = seg2->Fragments().begin();
+                fragit2 < seg2->Fragments().end();
+                fragit2++) {
+            tools::vec distance = top->PbShortestConnect(r1, (*fragit2)->getPos());
+            if (distance*distance <= cutoff2) {
+                return true;
+            }
+        } /* exit loop frag2 */
+    } /* exit loop frag1 */
+    return false;
+}
+
 bool Neighborlist::EvaluateFrame(ctp::Topology *top) {
   
 
@@ -204,97 +333,93 @@ bool Neighborlist::EvaluateFrame(ctp::Topology *top) {
         
         std::cout << "\r ... ... Evaluating " <<std::flush; 
         std::vector<std::string> skippedpairs;
-       
-        for (std::vector< ctp::Segment* > ::iterator segit1 = segs.begin();segit1 < segs.end();++segit1) {
-                ctp::Segment *seg1 = *segit1;
-                
-                std::vector< ctp::Segment* > ::iterator segit2;
-                std::vector< ctp::Fragment* > ::iterator fragit1;
-                std::vector< ctp::Fragment* > ::iterator fragit2;
-                double cutoff;
-                tools::vec r1;
-                tools::vec r2;
-
-                
-                if (tools::globals::verbose) {
-                    std::cout << "\r ... ... NB List Seg " << seg1->getId() << std::flush;
-                    
-                }
-
-            for (segit2 = segit1 + 1;segit2 < segs.end();++segit2) {
-
-                ctp::Segment *seg2 = *segit2;
-
-                if (!_useConstantCutoff) {
-                    // Find cut-off
+        
+        // cutoffs between the segment types, negative if none is given
+        std::vector<std::string> typenames;
+        if (_useConstantCutoff) {
+            typenames.push_back("");
+        } else {
+            typenames = _included_segments;
+        }
+        const int ntypes = typenames.size();
+        std::vector< std::vector<double> > cutoffs(ntypes, std::vector<double>(ntypes, -1.0));
+        std::vector<int> segtype(segs.size(), 0);
+        std::vector<int> typecount(ntypes, 0);
+        for (unsigned i = 0; i < segs.size(); i++) {
+            if (!_useConstantCutoff) {
+                segtype[i] = std::find(typenames.begin(), typenames.end(), segs[i]->getName()) - typenames.begin();
+            }
+            typecount[segtype[i]]++;
+        }
+        double maxcutoff = 0.0;
+        for (int t1 = 0; t1 < ntypes; t1++) {
+            for (int t2 = t1; t2 < ntypes; t2++) {
+                // only type pairs which occur in the topology
+                if (typecount[t1] == 0 || typecount[t2] == 0 || (t1 == t2 && typecount[t1] < 2)) continue;
+                if (_useConstantCutoff) {
+                    cutoffs[t1][t2] = _constantCutoff;
+                } else {
                     try {
-                        cutoff = _cutoffs.at(seg1->getName())
-                                         .at(seg2->getName());
+                        cutoffs[t1][t2] = _cutoffs.at(typenames[t1]).at(typenames[t2]);
                     }
                     catch (std::out_of_range) {
-                        std::string pairstring=seg1->getName()+"/"+seg2->getName();
-                        if(std::find(skippedpairs.begin(), skippedpairs.end(), pairstring) == skippedpairs.end()){
-                            skippedpairs.push_back(pairstring);
-                        }
+                        skippedpairs.push_back(typenames[t1]+"/"+typenames[t2]);
                         continue;
                     }
                 }
-
-                else { cutoff = _constantCutoff; }
-
-                if (cutoff>0.5*min){             
+                cutoffs[t2][t1] = cutoffs[t1][t2];
+                if (cutoffs[t1][t2]>0.5*min){             
                     throw std::runtime_error((boost::format("Cutoff is larger than half the box size. Maximum allowed cutoff is %1$1.1f") % (0.5*min)).str());
                 }
-                double cutoff2=cutoff*cutoff;
-                tools::vec segdistance=top->PbShortestConnect(seg1->getPos(),seg2->getPos());
-                double segdistance2=segdistance*segdistance;
-                double outside=cutoff+seg1->getApproxSize()+seg2->getApproxSize();
-                
-                if(segdistance2<cutoff2){
-                    top->NBList().Add(seg1, seg2);
-                }
-                else if(segdistance2>(outside*outside)){
-                    continue;
-                }
-                else {
-                    bool stopLoop = false;
-                    for (fragit1 = seg1->Fragments().begin();
-                            fragit1 < seg1->Fragments().end();
-                            fragit1++) {
-
-                        if (stopLoop) {
-                            break; }
-                        r1 = (*fragit1)->getPos();
-                        for (fragit2 = seg2->Fragments().begin();
-                                fragit2 < seg2->Fragments().end();
-                                fragit2++) {
-
-
-
-                            r2 = (*fragit2)->getPos();
-                                    tools::vec distance = top->PbShortestConnect(r1, r2);
-                                    double dist2 = distance*distance;
-                            if (dist2 > cutoff2) {
-                                continue;
-                            } else {
-                                top->NBList().Add(seg1, seg2);
-                                        stopLoop = true;
-                                break;
-                            }
-
-                        } /* exit loop frag2 */
-                    } /* exit loop frag1 */
+                maxcutoff = std::max(maxcutoff, cutoffs[t1][t2]);
+            }
+        }
+        
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+        
+        // segments further apart than any cutoff plus both sizes are never neighbours
+        if (_use_celllist) {
+            double maxsize = 0.0;
+            for (unsigned i = 0; i < segs.size(); i++) {
+                maxsize = std::max(maxsize, segs[i]->getApproxSize());
+            }
+            BuildCells(box, segs, maxcutoff + 2.0*maxsize);
+            std::cout << std::endl << " ... ... Linked-cell grid " << _ncells[0] << "x" << _ncells[1] << "x" << _ncells[2] << std::flush;
+        }
+        
+        // partners of each segment further down in segs, in ascending order, so
+        // the pairs are added to the list in the same order as by a double loop
+        const int nsegs = segs.size();
+        std::vector< std::vector<int> > partners(nsegs);
+#ifdef _OPENMP
+        if ( _nThreads > 0 ) omp_set_num_threads(_nThreads);
+#endif
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < nsegs; i++) {
+            std::vector<int> candidates;
+            if (_use_celllist) {
+                CellCandidates(i, candidates);
+            } else {
+                for (int j = i+1; j < nsegs; j++) candidates.push_back(j);
+            }
+            for (unsigned c = 0; c < candidates.size(); c++) {
+                const int j = candidates[c];
+                const double cutoff = cutoffs[segtype[i]][segtype[j]];
+                if (cutoff < 0.0) continue;
+                if (IsNeighbor(top, segs[i], segs[j], cutoff)) {
+                    partners[i].push_back(j);
                 }
-                
-                
-            } /* exit loop seg2 */
-                
-               
-           
-        } /* exit loop seg1 */   
+            }
+        }
         
-       
+        for (int i = 0; i < nsegs; i++) {
+            for (unsigned j = 0; j < partners[i].size(); j++) {
+                top->NBList().Add(segs[i], segs[partners[i][j]]);
+            }
+        }
         
+        boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::local_time() - start;
+        std::cout << std::endl << " ... ... Neighbor search took " << elapsed.total_milliseconds()/1000.0 << " s" << std::endl;
         
         if(skippedpairs.size()>0){
         std::cout << "WARNING: No cut-off specified for segment pairs of type "<<std::endl;              
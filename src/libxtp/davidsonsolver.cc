@@ -0,0 +1,398 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <votca/xtp/davidsonsolver.h>
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <boost/numeric/ublas/matrix_proxy.hpp>
+#include <boost/numeric/ublas/operation.hpp>
+#include <votca/tools/linalg.h>
+
+using boost::format;
+
+namespace votca {
+namespace xtp {
+namespace ub = boost::numeric::ublas;
+
+bool DavidsonSolver::Solve(const MatrixFreeOperator& A, int neigen) {
+
+  const int size = A.size();
+  if (neigen > size) neigen = size;
+
+  int max_space = _max_search_space;
+  if (max_space <= 0) max_space = std::max(8 * neigen, 40);
+  if (max_space < 2 * neigen) max_space = 2 * neigen;
+
+  const bool use_guess = (_guess.size1() == unsigned(size) &&
+                         _guess.size2() >= unsigned(neigen));
+
+  // for small problems the search space would span everything anyway
+  if (max_space >= size && !use_guess) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Davidson search space covers full problem of "
+        << size << ", using dense diagonalization" << flush;
+    SolveDense(A, neigen);
+    _iterations = 0;
+    return true;
+  }
+
+  const ub::vector<double> diag = A.diagonal();
+  ub::matrix<double> V;
+  if (use_guess) {
+    V = ub::matrix<double>(size, 0);
+    ub::matrix<double> guess = _guess;
+    OrthogonalizeAndAppend(V, guess);
+  }
+  if (V.size2() < unsigned(neigen)) {
+    V = InitialGuess(diag, std::min(2 * neigen, size));
+  }
+  ub::matrix<double> AV = A.matmul(V);
+
+  bool converged = false;
+  ub::vector<double> lambda;
+  ub::matrix<double> U;
+  ub::matrix<double> X;
+  ub::matrix<double> AX;
+
+  for (_iterations = 0; _iterations < _max_iterations; _iterations++) {
+    const unsigned nvec = V.size2();
+
+    // Rayleigh-Ritz in the current search space
+    ub::matrix<double> T = ub::prod(ub::trans(V), AV);
+    T = 0.5 * (T + ub::trans(T));
+    tools::linalg_eigenvalues(T, lambda, U);
+
+    ub::matrix<double> U_low =
+        ub::project(U, ub::range(0, nvec), ub::range(0, neigen));
+    X = ub::prod(V, U_low);
+    AX = ub::prod(AV, U_low);
+
+    // residuals r_k = A x_k - lambda_k x_k
+    ub::matrix<double> R = AX;
+    std::vector<int> unconverged;
+    double max_residual = 0.0;
+    for (int k = 0; k < neigen; k++) {
+      ub::matrix_column<ub::matrix<double> > r(R, k);
+      r -= lambda(k) * ub::column(X, k);
+      double norm = ub::norm_2(r);
+      if (norm > max_residual) max_residual = norm;
+      if (norm > _tolerance) unconverged.push_back(k);
+    }
+
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp()
+        << (format(" Davidson iteration %1$3d: search space %2$4d, "
+                   "unconverged %3$3d, max residual %4$1.3e") %
+            (_iterations + 1) % nvec % unconverged.size() % max_residual)
+               .str()
+        << flush;
+
+    if (unconverged.empty()) {
+      converged = true;
+      break;
+    }
+
+    // collapse onto the Ritz vectors if the search space would overflow
+    if (nvec + unconverged.size() > unsigned(max_space)) {
+      V = X;
+      AV = AX;
+    }
+
+    // correction vectors from the diagonal preconditioner
+    ub::matrix<double> corrections(size, unconverged.size());
+    for (unsigned j = 0; j < unconverged.size(); j++) {
+      const int k = unconverged[j];
+      for (int i = 0; i < size; i++) {
+        double denom = lambda(k) - diag(i);
+        if (std::abs(denom) < 1e-6) denom = (denom < 0) ? -1e-6 : 1e-6;
+        corrections(i, j) = R(i, k) / denom;
+      }
+    }
+
+    int added = OrthogonalizeAndAppend(V, corrections);
+    if (added == 0) {
+      CTP_LOG(ctp::logDEBUG, *_pLog)
+          << ctp::TimeStamp()
+          << " Davidson search space cannot be extended any further" << flush;
+      break;
+    }
+    unsigned nold = AV.size2();
+    AV.resize(size, nold + added, true);
+    ub::project(AV, ub::range(0, size), ub::range(nold, nold + added)) =
+        A.matmul(corrections);
+  }
+
+  _eigenvalues = ub::project(lambda, ub::range(0, neigen));
+  _eigenvectors = X;
+
+  if (converged) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Davidson converged " << neigen
+        << " eigenpairs after " << _iterations + 1 << " iterations" << flush;
+  } else {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " WARNING! Davidson not converged after "
+        << _iterations << " iterations. Inspect results carefully!" << flush;
+  }
+  return converged;
+}
+
+bool DavidsonSolver::SolveBTDA(const MatrixFreeOperator& ApB,
+                               const MatrixFreeOperator& AmB, int neigen) {
+
+  const int size = ApB.size();
+  if (neigen > size) neigen = size;
+
+  int max_space = _max_search_space;
+  if (max_space <= 0) max_space = std::max(8 * neigen, 40);
+  if (max_space < 4 * neigen) max_space = 4 * neigen;
+
+  ub::vector<double> omega;
+  ub::matrix<double> U_plus;
+  ub::matrix<double> U_minus;
+
+  // for small problems the reduced problem is the full one
+  if (max_space >= size) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Davidson search space covers full problem of "
+        << size << ", using dense diagonalization" << flush;
+    ub::matrix<double> identity = ub::identity_matrix<double>(size);
+    ub::matrix<double> P = ApB.matmul(identity);
+    ub::matrix<double> M = AmB.matmul(identity);
+    identity.resize(0, 0);
+    SolveReducedBTDA(P, M, neigen, omega, U_plus, U_minus);
+    _eigenvalues = omega;
+    _eigenvectors = 0.5 * (U_plus + U_minus);
+    _eigenvectors_AR = 0.5 * (U_plus - U_minus);
+    _iterations = 0;
+    return true;
+  }
+
+  // diagonal of A for preconditioning
+  const ub::vector<double> diag = 0.5 * (ApB.diagonal() + AmB.diagonal());
+  ub::matrix<double> V = InitialGuess(diag, std::min(2 * neigen, size));
+  ub::matrix<double> PV = ApB.matmul(V);
+  ub::matrix<double> MV = AmB.matmul(V);
+
+  bool converged = false;
+  ub::matrix<double> Xp;
+  ub::matrix<double> Xm;
+
+  for (_iterations = 0; _iterations < _max_iterations; _iterations++) {
+    const unsigned nvec = V.size2();
+
+    ub::matrix<double> P = ub::prod(ub::trans(V), PV);
+    P = 0.5 * (P + ub::trans(P));
+    ub::matrix<double> M = ub::prod(ub::trans(V), MV);
+    M = 0.5 * (M + ub::trans(M));
+    SolveReducedBTDA(P, M, neigen, omega, U_plus, U_minus);
+
+    // X+Y and X-Y in the full space
+    Xp = ub::prod(V, U_plus);
+    Xm = ub::prod(V, U_minus);
+
+    // residuals (A+B)|X+Y> - w|X-Y> and (A-B)|X-Y> - w|X+Y>
+    ub::matrix<double> Rp = ub::prod(PV, U_plus);
+    ub::matrix<double> Rm = ub::prod(MV, U_minus);
+    std::vector<int> unconverged;
+    double max_residual = 0.0;
+    for (int k = 0; k < neigen; k++) {
+      ub::matrix_column<ub::matrix<double> > rp(Rp, k);
+      ub::matrix_column<ub::matrix<double> > rm(Rm, k);
+      rp -= omega(k) * ub::column(Xm, k);
+      rm -= omega(k) * ub::column(Xp, k);
+      double norm = std::sqrt(ub::inner_prod(rp, rp) + ub::inner_prod(rm, rm));
+      if (norm > max_residual) max_residual = norm;
+      if (norm > _tolerance) unconverged.push_back(k);
+    }
+
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp()
+        << (format(" Davidson BTDA iteration %1$3d: search space %2$4d, "
+                   "unconverged %3$3d, max residual %4$1.3e") %
+            (_iterations + 1) % nvec % unconverged.size() % max_residual)
+               .str()
+        << flush;
+
+    if (unconverged.empty()) {
+      converged = true;
+      break;
+    }
+
+    // collapse onto the span of X+Y and X-Y if the space would overflow
+    if (nvec + 2 * unconverged.size() > unsigned(max_space)) {
+      ub::matrix<double> U(nvec, 2 * neigen);
+      ub::project(U, ub::range(0, nvec), ub::range(0, neigen)) = U_plus;
+      ub::project(U, ub::range(0, nvec), ub::range(neigen, 2 * neigen)) =
+          U_minus;
+      ub::matrix<double> empty(nvec, 0);
+      OrthogonalizeAndAppend(empty, U);
+      V = ub::prod(V, U);
+      PV = ub::prod(PV, U);
+      MV = ub::prod(MV, U);
+    }
+
+    // both residuals enter the common search space
+    ub::matrix<double> corrections(size, 2 * unconverged.size());
+    for (unsigned j = 0; j < unconverged.size(); j++) {
+      const int k = unconverged[j];
+      for (int i = 0; i < size; i++) {
+        double denom = omega(k) - diag(i);
+        if (std::abs(denom) < 1e-6) denom = (denom < 0) ? -1e-6 : 1e-6;
+        corrections(i, 2 * j) = Rp(i, k) / denom;
+        corrections(i, 2 * j + 1) = Rm(i, k) / denom;
+      }
+    }
+
+    int added = OrthogonalizeAndAppend(V, corrections);
+    if (added == 0) {
+      CTP_LOG(ctp::logDEBUG, *_pLog)
+          << ctp::TimeStamp()
+          << " Davidson search space cannot be extended any further" << flush;
+      break;
+    }
+    unsigned nold = PV.size2();
+    PV.resize(size, nold + added, true);
+    ub::project(PV, ub::range(0, size), ub::range(nold, nold + added)) =
+        ApB.matmul(corrections);
+    MV.resize(size, nold + added, true);
+    ub::project(MV, ub::range(0, size), ub::range(nold, nold + added)) =
+        AmB.matmul(corrections);
+  }
+
+  _eigenvalues = omega;
+  _eigenvectors = 0.5 * (Xp + Xm);
+  _eigenvectors_AR = 0.5 * (Xp - Xm);
+
+  if (converged) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Davidson converged " << neigen
+        << " BTDA eigenpairs after " << _iterations + 1 << " iterations"
+        << flush;
+  } else {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " WARNING! Davidson not converged after "
+        << _iterations << " iterations. Inspect results carefully!" << flush;
+  }
+  return converged;
+}
+
+void DavidsonSolver::SolveReducedBTDA(const ub::matrix<double>& P,
+                                      const ub::matrix<double>& M, int neigen,
+                                      ub::vector<double>& omega,
+                                      ub::matrix<double>& U_plus,
+                                      ub::matrix<double>& U_minus) const {
+  // M = L L^T, then L^T P L z = w^2 z (cf. GWBSE::Solve_nonhermitian)
+  const unsigned dim = P.size1();
+  ub::matrix<double> L = M;
+  tools::linalg_cholesky_decompose(L);
+  for (unsigned i = 0; i < dim; i++) {
+    for (unsigned j = i + 1; j < dim; j++) {
+      L(i, j) = 0.0;
+    }
+  }
+  ub::matrix<double> PL = ub::prod(P, L);
+  ub::matrix<double> H = ub::prod(ub::trans(L), PL);
+  H = 0.5 * (H + ub::trans(H));
+  ub::vector<double> omega2;
+  ub::matrix<double> Z;
+  tools::linalg_eigenvalues(H, omega2, Z, neigen);
+
+  // X+Y = L z / sqrt(w) and X-Y = P (X+Y) / w, so that (X+Y)^T(X-Y) = 1
+  omega.resize(neigen);
+  U_plus = ub::prod(L, Z);
+  for (int k = 0; k < neigen; k++) {
+    omega(k) = std::sqrt(omega2(k));
+    ub::column(U_plus, k) /= std::sqrt(omega(k));
+  }
+  U_minus = ub::prod(P, U_plus);
+  for (int k = 0; k < neigen; k++) {
+    ub::column(U_minus, k) /= omega(k);
+  }
+  return;
+}
+
+void DavidsonSolver::SolveDense(const MatrixFreeOperator& A, int neigen) {
+  ub::matrix<double> identity = ub::identity_matrix<double>(A.size());
+  ub::matrix<double> H = A.matmul(identity);
+  identity.resize(0, 0);
+  tools::linalg_eigenvalues(H, _eigenvalues, _eigenvectors, neigen);
+  return;
+}
+
+ub::matrix<double> DavidsonSolver::InitialGuess(const ub::vector<double>& diag,
+                                                int nguess) const {
+  // unit vectors on the smallest diagonal elements
+  std::vector<int> order(diag.size());
+  for (unsigned i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::partial_sort(order.begin(), order.begin() + nguess, order.end(),
+                    [&diag](int a, int b) { return diag(a) < diag(b); });
+
+  ub::matrix<double> guess = ub::zero_matrix<double>(diag.size(), nguess);
+  for (int k = 0; k < nguess; k++) {
+    guess(order[k], k) = 1.0;
+  }
+  return guess;
+}
+
+int DavidsonSolver::OrthogonalizeAndAppend(
+    ub::matrix<double>& V, ub::matrix<double>& newvectors) const {
+  const unsigned size = V.size1();
+  const unsigned nold = V.size2();
+
+  for (unsigned i = 0; i < newvectors.size2(); i++) {
+    ub::matrix_column<ub::matrix<double> > t(newvectors, i);
+    double norm = ub::norm_2(t);
+    if (norm > 0.0) t /= norm;
+  }
+
+  // two passes of block Gram-Schmidt against the search space
+  for (int pass = 0; pass < 2; pass++) {
+    ub::matrix<double> overlap = ub::prod(ub::trans(V), newvectors);
+    newvectors -= ub::prod(V, overlap);
+  }
+
+  // modified Gram-Schmidt within the new block, dropping dependent vectors
+  std::vector<unsigned> kept;
+  for (unsigned i = 0; i < newvectors.size2(); i++) {
+    ub::matrix_column<ub::matrix<double> > t(newvectors, i);
+    for (unsigned j = 0; j < kept.size(); j++) {
+      ub::matrix_column<ub::matrix<double> > u(newvectors, kept[j]);
+      t -= ub::inner_prod(u, t) * u;
+    }
+    double norm = ub::norm_2(t);
+    if (norm < 1e-6) continue;
+    t /= norm;
+    kept.push_back(i);
+  }
+
+  ub::matrix<double> added(size, kept.size());
+  V.resize(size, nold + kept.size(), true);
+  for (unsigned k = 0; k < kept.size(); k++) {
+    ub::column(added, k) = ub::column(newvectors, kept[k]);
+    ub::column(V, nold + k) = ub::column(added, k);
+  }
+  newvectors = added;
+  return kept.size();
+}
+}
+}
@@ -25,6 +25,10 @@
 
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/serialization/string.hpp>
 #include <boost/numeric/ublas/operation.hpp>
 #include <votca/xtp/aomatrix.h>
 #include <votca/xtp/threecenters.h>
@@ -83,12 +87,20 @@ namespace votca {
             }
             _with_guess = options->ifExistsReturnElseReturnDefault<bool>(key + ".read_guess", false);
             _initial_guess = options->ifExistsReturnElseReturnDefault<string>(key + ".initial_guess", "atom");
+            _atomic_density_dir = options->ifExistsReturnElseReturnDefault<string>(key + ".atomic_density_cache", "");
 
 
             // numerical integrations
             _grid_name = options->ifExistsReturnElseReturnDefault<string>(key + ".integration_grid", "medium");
             _use_small_grid = options->ifExistsReturnElseReturnDefault<bool>(key + ".integration_grid_small", true);
             _grid_name_small = Choosesmallgrid(_grid_name);
+            _incremental_fock = options->ifExistsReturnElseReturnDefault<bool>(key + ".incremental_fock", false);
+            _fock_rebuild = options->ifExistsReturnElseReturnDefault<int>(key + ".incremental_fock_rebuild", 10);
+            _incremental_tolerance = options->ifExistsReturnElseReturnDefault<double>(key + ".incremental_fock_tolerance", 1e-9);
+            if (_fock_rebuild < 1) {
+                throw runtime_error("DFTENGINE: incremental_fock_rebuild has to be at least 1");
+            }
+            _farfield_tolerance = options->ifExistsReturnElseReturnDefault<double>(key + ".externalsites_farfield_tolerance", 0.0);
 
             // exchange and correlation as in libXC
 
@@ -183,6 +195,9 @@ namespace votca {
 
 
 
+            _orbitals->setScaHFX(_ScaHFX);
+            // Fock matrices of a previous run belong to another Hamiltonian
+            _diis.Reset();
             ub::vector<double>& MOEnergies = _orbitals->MOEnergies();
             ub::matrix<double>& MOCoeff = _orbitals->MOCoefficients();
             if (MOEnergies.size() != _dftbasis.AOBasisSize()) {
@@ -230,10 +245,10 @@ namespace votca {
             if (_with_guess) {
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Reading guess from orbitals object/file" << flush;
                 _dftAOdmat = _orbitals->DensityMatrixGroundState();
-            } else if (guess_set) {
+            } else if (guess_set && last_mos.size2() == _dftbasis.AOBasisSize() && int(last_mos.size1()) == _numofelectrons / 2) {
                 ConfigOrbfile(_orbitals);
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Using starting guess from last iteration" << flush;
-                _dftAOdmat = last_dmat;
+                _dftAOdmat = DensityMatrix_lastMOs();
             } else {
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Setup Initial Guess using: " << _initial_guess << flush;
                 // this temp is necessary because eigenvalues_general returns MO^T and not MO
@@ -260,6 +275,9 @@ namespace votca {
                         CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT Vxc matrix " << flush;
                     }
                     ub::matrix<double> H = H0 + _ERIs.getERIs() + _orbitals->AOVxc();
+                    if (_ScaHFX > 0) {
+                        AddExactExchange(H);
+                    }
                     _diis.SolveFockmatrix(MOEnergies, MOCoeff, H);
                     _dftAOdmat = _orbitals->DensityMatrixGroundState();
                     //cout<<_dftAOdmat<<endl;
@@ -280,26 +298,44 @@ namespace votca {
             double energyold = 0;
             double diiserror = 100; //is evolved in DIIs scheme
             Mixing Mixer(_useautomaticmixing, _mixingparameter, &_dftAOoverlap.Matrix(), _pLog);
+            // convergence reached on an incremental Fock matrix is confirmed with a full one
+            bool force_full_fock = false;
 
             for (_this_iter = 0; _this_iter < _max_iter; _this_iter++) {
                 CTP_LOG(ctp::logDEBUG, *_pLog) << flush;
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Iteration " << _this_iter + 1 << " of " << _max_iter << flush;
 
+                // the incremental build contracts only the change of the density,
+                // a full build every _fock_rebuild iterations removes the screening errors
+                const bool full_fock = !_incremental_fock || force_full_fock || (_this_iter % _fock_rebuild == 0);
+                force_full_fock = false;
                 if (_with_RI) {
-                    _ERIs.CalculateERIs(_dftAOdmat);
+                    if (full_fock) {
+                        _ERIs.CalculateERIs(_dftAOdmat);
+                    } else {
+                        _ERIs.CalculateERIs_incremental(_dftAOdmat, _incremental_tolerance);
+                    }
                 } else {
                     _ERIs.CalculateERIs_4c_small_molecule(_dftAOdmat);
                 }
 
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT Electron repulsion matrix of dimension: " << _ERIs.getSize1() << " x " << _ERIs.getSize2() << flush;
                 double vxcenergy = 0.0;
-                if (_use_small_grid && diiserror > 1e-5) {
-                    _orbitals->AOVxc() = _gridIntegration_small.IntegrateVXC(_dftAOdmat);
-                    vxcenergy = _gridIntegration_small.getTotEcontribution();
+                NumericalIntegration& gridIntegration = (_use_small_grid && diiserror > 1e-5) ? _gridIntegration_small : _gridIntegration;
+                if (!_incremental_fock) {
+                    _orbitals->AOVxc() = gridIntegration.IntegrateVXC(_dftAOdmat);
+                } else if (full_fock) {
+                    // tolerance 0 evaluates every box and refreshes the stored box contributions
+                    _orbitals->AOVxc() = gridIntegration.IntegrateVXC_incremental(_dftAOdmat, 0.0);
+                } else {
+                    _orbitals->AOVxc() = gridIntegration.IntegrateVXC_incremental(_dftAOdmat, _incremental_tolerance);
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Evaluated " << gridIntegration.getEvaluatedBoxes()
+                            << " of " << gridIntegration.getBoxesSize() << " grid boxes" << flush;
+                }
+                vxcenergy = gridIntegration.getTotEcontribution();
+                if (&gridIntegration == &_gridIntegration_small) {
                     CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled approximate DFT Vxc matrix " << flush;
                 } else {
-                    _orbitals->AOVxc() = _gridIntegration.IntegrateVXC(_dftAOdmat);
-                    vxcenergy = _gridIntegration.getTotEcontribution();
                     CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT Vxc matrix " << flush;
                 }
                 //cout<<_dftAOdmat<<endl;
@@ -308,6 +344,11 @@ namespace votca {
                 //exit(0);
                 double Eone = linalg_traceofProd(_dftAOdmat, H0);
                 double Etwo = 0.5 * _ERIs.getERIsenergy() + vxcenergy;
+                if (_ScaHFX > 0) {
+                    double exxenergy = AddExactExchange(H);
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled exact exchange matrix" << flush;
+                    Etwo += exxenergy;
+                }
                 double totenergy = Eone + E_nucnuc + Etwo;
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Single particle energy " << std::setprecision(12) << Eone << flush;
                 CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Two particle energy " << std::setprecision(12) << Etwo << flush;
@@ -342,7 +383,12 @@ namespace votca {
 
                 CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\tGAP " << MOEnergies(_numofelectrons / 2) - MOEnergies(_numofelectrons / 2 - 1) << flush;
 
-                if (std::abs(totenergy - energyold) < _Econverged && diiserror < _error_converged) {
+                const bool converged = (std::abs(totenergy - energyold) < _Econverged && diiserror < _error_converged);
+                if (converged && !full_fock) {
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Converged with an incremental Fock matrix, confirming with a full build" << flush;
+                    force_full_fock = true;
+                    energyold = totenergy;
+                } else if (converged) {
                     CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Total Energy has converged to " << std::setprecision(9) << std::abs(totenergy - energyold) << "[Ha] after " << _this_iter + 1 <<
                             " iterations. DIIS error is converged up to " << _error_converged << "[Ha]" << flush;
                     CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Final Single Point Energy " << std::setprecision(12) << totenergy << " Ha" << flush;
@@ -355,7 +401,7 @@ namespace votca {
                         }
                     }
 
-                    last_dmat = _dftAOdmat;
+                    last_mos = ub::project(MOCoeff, ub::range(0, _numofelectrons / 2), ub::range(0, MOCoeff.size2()));
                     guess_set = true;
                     // orbitals saves total energies in [eV]
                     _orbitals->setQMEnergy(totenergy * tools::conv::hrt2ev);
@@ -372,6 +418,19 @@ namespace votca {
 
 
 
+        // adds -ScaHFX/2 K[D] to the Kohn-Sham matrix and returns the exact exchange energy
+
+        double DFTENGINE::AddExactExchange(ub::matrix<double>& H) {
+            if (_with_RI) {
+                _ERIs.CalculateEXX(_dftAOdmat);
+            } else {
+                _ERIs.CalculateEXX_4c_small_molecule(_dftAOdmat);
+            }
+            H -= 0.5 * _ScaHFX * _ERIs.getEXX();
+            return -0.25 * _ScaHFX * _ERIs.getEXXsenergy();
+        }
+
+
         // SETUP INVARIANT AOMatrices
 
         void DFTENGINE::SetupInvariantMatrices() {
@@ -411,46 +470,6 @@ namespace votca {
             _dftAOESP.Fillnucpotential(_dftbasis, _atoms, _with_ecp);
             CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT nuclear potential matrix of dimension: " << _dftAOESP.Dimension() << flush;
 
-            if (_addexternalsites) {
-                _dftAOESP.Fillextpotential(_dftbasis, _externalsites);
-                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external pointcharge potential matrix of dimension: " << _dftAOESP.Dimension() << flush;
-
-                _dftAODipole_Potential.Fillextpotential(_dftbasis, _externalsites);
-                if (_dftAODipole_Potential.Dimension() > 0) {
-                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external dipole potential matrix of dimension: " << _dftAODipole_Potential.Dimension() << flush;
-                }
-                _dftAOQuadrupole_Potential.Fillextpotential(_dftbasis, _externalsites);
-                if (_dftAOQuadrupole_Potential.Dimension()) {
-                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external quadrupole potential matrix of dimension: " << _dftAOQuadrupole_Potential.Dimension() << flush;
-                }
-                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " External sites\t Name \t Coordinates \t charge \t dipole \t quadrupole" << flush;
-
-
-                for (unsigned i = 0; i < _externalsites.size(); i++) {
-
-                    vector<ctp::APolarSite*> ::iterator pit;
-                    for (pit = _externalsites[i]->begin(); pit < _externalsites[i]->end(); ++pit) {
-
-                        CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << (*pit)->getName() << " | " << (*pit)->getPos().getX()
-                                << " " << (*pit)->getPos().getY() << " " << (*pit)->getPos().getZ() << " | " << (*pit)->getQ00();
-                        if ((*pit)->getRank() > 0) {
-                            tools::vec dipole = (*pit)->getQ1();
-                            CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << " | " << dipole.getX()
-                                    << " " << dipole.getY() << " " << dipole.getZ();
-                        }
-                        if ((*pit)->getRank() > 1) {
-                            std::vector<double> quadrupole = (*pit)->getQ2();
-                            CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << " | " << quadrupole[0] << " " << quadrupole[1] << " " << quadrupole[2] << " "
-                                    << quadrupole[3] << " " << quadrupole[4];
-                        }
-                        CTP_LOG(ctp::logDEBUG, *_pLog)  << flush;
-                    }
-                }
-            }
-
-
-
-
             if (_with_ecp) {
                
                 _dftAOECP.Fill(_dftbasis, vec(0, 0, 0), &_ecp);
@@ -488,6 +507,64 @@ namespace votca {
             return;
         }
 
+        // potential matrices of the MM background, recomputed in every QM/MM iteration
+
+        void DFTENGINE::SetupExternalMatrices() {
+            _dftAOESP.Fillextpotential(_dftbasis, _externalsites, _farfield_tolerance);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external pointcharge potential matrix of dimension: " << _dftAOESP.Dimension() << flush;
+
+            _dftAODipole_Potential.Fillextpotential(_dftbasis, _externalsites, _farfield_tolerance);
+            if (_dftAODipole_Potential.Dimension() > 0) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external dipole potential matrix of dimension: " << _dftAODipole_Potential.Dimension() << flush;
+            }
+            _dftAOQuadrupole_Potential.Fillextpotential(_dftbasis, _externalsites, _farfield_tolerance);
+            if (_dftAOQuadrupole_Potential.Dimension()) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Filled DFT external quadrupole potential matrix of dimension: " << _dftAOQuadrupole_Potential.Dimension() << flush;
+            }
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " External sites\t Name \t Coordinates \t charge \t dipole \t quadrupole" << flush;
+
+
+            for (unsigned i = 0; i < _externalsites.size(); i++) {
+
+                vector<ctp::APolarSite*> ::iterator pit;
+                for (pit = _externalsites[i]->begin(); pit < _externalsites[i]->end(); ++pit) {
+
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << (*pit)->getName() << " | " << (*pit)->getPos().getX()
+                            << " " << (*pit)->getPos().getY() << " " << (*pit)->getPos().getZ() << " | " << (*pit)->getQ00();
+                    if ((*pit)->getRank() > 0) {
+                        tools::vec dipole = (*pit)->getQ1();
+                        CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << " | " << dipole.getX()
+                                << " " << dipole.getY() << " " << dipole.getZ();
+                    }
+                    if ((*pit)->getRank() > 1) {
+                        std::vector<double> quadrupole = (*pit)->getQ2();
+                        CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << " | " << quadrupole[0] << " " << quadrupole[1] << " " << quadrupole[2] << " "
+                                << quadrupole[3] << " " << quadrupole[4];
+                    }
+                    CTP_LOG(ctp::logDEBUG, *_pLog)  << flush;
+                }
+            }
+            return;
+        }
+
+        /*
+         * Identifies the integrals of SetupInvariantMatrices, they only change
+         * with the QM geometry and the basis sets, not with the MM background.
+         */
+        std::size_t DFTENGINE::InvariantKey() const {
+            std::size_t key = 0;
+            for (unsigned i = 0; i < _atoms.size(); i++) {
+                boost::hash_combine(key, _atoms[i]->type);
+                boost::hash_combine(key, _atoms[i]->x);
+                boost::hash_combine(key, _atoms[i]->y);
+                boost::hash_combine(key, _atoms[i]->z);
+            }
+            boost::hash_combine(key, _dftbasis_name);
+            boost::hash_combine(key, _with_RI ? _auxbasis_name : "");
+            boost::hash_combine(key, _with_ecp ? _ecp_name : "");
+            return key;
+        }
+
         ub::matrix<double> DFTENGINE::AtomicGuess(Orbitals* _orbitals) {
             ub::matrix<double> guess = ub::zero_matrix<double>(_dftbasis.AOBasisSize());
 
@@ -528,6 +605,13 @@ namespace votca {
                 AOBasis ecp;
                 NumericalIntegration gridIntegration;
                 dftbasis.AOBasisFill(&_dftbasisset, atom);
+                const std::string cachekey = AtomicDensityKey((*st)->type);
+                ub::matrix<double> cached;
+                if (LoadAtomicDensity(cachekey, dftbasis.AOBasisSize(), cached)) {
+                    uniqueatom_guesses.push_back(cached);
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Reusing cached atomic density for " << (*st)->type << flush;
+                    continue;
+                }
                 if (with_ecp) {
                     ecp.ECPFill(&_ecpbasisset, atom);
                 }
@@ -615,6 +699,7 @@ namespace votca {
                 ub::matrix<double>dftAOdmat_alpha = DensityMatrix_unres(MOCoeff_alpha, alpha_e);
                 if ((*st)->type == "H") {
                     uniqueatom_guesses.push_back(dftAOdmat_alpha);
+                    StoreAtomicDensity(cachekey, dftAOdmat_alpha);
                     CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Atomic density Matrix for " << (*st)->type <<
                             " gives N=" << std::setprecision(9) << linalg_traceofProd(dftAOdmat_alpha, dftAOoverlap.Matrix()) << " electrons." << flush;
                     continue;
@@ -702,6 +787,8 @@ namespace votca {
 
                         ub::matrix<double> avdmat = AverageShells(dftAOdmat_alpha + dftAOdmat_beta, dftbasis);
                         uniqueatom_guesses.push_back(avdmat);
+                        // an unconverged density must not be reused by later jobs
+                        if (converged) StoreAtomicDensity(cachekey, avdmat);
                         CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Atomic density Matrix for " << (*st)->type << " gives N="
                                 << std::setprecision(9) << linalg_traceofProd(avdmat, dftAOoverlap.Matrix()) << " electrons." << flush;
                         break;
@@ -735,6 +822,82 @@ namespace votca {
             return guess;
         }
 
+        std::map<std::string, ub::matrix<double> > DFTENGINE::_atomic_densities;
+        std::mutex DFTENGINE::_atomic_densities_mutex;
+
+        /*
+         * The atomic guess of an element only depends on the basis set, ECP,
+         * functional, grid and convergence criteria, so converged densities are
+         * shared by all DFTENGINEs of the process (e.g. the threads of a parallel
+         * calculator) and, if atomic_density_cache names a directory, by later runs.
+         */
+        std::string DFTENGINE::AtomicDensityKey(const std::string& element) const {
+            const bool with_ecp = _with_ecp && element != "H" && element != "He";
+            return (format("%1%|%2%|%3%|%4%|%5%|%6$1.3e|%7$1.3e")
+                    % element % _dftbasis_name % (with_ecp ? _ecp_name : "") % _xc_functional_name
+                    % _grid_name % _Econverged % _error_converged).str();
+        }
+
+        bool DFTENGINE::LoadAtomicDensity(const std::string& key, unsigned size, ub::matrix<double>& dmat) {
+            {
+                std::lock_guard<std::mutex> lock(_atomic_densities_mutex);
+                std::map<std::string, ub::matrix<double> >::const_iterator it = _atomic_densities.find(key);
+                if (it != _atomic_densities.end()) {
+                    dmat = it->second;
+                    return true;
+                }
+            }
+            if (_atomic_density_dir.empty()) return false;
+
+            const std::string element = key.substr(0, key.find('|'));
+            const std::string filename = (path(_atomic_density_dir)
+                    / (format("atomdensity_%1%_%2$016x.dat") % element % boost::hash<std::string>()(key)).str()).string();
+            std::ifstream ifs(filename.c_str(), std::ios::binary);
+            if (!ifs.good()) return false;
+            std::string filekey;
+            ub::matrix<double> filedmat;
+            // a corrupt file or one from another boost version or architecture
+            // only means the density has to be computed
+            try {
+                boost::archive::binary_iarchive ia(ifs);
+                ia >> filekey >> filedmat;
+            } catch (const std::exception& e) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Ignoring unreadable atomic density " << filename << ": " << e.what() << flush;
+                return false;
+            }
+            // a hash collision or a changed basis set file must not be used as a guess
+            if (filekey != key || filedmat.size1() != size || filedmat.size2() != size) return false;
+
+            std::lock_guard<std::mutex> lock(_atomic_densities_mutex);
+            _atomic_densities[key] = filedmat;
+            dmat = filedmat;
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Read atomic density from " << filename << flush;
+            return true;
+        }
+
+        void DFTENGINE::StoreAtomicDensity(const std::string& key, const ub::matrix<double>& dmat) {
+            {
+                std::lock_guard<std::mutex> lock(_atomic_densities_mutex);
+                _atomic_densities[key] = dmat;
+            }
+            if (_atomic_density_dir.empty()) return;
+
+            const std::string element = key.substr(0, key.find('|'));
+            const std::string filename = (path(_atomic_density_dir)
+                    / (format("atomdensity_%1%_%2$016x.dat") % element % boost::hash<std::string>()(key)).str()).string();
+            // written under a unique temporary name without holding the lock,
+            // concurrent writers and readers never see a partial file
+            const std::string tmpname = filename + unique_path(".%%%%%%%%.tmp").string();
+            create_directories(_atomic_density_dir);
+            {
+                std::ofstream ofs(tmpname.c_str(), std::ios::binary);
+                boost::archive::binary_oarchive oa(ofs);
+                oa << key << dmat;
+            }
+            rename(tmpname, filename);
+            return;
+        }
+
         void DFTENGINE::ConfigOrbfile(Orbitals* _orbitals) {
             if (_with_guess) {
 
@@ -824,6 +987,15 @@ namespace votca {
             CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Setup numerical integration grid " << _grid_name << " for vxc functional "
                     << _xc_functional_name << " with " << _gridIntegration.getGridSize() << " points" << flush;
             CTP_LOG(ctp::logDEBUG, *_pLog) << "\t\t " << " divided into " << _gridIntegration.getBoxesSize() << " boxes" << flush;
+            _ScaHFX = _gridIntegration.getExactExchange(_xc_functional_name);
+            if (_ScaHFX > 0) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Using hybrid functional with " << _ScaHFX << " of exact exchange";
+                if (_with_RI) {
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << " from RI" << flush;
+                } else {
+                    CTP_LOG(ctp::logDEBUG, *_pLog) << " from 4c integrals" << flush;
+                }
+            }
             if (_use_small_grid) {
                 _gridIntegration_small.GridSetup(_grid_name_small, &_dftbasisset, _atoms, &_dftbasis);
                 _gridIntegration_small.setXCfunctional(_xc_functional_name);
@@ -862,7 +1034,18 @@ namespace votca {
 
             ConfigOrbfile(_orbitals);
             }
-            SetupInvariantMatrices();
+            // in QM/MM iterations only the MM background changes
+            const std::size_t key = InvariantKey();
+            if (_invariants_set && key == _invariant_key) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Reusing invariant integrals of the unchanged geometry" << flush;
+            } else {
+                SetupInvariantMatrices();
+                _invariant_key = key;
+                _invariants_set = true;
+            }
+            if (_addexternalsites) {
+                SetupExternalMatrices();
+            }
             return;
         }
 
@@ -887,6 +1070,26 @@ namespace votca {
             return _dmatGS;
         }
 
+        /*
+         * Density of the occupied MOs of the last converged run. If the atoms
+         * moved since (forces, geometry optimization) these are no longer
+         * orthonormal, so they are Loewdin orthonormalized with the current
+         * overlap first, C' = (C S C^T)^(-1/2) C, which keeps them closest to
+         * the old MOs and the density at the right number of electrons.
+         */
+        ub::matrix<double> DFTENGINE::DensityMatrix_lastMOs() {
+            const ub::matrix<double> _SC = ub::prod(_dftAOoverlap.Matrix(), ub::trans(last_mos));
+            ub::matrix<double> _metric = ub::prod(last_mos, _SC);
+            ub::vector<double> _metric_eigenvalues;
+            linalg_eigenvalues(_metric_eigenvalues, _metric);
+            for (unsigned _i = 0; _i < _metric.size2(); _i++) {
+                ub::column(_metric, _i) /= std::sqrt(std::sqrt(_metric_eigenvalues(_i)));
+            }
+            const ub::matrix<double> _minusonehalf = ub::prod(_metric, ub::trans(_metric));
+            const ub::matrix<double> _occupied = ub::prod(_minusonehalf, last_mos);
+            return 2.0 * ub::prod(ub::trans(_occupied), _occupied);
+        }
+
         ub::matrix<double> DFTENGINE::DensityMatrix_frac(const ub::matrix<double>& MOs, const ub::vector<double>& MOEnergies, int numofelec) {
             if (numofelec == 0) {
                 return ub::zero_matrix<double>(MOs.size1());
@@ -955,6 +1158,102 @@ namespace votca {
             return;
         }
 
+        ub::matrix<double> DFTENGINE::NuclearRepulsionGradient() {
+            Elements element;
+            std::vector<double> charge;
+            for (unsigned i = 0; i < _atoms.size(); i++) {
+                string name = _atoms[i]->type;
+                double Q = element.getNucCrg(name);
+                bool HorHe = (name == "H" || name == "He");
+                if (_with_ecp && !HorHe) {
+                    Q -= _ecpbasisset.getElement(name)->getNcore();
+                }
+                charge.push_back(Q);
+            }
+
+            ub::matrix<double> gradient = ub::zero_matrix<double>(_atoms.size(), 3);
+            for (unsigned i = 0; i < _atoms.size(); i++) {
+                const tools::vec r1 = _atoms[i]->getPos() * tools::conv::ang2bohr;
+                for (unsigned j = 0; j < i; j++) {
+                    const tools::vec r2 = _atoms[j]->getPos() * tools::conv::ang2bohr;
+                    const tools::vec r12 = r1 - r2;
+                    const double dist = abs(r12);
+                    const tools::vec force = (charge[i] * charge[j] / (dist * dist * dist)) * r12;
+                    gradient(i, 0) -= force.getX();
+                    gradient(i, 1) -= force.getY();
+                    gradient(i, 2) -= force.getZ();
+                    gradient(j, 0) += force.getX();
+                    gradient(j, 1) += force.getY();
+                    gradient(j, 2) += force.getZ();
+                }
+            }
+            return gradient;
+        }
+
+        /*
+         * The SCF energy is stationary in the MO coefficients, so its gradient
+         * needs the derivatives of the integrals only: Hellmann-Feynman terms of
+         * the moving nuclei and ECPs and Pulay terms of the moving basis functions,
+         * the orthonormality of the MOs enters with the energy weighted density
+         * W = 2 sum_occ e_i C_i C_i^T. The integral derivatives come from the block
+         * kernels evaluated for derivative shells, no SCF is repeated. The grid
+         * moves with the atoms, so the XC term includes the derivatives of the
+         * grid weights and the gradient is that of the energy on this grid.
+         */
+        ub::matrix<double> DFTENGINE::EvaluateGradient(Orbitals* _orbitals) {
+            if (!_with_RI) {
+                throw runtime_error("DFTENGINE::EvaluateGradient: gradients require the RI approximation");
+            }
+            if (_ScaHFX > 0) {
+                throw runtime_error("DFTENGINE::EvaluateGradient: gradients of hybrid functionals are not implemented");
+            }
+            if (_addexternalsites || _do_externalfield) {
+                throw runtime_error("DFTENGINE::EvaluateGradient: gradients in external fields are not implemented");
+            }
+            for (unsigned i = 0; i < _dftbasis.getNumofShells(); i++) {
+                if (_dftbasis.getShell(i)->getLmax() > 3) {
+                    throw runtime_error("DFTENGINE::EvaluateGradient: gradients of basis sets with g functions are not implemented");
+                }
+            }
+#ifdef _OPENMP
+            omp_set_num_threads(_openmp_threads);
+#endif
+            const int natoms = _atoms.size();
+            const int nocc = _numofelectrons / 2;
+            const ub::matrix<double>& MOCoeff = _orbitals->MOCoefficients();
+            const ub::vector<double>& MOEnergies = _orbitals->MOEnergies();
+            const ub::matrix<double> dmat = _orbitals->DensityMatrixGroundState();
+            const ub::matrix<double> occupied = ub::project(MOCoeff, ub::range(0, nocc), ub::range(0, MOCoeff.size2()));
+            ub::matrix<double> weighted = occupied;
+            for (int i = 0; i < nocc; i++) {
+                ub::row(weighted, i) *= 2.0 * MOEnergies(i);
+            }
+            const ub::matrix<double> edmat = ub::prod(ub::trans(occupied), weighted);
+
+            ub::matrix<double> gradient = NuclearRepulsionGradient();
+            gradient += _dftAOkinetic.FillGradient(_dftbasis, dmat, natoms);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Kinetic energy gradient " << flush;
+            gradient += _dftAOESP.NuclearGradient(_dftbasis, _atoms, dmat, _with_ecp);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Nuclear attraction gradient " << flush;
+            if (_with_ecp) {
+                gradient += _dftAOECP.FillECPGradient(_dftbasis, _ecp, dmat, natoms);
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " ECP gradient " << flush;
+            }
+            gradient -= _dftAOoverlap.FillGradient(_dftbasis, edmat, natoms);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Overlap gradient " << flush;
+            gradient += _ERIs.CalculateGradient(_dftbasis, _auxbasis, dmat, natoms);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " RI Coulomb gradient " << flush;
+            gradient += _gridIntegration.IntegrateVXCGradient(dmat, natoms);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Exchange-correlation gradient " << flush;
+
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Ground state gradient [Ha/bohr]" << flush;
+            for (int i = 0; i < natoms; i++) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << (boost::format("\t\t %1$4d %2$-3s %3$+1.6e %4$+1.6e %5$+1.6e")
+                        % i % _atoms[i]->type % gradient(i, 0) % gradient(i, 1) % gradient(i, 2)).str() << flush;
+            }
+            return gradient;
+        }
+
         double DFTENGINE::ExternalRepulsion(ctp::Topology* top) {
             Elements element;
 
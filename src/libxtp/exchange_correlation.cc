@@ -31,7 +31,10 @@ using namespace std;
 
          void ExchangeCorrelation::getXC(int type, const double rho, const double drho_dX, const double drho_dY, const double drho_dZ, double& f, double& df_drho, double& df_dsigma) {
 
-            if (type == -1) evalLDA(rho, f, df_drho);
+            if (type == -1) {
+                evalLDA(rho, f, df_drho);
+                df_dsigma = 0.0;
+            }
             else if (type == -2) evalPBE(rho, drho_dX, drho_dY, drho_dZ, f, df_drho, df_dsigma );
 
             return;
@@ -19,7 +19,9 @@
 
 #include <votca/tools/linalg.h>
 #include <votca/xtp/forces.h>
+#include <votca/xtp/qmpackagefactory.h>
 #include <boost/format.hpp>
+#include <boost/filesystem.hpp>
 
 namespace votca {
     namespace xtp {
@@ -31,15 +33,18 @@ namespace votca {
             if (_nsegments > 1) throw runtime_error(string("\n Force calculation for more than 1 conjugated segment not supported. Stopping!"));
 
             // pre-check forces method
-            std::vector<string> choices = {"forward", "central"};
+            std::vector<string> choices = {"forward", "central", "analytic"};
             _force_method = options->ifExistsAndinListReturnElseThrowRuntimeError<string>(".method", choices);
 
             // output level
             _noisy_output = options->ifExistsReturnElseReturnDefault<bool>(".noisy", false); 
             
             
-            // precaution in case we implement approx. analytic forces in the future
-            if ((_force_method == "forward") || (_force_method == "central")) {
+            // analytic forces come from the gradient of the QM package,
+            // numerical_check compares them with central differences
+            _check_numerical = (_force_method == "analytic")
+                    && options->ifExistsReturnElseReturnDefault<bool>(".numerical_check", false);
+            if ((_force_method == "forward") || (_force_method == "central") || _check_numerical) {
                 _displacement = options->ifExistsReturnElseReturnDefault<double>(".displacement", 0.001); // Angstrom
             }
 
@@ -49,6 +54,17 @@ namespace votca {
             if (_force_removal == "total") _remove_total_force = true;
             if (_force_removal == "CoM") _remove_CoM_force = true;
 
+            // number of displaced geometries calculated at the same time,
+            // each in its own directory, DFT and GW-BSE of a task run with
+            // _task_threads, by default the available threads are split evenly
+            _tasks = options->ifExistsReturnElseReturnDefault<int>(".tasks", 1);
+            int _threads_per_task = 1;
+#ifdef _OPENMP
+            _threads_per_task = std::max(1, omp_get_max_threads() / std::max(1, _tasks));
+#endif
+            _task_threads = options->ifExistsReturnElseReturnDefault<int>(".threads", _threads_per_task);
+            _task_dir = options->ifExistsReturnElseReturnDefault<string>(".rundir", "forces");
+
             _natoms = _segments[0]->Atoms().size();
             _forces = ub::zero_matrix<double>(_natoms, 3);
 
@@ -59,6 +75,13 @@ namespace votca {
 
         void Forces::Calculate(const double& energy) {
 
+            if (_force_method == "analytic") {
+                AnalyticForce();
+                if (_check_numerical) CheckAnalyticForce(energy);
+                if (_remove_total_force) RemoveTotalForce();
+                return;
+            }
+
             ctp::TLogLevel _ReportLevel = _pLog->getReportLevel(); // backup report level
             if ( ! _noisy_output ){
                 _pLog->setReportLevel(ctp::logERROR); // go silent for force calculations
@@ -70,6 +93,13 @@ namespace votca {
             _qminterface.Orbitals2Segment(&_current_coordinates, _orbitals);
             _molecule.push_back(&_current_coordinates);
 
+            if (_tasks > 1) {
+                NumForceParallel(energy, _force_method == "central");
+                _pLog->setReportLevel(_ReportLevel);
+                if (_remove_total_force) RemoveTotalForce();
+                return;
+            }
+
             // displace all atoms in each Cartesian coordinate and get new energy
             std::vector< ctp::Atom* > _atoms;
             std::vector< ctp::Atom* > ::iterator ait;
@@ -101,8 +131,12 @@ namespace votca {
         void Forces::Report() {
 
             CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("   ---- FORCES (Hartree/Bohr)   ")).str() << flush;
-            CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("        %1$s differences   ") % _force_method).str() << flush;
-            CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("        displacement %1$1.4f Angstrom   ") % _displacement).str() << flush;
+            if (_force_method == "analytic") {
+                CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("        analytic gradient of %1$s   ") % _qmpackage->getPackageName()).str() << flush;
+            } else {
+                CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("        %1$s differences   ") % _force_method).str() << flush;
+                CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("        displacement %1$1.4f Angstrom   ") % _displacement).str() << flush;
+            }
             CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("   Atom\t x\t  y\t  z ")).str() << flush;
 
             for (unsigned _i = 0; _i < _forces.size1(); _i++) {
@@ -114,6 +148,44 @@ namespace votca {
 
         }
 
+        /* Ground state forces from the nuclear gradient of the QM package */
+        void Forces::AnalyticForce() {
+
+            if (_spin_type != "ground") {
+                throw runtime_error("Forces: analytic forces are only available for spintype ground");
+            }
+            ub::matrix<double> _gradient;
+            if (!_qmpackage->Gradient(_orbitals, _gradient)) {
+                throw runtime_error("Forces: package " + _qmpackage->getPackageName() + " provides no nuclear gradient");
+            }
+            if (_gradient.size1() != _natoms) {
+                throw runtime_error("Forces: nuclear gradient does not cover all atoms of the segment");
+            }
+            _forces = -_gradient;
+            return;
+        }
+
+        /* Regression check of the analytic forces against central differences
+         * of the energy, meant for small molecules */
+        void Forces::CheckAnalyticForce(double energy) {
+
+            const ub::matrix<double> _analytic = _forces;
+            ctp::TLogLevel _ReportLevel = _pLog->getReportLevel();
+            if (!_noisy_output) _pLog->setReportLevel(ctp::logERROR);
+            NumForceParallel(energy, true);
+            _pLog->setReportLevel(_ReportLevel);
+            double _maxdeviation = 0.0;
+            for (unsigned _i_atom = 0; _i_atom < _natoms; _i_atom++) {
+                for (unsigned _i_cart = 0; _i_cart < 3; _i_cart++) {
+                    _maxdeviation = std::max(_maxdeviation, std::abs(_forces(_i_atom, _i_cart) - _analytic(_i_atom, _i_cart)));
+                }
+            }
+            CTP_LOG(ctp::logINFO, *_pLog) << (boost::format("FORCES largest deviation of analytic and central difference forces %1$1.3e Hartree/Bohr")
+                    % _maxdeviation).str() << flush;
+            _forces = _analytic;
+            return;
+        }
+
         /* Calculate forces on an atom numerically by forward differences */
         void Forces::NumForceForward(double energy, std::vector< ctp::Atom* > ::iterator ait, ub::matrix_range< ub::matrix<double> >& _force,
                 std::vector<ctp::Segment*> _molecule) {
@@ -210,6 +282,117 @@ namespace votca {
             return;
         }
 
+        /* Calculate forces on all atoms numerically, the displaced geometries
+         * are independent and run concurrently */
+        void Forces::NumForceParallel(double energy, bool central) {
+
+            if (!_package_options.exists("package.name")) {
+                throw runtime_error("Concurrent force calculation requires the DFT package options");
+            }
+
+            const int _nsigns = central ? 2 : 1;
+            const int _ndisplacements = 3 * _nsigns * _natoms;
+            std::vector<double> _energies(_ndisplacements, 0.0);
+            string _error;
+
+            CTP_LOG(ctp::logINFO, *_pLog) << "FORCES running " << _ndisplacements << " displacements in "
+                    << _tasks << " tasks with " << _task_threads << " threads each" << flush;
+
+            // the engines of a task open their own parallel regions
+#ifdef _OPENMP
+            const int _nested = omp_get_nested();
+            omp_set_nested(1);
+#endif
+            #pragma omp parallel for num_threads(_tasks) schedule(dynamic)
+            for (int _i_disp = 0; _i_disp < _ndisplacements; _i_disp++) {
+                const int _i_atom = _i_disp / (3 * _nsigns);
+                const int _i_cart = (_i_disp / _nsigns) % 3;
+                const double _sign = (_i_disp % _nsigns == 0) ? 1.0 : -1.0;
+                // an exception must not leave the parallel region
+                try {
+                    _energies[_i_disp] = DisplacedEnergy(_i_atom, _i_cart, _sign);
+                } catch (std::exception& _e) {
+                    #pragma omp critical
+                    _error = _e.what();
+                }
+            }
+#ifdef _OPENMP
+            omp_set_nested(_nested);
+#endif
+            if (!_error.empty()) throw runtime_error(_error);
+
+            const double _step = _displacement * votca::tools::conv::ang2bohr;
+            for (unsigned _i_atom = 0; _i_atom < _natoms; _i_atom++) {
+                for (unsigned _i_cart = 0; _i_cart < 3; _i_cart++) {
+                    const int _index = _nsigns * (3 * _i_atom + _i_cart);
+                    if (central) {
+                        _forces(_i_atom, _i_cart) = 0.5 * (_energies[_index + 1] - _energies[_index]) / _step;
+                    } else {
+                        _forces(_i_atom, _i_cart) = (energy - _energies[_index]) / _step;
+                    }
+                }
+            }
+            return;
+        }
+
+        /* Energy of the optimized state with one atom displaced, runs DFT and
+         * GW-BSE in a separate directory with its own package and orbitals */
+        double Forces::DisplacedEnergy(int _i_atom, int _i_cart, double _sign) {
+
+            const string _run_dir = (boost::format("%1%/atom%2%_%3%%4%") % _task_dir % _i_atom
+                    % "xyz"[_i_cart] % (_sign > 0.0 ? "+" : "-")).str();
+            boost::filesystem::create_directories(_run_dir);
+
+            // own copy of the geometry, other tasks work on the same orbitals
+            QMMInterface _interface;
+            ctp::Segment _displaced_coordinates(0, "mol");
+            _interface.Orbitals2Segment(&_displaced_coordinates, _orbitals);
+            std::vector< ctp::Segment* > _molecule;
+            _molecule.push_back(&_displaced_coordinates);
+
+            vec _displaced(0, 0, 0);
+            if (_i_cart == 0) _displaced.setX(_sign * _displacement * tools::conv::ang2nm);
+            if (_i_cart == 1) _displaced.setY(_sign * _displacement * tools::conv::ang2nm);
+            if (_i_cart == 2) _displaced.setZ(_sign * _displacement * tools::conv::ang2nm);
+            ctp::Atom* _atom = _displaced_coordinates.Atoms()[_i_atom];
+            _atom->setQMPos(_atom->getQMPos() + _displaced);
+
+            ctp::Logger _task_log(_pLog->getReportLevel());
+            QMPackage* _task_package = QMPackages().Create(_package_options.get("package.name").as<string> ());
+            _task_package->setLog(&_task_log);
+            _task_package->Initialize(&_package_options);
+            _task_package->setRunDir(_run_dir);
+            _task_package->setThreads(_task_threads);
+
+            // copy of the engine, starts from the results of the reference geometry
+            GWBSEENGINE _task_engine = _gwbse_engine;
+            _task_engine.setLog(&_task_log);
+            _task_engine.setLoggerFile(_run_dir + "/gwbse.log");
+            _task_engine.setThreads(_task_threads);
+
+            Orbitals _displaced_orbitals;
+            try {
+                _task_engine.ExcitationEnergies(_task_package, _molecule, &_displaced_orbitals);
+            } catch (...) {
+                delete _task_package;
+                #pragma omp critical
+                {
+                    CTP_LOG(ctp::logERROR, *_pLog) << "FORCES failed " << _run_dir << "\n" << _task_log << flush;
+                }
+                throw;
+            }
+            delete _task_package;
+
+            // tasks finish in any order, keep the output of each one together
+            if ( _noisy_output ){
+                #pragma omp critical
+                {
+                    CTP_LOG(ctp::logINFO, *_pLog) << "FORCES--DEBUG finished " << _run_dir << "\n" << _task_log << flush;
+                }
+            }
+            return _displaced_orbitals.GetTotalEnergy(_spin_type, _opt_state);
+        }
+
         /* Adjust forces so that sum of forces is zero */
         void Forces::RemoveTotalForce() {
 
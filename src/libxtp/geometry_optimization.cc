@@ -41,7 +41,7 @@ namespace votca {
             _optimizer_options = options->get(".optimizer");
 
             // pre-check forces method
-            choices = {"forward", "central"};
+            choices = {"forward", "central", "analytic"};
             _force_method = options->ifExistsAndinListReturnElseThrowRuntimeError<string>(".forces.method", choices);
             _force_options = options->get(".forces");
 
@@ -60,6 +60,7 @@ namespace votca {
             Forces _force_engine(_gwbse_engine, _qmpackage, _segments, _orbitals);
             _force_engine.Initialize(&_force_options);
             _force_engine.setLog(_pLog);
+            _force_engine.setPackageOptions(_package_options);
             _force_engine.SetOptState(_opt_state);
             _force_engine.SetSpinType(_spintype);
 
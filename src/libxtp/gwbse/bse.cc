@@ -24,6 +24,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/numeric/ublas/operation.hpp>
 #include <votca/xtp/aomatrix.h>
+#include <votca/xtp/bse_operator.h>
 #include <votca/xtp/threecenters.h>
 // #include <votca/xtp/logger.h>
 #include <votca/xtp/qmpackagefactory.h>
@@ -54,15 +55,125 @@ namespace votca {
 
         void GWBSE::BSE_solve_triplets(){
             
-            // add full QP Hamiltonian contributions to free transitions
+            // falls back to the full diagonalization if Davidson does not converge
+            if ( _do_davidson ){
+                BSEOperator _bse(_eh_d);
+                if ( BSE_solve_davidson( _bse, _bse_triplet_guess, _bse_triplet_energies, _bse_triplet_coefficients ) ) return;
+            }
+           
+            if ( _do_mixed_precision ){
+                ub::matrix<float> _bse_float = _eh_d;
+                BSEOperator _refine(_eh_d);
+                if ( BSE_solve_mixed( _bse_float, _refine, _bse_triplet_energies, _bse_triplet_coefficients ) ) return;
+            }
            
             ub::matrix<real_gwbse> _bse=_eh_d;
-            
             linalg_eigenvalues(  _bse, _bse_triplet_energies, _bse_triplet_coefficients, _bse_nmax);
             return;
         }
         
         
+        bool GWBSE::BSE_solve_mixed(ub::matrix<float>& _bse_float, const MatrixFreeOperator& H, ub::vector<real_gwbse>& energies, ub::matrix<real_gwbse>& coefficients){
+            
+            // eigenvectors from a single precision diagonalization are
+            // accurate to about 1e-7 relative, a few Davidson steps with the
+            // double precision Hamiltonian restore the full accuracy
+            ub::vector<float> _energies_float;
+            ub::matrix<float> _coefficients_float;
+            linalg_eigenvalues( _bse_float, _energies_float, _coefficients_float, _bse_nmax );
+            _bse_float.resize(0,0);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Diagonalized BSE in single precision " << flush;
+            
+            DavidsonSolver _davidson(_pLog);
+            _davidson.setTolerance(_davidson_tolerance);
+            _davidson.setMaxIterations(_davidson_maxiter);
+            _davidson.setInitialGuess(_coefficients_float);
+            if ( !_davidson.Solve(H, _coefficients_float.size2()) ){
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Refinement in double precision did not converge " << flush;
+                return false;
+            }
+            
+            energies = _davidson.eigenvalues();
+            coefficients = _davidson.eigenvectors();
+            return true;
+        }
+        
+        
+        bool GWBSE::BSE_solve_davidson(const MatrixFreeOperator& H, const ub::matrix<double>& guess, ub::vector<real_gwbse>& energies, ub::matrix<real_gwbse>& coefficients){
+            
+            // only the lowest _bse_nmax roots are determined iteratively,
+            // unconverged eigenpairs are not returned
+            DavidsonSolver _davidson(_pLog);
+            _davidson.setTolerance(_davidson_tolerance);
+            _davidson.setMaxIterations(_davidson_maxiter);
+            // eigenvectors of a previous geometry, ignored if the BSE basis changed
+            if ( int(guess.size1()) == H.size() && int(guess.size2()) >= _bse_nmax ){
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Starting Davidson from previous BSE eigenvectors " << flush;
+                _davidson.setInitialGuess(guess);
+            }
+            if ( !_davidson.Solve(H, _bse_nmax) ){
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Davidson solver did not converge " << flush;
+                return false;
+            }
+            
+            energies = _davidson.eigenvalues();
+            coefficients = _davidson.eigenvectors();
+            return true;
+        }
+        
+        
+        void GWBSE::BSE_solve_matrixfree(const TCMatrix& _Mmn){
+            
+            // e-h interaction is evaluated from Mmn whenever it is applied,
+            // _eh_d, _eh_d2 and _eh_x are never set up
+            // out of core the operator loads the BSE levels in tiles whenever it is applied
+            BSEDirectOperator _bse(_Mmn, _ppm_weight, _vxc, _bse_vmin, _bse_vtotal, _bse_cmin, _bse_ctotal);
+            _bse_operator = &_bse;
+            
+            if ( _do_bse_triplets ){
+                BSEDirectOperator _triplet = _bse;
+                _triplet.setFactors(1.0, 1.0, 0.0, 0.0);
+                if ( !BSE_solve_davidson( _triplet, _bse_triplet_guess, _bse_triplet_energies, _bse_triplet_coefficients ) ){
+                    throw std::runtime_error("GWBSE: matrix-free BSE for triplets did not converge, increase davidson.maxiter");
+                }
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Solved matrix-free BSE for triplets " << flush;
+                BSE_analyze_triplets();
+            }
+            
+            if ( _do_bse_singlets && _do_full_BSE ){
+                // A+B = H_qp + K_d + K_d2 + 4 K_x, A-B = H_qp + K_d - K_d2
+                BSEDirectOperator _ApB = _bse;
+                _ApB.setFactors(1.0, 1.0, 1.0, 4.0);
+                BSEDirectOperator _AmB = _bse;
+                _AmB.setFactors(1.0, 1.0, -1.0, 0.0);
+                
+                DavidsonSolver _davidson(_pLog);
+                _davidson.setTolerance(_davidson_tolerance);
+                _davidson.setMaxIterations(_davidson_maxiter);
+                if ( !_davidson.SolveBTDA(_ApB, _AmB, _bse_nmax) ){
+                    throw std::runtime_error("GWBSE: matrix-free full BSE for singlets did not converge, increase davidson.maxiter");
+                }
+                
+                _bse_singlet_energies = _davidson.eigenvalues();
+                _bse_singlet_coefficients = _davidson.eigenvectors();
+                _bse_singlet_coefficients_AR = _davidson.eigenvectors_AR();
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Solved matrix-free full BSE for singlets " << flush;
+                BSE_analyze_singlets_BTDA();
+            } else if ( _do_bse_singlets ){
+                BSEDirectOperator _singlet = _bse;
+                _singlet.setFactors(1.0, 1.0, 0.0, 2.0);
+                if ( !BSE_solve_davidson( _singlet, _bse_singlet_guess, _bse_singlet_energies, _bse_singlet_coefficients ) ){
+                    throw std::runtime_error("GWBSE: matrix-free BSE for singlets did not converge, increase davidson.maxiter");
+                }
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Solved matrix-free BSE for singlets " << flush;
+                BSE_analyze_singlets();
+            }
+            
+            _bse_operator = NULL;
+            return;
+        }
+        
+        
         void GWBSE::Solve_nonhermitian(ub::matrix<double>& H, ub::matrix<double>& LT) {
 
             // remove stuff from Cholesky and Calculated L^T,, because more efficient for mat prods 
@@ -197,6 +308,18 @@ namespace votca {
    
         
       void GWBSE::BSE_solve_singlets(){
+          
+            // falls back to the full diagonalization if Davidson does not converge
+            if ( _do_davidson ){
+                BSEOperator _bse(_eh_d, _eh_x, 2.0);
+                if ( BSE_solve_davidson( _bse, _bse_singlet_guess, _bse_singlet_energies, _bse_singlet_coefficients ) ) return;
+            }
+            
+            if ( _do_mixed_precision ){
+                ub::matrix<float> _bse_float = _eh_d + 2.0 * _eh_x;
+                BSEOperator _refine(_eh_d, _eh_x, 2.0);
+                if ( BSE_solve_mixed( _bse_float, _refine, _bse_singlet_energies, _bse_singlet_coefficients ) ) return;
+            }
             
             ub::matrix<real_gwbse> _bse = _eh_d + 2.0 * _eh_x;
             
@@ -207,41 +330,68 @@ namespace votca {
         
         
         void GWBSE::BSE_d_setup ( TCMatrix& _Mmn){
+#if (GWBSE_DOUBLE)
+            // the intermediates are single precision from the start, so no
+            // double copy of them is alive during the products
+            if ( _do_mixed_precision ){
+                BSE_d_setup_storage<float>( _Mmn );
+                return;
+            }
+#endif
+            BSE_d_setup_storage<real_gwbse>( _Mmn );
+            return;
+        }
+        
+        
+        template<typename T>
+        void GWBSE::BSE_d_setup_storage ( TCMatrix& _Mmn){
             // gwbasis size
-            size_t _gwsize = _Mmn[_homo].size1();
+            size_t _gwsize = _Mmn.get_beta();
+            // out of core the levels are read in tiles
+            const size_t _tile = _Mmn.TileSize();
 
             // messy procedure, first get two matrices for occ and empty subbparts
             // store occs directly transposed
-            ub::matrix<real_gwbse> _storage_v = ub::zero_matrix<real_gwbse>(  _bse_vtotal * _bse_vtotal , _gwsize );
-            #pragma omp parallel for
-            for ( size_t _v1 = 0; _v1 < _bse_vtotal; _v1++){
-                const ub::matrix<real_gwbse>& Mmn = _Mmn[_v1 + _bse_vmin ];
-                for ( size_t _v2 = 0; _v2 < _bse_vtotal; _v2++){
-                    size_t _index_vv = _bse_vtotal * _v1 + _v2;
-                    for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
-                        _storage_v( _index_vv , _i_gw ) = Mmn( _i_gw , _v2 + _bse_vmin );
+            ub::matrix<T> _storage_v = ub::zero_matrix<T>(  _bse_vtotal * _bse_vtotal , _gwsize );
+            for ( size_t _start = 0; _start < _bse_vtotal; _start += _tile ){
+                const size_t _end = std::min<size_t>(_start + _tile, _bse_vtotal);
+                _Mmn.Load(_start + _bse_vmin, _end + _bse_vmin);
+                #pragma omp parallel for
+                for ( size_t _v1 = _start; _v1 < _end; _v1++){
+                    const ub::matrix<real_gwbse>& Mmn = _Mmn[_v1 + _bse_vmin ];
+                    for ( size_t _v2 = 0; _v2 < _bse_vtotal; _v2++){
+                        size_t _index_vv = _bse_vtotal * _v1 + _v2;
+                        for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
+                            _storage_v( _index_vv , _i_gw ) = Mmn( _i_gw , _v2 + _bse_vmin );
+                        }
                     }
                 }
+                _Mmn.Release(_start + _bse_vmin, _end + _bse_vmin);
             }
             
             
-            ub::matrix<real_gwbse> _storage_c = ub::zero_matrix<real_gwbse>( _gwsize, _bse_ctotal * _bse_ctotal );
-            #pragma omp parallel for
-            for ( size_t _c1 = 0; _c1 < _bse_ctotal; _c1++){
-                const ub::matrix<real_gwbse>& Mmn = _Mmn[_c1 + _bse_cmin];
-                for ( size_t _c2 = 0; _c2 < _bse_ctotal; _c2++){
-                    size_t _index_cc = _bse_ctotal * _c1 + _c2;
-                    for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
-                        _storage_c( _i_gw , _index_cc ) = Mmn( _i_gw , _c2 + _bse_cmin );
+            ub::matrix<T> _storage_c = ub::zero_matrix<T>( _gwsize, _bse_ctotal * _bse_ctotal );
+            for ( size_t _start = 0; _start < _bse_ctotal; _start += _tile ){
+                const size_t _end = std::min<size_t>(_start + _tile, _bse_ctotal);
+                _Mmn.Load(_start + _bse_cmin, _end + _bse_cmin);
+                #pragma omp parallel for
+                for ( size_t _c1 = _start; _c1 < _end; _c1++){
+                    const ub::matrix<real_gwbse>& Mmn = _Mmn[_c1 + _bse_cmin];
+                    for ( size_t _c2 = 0; _c2 < _bse_ctotal; _c2++){
+                        size_t _index_cc = _bse_ctotal * _c1 + _c2;
+                        for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
+                            _storage_c( _i_gw , _index_cc ) = Mmn( _i_gw , _c2 + _bse_cmin );
+                        }
                     }
                 }
+                _Mmn.Release(_start + _bse_cmin, _end + _bse_cmin);
             }
             
             if ( ! _do_bse_singlets )  _Mmn.Cleanup();
             
             // store elements in a vtotal^2 x ctotal^2 matrix
             // cout << "BSE_d_setup 1 [" << _storage_v.size1() << "x" << _storage_v.size2() << "]\n" << std::flush;
-            ub::matrix<real_gwbse> _storage_prod = ub::prod( _storage_v , _storage_c );
+            ub::matrix<T> _storage_prod = ub::prod( _storage_v , _storage_c );
             
 
             // now patch up _storage for screened interaction
@@ -268,7 +418,7 @@ namespace votca {
             
             // multiply and subtract from _storage_prod
          
-            _storage_prod -= ub::prod( _storage_v , _storage_c );
+            ub::noalias(_storage_prod) -= ub::prod( _storage_v , _storage_c );
             
             // free storage_v and storage_c
             _storage_c.resize(0,0);
@@ -301,39 +451,64 @@ namespace votca {
         
         
          void GWBSE::BSE_d2_setup ( TCMatrix& _Mmn){
+#if (GWBSE_DOUBLE)
+            if ( _do_mixed_precision ){
+                BSE_d2_setup_storage<float>( _Mmn );
+                return;
+            }
+#endif
+            BSE_d2_setup_storage<real_gwbse>( _Mmn );
+            return;
+        }
+        
+        
+        template<typename T>
+        void GWBSE::BSE_d2_setup_storage ( TCMatrix& _Mmn){
             // gwbasis size
-            size_t _gwsize = _Mmn[_homo].size1();
+            size_t _gwsize = _Mmn.get_beta();
+            // out of core the levels are read in tiles
+            const size_t _tile = _Mmn.TileSize();
 
             // messy procedure, first get two matrices for occ and empty subbparts
             // store occs directly transposed
-            ub::matrix<real_gwbse> _storage_cv = ub::zero_matrix<real_gwbse>(  _bse_vtotal * _bse_ctotal , _gwsize );
-            #pragma omp parallel for
-            for ( size_t _c1 = 0; _c1 < _bse_ctotal; _c1++){
-                const ub::matrix<real_gwbse>& Mmn = _Mmn[_c1 + _bse_cmin ];
-                for ( size_t _v2 = 0; _v2 < _bse_vtotal; _v2++){
-                    size_t _index_cv = _bse_vtotal * _c1 + _v2;
-                    for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
-                        _storage_cv( _index_cv , _i_gw ) = Mmn( _i_gw , _v2 + _bse_vmin );
+            ub::matrix<T> _storage_cv = ub::zero_matrix<T>(  _bse_vtotal * _bse_ctotal , _gwsize );
+            for ( size_t _start = 0; _start < _bse_ctotal; _start += _tile ){
+                const size_t _end = std::min<size_t>(_start + _tile, _bse_ctotal);
+                _Mmn.Load(_start + _bse_cmin, _end + _bse_cmin);
+                #pragma omp parallel for
+                for ( size_t _c1 = _start; _c1 < _end; _c1++){
+                    const ub::matrix<real_gwbse>& Mmn = _Mmn[_c1 + _bse_cmin ];
+                    for ( size_t _v2 = 0; _v2 < _bse_vtotal; _v2++){
+                        size_t _index_cv = _bse_vtotal * _c1 + _v2;
+                        for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
+                            _storage_cv( _index_cv , _i_gw ) = Mmn( _i_gw , _v2 + _bse_vmin );
+                        }
                     }
                 }
+                _Mmn.Release(_start + _bse_cmin, _end + _bse_cmin);
             }
          
-            ub::matrix<real_gwbse> _storage_vc = ub::zero_matrix<real_gwbse>( _gwsize, _bse_vtotal * _bse_ctotal );
-            #pragma omp parallel for
-            for ( size_t _v1 = 0; _v1 < _bse_vtotal; _v1++){
-                const ub::matrix<real_gwbse>& Mmn = _Mmn[_v1 + _bse_vmin];
-                for ( size_t _c2 = 0; _c2 < _bse_ctotal; _c2++){
-                    size_t _index_vc = _bse_ctotal * _v1 + _c2;
-                    for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
-                        _storage_vc( _i_gw , _index_vc ) = Mmn( _i_gw , _c2 + _bse_cmin );
+            ub::matrix<T> _storage_vc = ub::zero_matrix<T>( _gwsize, _bse_vtotal * _bse_ctotal );
+            for ( size_t _start = 0; _start < _bse_vtotal; _start += _tile ){
+                const size_t _end = std::min<size_t>(_start + _tile, _bse_vtotal);
+                _Mmn.Load(_start + _bse_vmin, _end + _bse_vmin);
+                #pragma omp parallel for
+                for ( size_t _v1 = _start; _v1 < _end; _v1++){
+                    const ub::matrix<real_gwbse>& Mmn = _Mmn[_v1 + _bse_vmin];
+                    for ( size_t _c2 = 0; _c2 < _bse_ctotal; _c2++){
+                        size_t _index_vc = _bse_ctotal * _v1 + _c2;
+                        for ( size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++) {
+                            _storage_vc( _i_gw , _index_vc ) = Mmn( _i_gw , _c2 + _bse_cmin );
+                        }
                     }
                 }
+                _Mmn.Release(_start + _bse_vmin, _end + _bse_vmin);
             }
             
             if ( ! _do_bse_singlets )  _Mmn.Cleanup();
             
             // store elements in a vtotal^2 x ctotal^2 matrix
-            ub::matrix<real_gwbse> _storage_prod = ub::prod( _storage_cv , _storage_vc );
+            ub::matrix<T> _storage_prod = ub::prod( _storage_cv , _storage_vc );
        
             
             // now patch up _storage for screened interaction
@@ -358,7 +533,7 @@ namespace votca {
             }
          
             // multiply and subtract from _storage_prod
-            _storage_prod -= ub::prod( _storage_cv , _storage_vc );
+            ub::noalias(_storage_prod) -= ub::prod( _storage_cv , _storage_vc );
             
             // free storage_v and storage_c
             _storage_cv.resize(0,0);
@@ -396,7 +571,9 @@ namespace votca {
              */
                         
             // gwbasis size
-            size_t _gwsize = _Mmn[_homo].size1();
+            size_t _gwsize = _Mmn.get_beta();
+            // out of core the levels are read in tiles
+            const size_t _tile = _Mmn.TileSize();
             
             // get a different storage for 3-center integrals we need
             //cout<< "Starting to set up "<< endl;
@@ -404,21 +581,34 @@ namespace votca {
             //cout<< "Storage set up"<< endl;
          
             // occupied levels
-            #pragma omp parallel for
-            for ( size_t _v = 0; _v < _bse_vtotal ; _v++ ){
-                // cout << " act threads: " << omp_get_thread_num( ) << " total threads " << omp_get_num_threads( ) << " max threads " << omp_get_max_threads( ) <<endl;
-                ub::matrix<real_gwbse>& Mmn = _Mmn[_v + _bse_vmin];
-                // empty levels
-                for (size_t _c =0 ; _c < _bse_ctotal ; _c++ ){
-                    size_t _index_vc = _bse_ctotal * _v + _c ;
-                    for (size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
-                        _storage( _i_gw, _index_vc ) = Mmn( _i_gw, _c + _bse_cmin);
+            for ( size_t _start = 0; _start < _bse_vtotal; _start += _tile ){
+                const size_t _end = std::min<size_t>(_start + _tile, _bse_vtotal);
+                _Mmn.Load(_start + _bse_vmin, _end + _bse_vmin);
+                #pragma omp parallel for
+                for ( size_t _v = _start; _v < _end ; _v++ ){
+                    // cout << " act threads: " << omp_get_thread_num( ) << " total threads " << omp_get_num_threads( ) << " max threads " << omp_get_max_threads( ) <<endl;
+                    ub::matrix<real_gwbse>& Mmn = _Mmn[_v + _bse_vmin];
+                    // empty levels
+                    for (size_t _c =0 ; _c < _bse_ctotal ; _c++ ){
+                        size_t _index_vc = _bse_ctotal * _v + _c ;
+                        for (size_t _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
+                            _storage( _i_gw, _index_vc ) = Mmn( _i_gw, _c + _bse_cmin);
+                        }
                     }
                 }
+                _Mmn.Release(_start + _bse_vmin, _end + _bse_vmin);
             }
             
             _Mmn.Cleanup();   
             // with this storage, _eh_x is obtained by matrix multiplication
+#if (GWBSE_DOUBLE)
+            if ( _do_mixed_precision ){
+                const ub::matrix<float> _storage_float = _storage;
+                _storage.resize(0,0);
+                _eh_x = ub::prod( ub::trans( _storage_float ), _storage_float );
+                return;
+            }
+#endif
 	    _eh_x = ub::prod( ub::trans( _storage ), _storage ); 
             return;    
         }
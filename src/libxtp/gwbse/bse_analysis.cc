@@ -18,6 +18,7 @@
  */
 
 #include <votca/xtp/gwbse.h>
+#include <votca/xtp/bse_operator.h>
 
 using boost::format;
 using namespace boost::filesystem;
@@ -117,7 +118,22 @@ namespace votca {
          void GWBSE::BSE_analyze_eh_interaction_BTDA_singlet(std::vector<real_gwbse>& _c_x, std::vector<real_gwbse>& _c_d, std::vector<real_gwbse>& _c_qp) {
 
 
-            if (tools::globals::verbose) {
+            if (tools::globals::verbose && _bse_operator != NULL) {
+                // matrix-free: apply K_d and K_x to all printed excitations at once
+                ub::matrix<double> _slice_R = ub::project(_bse_singlet_coefficients, ub::range(0, _bse_size), ub::range(0, _bse_nprint));
+                ub::matrix<double> _slice_AR = ub::project(_bse_singlet_coefficients_AR, ub::range(0, _bse_size), ub::range(0, _bse_nprint));
+                ub::matrix<double> _Kd_R = _bse_operator->matmul(_slice_R, 0.0, 1.0, 0.0, 0.0);
+                ub::matrix<double> _Kd_AR = _bse_operator->matmul(_slice_AR, 0.0, 1.0, 0.0, 0.0);
+                ub::matrix<double> _Kx_R = _bse_operator->matmul(_slice_R, 0.0, 0.0, 0.0, 1.0);
+                ub::matrix<double> _Kx_AR = _bse_operator->matmul(_slice_AR, 0.0, 0.0, 0.0, 1.0);
+                for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
+                    _c_d[_i_exc] = ub::inner_prod(ub::column(_slice_R, _i_exc), ub::column(_Kd_R, _i_exc))
+                                 - ub::inner_prod(ub::column(_slice_AR, _i_exc), ub::column(_Kd_AR, _i_exc));
+                    _c_x[_i_exc] = 2.0 * ub::inner_prod(ub::column(_slice_R, _i_exc), ub::column(_Kx_R, _i_exc))
+                                 - 2.0 * ub::inner_prod(ub::column(_slice_AR, _i_exc), ub::column(_Kx_AR, _i_exc));
+                    _c_qp[_i_exc] = _bse_singlet_energies(_i_exc) - _c_d[_i_exc] - _c_x[_i_exc];
+                }
+            } else if (tools::globals::verbose) {
                 for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
 
                     ub::matrix<real_gwbse> _slice_R = ub::project(_bse_singlet_coefficients, ub::range(0, _bse_size), ub::range(_i_exc, _i_exc + 1));
@@ -164,7 +180,16 @@ namespace votca {
 
         void GWBSE::BSE_analyze_eh_interaction_Singlet(std::vector<real_gwbse>& _c_x, std::vector<real_gwbse>& _c_d, std::vector<real_gwbse>& _c_qp) {
 
-            if (tools::globals::verbose) {
+            if (tools::globals::verbose && _bse_operator != NULL) {
+                ub::matrix<double> _slice = ub::project(_bse_singlet_coefficients, ub::range(0, _bse_size), ub::range(0, _bse_nprint));
+                ub::matrix<double> _Kd = _bse_operator->matmul(_slice, 0.0, 1.0, 0.0, 0.0);
+                ub::matrix<double> _Kx = _bse_operator->matmul(_slice, 0.0, 0.0, 0.0, 1.0);
+                for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
+                    _c_d[_i_exc] = ub::inner_prod(ub::column(_slice, _i_exc), ub::column(_Kd, _i_exc));
+                    _c_x[_i_exc] = 2.0 * ub::inner_prod(ub::column(_slice, _i_exc), ub::column(_Kx, _i_exc));
+                    _c_qp[_i_exc] = _bse_singlet_energies(_i_exc) - _c_d[_i_exc] - _c_x[_i_exc];
+                }
+            } else if (tools::globals::verbose) {
                 for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
 
                     ub::matrix<real_gwbse> _slice = ub::project(_bse_singlet_coefficients, ub::range(0, _bse_size), ub::range(_i_exc, _i_exc + 1));
@@ -187,7 +212,14 @@ namespace votca {
         
         void GWBSE::BSE_analyze_eh_interaction_Triplet(std::vector<real_gwbse>& _c_d, std::vector<real_gwbse>& _c_qp) {
 
-            if (tools::globals::verbose) {
+            if (tools::globals::verbose && _bse_operator != NULL) {
+                ub::matrix<double> _slice = ub::project(_bse_triplet_coefficients, ub::range(0, _bse_size), ub::range(0, _bse_nprint));
+                ub::matrix<double> _Kd = _bse_operator->matmul(_slice, 0.0, 1.0, 0.0, 0.0);
+                for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
+                    _c_d[_i_exc] = ub::inner_prod(ub::column(_slice, _i_exc), ub::column(_Kd, _i_exc));
+                    _c_qp[_i_exc] = _bse_triplet_energies(_i_exc) - _c_d[_i_exc];
+                }
+            } else if (tools::globals::verbose) {
                 for (int _i_exc = 0; _i_exc < _bse_nprint; _i_exc++) {
 
                     ub::matrix<real_gwbse> _slice = ub::project(_bse_triplet_coefficients, ub::range(0, _bse_size), ub::range(_i_exc, _i_exc + 1));
@@ -0,0 +1,323 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <votca/xtp/bse_operator.h>
+
+#include <boost/numeric/ublas/matrix_proxy.hpp>
+#include <boost/numeric/ublas/operation.hpp>
+#include <votca/tools/linalg.h>
+
+namespace votca {
+namespace xtp {
+namespace ub = boost::numeric::ublas;
+
+ub::vector<double> BSEOperator::diagonal() const {
+  const int dim = size();
+  ub::vector<double> diag(dim);
+  for (int i = 0; i < dim; i++) {
+    diag(i) = (*_eh_d)(i, i);
+    if (_eh_x != NULL) diag(i) += _xfactor * (*_eh_x)(i, i);
+  }
+  return diag;
+}
+
+ub::matrix<double> BSEOperator::matmul(const ub::matrix<double>& X) const {
+#if (GWBSE_DOUBLE)
+  const ub::matrix<double>& X_bse = X;
+#else
+  const ub::matrix<float> X_bse = X;
+#endif
+  ub::matrix<real_gwbse> result = ub::prod(*_eh_d, X_bse);
+  if (_eh_x != NULL) {
+    result += _xfactor * ub::prod(*_eh_x, X_bse);
+  }
+  return result;
+}
+
+BSEDirectOperator::BSEDirectOperator(const TCMatrix& Mmn,
+                                     const ub::vector<double>& ppm_weight,
+                                     const ub::matrix<double>& Hqp,
+                                     unsigned vmin, unsigned vtotal,
+                                     unsigned cmin, unsigned ctotal)
+    : _Mmn(&Mmn),
+      _vmin(vmin),
+      _vtotal(vtotal),
+      _cmin(cmin),
+      _ctotal(ctotal),
+      _qpfactor(1.0),
+      _dfactor(1.0),
+      _d2factor(0.0),
+      _xfactor(0.0) {
+  _gwsize = Mmn.get_beta();
+
+  // same screening as in the dense setup, weights below 1e-9 count as zero
+  _screening = ub::vector<double>(_gwsize);
+  for (unsigned i_gw = 0; i_gw < _gwsize; i_gw++) {
+    _screening(i_gw) =
+        (ppm_weight(i_gw) < 1.e-9) ? 1.0 : 1.0 - ppm_weight(i_gw);
+  }
+
+  // QP Hamiltonian blocks, indexed as in GWBSE::BSE_Add_qp2H
+  _Hqp_v = ub::project(Hqp, ub::range(0, _vtotal), ub::range(0, _vtotal));
+  _Hqp_c = ub::project(Hqp, ub::range(_vtotal, _vtotal + _ctotal),
+                       ub::range(_vtotal, _vtotal + _ctotal));
+}
+
+unsigned BSEDirectOperator::TileSize() const {
+  // a tile of occupied and one of virtual levels are loaded at the same time
+  if (!_Mmn->OutOfCore()) return std::max(_vtotal, _ctotal);
+  return std::max(1, _Mmn->TileSize() / 2);
+}
+
+ub::vector<double> BSEDirectOperator::diagonal() const {
+  ub::vector<double> diag = ub::zero_vector<double>(size());
+  const unsigned tile = TileSize();
+  for (unsigned v_start = 0; v_start < _vtotal; v_start += tile) {
+    const unsigned v_end = std::min(_vtotal, v_start + tile);
+    _Mmn->Load(v_start + _vmin, v_end + _vmin);
+    for (unsigned c_start = 0; c_start < _ctotal; c_start += tile) {
+      const unsigned c_end = std::min(_ctotal, c_start + tile);
+      _Mmn->Load(c_start + _cmin, c_end + _cmin);
+#pragma omp parallel for
+      for (unsigned v = v_start; v < v_end; v++) {
+        const ub::matrix<real_gwbse>& Mv = (*_Mmn)[v + _vmin];
+        for (unsigned c = c_start; c < c_end; c++) {
+          const ub::matrix<real_gwbse>& Mc = (*_Mmn)[c + _cmin];
+          double d = 0.0;
+          double d2 = 0.0;
+          double x = 0.0;
+          for (unsigned i_gw = 0; i_gw < _gwsize; i_gw++) {
+            const double Mvc = Mv(i_gw, c + _cmin);
+            d -= _screening(i_gw) * Mv(i_gw, v + _vmin) * Mc(i_gw, c + _cmin);
+            d2 -= _screening(i_gw) * Mc(i_gw, v + _vmin) * Mvc;
+            x += Mvc * Mvc;
+          }
+          const double qp = _Hqp_c(c, c) - _Hqp_v(v, v);
+          diag(_ctotal * v + c) =
+              _qpfactor * qp + _dfactor * d + _d2factor * d2 + _xfactor * x;
+        }
+      }
+      _Mmn->Release(c_start + _cmin, c_end + _cmin);
+    }
+    _Mmn->Release(v_start + _vmin, v_end + _vmin);
+  }
+  return diag;
+}
+
+ub::matrix<double> BSEDirectOperator::matmul(const ub::matrix<double>& X,
+                                             double qp, double d, double d2,
+                                             double x) const {
+  const unsigned nvec = X.size2();
+
+  // QP and direct terms work on each vector reshaped to vtotal x ctotal,
+  // the reshaped vectors are stacked on top of each other in Yv
+  ub::matrix<double> Yv = ub::zero_matrix<double>(nvec * _vtotal, _ctotal);
+
+  if (qp != 0.0) {
+    // (H_qp x)(v,c) = sum_c2 Hc(c,c2) x(v,c2) - sum_v2 Hv(v,v2) x(v2,c)
+    ub::matrix<double> Xm(_vtotal, _ctotal);
+    for (unsigned k = 0; k < nvec; k++) {
+      for (unsigned v = 0; v < _vtotal; v++) {
+        for (unsigned c = 0; c < _ctotal; c++) {
+          Xm(v, c) = X(_ctotal * v + c, k);
+        }
+      }
+      ub::matrix<double> HX = ub::prod(Xm, ub::trans(_Hqp_c));
+      HX -= ub::prod(_Hqp_v, Xm);
+      ub::project(Yv, ub::range(k * _vtotal, (k + 1) * _vtotal),
+                  ub::range(0, _ctotal)) += qp * HX;
+    }
+  }
+
+  if (d != 0.0 || d2 != 0.0) Add_direct(X, Yv, d, d2);
+
+  ub::matrix<double> Y(size(), nvec);
+  for (unsigned k = 0; k < nvec; k++) {
+    for (unsigned v = 0; v < _vtotal; v++) {
+      for (unsigned c = 0; c < _ctotal; c++) {
+        Y(_ctotal * v + c, k) = Yv(k * _vtotal + v, c);
+      }
+    }
+  }
+  Yv.resize(0, 0);
+
+  if (x != 0.0) Add_exchange(X, Y, x);
+  return Y;
+}
+
+void BSEDirectOperator::Add_direct(const ub::matrix<double>& X,
+                                   ub::matrix<double>& Yv, double d,
+                                   double d2) const {
+  const unsigned nvec = X.size2();
+
+  // K_d x = -sum_g s_g A_g X B_g^T with A_g(v1,v2) = M_v1v2(g) and
+  // B_g(c1,c2) = M_c1c2(g), first factor applied to the vectors side by side
+  ub::matrix<double> Xh(_vtotal, nvec * _ctotal);
+  // K_d2 x = -sum_g s_g D_g X^T E_g with D_g(v,c) = M_vc(g) and
+  // E_g(v,c) = M_cv(g), transposed vectors side by side
+  ub::matrix<double> XTh(_ctotal, nvec * _vtotal);
+  for (unsigned k = 0; k < nvec; k++) {
+    for (unsigned v = 0; v < _vtotal; v++) {
+      for (unsigned c = 0; c < _ctotal; c++) {
+        Xh(v, k * _ctotal + c) = X(_ctotal * v + c, k);
+        XTh(c, k * _vtotal + v) = X(_ctotal * v + c, k);
+      }
+    }
+  }
+
+  // the output rows of a tile of occupied levels and its columns of a tile
+  // of virtual levels only need the Mmn of these levels, out of core the
+  // first factor is recomputed for every tile of virtual levels
+  const unsigned tile = TileSize();
+  for (unsigned v_start = 0; v_start < _vtotal; v_start += tile) {
+    const unsigned v_end = std::min(_vtotal, v_start + tile);
+    const unsigned vt = v_end - v_start;
+    _Mmn->Load(v_start + _vmin, v_end + _vmin);
+    for (unsigned c_start = 0; c_start < _ctotal; c_start += tile) {
+      const unsigned c_end = std::min(_ctotal, c_start + tile);
+      const unsigned ct = c_end - c_start;
+      _Mmn->Load(c_start + _cmin, c_end + _cmin);
+
+#pragma omp parallel
+      {
+        ub::matrix<double> Yv_thread = ub::zero_matrix<double>(nvec * vt, ct);
+        ub::matrix<double> A(vt, _vtotal);
+        ub::matrix<double> B(ct, _ctotal);
+        ub::matrix<double> D(vt, _ctotal);
+        ub::matrix<double> E(_vtotal, ct);
+        ub::matrix<double> Tv;
+
+#pragma omp for
+        for (unsigned i_gw = 0; i_gw < _gwsize; i_gw++) {
+          if (d != 0.0) {
+            for (unsigned v1 = v_start; v1 < v_end; v1++) {
+              const ub::matrix<real_gwbse>& Mmn = (*_Mmn)[v1 + _vmin];
+              for (unsigned v2 = 0; v2 < _vtotal; v2++) {
+                A(v1 - v_start, v2) = Mmn(i_gw, v2 + _vmin);
+              }
+            }
+            for (unsigned c1 = c_start; c1 < c_end; c1++) {
+              const ub::matrix<real_gwbse>& Mmn = (*_Mmn)[c1 + _cmin];
+              for (unsigned c2 = 0; c2 < _ctotal; c2++) {
+                B(c1 - c_start, c2) = Mmn(i_gw, c2 + _cmin);
+              }
+            }
+            ub::matrix<double> T = ub::prod(A, Xh);
+            // restack from side by side to on top of each other
+            Tv.resize(nvec * vt, _ctotal, false);
+            for (unsigned k = 0; k < nvec; k++) {
+              for (unsigned v = 0; v < vt; v++) {
+                for (unsigned c = 0; c < _ctotal; c++) {
+                  Tv(k * vt + v, c) = T(v, k * _ctotal + c);
+                }
+              }
+            }
+            Yv_thread -= (d * _screening(i_gw)) * ub::prod(Tv, ub::trans(B));
+          }
+
+          if (d2 != 0.0) {
+            for (unsigned v = v_start; v < v_end; v++) {
+              const ub::matrix<real_gwbse>& Mmn = (*_Mmn)[v + _vmin];
+              for (unsigned c = 0; c < _ctotal; c++) {
+                D(v - v_start, c) = Mmn(i_gw, c + _cmin);
+              }
+            }
+            for (unsigned c = c_start; c < c_end; c++) {
+              const ub::matrix<real_gwbse>& Mmn = (*_Mmn)[c + _cmin];
+              for (unsigned v = 0; v < _vtotal; v++) {
+                E(v, c - c_start) = Mmn(i_gw, v + _vmin);
+              }
+            }
+            ub::matrix<double> T = ub::prod(D, XTh);
+            Tv.resize(nvec * vt, _vtotal, false);
+            for (unsigned k = 0; k < nvec; k++) {
+              for (unsigned v1 = 0; v1 < vt; v1++) {
+                for (unsigned v2 = 0; v2 < _vtotal; v2++) {
+                  Tv(k * vt + v1, v2) = T(v1, k * _vtotal + v2);
+                }
+              }
+            }
+            Yv_thread -= (d2 * _screening(i_gw)) * ub::prod(Tv, E);
+          }
+        }
+
+#pragma omp critical
+        {
+          for (unsigned k = 0; k < nvec; k++) {
+            ub::project(Yv, ub::range(k * _vtotal + v_start, k * _vtotal + v_end),
+                        ub::range(c_start, c_end)) +=
+                ub::project(Yv_thread, ub::range(k * vt, (k + 1) * vt),
+                            ub::range(0, ct));
+          }
+        }
+      }
+      _Mmn->Release(c_start + _cmin, c_end + _cmin);
+    }
+    _Mmn->Release(v_start + _vmin, v_end + _vmin);
+  }
+  return;
+}
+
+void BSEDirectOperator::Add_exchange(const ub::matrix<double>& X,
+                                     ub::matrix<double>& Y, double x) const {
+  const unsigned nvec = X.size2();
+
+  // K_x = S^T S with S(g,vc) = M_vc(g), S is taken blockwise from Mmn,
+  // only occupied levels are needed
+  const unsigned tile = _Mmn->OutOfCore() ? _Mmn->TileSize() : _vtotal;
+  ub::matrix<double> SX = ub::zero_matrix<double>(_gwsize, nvec);
+  for (unsigned v_start = 0; v_start < _vtotal; v_start += tile) {
+    const unsigned v_end = std::min(_vtotal, v_start + tile);
+    _Mmn->Load(v_start + _vmin, v_end + _vmin);
+#pragma omp parallel
+    {
+      ub::matrix<double> SX_thread = ub::zero_matrix<double>(_gwsize, nvec);
+#pragma omp for
+      for (unsigned v = v_start; v < v_end; v++) {
+        ub::matrix<double> Mv = ub::project(
+            (*_Mmn)[v + _vmin], ub::range(0, _gwsize),
+            ub::range(_cmin, _cmin + _ctotal));
+        ub::matrix<double> Xv = ub::project(
+            X, ub::range(_ctotal * v, _ctotal * (v + 1)), ub::range(0, nvec));
+        SX_thread += ub::prod(Mv, Xv);
+      }
+#pragma omp critical
+      { SX += SX_thread; }
+    }
+    _Mmn->Release(v_start + _vmin, v_end + _vmin);
+  }
+
+  for (unsigned v_start = 0; v_start < _vtotal; v_start += tile) {
+    const unsigned v_end = std::min(_vtotal, v_start + tile);
+    _Mmn->Load(v_start + _vmin, v_end + _vmin);
+#pragma omp parallel for
+    for (unsigned v = v_start; v < v_end; v++) {
+      ub::matrix<double> Mv =
+          ub::project((*_Mmn)[v + _vmin], ub::range(0, _gwsize),
+                      ub::range(_cmin, _cmin + _ctotal));
+      ub::matrix<double> MTSX = ub::prod(ub::trans(Mv), SX);
+      ub::project(Y, ub::range(_ctotal * v, _ctotal * (v + 1)),
+                  ub::range(0, nvec)) += x * MTSX;
+    }
+    _Mmn->Release(v_start + _vmin, v_end + _vmin);
+  }
+  return;
+}
+}
+}
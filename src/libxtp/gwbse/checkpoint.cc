@@ -0,0 +1,220 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+
+#include <votca/xtp/gwbse.h>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <votca/xtp/threecenters.h>
+
+using boost::format;
+
+namespace votca {
+    namespace xtp {
+        namespace ub = boost::numeric::ublas;
+
+        /*
+         * Checkpoints of the GW stages. Each stage is stored in a file named
+         * by a hash of everything its result depends on, so a rerun finds a
+         * stage only if none of its inputs changed. The three-center stage
+         * holds the symmetrized (and compressed) Mmn with the GW overlap and
+         * its Cholesky inverse, the QP stage the PPM transformed Mmn, the QP
+         * energies, Sigma and the PPM weights needed by BSE.
+         */
+        void GWBSE::CheckpointKeys(const std::vector<ctp::QMAtom*>& _atoms) {
+
+            // geometry, basis sets and DFT orbitals fix the three-center integrals
+            std::size_t _key = 0;
+            boost::hash_combine(_key, sizeof (real_gwbse));
+            for (unsigned _i = 0; _i < _atoms.size(); _i++) {
+                boost::hash_combine(_key, _atoms[_i]->type);
+                boost::hash_combine(_key, _atoms[_i]->x);
+                boost::hash_combine(_key, _atoms[_i]->y);
+                boost::hash_combine(_key, _atoms[_i]->z);
+            }
+            boost::hash_combine(_key, _dftbasis_name);
+            boost::hash_combine(_key, _gwbasis_name);
+            boost::hash_combine(_key, boost::hash_range(_dft_orbitals.data().begin(), _dft_orbitals.data().end()));
+            boost::hash_combine(_key, _rpamin);
+            boost::hash_combine(_key, _rpamax);
+            boost::hash_combine(_key, _qpmax);
+            boost::hash_combine(_key, _compression_tolerance);
+            _threecenter_key = _key;
+
+            // QP energies additionally depend on the DFT energies, Vxc and the GW settings
+            const ub::vector<double>& _dft_energies = _orbitals->MOEnergies();
+            boost::hash_combine(_key, boost::hash_range(_dft_energies.data().begin(), _dft_energies.data().end()));
+            boost::hash_combine(_key, boost::hash_range(_vxc.data().begin(), _vxc.data().end()));
+            boost::hash_combine(_key, _homo);
+            boost::hash_combine(_key, _qpmin);
+            boost::hash_combine(_key, _ScaHFX);
+            boost::hash_combine(_key, _shift);
+            boost::hash_combine(_key, _g_sc_limit);
+            boost::hash_combine(_key, _g_sc_max_iterations);
+            boost::hash_combine(_key, _iterate_gw);
+            boost::hash_combine(_key, _gw_sc_limit);
+            boost::hash_combine(_key, _gw_sc_max_iterations);
+            _qp_key = _key;
+            return;
+        }
+
+
+        std::string GWBSE::CheckpointFile(const std::string& stage, std::size_t key) const {
+            boost::filesystem::path _path = boost::filesystem::path(_checkpoint_dir)
+                    / (format("gwbse_%1%_%2$016x.chk") % stage % key).str();
+            return _path.string();
+        }
+
+
+        bool GWBSE::ReadThreecenterCheckpoint(TCMatrix& _Mmn, ub::matrix<double>& _overlap,
+                ub::matrix<double>& _overlap_cholesky_inverse) {
+            if (_checkpoint_dir.empty()) return false;
+            return ReadThreecenterFile(CheckpointFile("threecenters", _threecenter_key),
+                    _Mmn, _overlap, _overlap_cholesky_inverse, _pLog);
+        }
+
+
+        void GWBSE::WriteThreecenterCheckpoint(const TCMatrix& _Mmn, const ub::matrix<double>& _overlap,
+                const ub::matrix<double>& _overlap_cholesky_inverse) const {
+            if (_checkpoint_dir.empty()) return;
+            boost::filesystem::create_directories(_checkpoint_dir);
+            WriteThreecenterFile(CheckpointFile("threecenters", _threecenter_key),
+                    _Mmn, _overlap, _overlap_cholesky_inverse, _pLog);
+            return;
+        }
+
+
+        bool GWBSE::ReadThreecenterFile(const std::string& _filename, TCMatrix& _Mmn, ub::matrix<double>& _overlap,
+                ub::matrix<double>& _overlap_cholesky_inverse, ctp::Logger* _pLog) {
+            std::ifstream _ifs(_filename.c_str(), std::ios::binary);
+            if (!_ifs.good()) return false;
+
+            // a truncated checkpoint or one from another boost version only
+            // means the stage has to be computed, _Mmn is initialized again then
+            ub::matrix<double> _overlap_file;
+            ub::matrix<double> _overlap_cholesky_inverse_file;
+            try {
+                boost::archive::binary_iarchive _ia(_ifs);
+                _ia >> _overlap_file >> _overlap_cholesky_inverse_file;
+                _Mmn.Read(_ia);
+            } catch (const boost::archive::archive_exception& e) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                        << " Ignoring unreadable checkpoint " << _filename << ": " << e.what() << flush;
+                return false;
+            } catch (const std::exception& e) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                        << " Ignoring checkpoint " << _filename << ": " << e.what() << flush;
+                return false;
+            }
+            _overlap = _overlap_file;
+            _overlap_cholesky_inverse = _overlap_cholesky_inverse_file;
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                    << " Read Mmn_beta and GW overlap from checkpoint " << _filename << flush;
+            return true;
+        }
+
+
+        void GWBSE::WriteThreecenterFile(const std::string& _filename, const TCMatrix& _Mmn, const ub::matrix<double>& _overlap,
+                const ub::matrix<double>& _overlap_cholesky_inverse, ctp::Logger* _pLog) {
+            // written under a temporary name, an interrupted run leaves no broken checkpoint
+            {
+                std::ofstream _ofs((_filename + ".tmp").c_str(), std::ios::binary);
+                boost::archive::binary_oarchive _oa(_ofs);
+                _oa << _overlap << _overlap_cholesky_inverse;
+                _Mmn.Write(_oa);
+            }
+            boost::filesystem::rename(_filename + ".tmp", _filename);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                    << " Wrote checkpoint " << _filename << flush;
+            return;
+        }
+
+
+        bool GWBSE::ReadQPCheckpoint(TCMatrix& _Mmn) {
+            if (_checkpoint_dir.empty()) return false;
+            const std::string _filename = CheckpointFile("qp", _qp_key);
+            std::ifstream _ifs(_filename.c_str(), std::ios::binary);
+            if (!_ifs.good()) return false;
+
+            ub::vector<double> _qp_energies_file;
+            ub::matrix<double> _sigma_x_full;
+            ub::matrix<double> _sigma_c_full;
+            double _shift_file;
+            ub::vector<double> _ppm_weight_file;
+            ub::vector<double> _ppm_freq_file;
+            // as for the three-center stage, nothing is changed if the
+            // checkpoint cannot be read completely
+            try {
+                boost::archive::binary_iarchive _ia(_ifs);
+                _ia >> _qp_energies_file >> _sigma_x_full >> _sigma_c_full >> _shift_file >> _ppm_weight_file >> _ppm_freq_file;
+                _Mmn.Read(_ia);
+            } catch (const boost::archive::archive_exception& e) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                        << " Ignoring unreadable checkpoint " << _filename << ": " << e.what() << flush;
+                return false;
+            } catch (const std::exception& e) {
+                CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                        << " Ignoring checkpoint " << _filename << ": " << e.what() << flush;
+                return false;
+            }
+            _qp_energies = _qp_energies_file;
+            _shift = _shift_file;
+            _ppm_weight = _ppm_weight_file;
+            _ppm_freq = _ppm_freq_file;
+
+            // symmetric matrices do not serialize
+            _sigma_x.resize(_qptotal);
+            _sigma_c.resize(_qptotal);
+            for (unsigned _i = 0; _i < _qptotal; _i++) {
+                for (unsigned _j = 0; _j <= _i; _j++) {
+                    _sigma_x(_i, _j) = _sigma_x_full(_i, _j);
+                    _sigma_c(_i, _j) = _sigma_c_full(_i, _j);
+                }
+            }
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                    << " Read QP energies, Sigma and Mmn_beta from checkpoint " << _filename << flush;
+            return true;
+        }
+
+
+        void GWBSE::WriteQPCheckpoint(const TCMatrix& _Mmn) const {
+            if (_checkpoint_dir.empty()) return;
+            const std::string _filename = CheckpointFile("qp", _qp_key);
+            boost::filesystem::create_directories(_checkpoint_dir);
+            {
+                std::ofstream _ofs((_filename + ".tmp").c_str(), std::ios::binary);
+                boost::archive::binary_oarchive _oa(_ofs);
+                const ub::matrix<double> _sigma_x_full = _sigma_x;
+                const ub::matrix<double> _sigma_c_full = _sigma_c;
+                _oa << _qp_energies << _sigma_x_full << _sigma_c_full << _shift << _ppm_weight << _ppm_freq;
+                _Mmn.Write(_oa);
+            }
+            boost::filesystem::rename(_filename + ".tmp", _filename);
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                    << " Wrote checkpoint " << _filename << flush;
+            return;
+        }
+
+    }
+}
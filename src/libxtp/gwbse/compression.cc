@@ -0,0 +1,120 @@
+/*
+ *            Copyright 2009-2017 The VOTCA Development Team
+ *                       (http://www.votca.org)
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License")
+ *
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *              http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+
+#include <votca/xtp/gwbse.h>
+
+#include <boost/format.hpp>
+#include <votca/xtp/threecenters.h>
+
+using boost::format;
+
+namespace votca {
+    namespace xtp {
+        namespace ub = boost::numeric::ublas;
+
+        /*
+         * Reduces the GW basis dimension of the symmetrized three-center
+         * integrals. In the basis orthonormalized with the GW overlap the pair
+         * densities M_mn span the range of G = sum_mn M_mn M_mn^T, a pivoted
+         * Cholesky decomposition of G selects the directions which are needed
+         * up to _compression_tolerance times the largest diagonal element.
+         * Afterwards the metric of the compressed basis is the identity.
+         */
+        int GWBSE::Compress_threecenters(TCMatrix& _Mmn, const ub::matrix<double>& _overlap_cholesky_inverse) {
+
+            const int _gwsize = _Mmn.get_beta();
+            _Mmn.Transform(_overlap_cholesky_inverse);
+            ub::matrix<double> _gram = _Mmn.GramMatrix();
+
+            // pivoted Cholesky, column k of _cholesky is the k-th Cholesky vector
+            ub::vector<double> _diagonal = ub::vector<double>(_gwsize);
+            double _maxdiagonal = 0.0;
+            for (int _i_gw = 0; _i_gw < _gwsize; _i_gw++) {
+                _diagonal(_i_gw) = _gram(_i_gw, _i_gw);
+                _maxdiagonal = std::max(_maxdiagonal, _diagonal(_i_gw));
+            }
+            const double _threshold = _compression_tolerance * _maxdiagonal;
+            std::vector< ub::vector<double> > _cholesky;
+            while (static_cast<int>(_cholesky.size()) < _gwsize) {
+                int _pivot = 0;
+                for (int _i_gw = 1; _i_gw < _gwsize; _i_gw++) {
+                    if (_diagonal(_i_gw) > _diagonal(_pivot)) _pivot = _i_gw;
+                }
+                if (_diagonal(_pivot) <= _threshold) break;
+                ub::vector<double> _vector = ub::column(_gram, _pivot);
+                for (unsigned _k = 0; _k < _cholesky.size(); _k++) {
+                    _vector -= _cholesky[_k](_pivot) * _cholesky[_k];
+                }
+                _vector /= std::sqrt(_diagonal(_pivot));
+                for (int _i_gw = 0; _i_gw < _gwsize; _i_gw++) {
+                    _diagonal(_i_gw) -= _vector(_i_gw) * _vector(_i_gw);
+                }
+                // exactly zero from now on, rounding must not select it again
+                _diagonal(_pivot) = 0.0;
+                _cholesky.push_back(_vector);
+            }
+            _gram.resize(0, 0);
+            const int _rank = _cholesky.size();
+
+            // orthonormal basis of the Cholesky vectors, Gram-Schmidt applied twice
+            ub::matrix<double> _projector = ub::matrix<double>(_rank, _gwsize);
+            for (int _k = 0; _k < _rank; _k++) {
+                ub::vector<double> _vector = _cholesky[_k];
+                for (int _pass = 0; _pass < 2; _pass++) {
+                    for (int _l = 0; _l < _k; _l++) {
+                        _vector -= ub::inner_prod(ub::row(_projector, _l), _vector) * ub::row(_projector, _l);
+                    }
+                }
+                ub::row(_projector, _k) = _vector / ub::norm_2(_vector);
+            }
+            _cholesky.clear();
+
+            // the exchange self-energy of the QP levels loses exactly the
+            // occupied pair densities outside the compressed basis
+            double _maxerror = 0.0;
+            const int _offset = _qpmin - _Mmn.get_mmin();
+            const int _tile = _Mmn.TileSize();
+            for (unsigned _start = 0; _start < _qptotal; _start += _tile) {
+                const unsigned _end = std::min(_start + _tile, _qptotal);
+                _Mmn.Load(_start + _offset, _end + _offset);
+                #pragma omp parallel for reduction(max:_maxerror)
+                for (unsigned _gw_level = _start; _gw_level < _end; _gw_level++) {
+                    const ub::matrix<double> _occupied = ub::project(_Mmn[ _gw_level + _offset ],
+                            ub::range(0, _gwsize), ub::range(0, _homo + 1 - _Mmn.get_nmin()));
+                    const ub::matrix<double> _compressed = ub::prod(_projector, _occupied);
+                    const double _error = (1.0 - _ScaHFX) * (std::pow(ub::norm_frobenius(_occupied), 2)
+                            - std::pow(ub::norm_frobenius(_compressed), 2));
+                    _maxerror = std::max(_maxerror, _error);
+                }
+                _Mmn.Release(_start + _offset, _end + _offset);
+            }
+
+            _Mmn.Transform(_projector);
+
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Compressed GW basis from "
+                    << _gwsize << " to " << _rank << " functions" << flush;
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                    << (format(" Largest change of Sigma_x in the QP range %1$1.3e Hartree") % _maxerror).str() << flush;
+            return _rank;
+        }
+
+    }
+}
@@ -43,6 +43,102 @@ namespace votca {
         
         
 
+namespace {
+    // 0.5 * fac * stab / (shift - e_i) for the bands begin..end-1, the
+    // stabilization damps denominators below 0.25 Hartree
+    inline void PPMFactors(double* factors, const double* energies, unsigned begin, unsigned end,
+            double shift, double fac) {
+        const double fourpi = 4.0 * boost::math::constants::pi<double>();
+        #pragma omp simd
+        for (unsigned _i = begin; _i < end; _i++) {
+            const double _denom = shift - energies[_i];
+            const double _abs = std::abs(_denom);
+            const double _stab = (_abs < 0.25) ? 0.5 * (1.0 - std::cos(fourpi * _abs)) : 1.0;
+            factors[_i] = 0.5 * fac * _stab / _denom;
+        }
+        return;
+    }
+
+    // number of levels, at most levels, whose copies of a flattened row of
+    // rowsize doubles fit into work_mb MB
+    inline unsigned SigmaTile(double work_mb, unsigned rowsize, unsigned copies, unsigned levels) {
+        const double _levelbytes = sizeof (double) * static_cast<double> (rowsize) * copies;
+        if (_levelbytes <= 0.0) return levels;
+        const double _tile = work_mb * 1024 * 1024 / _levelbytes;
+        return std::max(1u, static_cast<unsigned> (std::min(_tile, static_cast<double> (levels))));
+    }
+}
+        
+        
+        void GWBSE::sigma_filter_ppm(){
+            // the ppm_weights smaller 1.e-5 are set to zero in rpa.cc PPM_construct_parameters
+            _ppm_active.clear();
+            _ppm_active_freq.clear();
+            _ppm_active_fac.clear();
+            for (unsigned _i_gw = 0; _i_gw < _ppm_weight.size(); _i_gw++) {
+                if (_ppm_weight(_i_gw) < 1.e-9) continue;
+                _ppm_active.push_back(_i_gw);
+                _ppm_active_freq.push_back(_ppm_freq(_i_gw));
+                _ppm_active_fac.push_back(_ppm_weight(_i_gw) * _ppm_freq(_i_gw));
+            }
+            return;
+        }
+        
+        
+        ub::matrix<double> GWBSE::sigma_ppm_rows(const ub::matrix<real_gwbse>& Mmn) const{
+            // rows of the active GW functions only
+            ub::matrix<double> _rows = ub::matrix<double>(_ppm_active.size(), Mmn.size2());
+            for (unsigned _k = 0; _k < _ppm_active.size(); _k++) {
+                ub::row(_rows, _k) = ub::row(Mmn, _ppm_active[_k]);
+            }
+            return _rows;
+        }
+        
+        
+        void GWBSE::sigma_c_factors(double qp_energy, const ub::vector<double>& energies, ub::matrix<double>& factors) const{
+            // energy dependent PPM factor of every active GW function and band,
+            // occupied bands are shifted by +freq, empty ones by -freq
+            const unsigned _levelsum = factors.size2();
+            const double* _energies = &energies(0);
+            for (unsigned _k = 0; _k < _ppm_active.size(); _k++) {
+                double* _row = &factors(_k, 0);
+                PPMFactors(_row, _energies, 0, _homo + 1, qp_energy + _ppm_active_freq[_k], _ppm_active_fac[_k]);
+                PPMFactors(_row, _energies, _homo + 1, _levelsum, qp_energy - _ppm_active_freq[_k], _ppm_active_fac[_k]);
+            }
+            return;
+        }
+        
+        
+        void GWBSE::sigma_c_offdiag_rows(const TCMatrix& _Mmn, unsigned _start, unsigned _end,
+                ub::matrix<double>& M, ub::matrix<double>& A) const{
+            // one row per QP level with the active Mmn elements, flattened
+            const unsigned _offset = _qpmin - _Mmn.get_mmin();
+            const unsigned _levelsum = _Mmn.get_ntot();
+            const unsigned _size = _ppm_active.size() * _levelsum;
+            M = ub::matrix<double>(_end - _start, _size);
+            A = ub::matrix<double>(_end - _start, _size);
+            #pragma omp parallel
+            {
+            ub::matrix<double> _factors = ub::matrix<double>(_ppm_active.size(), _levelsum);
+            #pragma omp for
+            for (unsigned _gw_level = _start; _gw_level < _end; _gw_level++) {
+                const ub::matrix<double> _rows = sigma_ppm_rows(_Mmn[ _gw_level + _offset ]);
+                sigma_c_factors(_qp_energies(_gw_level + _qpmin), _qp_energies, _factors);
+                const double* _m = _rows.data().begin();
+                const double* _f = _factors.data().begin();
+                double* _M = &M(_gw_level - _start, 0);
+                double* _A = &A(_gw_level - _start, 0);
+                #pragma omp simd
+                for (unsigned _j = 0; _j < _size; _j++) {
+                    _M[_j] = _m[_j];
+                    _A[_j] = _m[_j] * _f[_j];
+                }
+            }
+            }
+            return;
+        }
+        
+
         void GWBSE::FullQPHamiltonian(){
             
             // constructing full QP Hamiltonian, storage in vxc
@@ -69,23 +165,30 @@ namespace votca {
         
         void GWBSE::sigma_diag(const TCMatrix& _Mmn){
             
-            unsigned _levelsum = _Mmn[0].size2(); // total number of bands
-            unsigned _gwsize = _Mmn[0].size1(); // size of the GW basis
-            const double pi = boost::math::constants::pi<double>();
-
+            unsigned _levelsum = _Mmn.get_ntot(); // total number of bands
+            unsigned _gwsize = _Mmn.get_beta(); // size of the GW basis
+            // index of the first QP level in _Mmn
+            const unsigned _offset = _qpmin - _Mmn.get_mmin();
+            // out of core the GW levels are processed in tiles
+            const unsigned _tile = _Mmn.TileSize();
             
-             #pragma omp parallel for
-                for (unsigned _gw_level = 0; _gw_level < _qptotal; _gw_level++) {
-                    const ub::matrix<real_gwbse>& Mmn = _Mmn[ _gw_level + _qpmin ];
-                    double sigma_x=0;
-                        for ( unsigned _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
-                            // loop over all occupied bands used in screening
-                            for ( unsigned _i_occ = 0 ; _i_occ <= _homo ; _i_occ++ ){
-                                sigma_x-= Mmn( _i_gw , _i_occ ) * Mmn( _i_gw , _i_occ );
-                            } // occupied bands
-                        } // gwbasis functions             
-                    _sigma_x(_gw_level,_gw_level)=( 1.0 - _ScaHFX ) * sigma_x; 
-                }
+            for (unsigned _start = 0; _start < _qptotal; _start += _tile) {
+                const unsigned _end = std::min(_start + _tile, _qptotal);
+                _Mmn.Load(_start + _offset, _end + _offset);
+                 #pragma omp parallel for
+                    for (unsigned _gw_level = _start; _gw_level < _end; _gw_level++) {
+                        const ub::matrix<real_gwbse>& Mmn = _Mmn[ _gw_level + _offset ];
+                        double sigma_x=0;
+                            for ( unsigned _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
+                                // loop over all occupied bands used in screening
+                                for ( unsigned _i_occ = 0 ; _i_occ <= _homo ; _i_occ++ ){
+                                    sigma_x-= Mmn( _i_gw , _i_occ ) * Mmn( _i_gw , _i_occ );
+                                } // occupied bands
+                            } // gwbasis functions             
+                        _sigma_x(_gw_level,_gw_level)=( 1.0 - _ScaHFX ) * sigma_x; 
+                    }
+                _Mmn.Release(_start + _offset, _end + _offset);
+            }
             
                 if(_g_sc_max_iterations==0) {_g_sc_max_iterations=1;}
                 ub::vector<double>& dftenergies=_orbitals->MOEnergies();
@@ -95,53 +198,62 @@ namespace votca {
                 bool energies_converged=false;
 
             
+            // squared Mmn of the active GW functions do not change during the
+            // G iterations, they are set up once if all levels fit into the
+            // working memory, otherwise again for each tile
+            sigma_filter_ppm();
+            const bool _cache_squares = !_Mmn.OutOfCore()
+                    && SigmaTile(_sigma_work_mb, _ppm_active.size() * _levelsum, 1, _qptotal) == _qptotal;
+            std::vector< ub::matrix<double> > _squares(_cache_squares ? _qptotal : 0);
+            if (_cache_squares) {
+                #pragma omp parallel for
+                for (unsigned _gw_level = 0; _gw_level < _qptotal; _gw_level++) {
+                    _squares[_gw_level] = sigma_ppm_rows(_Mmn[ _gw_level + _offset ]);
+                    _squares[_gw_level] = ub::element_prod(_squares[_gw_level], _squares[_gw_level]);
+                }
+            }
+            
 	    // only diagonal elements except for in final iteration
             for (unsigned _g_iter = 0; _g_iter < _g_sc_max_iterations; _g_iter++) {
                 // loop over all GW levels
 
-                #pragma omp parallel for
-                for (unsigned _gw_level = 0; _gw_level < _qptotal; _gw_level++) {
-                    const ub::matrix<real_gwbse>& Mmn = _Mmn[ _gw_level + _qpmin ];
-                    const double qpmin = _qp_old(_gw_level + _qpmin);
-                    
-                    double sigma_c=0.0;
-                    
-                    // loop over all functions in GW basis
-                    for (unsigned _i_gw = 0; _i_gw < _gwsize; _i_gw++) {
-                        // the ppm_weights smaller 1.e-5 are set to zero in rpa.cc PPM_construct_parameters
-                        if (_ppm_weight(_i_gw) < 1.e-9) { continue;}
-                        const double ppm_freq = _ppm_freq(_i_gw);
-                        const double fac = _ppm_weight(_i_gw) * ppm_freq;
-                        // loop over all bands
-                        for (unsigned _i = 0; _i < _levelsum; _i++) {
-
-                            double occ = 1.0;
-                            if (_i > _homo) occ = -1.0; // sign for empty levels
-
-                            // energy denominator
-                            const double _denom = qpmin - _qp_old(_i) + occ*ppm_freq;
-
-                            double _stab = 1.0;
-                            if (std::abs(_denom) < 0.25) {
-                                 
-                                _stab = 0.5 * (1.0 - std::cos(4.0 * pi * std::abs(_denom)));
-                               
-                            }
-                            
-                            const double _factor =0.5* fac * _stab / _denom; //Hartree
-
-                            // sigma_c diagonal elements
-                            sigma_c += _factor * Mmn(_i_gw, _i) * Mmn(_i_gw, _i);
-                           
-                        }// bands
-
-                    }// GW functions
-                    _sigma_c(_gw_level, _gw_level)=sigma_c;
-                    // update _qp_energies
+                for (unsigned _start = 0; _start < _qptotal; _start += _tile) {
+                    const unsigned _end = std::min(_start + _tile, _qptotal);
+                    if (!_cache_squares) _Mmn.Load(_start + _offset, _end + _offset);
+                    #pragma omp parallel
+                    {
+                    ub::matrix<double> _factors = ub::matrix<double>(_ppm_active.size(), _levelsum);
+                    ub::matrix<double> _tile_squares;
+                    #pragma omp for
+                    for (unsigned _gw_level = _start; _gw_level < _end; _gw_level++) {
+                        const ub::matrix<double>* _level_squares = &_tile_squares;
+                        if (_cache_squares) {
+                            _level_squares = &_squares[_gw_level];
+                        } else {
+                            _tile_squares = sigma_ppm_rows(_Mmn[ _gw_level + _offset ]);
+                            _tile_squares = ub::element_prod(_tile_squares, _tile_squares);
+                        }
+                        
+                        sigma_c_factors(_qp_old(_gw_level + _qpmin), _qp_old, _factors);
+                        
+                        // sigma_c diagonal element, sum over active GW functions and bands
+                        const double* _f = _factors.data().begin();
+                        const double* _m = _level_squares->data().begin();
+                        const unsigned _size = _factors.data().size();
+                        double sigma_c = 0.0;
+                        #pragma omp simd reduction(+:sigma_c)
+                        for (unsigned _j = 0; _j < _size; _j++) {
+                            sigma_c += _f[_j] * _m[_j];
+                        }
+                        _sigma_c(_gw_level, _gw_level)=sigma_c;
+                        // update _qp_energies
                    
-                    _qp_energies(_gw_level + _qpmin) = dftenergies(_gw_level + _qpmin) + sigma_c + _sigma_x(_gw_level, _gw_level) - _vxc(_gw_level, _gw_level);
+                        _qp_energies(_gw_level + _qpmin) = dftenergies(_gw_level + _qpmin) + sigma_c + _sigma_x(_gw_level, _gw_level) - _vxc(_gw_level, _gw_level);
 
-                }// all bands
+                    }// all bands
+                    }
+                    if (!_cache_squares) _Mmn.Release(_start + _offset, _end + _offset);
+                }
                 ub::vector<double> diff= _qp_old - _qp_energies;
                 energies_converged = true;
                 double diff_max=0;
@@ -182,88 +294,105 @@ namespace votca {
       
        
          void GWBSE::sigma_offdiag(const TCMatrix& _Mmn) {
-            unsigned _levelsum = _Mmn[0].size2(); // total number of bands
-            unsigned _gwsize = _Mmn[0].size1(); // size of the GW basis
-            const double pi = boost::math::constants::pi<double>();
+            unsigned _gwsize = _Mmn.get_beta(); // size of the GW basis
+            // index of the first QP level in _Mmn
+            const unsigned _offset = _qpmin - _Mmn.get_mmin();
+            // out of core pairs of tiles of GW levels are loaded, a tile of
+            // level1 is combined with all tiles of level2 up to it
+            const unsigned _tile = _Mmn.OutOfCore() ? std::max(1, _Mmn.TileSize() / 2) : _qptotal;
            
-            #pragma omp parallel for
-            for (unsigned _gw_level1 = 0; _gw_level1 < _qptotal; _gw_level1++) {
-                const ub::matrix<real_gwbse>& Mmn1 =  _Mmn[ _gw_level1 + _qpmin ];
-                for (unsigned _gw_level2 = 0; _gw_level2 < _gw_level1; _gw_level2++) {
-                    const ub::matrix<real_gwbse>& Mmn2 =  _Mmn[ _gw_level2 + _qpmin ];
-                    double sigma_x=0;
-                    for ( unsigned _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
-                        // loop over all occupied bands used in screening
-                        for ( unsigned _i_occ = 0 ; _i_occ <= _homo ; _i_occ++ ){
-                            sigma_x -= Mmn1( _i_gw , _i_occ ) * Mmn2( _i_gw , _i_occ );
-                        } // occupied bands
-                    } // gwbasis functions
-                    _sigma_x(_gw_level1, _gw_level2)=( 1.0 - _ScaHFX ) * sigma_x;
+            for (unsigned _start1 = 0; _start1 < _qptotal; _start1 += _tile) {
+                const unsigned _end1 = std::min(_start1 + _tile, _qptotal);
+                _Mmn.Load(_start1 + _offset, _end1 + _offset);
+                for (unsigned _start2 = 0; _start2 <= _start1; _start2 += _tile) {
+                    const unsigned _end2 = std::min(_start2 + _tile, _qptotal);
+                    _Mmn.Load(_start2 + _offset, _end2 + _offset);
+                    #pragma omp parallel for
+                    for (unsigned _gw_level1 = _start1; _gw_level1 < _end1; _gw_level1++) {
+                        const ub::matrix<real_gwbse>& Mmn1 =  _Mmn[ _gw_level1 + _offset ];
+                        for (unsigned _gw_level2 = _start2; _gw_level2 < std::min(_end2, _gw_level1); _gw_level2++) {
+                            const ub::matrix<real_gwbse>& Mmn2 =  _Mmn[ _gw_level2 + _offset ];
+                            double sigma_x=0;
+                            for ( unsigned _i_gw = 0 ; _i_gw < _gwsize ; _i_gw++ ){
+                                // loop over all occupied bands used in screening
+                                for ( unsigned _i_occ = 0 ; _i_occ <= _homo ; _i_occ++ ){
+                                    sigma_x -= Mmn1( _i_gw , _i_occ ) * Mmn2( _i_gw , _i_occ );
+                                } // occupied bands
+                            } // gwbasis functions
+                            _sigma_x(_gw_level1, _gw_level2)=( 1.0 - _ScaHFX ) * sigma_x;
+                        }
+                    }
+                    if (_start2 != _start1) _Mmn.Release(_start2 + _offset, _end2 + _offset);
                 }
+                _Mmn.Release(_start1 + _offset, _end1 + _offset);
             }
             
-            #pragma omp parallel for
-            for (unsigned _gw_level1 = 0; _gw_level1 < _qptotal; _gw_level1++) {
-                const double qpmin1 = _qp_energies(_gw_level1 + _qpmin);
-                const ub::matrix<real_gwbse>& Mmn1 = _Mmn[ _gw_level1 + _qpmin ];
-                for (unsigned _gw_level2 = 0; _gw_level2 < _gw_level1; _gw_level2++) {
-                    const double qpmin2 = _qp_energies(_gw_level1 + _qpmin);
-                    const ub::matrix<real_gwbse>& Mmn2 = _Mmn[ _gw_level2 + _qpmin ];
-                    double sigma_c = 0;
-                    for (unsigned _i_gw = 0; _i_gw < _gwsize; _i_gw++) {
-                        // the ppm_weights smaller 1.e-5 are set to zero in rpa.cc PPM_construct_parameters
-                        if (_ppm_weight(_i_gw) < 1.e-9) {
-                            continue;
+            // with the PPM factors F_l of level l the averaged element is
+            // sigma_c(l1,l2) = 0.5 * sum_(k,i) M_l1 M_l2 (F_l1 + F_l2), i.e. two
+            // dot products of M_l and A_l = M_l*F_l, computed for whole tiles
+            // as matrix products of their flattened rows
+            // the flattened copies M and A of both tiles are bounded by the
+            // working memory, out of core they take another twice the size of
+            // the loaded tiles, so these are halved once more
+            sigma_filter_ppm();
+            const unsigned _rowsize = _ppm_active.size() * _Mmn.get_ntot();
+            const unsigned _tile_c = std::min(_Mmn.OutOfCore() ? std::max(1, _Mmn.TileSize() / 4) : _qptotal,
+                    SigmaTile(_sigma_work_mb, _rowsize, 4, _qptotal));
+            for (unsigned _start1 = 0; _start1 < _qptotal; _start1 += _tile_c) {
+                const unsigned _end1 = std::min(_start1 + _tile_c, _qptotal);
+                _Mmn.Load(_start1 + _offset, _end1 + _offset);
+                ub::matrix<double> _M1;
+                ub::matrix<double> _A1;
+                sigma_c_offdiag_rows(_Mmn, _start1, _end1, _M1, _A1);
+                for (unsigned _start2 = 0; _start2 <= _start1; _start2 += _tile_c) {
+                    const unsigned _end2 = std::min(_start2 + _tile_c, _qptotal);
+                    ub::matrix<double> _M2;
+                    ub::matrix<double> _A2;
+                    if (_start2 != _start1) {
+                        _Mmn.Load(_start2 + _offset, _end2 + _offset);
+                        sigma_c_offdiag_rows(_Mmn, _start2, _end2, _M2, _A2);
+                        _Mmn.Release(_start2 + _offset, _end2 + _offset);
+                    }
+                    const ub::matrix<double>& M2 = (_start2 != _start1) ? _M2 : _M1;
+                    const ub::matrix<double>& A2 = (_start2 != _start1) ? _A2 : _A1;
+                    ub::matrix<double> _block = ub::prod(_A1, ub::trans(M2));
+                    _block += ub::prod(_M1, ub::trans(A2));
+                    for (unsigned _gw_level1 = _start1; _gw_level1 < _end1; _gw_level1++) {
+                        for (unsigned _gw_level2 = _start2; _gw_level2 < std::min(_end2, _gw_level1); _gw_level2++) {
+                            _sigma_c(_gw_level1, _gw_level2) = 0.5 * _block(_gw_level1 - _start1, _gw_level2 - _start2);
                         }
-                        const double ppm_freq = _ppm_freq(_i_gw);
-                        const double fac = _ppm_weight(_i_gw) * ppm_freq;
-                        // loop over all screening levels
-                        for (unsigned _i = 0; _i < _levelsum; _i++) {
-
-                            double occ = 1.0;
-                            if (_i > _homo) occ = -1.0; // sign for empty levels
-
-                            // energy denominator
-                            const double _denom1 = qpmin1 - _qp_energies(_i) + occ * ppm_freq;
-                            const double _denom2 = qpmin2 - _qp_energies(_i) + occ * ppm_freq;
-
-                            double _stab1 = 1.0;
-                            if (std::abs(_denom1) < 0.25) {
-                                _stab1 = 0.5 * (1.0 - std::cos(4.0 * pi * std::abs(_denom1)));
-                            }
-                            const double factor1 = 0.5 * fac * _stab1 / _denom1; //Hartree
-                            double _stab2 = 1.0;
-                            if (std::abs(_denom2) < 0.25) {
-                                _stab2 = 0.5 * (1.0 - std::cos(4.0 * pi * std::abs(_denom2)));
-                            }
-                            const double factor2 = 0.5 * fac * _stab2 / _denom2; //Hartree
-                            sigma_c +=Mmn1(_i_gw, _i) * Mmn2(_i_gw, _i)*0.5*(factor1+factor2);
-                        }// screening levels 
-                    }// GW functions 
-
-                    _sigma_c(_gw_level1, _gw_level2) = sigma_c;
-
-
-                }// GW row             
-            }//GW col
+                    }
+                }
+                _Mmn.Release(_start1 + _offset, _end1 + _offset);
+            }
          
         return;
         } 
 
 
-        void GWBSE::sigma_prepare_threecenters(TCMatrix& _Mmn){
+        void GWBSE::sigma_prepare_threecenters(TCMatrix& _Mmn_sigma, const TCMatrix& _Mmn){
             #if (GWBSE_DOUBLE)
                 const ub::matrix<double>& ppm_phi=_ppm_phi;
             #else
                 const ub::matrix<float> ppm_phi=_ppm_phi;        
             #endif
             
-            
-            #pragma omp parallel for
-            for ( int _m_level = 0 ; _m_level < _Mmn.get_mtot(); _m_level++ ){
-                // get Mmn for this _m_level
-                // and multiply with _ppm_phi = eigenvectors of epsilon
-              _Mmn[ _m_level ] = ub::prod(  ppm_phi , _Mmn[_m_level] );
+            // level i of _Mmn_sigma is taken from level i + _offset of _Mmn,
+            // each matrix loads its tile from its own share of the budget
+            const int _offset = _Mmn_sigma.get_mmin() - _Mmn.get_mmin();
+            const int _tile = std::min(_Mmn_sigma.TileSize(), _Mmn.TileSize());
+            for ( int _start = 0 ; _start < _Mmn_sigma.get_mtot(); _start += _tile ){
+                const int _end = std::min(_start + _tile, _Mmn_sigma.get_mtot());
+                _Mmn.Load(_start + _offset, _end + _offset);
+                _Mmn_sigma.Load(_start, _end);
+                #pragma omp parallel for
+                for ( int _m_level = _start ; _m_level < _end; _m_level++ ){
+                    // get Mmn for this _m_level
+                    // and multiply with _ppm_phi = eigenvectors of epsilon
+                  _Mmn_sigma[ _m_level ] = ub::prod(  ppm_phi , _Mmn[_m_level + _offset] );
+                }
+                _Mmn_sigma.Store(_start, _end);
+                if (&_Mmn != &_Mmn_sigma) _Mmn.Release(_start + _offset, _end + _offset);
             }
             return;
         }        
@@ -103,9 +103,80 @@ void GWBSE::Initialize(Property *options) {
     CTP_LOG(ctp::logDEBUG, *_pLog) << " BSE type: TDA" << flush;
   }
 
+  _do_davidson = false;
+  _do_matrixfree = false;
+  _davidson_tolerance = 1e-5;
+  _davidson_maxiter = 50;
+  if (options->exists(key + ".davidson")) {
+    _do_davidson = options->ifExistsReturnElseThrowRuntimeError<bool>(
+        key + ".davidson.dodavidson");
+    if (_do_davidson) {
+      _davidson_tolerance = options->ifExistsReturnElseReturnDefault<double>(
+          key + ".davidson.tolerance", 1e-5);
+      _davidson_maxiter = options->ifExistsReturnElseReturnDefault<int>(
+          key + ".davidson.maxiter", 50);
+      _do_matrixfree = options->ifExistsReturnElseReturnDefault<bool>(
+          key + ".davidson.matrixfree", false);
+      CTP_LOG(ctp::logDEBUG, *_pLog) << " BSE eigensolver: Davidson" << flush;
+      if (_do_matrixfree) {
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << " BSE Hamiltonian applied matrix-free from Mmn" << flush;
+      } else if (_do_full_BSE) {
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << " Davidson only applies to TDA, full BSE singlets are solved "
+               "densely"
+            << flush;
+      }
+    }
+  }
+
+  // only meaningful if the BSE is stored in double precision
+  _do_mixed_precision = options->ifExistsReturnElseReturnDefault<bool>(
+      key + ".mixedprecision", false);
+#if (GWBSE_DOUBLE)
+  if (_do_mixed_precision) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << " BSE set up and diagonalized in single precision, eigenpairs "
+           "refined in double"
+        << flush;
+  }
+#else
+  _do_mixed_precision = false;
+#endif
+
   _openmp_threads =
       options->ifExistsReturnElseReturnDefault<int>(key + ".openmp", 0);
 
+  // relative tolerance of the pivoted Cholesky compression of the GW basis,
+  // 0 keeps the full basis
+  _compression_tolerance = options->ifExistsReturnElseReturnDefault<double>(
+      key + ".compression.tolerance", 0.0);
+  if (_compression_tolerance > 0.0) {
+    CTP_LOG(ctp::logDEBUG, *_pLog) << " GW basis compressed with tolerance "
+                                   << _compression_tolerance << flush;
+  }
+
+  // three-center integrals larger than the RAM budget [MB] go to a scratch file
+  _ram_budget = options->ifExistsReturnElseReturnDefault<double>(
+      key + ".outofcore.ram", 0.0);
+  _scratch_dir = options->ifExistsReturnElseReturnDefault<string>(
+      key + ".outofcore.scratch", ".");
+  _sigma_work_mb = options->ifExistsReturnElseReturnDefault<double>(
+      key + ".outofcore.sigma", 256.0);
+  if (_ram_budget > 0.0) {
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << " Mmn kept out of core beyond " << _ram_budget << " MB in "
+        << _scratch_dir << flush;
+  }
+
+  // reruns with unchanged inputs of a stage read it from here
+  _checkpoint_dir = options->ifExistsReturnElseReturnDefault<string>(
+      key + ".checkpoint", "");
+  if (!_checkpoint_dir.empty()) {
+    CTP_LOG(ctp::logDEBUG, *_pLog) << " GW checkpoints in " << _checkpoint_dir
+                                   << flush;
+  }
+
   if (options->exists(key + ".vxc")) {
     _doVxc =
         options->ifExistsReturnElseThrowRuntimeError<bool>(key + ".vxc.dovxc");
@@ -210,6 +281,15 @@ void GWBSE::Initialize(Property *options) {
   if (_store_string.find("ehint") != std::string::npos)
     _store_eh_interaction = true;
 
+  // the e-h interaction matrices are never formed in matrix-free mode
+  if (_do_matrixfree && (!_do_bse_diag || _store_eh_interaction)) {
+    _do_matrixfree = false;
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << " Storing e-h interaction requires the dense BSE Hamiltonian, "
+           "matrix-free mode disabled"
+        << flush;
+  }
+
   CTP_LOG(ctp::logDEBUG, *_pLog) << " Tasks: " << flush;
   if (_do_qp_diag) {
     CTP_LOG(ctp::logDEBUG, *_pLog) << " qpdiag " << flush;
@@ -317,6 +397,309 @@ void GWBSE::addoutput(Property *_summary) {
   return;
 }
 
+/*
+ * _Mmn, _Mmn_RPA and, for evGW, _Mmn_sigma exist at the same time, each
+ * gets a part of the RAM budget in proportion to its size so that all
+ * of them together stay within the budget.
+ */
+double GWBSE::RamShare(unsigned levels, unsigned columns) const {
+  const double _columns = _rpamax - _rpamin + 1;
+  double _total = (_qpmax - _rpamin + 1) * _columns +
+                  (_homo - _rpamin + 1) * double(_rpamax - _homo);
+  if (_iterate_gw) _total += _qptotal * _columns;
+  return _ram_budget * levels * double(columns) / _total;
+}
+
+/*
+ * GW part of the calculation, from the auxiliary basis to the QP energies.
+ * On return _Mmn holds the three-center integrals transformed with the
+ * final PPM, _sigma_x, _sigma_c and _qp_energies are set.
+ */
+void GWBSE::GWA_calculate(const std::vector<ctp::QMAtom *> &_atoms,
+                          TCMatrix &_Mmn) {
+
+  AOOverlap _gwoverlap;
+  ub::matrix<double> _gwoverlap_cholesky_inverse;  // will also be needed in PPM
+                                                   // itself
+  if (!ReadThreecenterCheckpoint(_Mmn, _gwoverlap.Matrix(),
+                                 _gwoverlap_cholesky_inverse)) {
+    // load auxiliary GW basis set (element-wise information) from xml file
+    BasisSet gwbs;
+    gwbs.LoadBasisSet(_gwbasis_name);
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Loaded GW Basis Set " << _gwbasis_name
+                                   << flush;
+
+    // fill auxiliary GW AO basis by going through all atoms
+    AOBasis gwbasis;
+    gwbasis.AOBasisFill(&gwbs, _atoms);
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Filled GW Basis of size "
+                                   << gwbasis.AOBasisSize() << flush;
+
+    /*
+     * for the representation of 2-point functions with the help of the
+     * auxiliary GW basis, its AO overlap matrix is required.
+     * cf. M. Rohlfing, PhD thesis, ch. 3
+     */
+    // Fill overlap
+    _gwoverlap.Fill(gwbasis);
+
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Filled GW Overlap matrix of dimension: "
+                                   << _gwoverlap.Matrix().size1() << flush;
+
+    /*
+     *  for the calculation of Coulomb and exchange term in the self
+     *  energy and electron-hole interaction, the Coulomb interaction
+     *  is represented using the auxiliary GW basis set.
+     *  Here, we need to prepare the Coulomb matrix expressed in
+     *  the AOs of the GW basis
+     */
+
+    // get Coulomb matrix as AOCoulomb
+    AOCoulomb _gwcoulomb;
+
+    // Fill Coulomb matrix
+    _gwcoulomb.Fill(gwbasis);
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Filled GW Coulomb matrix of dimension: "
+                                   << _gwcoulomb.Matrix().size1() << flush;
+
+    // PPM is symmetric, so we need to get the sqrt of the Coulomb matrix
+
+    ub::matrix<double> _gwoverlap_cholesky = _gwoverlap.Matrix();
+    linalg_cholesky_decompose(_gwoverlap_cholesky);
+
+// remove L^T from Cholesky
+#pragma omp parallel for
+    for (unsigned i = 0; i < _gwoverlap_cholesky.size1(); i++) {
+      for (unsigned j = i + 1; j < _gwoverlap_cholesky.size1(); j++) {
+        _gwoverlap_cholesky(i, j) = 0.0;
+      }
+    }
+
+    int removed = linalg_invert_svd(_gwoverlap_cholesky,
+                                    _gwoverlap_cholesky_inverse, 1e7);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Removed " << removed
+        << " functions from gwoverlap to avoid near linear dependencies"
+        << flush;
+
+    int removed_functions = _gwcoulomb.Symmetrize(_gwoverlap_cholesky);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Prepared GW Coulomb matrix for symmetric PPM"
+        << flush;
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Removed " << removed_functions
+        << " functions from gwcoulomb to avoid near linear dependencies"
+        << flush;
+    /* calculate 3-center integrals,  convoluted with DFT eigenvectors
+     *
+     *  M_mn(beta) = \int{ \psi^DFT_m(r) \phi^GW_beta(r) \psi^DFT_n d3r  }
+     *             = \sum_{alpha,gamma} { c_m,alpha c_n,gamma \int
+     * {\phi^DFT_alpha(r) \phi^GW_beta(r) \phi^DFT_gamma(r) d3r}  }
+     *
+     *  cf. M. Rohlfing, PhD thesis, ch. 3.2
+     *
+     */
+
+    // --- prepare a vector (gwdacay) of matrices (orbitals, orbitals) as
+    // container => M_mn
+    // prepare 3-center integral object
+
+    _Mmn.Initialize(gwbasis.AOBasisSize(), _rpamin, _qpmax, _rpamin, _rpamax);
+    _Mmn.Fill(gwbasis, _dftbasis, _dft_orbitals);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp()
+        << " Calculated Mmn_beta (3-center-repulsion x orbitals)  " << flush;
+
+    // make _Mmn symmetric
+    _Mmn.Symmetrize(_gwcoulomb.Matrix());
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Symmetrize Mmn_beta for self-energy  "
+        << flush;
+
+    if (_compression_tolerance > 0.0) {
+      // from here on the GW basis is the orthonormal compressed one
+      int _rank = Compress_threecenters(_Mmn, _gwoverlap_cholesky_inverse);
+      _gwoverlap.Matrix() = ub::identity_matrix<double>(_rank);
+      _gwoverlap_cholesky_inverse = ub::identity_matrix<double>(_rank);
+    }
+
+    WriteThreecenterCheckpoint(_Mmn, _gwoverlap.Matrix(),
+                               _gwoverlap_cholesky_inverse);
+  }
+
+  // for use in RPA, make a copy of _Mmn with dimensions
+  // (1:HOMO)(gwabasissize,LUMO:nmax)
+  TCMatrix _Mmn_RPA;
+  _Mmn_RPA.SetScratch(_scratch_dir,
+                      RamShare(_homo - _rpamin + 1, _rpamax - _homo));
+  _Mmn_RPA.Initialize(_Mmn.get_beta(), _rpamin, _homo, _homo + 1,
+                      _rpamax);
+  RPA_prepare_threecenters(_Mmn_RPA, _Mmn);
+  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                 << " Prepared Mmn_beta for RPA  " << flush;
+
+  // fix the frequencies for PPM
+  _screening_freq = ub::zero_matrix<double>(2, 2);  // two frequencies
+  // first one
+  _screening_freq(0, 0) = 0.0;  // real part
+  _screening_freq(0, 1) = 0.0;  // imaginary part
+  // second one
+  _screening_freq(1, 0) = 0.0;  // real part
+  _screening_freq(1, 1) = 0.5;  // imaginary part  //hartree
+
+  // one entry to epsilon for each frequency
+  _epsilon.resize(_screening_freq.size1());
+
+  /* for automatic iteration of _shift, we need to
+   * - calculate eps
+   * - construct ppm
+   * - threecenters for sigma (QP levels only, _Mmn is not modified)
+   * - sigma_x
+   * - sigma_c
+   * - test for convergence
+   *
+   */
+
+  // initialize _qp_energies;
+  // shift unoccupied levels by the shift
+  _qp_energies = ub::zero_vector<double>(_orbitals->getNumberOfLevels());
+  for (size_t i = 0; i < _qp_energies.size(); ++i) {
+    _qp_energies(i) = _orbitals->MOEnergies()(i);
+    if (i > _homo) {
+      _qp_energies(i) += _shift;
+    }
+  }
+
+  _sigma_c.resize(_qptotal);
+  _sigma_x.resize(_qptotal);
+
+  // for evGW the PPM transformation changes in every iteration, the
+  // transformed QP levels are kept apart so that _Mmn stays untouched
+  TCMatrix _Mmn_sigma;
+  if (_iterate_gw) {
+    _Mmn_sigma.SetScratch(_scratch_dir,
+                          RamShare(_qptotal, _rpamax - _rpamin + 1));
+    _Mmn_sigma.Initialize(_Mmn.get_beta(), _qpmin, _qpmax, _rpamin,
+                          _rpamax);
+  } else {
+    _gw_sc_max_iterations = 1;
+  }
+  TCMatrix &_Mmn_qp = _iterate_gw ? _Mmn_sigma : _Mmn;
+
+  const ub::vector<double> &_dft_energies = _orbitals->MOEnergies();
+  for (unsigned gw_iteration = 0; gw_iteration < _gw_sc_max_iterations;
+       ++gw_iteration) {
+
+    ub::vector<double> _qp_old_rpa = _qp_energies;
+    if (_iterate_gw) {
+      CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " GW Iteraton "
+                                     << gw_iteration + 1 << " of "
+                                     << _gw_sc_max_iterations << flush;
+    }
+
+    // for symmetric PPM, we can initialize _epsilon with the overlap matrix!
+    for (unsigned _i_freq = 0; _i_freq < _screening_freq.size1(); _i_freq++) {
+      _epsilon[_i_freq] = _gwoverlap.Matrix();
+    }
+
+    // determine epsilon from RPA
+    RPA_calculate_epsilon(_Mmn_RPA);
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Calculated epsilon via RPA  " << flush;
+
+    // construct PPM parameters
+    PPM_construct_parameters(_gwoverlap_cholesky_inverse);
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Constructed PPM parameters  " << flush;
+
+    // prepare threecenters for Sigma
+    sigma_prepare_threecenters(_Mmn_qp, _Mmn);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Prepared threecenters for sigma  " << flush;
+
+    sigma_diag(_Mmn_qp);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Calculated diagonal part of Sigma  " << flush;
+    // iterative refinement of qp energies
+
+    double _DFTgap = _dft_energies(_homo + 1) - _dft_energies(_homo);
+    double _QPgap = _qp_energies(_homo + 1) - _qp_energies(_homo);
+    _shift = _QPgap - _DFTgap;
+
+    // qp energies outside the update range are simply shifted.
+    for (unsigned i = _qpmax + 1; i < _dft_energies.size(); ++i) {
+      _qp_energies(i) = _dft_energies(i) + _shift;
+    }
+
+    if (_iterate_gw) {
+      bool _gw_converged = true;
+      ub::vector<double> diff = _qp_old_rpa - _qp_energies;
+      unsigned int _l_not_converged = 0;
+      double E_max = 0;
+      for (unsigned l = 0; l < diff.size(); l++) {
+        if (std::abs(diff(l)) > std::abs(E_max)) {
+          _l_not_converged = l;
+          E_max = diff(l);
+        }
+        if (std::abs(diff(l)) > _gw_sc_limit) {
+          _gw_converged = false;
+        }
+      }
+      double alpha = 0.0;
+      _qp_energies = alpha * _qp_old_rpa + (1 - alpha) * _qp_energies;
+      if (tools::globals::verbose) {
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << ctp::TimeStamp() << " GW_Iteration: " << gw_iteration + 1
+            << " shift=" << _shift << " E_diff max=" << E_max
+            << " StateNo:" << _l_not_converged << flush;
+      }
+
+      if (_gw_converged) {
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << ctp::TimeStamp() << " Converged after " << gw_iteration + 1
+            << " GW iterations" << flush;
+        break;
+      } else if (gw_iteration == _gw_sc_max_iterations - 1) {
+        // continue regardless for now, but drop WARNING
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << ctp::TimeStamp() << " WARNING! GWA spectrum not converged after "
+            << _gw_sc_max_iterations << " iterations." << flush;
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << ctp::TimeStamp() << "          GWA level " << _l_not_converged
+            << " energy changed by " << diff(_l_not_converged) << flush;
+        CTP_LOG(ctp::logDEBUG, *_pLog)
+            << ctp::TimeStamp()
+            << "          Run continues. Inspect results carefully!" << flush;
+        break;
+      }
+
+    }
+  }
+
+  sigma_offdiag(_Mmn_qp);
+  CTP_LOG(ctp::logDEBUG, *_pLog)
+      << ctp::TimeStamp() << " Calculated offdiagonal part of Sigma  " << flush;
+  _gwoverlap.Matrix().resize(0, 0);
+  _gwoverlap_cholesky_inverse.resize(0, 0);
+  _Mmn_RPA.Cleanup();
+  if (_iterate_gw) {
+    _Mmn_sigma.Cleanup();
+    // BSE works with the levels transformed by the final PPM
+    sigma_prepare_threecenters(_Mmn, _Mmn);
+    CTP_LOG(ctp::logDEBUG, *_pLog)
+        << ctp::TimeStamp() << " Cleaned up Overlap, MmnRPA and Mmn_sigma "
+        << flush;
+  } else {
+    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
+                                   << " Cleaned up Overlap and MmnRPA" << flush;
+  }
+  return;
+}
+
 /*
  *    Many-body Green's fuctions theory implementation
  *
@@ -604,279 +987,26 @@ bool GWBSE::Evaluate() {
   _vxc_ao.resize(0, 0);
 
   /// ------- actual calculation begins here -------
-
-  // load auxiliary GW basis set (element-wise information) from xml file
-  BasisSet gwbs;
-  gwbs.LoadBasisSet(_gwbasis_name);
-  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Loaded GW Basis Set "
-                                 << _gwbasis_name << flush;
-
-  // fill auxiliary GW AO basis by going through all atoms
-  AOBasis gwbasis;
-  gwbasis.AOBasisFill(&gwbs, _atoms);
   _orbitals->setGWbasis(_gwbasis_name);
-  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                 << " Filled GW Basis of size "
-                                 << gwbasis.AOBasisSize() << flush;
-
-  /*
-   * for the representation of 2-point functions with the help of the
-   * auxiliary GW basis, its AO overlap matrix is required.
-   * cf. M. Rohlfing, PhD thesis, ch. 3
-   */
-  AOOverlap _gwoverlap;
-  // Fill overlap
-  _gwoverlap.Fill(gwbasis);
-
-  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                 << " Filled GW Overlap matrix of dimension: "
-                                 << _gwoverlap.Matrix().size1() << flush;
-
-  /*
-   *  for the calculation of Coulomb and exchange term in the self
-   *  energy and electron-hole interaction, the Coulomb interaction
-   *  is represented using the auxiliary GW basis set.
-   *  Here, we need to prepare the Coulomb matrix expressed in
-   *  the AOs of the GW basis
-   */
-
-  // get Coulomb matrix as AOCoulomb
-  AOCoulomb _gwcoulomb;
-
-  // Fill Coulomb matrix
-  _gwcoulomb.Fill(gwbasis);
-  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                 << " Filled GW Coulomb matrix of dimension: "
-                                 << _gwcoulomb.Matrix().size1() << flush;
-
-  // PPM is symmetric, so we need to get the sqrt of the Coulomb matrix
-
-  ub::matrix<double> _gwoverlap_cholesky = _gwoverlap.Matrix();
-  linalg_cholesky_decompose(_gwoverlap_cholesky);
-
-// remove L^T from Cholesky
-#pragma omp parallel for
-  for (unsigned i = 0; i < _gwoverlap_cholesky.size1(); i++) {
-    for (unsigned j = i + 1; j < _gwoverlap_cholesky.size1(); j++) {
-      _gwoverlap_cholesky(i, j) = 0.0;
-    }
+  if (!_checkpoint_dir.empty()) {
+    CheckpointKeys(_atoms);
   }
 
-  ub::matrix<double> _gwoverlap_cholesky_inverse;  // will also be needed in PPM
-                                                   // itself
-  int removed =
-      linalg_invert_svd(_gwoverlap_cholesky, _gwoverlap_cholesky_inverse, 1e7);
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp() << " Removed " << removed
-      << " functions from gwoverlap to avoid near linear dependencies" << flush;
-
-  int removed_functions = _gwcoulomb.Symmetrize(_gwoverlap_cholesky);
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp() << " Prepared GW Coulomb matrix for symmetric PPM"
-      << flush;
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp() << " Removed " << removed_functions
-      << " functions from gwcoulomb to avoid near linear dependencies" << flush;
-  /* calculate 3-center integrals,  convoluted with DFT eigenvectors
-   *
-   *  M_mn(beta) = \int{ \psi^DFT_m(r) \phi^GW_beta(r) \psi^DFT_n d3r  }
-   *             = \sum_{alpha,gamma} { c_m,alpha c_n,gamma \int
-   * {\phi^DFT_alpha(r) \phi^GW_beta(r) \phi^DFT_gamma(r) d3r}  }
-   *
-   *  cf. M. Rohlfing, PhD thesis, ch. 3.2
-   *
-   */
-
-  // --- prepare a vector (gwdacay) of matrices (orbitals, orbitals) as
-  // container => M_mn
-  // prepare 3-center integral object
-
+  // the QP stage yields the PPM transformed three-center integrals for BSE
   TCMatrix _Mmn;
-  _Mmn.Initialize(gwbasis.AOBasisSize(), _rpamin, _qpmax, _rpamin, _rpamax);
-  _Mmn.Fill(gwbasis, _dftbasis, _dft_orbitals);
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp()
-      << " Calculated Mmn_beta (3-center-repulsion x orbitals)  " << flush;
-
-  // make _Mmn symmetric
-  _Mmn.Symmetrize(_gwcoulomb.Matrix());
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp() << " Symmetrize Mmn_beta for self-energy  " << flush;
-
-  // for use in RPA, make a copy of _Mmn with dimensions
-  // (1:HOMO)(gwabasissize,LUMO:nmax)
-  TCMatrix _Mmn_RPA;
-  _Mmn_RPA.Initialize(gwbasis.AOBasisSize(), _rpamin, _homo, _homo + 1,
-                      _rpamax);
-  RPA_prepare_threecenters(_Mmn_RPA, _Mmn);
-  CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                 << " Prepared Mmn_beta for RPA  " << flush;
-
-  // fix the frequencies for PPM
-  _screening_freq = ub::zero_matrix<double>(2, 2);  // two frequencies
-  // first one
-  _screening_freq(0, 0) = 0.0;  // real part
-  _screening_freq(0, 1) = 0.0;  // imaginary part
-  // second one
-  _screening_freq(1, 0) = 0.0;  // real part
-  _screening_freq(1, 1) = 0.5;  // imaginary part  //hartree
-
-  // one entry to epsilon for each frequency
-  _epsilon.resize(_screening_freq.size1());
-
-  /* for automatic iteration of _shift, we need to
-   * - make a copy of _Mmn
-   * - calculate eps
-   * - construct ppm
-   * - threecenters for sigma
-   * - sigma_x
-   * - sigma_c
-   * - test for convergence
-   *
-   */
-
-  // initialize _qp_energies;
-  // shift unoccupied levels by the shift
-  _qp_energies = ub::zero_vector<double>(_orbitals->getNumberOfLevels());
-  for (size_t i = 0; i < _qp_energies.size(); ++i) {
-    _qp_energies(i) = _orbitals->MOEnergies()(i);
-    if (i > _homo) {
-      _qp_energies(i) += _shift;
-    }
-  }
-
-  _sigma_c.resize(_qptotal);
-  _sigma_x.resize(_qptotal);
-
-  TCMatrix _Mmn_backup;
-  if (_iterate_gw) {
-
-    // make copy of _Mmn, memory++
-
-    _Mmn_backup.Initialize(gwbasis.AOBasisSize(), _rpamin, _qpmax, _rpamin,
-                           _rpamax);
-    int _mnsize = _Mmn_backup.get_mtot();
-    for (int _i = 0; _i < _mnsize; _i++) {
-      _Mmn_backup[_i] = _Mmn[_i];
-    }
-    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                   << " Made backup of _Mmn  " << flush;
-  } else {
-    _gw_sc_max_iterations = 1;
+  _Mmn.SetScratch(_scratch_dir,
+                  RamShare(_qpmax - _rpamin + 1, _rpamax - _rpamin + 1));
+  if (!ReadQPCheckpoint(_Mmn)) {
+    GWA_calculate(_atoms, _Mmn);
+    WriteQPCheckpoint(_Mmn);
   }
-
+  // the GW matrices are freed, BSE loads tiles of _Mmn from the whole budget
+  _Mmn.SetRamBudget(_ram_budget);
   const ub::vector<double> &_dft_energies = _orbitals->MOEnergies();
-  for (unsigned gw_iteration = 0; gw_iteration < _gw_sc_max_iterations;
-       ++gw_iteration) {
-
-    ub::vector<double> _qp_old_rpa = _qp_energies;
-    if (_iterate_gw) {
-      CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " GW Iteraton "
-                                     << gw_iteration + 1 << " of "
-                                     << _gw_sc_max_iterations << flush;
-    }
-
-    // for symmetric PPM, we can initialize _epsilon with the overlap matrix!
-    for (unsigned _i_freq = 0; _i_freq < _screening_freq.size1(); _i_freq++) {
-      _epsilon[_i_freq] = _gwoverlap.Matrix();
-    }
-
-    // determine epsilon from RPA
-    RPA_calculate_epsilon(_Mmn_RPA);
-    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                   << " Calculated epsilon via RPA  " << flush;
-
-    // construct PPM parameters
-    PPM_construct_parameters(_gwoverlap_cholesky_inverse);
-    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                   << " Constructed PPM parameters  " << flush;
-
-    // prepare threecenters for Sigma
-    sigma_prepare_threecenters(_Mmn);
-    CTP_LOG(ctp::logDEBUG, *_pLog)
-        << ctp::TimeStamp() << " Prepared threecenters for sigma  " << flush;
-
-    sigma_diag(_Mmn);
-    CTP_LOG(ctp::logDEBUG, *_pLog)
-        << ctp::TimeStamp() << " Calculated diagonal part of Sigma  " << flush;
-    // iterative refinement of qp energies
-
-    double _DFTgap = _dft_energies(_homo + 1) - _dft_energies(_homo);
-    double _QPgap = _qp_energies(_homo + 1) - _qp_energies(_homo);
-    _shift = _QPgap - _DFTgap;
-
-    // qp energies outside the update range are simply shifted.
-    for (unsigned i = _qpmax + 1; i < _dft_energies.size(); ++i) {
-      _qp_energies(i) = _dft_energies(i) + _shift;
-    }
-
-    if (_iterate_gw) {
-      bool _gw_converged = true;
-      ub::vector<double> diff = _qp_old_rpa - _qp_energies;
-      unsigned int _l_not_converged = 0;
-      double E_max = 0;
-      for (unsigned l = 0; l < diff.size(); l++) {
-        if (std::abs(diff(l)) > std::abs(E_max)) {
-          _l_not_converged = l;
-          E_max = diff(l);
-        }
-        if (std::abs(diff(l)) > _gw_sc_limit) {
-          _gw_converged = false;
-        }
-      }
-      double alpha = 0.0;
-      _qp_energies = alpha * _qp_old_rpa + (1 - alpha) * _qp_energies;
-      if (tools::globals::verbose) {
-        CTP_LOG(ctp::logDEBUG, *_pLog)
-            << ctp::TimeStamp() << " GW_Iteration: " << gw_iteration + 1
-            << " shift=" << _shift << " E_diff max=" << E_max
-            << " StateNo:" << _l_not_converged << flush;
-      }
-
-      if (_gw_converged) {
-        CTP_LOG(ctp::logDEBUG, *_pLog)
-            << ctp::TimeStamp() << " Converged after " << gw_iteration + 1
-            << " GW iterations" << flush;
-        break;
-      } else if (gw_iteration == _gw_sc_max_iterations - 1) {
-        // continue regardless for now, but drop WARNING
-        CTP_LOG(ctp::logDEBUG, *_pLog)
-            << ctp::TimeStamp() << " WARNING! GWA spectrum not converged after "
-            << _gw_sc_max_iterations << " iterations." << flush;
-        CTP_LOG(ctp::logDEBUG, *_pLog)
-            << ctp::TimeStamp() << "          GWA level " << _l_not_converged
-            << " energy changed by " << diff(_l_not_converged) << flush;
-        CTP_LOG(ctp::logDEBUG, *_pLog)
-            << ctp::TimeStamp()
-            << "          Run continues. Inspect results carefully!" << flush;
-        break;
-      }
-
-      int _mnsize = _Mmn_backup.get_mtot();
-      for (int _i = 0; _i < _mnsize; _i++) {
-        _Mmn[_i] = _Mmn_backup[_i];
-      }
-    }
-  }
 
-  sigma_offdiag(_Mmn);
-  CTP_LOG(ctp::logDEBUG, *_pLog)
-      << ctp::TimeStamp() << " Calculated offdiagonal part of Sigma  " << flush;
-  _gwoverlap.Matrix().resize(0, 0);
-  _gwoverlap_cholesky_inverse.resize(0, 0);
-  _Mmn_RPA.Cleanup();
-  if (_iterate_gw) {
-    _Mmn_backup.Cleanup();
-    CTP_LOG(ctp::logDEBUG, *_pLog)
-        << ctp::TimeStamp() << " Cleaned up Overlap, MmnRPA and Mmn_backup "
-        << flush;
-  } else {
-    CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp()
-                                   << " Cleaned up Overlap and MmnRPA" << flush;
-  }
   // free no longer required three-center matrices in _Mmn
   // max required is _bse_cmax (could be smaller than _qpmax)
-  _Mmn.Prune(gwbasis.AOBasisSize(), _bse_vmin, _bse_cmax);
+  _Mmn.Prune(_Mmn.get_beta(), _bse_vmin, _bse_cmax);
 
   // Output of quasiparticle energies after all is done:
 
@@ -978,7 +1108,9 @@ bool GWBSE::Evaluate() {
   }    // constructing full quasiparticle Hamiltonian
 
   // proceed only if BSE requested
-  if (_do_bse_singlets || _do_bse_triplets) {
+  if (_do_matrixfree && (_do_bse_singlets || _do_bse_triplets)) {
+    BSE_solve_matrixfree(_Mmn);
+  } else if (_do_bse_singlets || _do_bse_triplets) {
 
     // calculate direct part of eh interaction, needed for singlets and triplets
     BSE_d_setup(_Mmn);
@@ -75,6 +75,11 @@ namespace votca {
             // Logger redirection
             _redirect_logger = options->ifExistsReturnElseReturnDefault<bool>(".redirect_logger", false);
             _logger_file = "gwbse.log";
+
+            // reuse MOs and BSE eigenvectors of the previous call as guess,
+            // e.g. for the displaced geometries of numerical forces
+            _do_warmstart = options->ifExistsReturnElseReturnDefault<bool>(".warmstart", false);
+            _reference_electrons = 0;
             
             // for requested merged guess, two archived orbitals objects are needed
             if ( _do_guess ){
@@ -110,6 +115,7 @@ namespace votca {
 
                 // required for merged guess
                 Orbitals *_orbitalsAB = NULL;
+                Orbitals _orbitals_previous;
                 if (_qmpackage->GuessRequested() && _do_guess) { // do not want to do an SCF loop for a dimer
                     if (_redirect_logger) {
                        CTP_LOG_SAVE(ctp::logINFO, _gwbse_engine_logger) << "Guess requested, reading molecular orbitals" << flush;
@@ -132,6 +138,19 @@ namespace votca {
 
                     _orbitals->PrepareGuess(&_orbitalsA, &_orbitalsB, _orbitalsAB);
 
+                } else if (_qmpackage->GuessRequested() && _do_warmstart && _reference_mos.size1() > 0) {
+                    // xtpdft keeps its last MOs itself, other packages get them as guess file
+                    if (_redirect_logger) {
+                       CTP_LOG_SAVE(ctp::logINFO, _gwbse_engine_logger) << "Guess requested, using molecular orbitals of the previous geometry" << flush;
+                    } else {
+                       CTP_LOG_SAVE(ctp::logINFO, *_pLog) << "Guess requested, using molecular orbitals of the previous geometry" << flush;
+                    }
+                    _orbitals_previous.setBasisSetSize(_reference_mos.size2());
+                    _orbitals_previous.setNumberOfElectrons(_reference_electrons);
+                    _orbitals_previous.setNumberOfLevels(_reference_electrons, _reference_mos.size1() - _reference_electrons);
+                    _orbitals_previous.MOCoefficients() = _reference_mos;
+                    _orbitals_previous.MOEnergies() = _reference_mo_energies;
+                    _orbitalsAB = &_orbitals_previous;
                 }
                 
                 _qmpackage->WriteInputFile(_segments, _orbitalsAB);
@@ -172,16 +191,49 @@ namespace votca {
                 _orbitals->Load(_archive_file);
             }
 
+            if (_do_warmstart) AlignMOPhases(_orbitals);
+
             if (_do_gwbse) {
                 GWBSE _gwbse = GWBSE(_orbitals);
                 _gwbse.setLogger(_pLog);
                 if (_redirect_logger) _gwbse.setLogger(&_gwbse_engine_logger);
                 _gwbse.Initialize(&_gwbse_options);
+                if (_openmp_threads > 0) _gwbse.setThreads(_openmp_threads);
+                if (_do_warmstart) _gwbse.setBSEGuess(_reference_singlets, _reference_triplets);
                 _gwbse.Evaluate();
                 if (_redirect_logger) SaveRedirectedLogger(&_gwbse_engine_logger);
                 Property *_output_summary = &(_summary.add("output", ""));
                 _gwbse.addoutput(_output_summary);
             }
+
+            if (_do_warmstart) {
+                _reference_mos = _orbitals->MOCoefficients();
+                _reference_mo_energies = _orbitals->MOEnergies();
+                _reference_electrons = _orbitals->getNumberOfElectrons();
+                if (_do_gwbse) {
+                    _reference_singlets = _orbitals->BSESingletCoefficients();
+                    _reference_triplets = _orbitals->BSETripletCoefficients();
+                }
+            }
+            return;
+        }
+
+        /*
+         * The DFT code may return any MO with the opposite sign. For a BSE
+         * guess from the previous geometry the signs have to agree with the
+         * reference, otherwise the transitions v->c pick up random signs.
+         */
+        void GWBSEENGINE::AlignMOPhases(Orbitals* _orbitals) {
+            ub::matrix<double>& _mos = _orbitals->MOCoefficients();
+            if (_mos.size1() != _reference_mos.size1() || _mos.size2() != _reference_mos.size2()) return;
+            int _flipped = 0;
+            for (unsigned _level = 0; _level < _mos.size1(); _level++) {
+                if (ub::inner_prod(ub::row(_mos, _level), ub::row(_reference_mos, _level)) < 0.0) {
+                    ub::row(_mos, _level) *= -1.0;
+                    _flipped++;
+                }
+            }
+            CTP_LOG(ctp::logDEBUG, *_pLog) << ctp::TimeStamp() << " Aligned phases of " << _flipped << " MOs to the previous geometry" << flush;
             return;
         }
 
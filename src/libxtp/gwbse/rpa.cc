@@ -106,128 +106,101 @@ namespace votca {
         }
         
         
-        //imaginary
-        ub::matrix<double> GWBSE::RPA_imaginary(const TCMatrix& _Mmn_RPA,const double screening_freq) {
-            const int _size = _Mmn_RPA.get_beta(); // size of gwbasis
-            const int index_n = _Mmn_RPA.get_nmin();
-            const int index_m = _Mmn_RPA.get_mmin();
-            const double screenf2=screening_freq * screening_freq;
-            ub::matrix<double> result=ub::zero_matrix<double>(_size);
-          
-            const ub::vector<double>& qp_energies=   _qp_energies;
-              
-          
-            
-            #pragma omp parallel for 
-            for (int _m_level = 0; _m_level < _Mmn_RPA.get_mtot(); _m_level++) {
-                const double _qp_energy_m=qp_energies(_m_level + index_m);
-#if (GWBSE_DOUBLE)
-                const ub::matrix<double>& Mmn_RPA = _Mmn_RPA[ _m_level ];
-#else
-                const ub::matrix<double> Mmn_RPA = _Mmn_RPA[ _m_level ];
-#endif
-                // a temporary matrix, that will get filled in empty levels loop
-                ub::matrix<double> _temp = ub::matrix<double>(_Mmn_RPA.get_ntot(), _size);
-
-                // loop over empty levels
-                for (int _n_level = 0; _n_level < _Mmn_RPA.get_ntot(); _n_level++) {
-                    
-
-                    const double _deltaE = qp_energies(_n_level + index_n) -_qp_energy_m ; // get indices and units right!!!
-
-                    // this only works, if we have either purely real or purely imaginary frequencies
-
-                    // purely imaginary
-                    const double _energy_factor = 4.0 * _deltaE / (_deltaE * _deltaE + screenf2);//hartree
-                    for (int _i_gw = 0; _i_gw < _size; _i_gw++) {
-                        _temp(_n_level, _i_gw) = _energy_factor * Mmn_RPA(_i_gw, _n_level);
-                    } // matrix size
+    void GWBSE::RPA_calculate_epsilon(const TCMatrix& _Mmn_RPA){
 
-                } // empty levels
-                _temp=ub::prod(Mmn_RPA, _temp);
-                // now multiply and add to epsilon
-                #pragma omp critical
-                {
-                result+=_temp;
-                }
-            } // occupied levels
-              
-            return result;
+        const int _size = _Mmn_RPA.get_beta(); // size of gwbasis
+        const int index_n = _Mmn_RPA.get_nmin();
+        const int index_m = _Mmn_RPA.get_mmin();
+        const int _ntot = _Mmn_RPA.get_ntot();
+        const int _mtot = _Mmn_RPA.get_mtot();
+        const unsigned _nfreq = _screening_freq.size1();
+        const ub::vector<double>& qp_energies = _qp_energies;
+
+        // this only works, if we have either purely real or purely imaginary frequencies
+        for (unsigned _i_freq = 0; _i_freq < _nfreq; _i_freq++) {
+            if (_screening_freq(_i_freq, 0) != 0.0 && _screening_freq(_i_freq, 1) != 0.0) {
+                // mixed -> FAIL
+                cerr << " mixed frequency! real part: " << _screening_freq(_i_freq, 0) << " imaginary part: " << _screening_freq(_i_freq, 1) << flush;
+                exit(1);
+            }
         }
-        //real
-
-        ub::matrix<double> GWBSE::RPA_real(const TCMatrix& _Mmn_RPA, const double screening_freq) {
-            const int _size = _Mmn_RPA.get_beta(); // size of gwbasis
-            const int index_n = _Mmn_RPA.get_nmin();
-            const int index_m = _Mmn_RPA.get_mmin();
-            const ub::vector<double>& qp_energies=   _qp_energies;
-            ub::matrix<double> result=ub::zero_matrix<double>(_size);
-           
-            
-            #pragma omp parallel for 
-            for (int _m_level = 0; _m_level < _Mmn_RPA.get_mtot(); _m_level++) {
-                const double _qp_energy_m=qp_energies(_m_level + index_m);
-                
-                
-#if (GWBSE_DOUBLE)
-                const ub::matrix<double>& Mmn_RPA = _Mmn_RPA[ _m_level ];
-#else
-                const ub::matrix<double> Mmn_RPA = _Mmn_RPA[ _m_level ];
-#endif
 
-                // a temporary matrix, that will get filled in empty levels loop
-                ub::matrix<double> _temp = ub::matrix<double>(_Mmn_RPA.get_ntot(), _size);
-                
-
-                // loop over empty levels
-                for (int _n_level = 0; _n_level < _Mmn_RPA.get_ntot(); _n_level++) {
-                   
-                    const double _deltaE = qp_energies(_n_level + index_n) - _qp_energy_m; // get indices and units right!!!
-
-                    // this only works, if we have either purely real or purely imaginary frequencies
+        // occupied levels are stacked into blocks, so that each product has
+        // an inner dimension of at least the size of the gwbasis
+        const int _blocksize = std::min(_mtot, std::max(1, (_size + _ntot - 1) / std::max(1, _ntot)));
+
+        // every Mmn is read once for all frequencies, out of core the blocks
+        // are processed in tiles of levels which fit into the RAM budget
+        const int _tile = std::max(1, _Mmn_RPA.TileSize() / _blocksize) * _blocksize;
+        for (int _tile_start = 0; _tile_start < _mtot; _tile_start += _tile) {
+            const int _tile_end = std::min(_mtot, _tile_start + _tile);
+            _Mmn_RPA.Load(_tile_start, _tile_end);
+            for (int _m_start = _tile_start; _m_start < _tile_end; _m_start += _blocksize) {
+                const int _m_end = std::min(_tile_end, _m_start + _blocksize);
+                const int _stacksize = (_m_end - _m_start) * _ntot;
+
+                // Mmn of all levels in the block side by side
+                ub::matrix<double> _Mstack = ub::matrix<double>(_size, _stacksize);
+                ub::vector<double> _deltaE = ub::vector<double>(_stacksize);
+                #pragma omp parallel for
+                for (int _m_level = _m_start; _m_level < _m_end; _m_level++) {
+                    const int _offset = (_m_level - _m_start) * _ntot;
+                    ub::project(_Mstack, ub::range(0, _size), ub::range(_offset, _offset + _ntot)) = _Mmn_RPA[ _m_level ];
+                    for (int _n_level = 0; _n_level < _ntot; _n_level++) {
+                        _deltaE(_offset + _n_level) = qp_energies(_n_level + index_n) - qp_energies(_m_level + index_m);
+                    }
+                }
+                RPA_add_transitions(_epsilon, _Mstack, _deltaE, _screening_freq);
+            } // blocks of occupied levels
+            _Mmn_RPA.Release(_tile_start, _tile_end);
+        } // tiles
 
+        return;
+    }
+        
+        
+   
+    void GWBSE::RPA_add_transitions(std::vector< ub::matrix<double> >& epsilon, const ub::matrix<double>& Mstack,
+                                    const ub::vector<double>& deltaE, const ub::matrix<double>& screening_freqs){
+
+        const int _size = Mstack.size1();
+        const int _stacksize = Mstack.size2();
+        unsigned nthreads = 1;
+        #ifdef _OPENMP
+            nthreads = omp_get_max_threads();
+        #endif
+        // every thread adds to its own rows of epsilon, so no private
+        // copies of epsilon are needed
+        const int _rows = (_size + nthreads - 1) / nthreads;
+
+        ub::matrix<double> _temp = ub::matrix<double>(_stacksize, _size);
+        for (unsigned _i_freq = 0; _i_freq < screening_freqs.size1(); _i_freq++) {
+            const bool _imaginary = (screening_freqs(_i_freq, 0) == 0.0);
+            const double screening_freq = _imaginary ? screening_freqs(_i_freq, 1) : screening_freqs(_i_freq, 0);
+            const double screenf2 = screening_freq * screening_freq;
+            #pragma omp parallel for
+            for (int _index = 0; _index < _stacksize; _index++) {
+                const double _dE = deltaE(_index);
+                double _energy_factor;
+                if (_imaginary) {
+                    // purely imaginary
+                    _energy_factor = 4.0 * _dE / (_dE * _dE + screenf2); //hartree
+                } else {
                     // purely real
-                    const double _energy_factor =2.0*  (1.0 / (_deltaE - screening_freq) + 1.0 / (_deltaE + screening_freq));//hartree
-
-                    for (int _i_gw = 0; _i_gw < _size; _i_gw++) {
-                        _temp(_n_level, _i_gw) = _energy_factor * Mmn_RPA(_i_gw, _n_level);
-                    } // matrix size
-
-                } // empty levels
-
-                // now multiply and add to epsilon
-               _temp=ub::prod(Mmn_RPA, _temp);
-                #pragma omp critical
-                {
-                result+=_temp;
+                    _energy_factor = 2.0 * (1.0 / (_dE - screening_freq) + 1.0 / (_dE + screening_freq)); //hartree
                 }
-            } // occupied levels
-   
-            return result;
+                for (int _i_gw = 0; _i_gw < _size; _i_gw++) {
+                    _temp(_index, _i_gw) = _energy_factor * Mstack(_i_gw, _index);
+                }
+            }
+            // now multiply and add to epsilon
+            #pragma omp parallel for
+            for (int _row_start = 0; _row_start < _size; _row_start += _rows) {
+                const ub::range _range(_row_start, std::min(_size, _row_start + _rows));
+                ub::matrix_range< ub::matrix<double> > _epsilon_rows(epsilon[ _i_freq ], _range, ub::range(0, _size));
+                ub::noalias(_epsilon_rows) += ub::prod(ub::project(Mstack, _range, ub::range(0, _stacksize)), _temp);
+            }
         }
-        
-
-    void GWBSE::RPA_calculate_epsilon(const TCMatrix& _Mmn_RPA){
-
-        // loop over frequencies
-        for ( unsigned _i_freq = 0 ; _i_freq < _screening_freq.size1() ; _i_freq++ ){
-           
-             if ( _screening_freq( _i_freq, 0) == 0.0 ) {         
-                 _epsilon[ _i_freq ]+=RPA_imaginary(_Mmn_RPA, _screening_freq( _i_freq, 1));
-             }
-
-             else if ( _screening_freq( _i_freq, 1) == 0.0  ) {
-                  // purely real
-                 _epsilon[ _i_freq ]+= RPA_real(_Mmn_RPA, _screening_freq( _i_freq, 0));
-                    } 
-             else {
-                    // mixed -> FAIL
-                    cerr << " mixed frequency! real part: " << _screening_freq( _i_freq, 0 ) << " imaginary part: "  << _screening_freq( _i_freq, 1 ) << flush;
-                    exit(1);
-                    }   
-
-        } // loop over frequencies
-
         return;
     }
         
@@ -237,15 +210,23 @@ namespace votca {
         
         ub::range full=ub::range(0, _Mmn_full.get_beta());
         ub::range RPA_cut=ub::range(_Mmn_RPA.get_nmin() - _Mmn_full.get_nmin(), _Mmn_RPA.get_nmax() - _Mmn_full.get_nmin() + 1);
-            // loop over m-levels in _Mmn_RPA
-            #pragma omp parallel for 
-            for (int _m_level = 0; _m_level < _Mmn_RPA.size(); _m_level++) {
-          
-                // copy to _Mmn_RPA
-                _Mmn_RPA[ _m_level ] = ub::project(_Mmn_full[ _m_level ], full, RPA_cut);
-              
-
-            }// loop m-levels
+            // loop over m-levels in _Mmn_RPA, each matrix loads its tile
+            // from its own share of the budget
+            const int _tile = std::min(_Mmn_RPA.TileSize(), _Mmn_full.TileSize());
+            for (int _start = 0; _start < _Mmn_RPA.get_mtot(); _start += _tile) {
+                const int _end = std::min(_start + _tile, _Mmn_RPA.get_mtot());
+                _Mmn_full.Load(_start, _end);
+                _Mmn_RPA.Load(_start, _end);
+                #pragma omp parallel for 
+                for (int _m_level = _start; _m_level < _end; _m_level++) {
+
+                    // copy to _Mmn_RPA
+                    _Mmn_RPA[ _m_level ] = ub::project(_Mmn_full[ _m_level ], full, RPA_cut);
+
+                }// loop m-levels
+                _Mmn_RPA.Store(_start, _end);
+                _Mmn_full.Release(_start, _end);
+            }
      return;   
     } 
 
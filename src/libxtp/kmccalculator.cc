@@ -29,7 +29,7 @@ using namespace std;
 namespace votca {
     namespace xtp {
         
-        KMCCalculator::KMCCalculator(){};
+        KMCCalculator::KMCCalculator():_replicas(1){};
 
     void KMCCalculator::LoadGraph(ctp::Topology *top) {
 
@@ -113,50 +113,6 @@ namespace votca {
     }
     
 
-        void KMCCalculator::ResetForbiddenlist(std::vector<int> &forbiddenid) {
-            forbiddenid.clear();
-            return;
-        }
-
-        void KMCCalculator::AddtoForbiddenlist(int id, std::vector<int> &forbiddenid) {
-            forbiddenid.push_back(id);
-            return;
-        }
-
-        bool KMCCalculator::CheckForbidden(int id,const std::vector<int> &forbiddenlist) {
-            // cout << "forbidden list has " << forbiddenlist.size() << " entries" << endl;
-            bool forbidden = false;
-            for (unsigned int i = 0; i < forbiddenlist.size(); i++) {
-                if (id == forbiddenlist[i]) {
-                    forbidden = true;
-                    //cout << "ID " << id << " has been found as element " << i << " (" << forbiddenlist[i]<< ") in the forbidden list." << endl;
-                    break;
-                }
-            }
-            return forbidden;
-        }
-
-        bool KMCCalculator::CheckSurrounded(GNode* node,const std::vector<int> & forbiddendests) {
-            bool surrounded = true;
-            for (unsigned  i = 0; i < node->events.size(); i++) {
-                bool thisevent_possible = true;
-                for (unsigned int j = 0; j < forbiddendests.size(); j++) {
-                    if (node->events[i].destination == forbiddendests[j]) {
-                        thisevent_possible = false;
-                        break;
-                    }
-                }
-                if (thisevent_possible == true) {
-                    surrounded = false;
-                    break;
-                }
-            }
-            return surrounded;
-        }
-
-        
-        
-        
         std::string KMCCalculator::CarrierInttoLongString(int carriertype){
             std::string name="";
             if (carriertype==-1){
@@ -223,13 +179,17 @@ namespace votca {
          
         
         cout << "looking for injectable nodes..." << endl;
+        _carrierofnode=std::vector<int>(_nodes.size(), -1);
+        _occupationtime=std::vector<double>(_nodes.size(), 0.0);
         for (unsigned int i = 0; i < _numberofcharges; i++) {
             Chargecarrier *newCharge = new Chargecarrier;
             newCharge->id = i;
+            _carriers.push_back(newCharge);
             RandomlyAssignCarriertoSite(newCharge);
             
-            cout << "starting position for charge " << i + 1 << ": segment " << newCharge->getCurrentNodeId()+1 << endl;
-            _carriers.push_back(newCharge);
+            if (_replicas == 1) {
+                cout << "starting position for charge " << i + 1 << ": segment " << newCharge->getCurrentNodeId()+1 << endl;
+            }
         }
         return;
          }
@@ -239,12 +199,14 @@ namespace votca {
             do{
             nodeId_guess=_RandomVariable->rand_uniform_int(_nodes.size());   
             }
-            while (_nodes[nodeId_guess]->occupied || _nodes[nodeId_guess]->injectable==false ); // maybe already occupied? or maybe not injectable?
+            while (Occupied(_nodes[nodeId_guess]) || _nodes[nodeId_guess]->injectable==false ); // maybe already occupied? or maybe not injectable?
             if (Charge->hasNode()){
-                Charge->jumpfromCurrentNodetoNode(_nodes[nodeId_guess]);
+                MoveCarrier(Charge, _nodes[nodeId_guess]);
             }
             else{
+            // new carriers are placed right after they are appended to _carriers
             Charge->settoNote(_nodes[nodeId_guess]);
+            _carrierofnode[nodeId_guess]=_carriers.size()-1;
             }
              return;
          }
@@ -351,32 +313,66 @@ namespace votca {
         }
         
         
-        GLink* KMCCalculator::ChooseHoppingDest(GNode* node){
-            double u = 1 - _RandomVariable->rand_uniform();
-            
-            for (unsigned int j = 0; j < node->events.size(); j++) {
-                u -= node->events[j].rate / node->getEscapeRate();
-                if (u <= 0 || j==node->events.size()-1) {    
-                    return &(node->events[j]);
+        void KMCCalculator::InitEventSelection(){
+            _incomingevents=std::vector< std::vector< std::pair<int,int> > >(_nodes.size());
+            _eventtrees=std::vector<RateTree>(_nodes.size());
+            for (unsigned i = 0; i < _nodes.size(); i++) {
+                const std::vector<GLink>& events=_nodes[i]->events;
+                _eventtrees[i].Resize(events.size());
+                for (unsigned j = 0; j < events.size(); j++) {
+                    if (events[j].decayevent || !Occupied(_nodes[events[j].destination])) {
+                        _eventtrees[i].setRate(j, events[j].rate);
+                    }
+                    if (!events[j].decayevent) {
+                        _incomingevents[events[j].destination].push_back(std::pair<int,int>(i, j));
+                    }
                 }
             }
-            throw runtime_error("Choose Hopping Destination, somehow no event was found");
-            return NULL;
+            _carriertree.Resize(_carriers.size());
+            for (unsigned i = 0; i < _carriers.size(); i++) {
+                int nodeid=_carriers[i]->getCurrentNodeId();
+                _carriertree.setRate(i, _eventtrees[nodeid].Total());
+            }
+            return;
         }
         
-        Chargecarrier* KMCCalculator::ChooseAffectedCarrier(double cumulated_rate){
-            Chargecarrier* carrier=NULL;
-            double u = 1 - _RandomVariable->rand_uniform();
-            for (unsigned int i = 0; i < _numberofcharges; i++) {
-                u -= _carriers[i]->getCurrentEscapeRate() / cumulated_rate;
-
-                if (u <= 0 || i==_numberofcharges-1) {
-
-                    carrier = _carriers[i];
-                    break;}  
-
+        void KMCCalculator::UpdateIncomingEvents(GNode* node){
+            const std::vector< std::pair<int,int> >& incoming=_incomingevents[node->id];
+            for (unsigned i = 0; i < incoming.size(); i++) {
+                const int source=incoming[i].first;
+                const GLink& event=_nodes[source]->events[incoming[i].second];
+                _eventtrees[source].setRate(incoming[i].second, Occupied(node) ? 0.0 : event.rate);
+                if (_carrierofnode[source] >= 0) {
+                    _carriertree.setRate(_carrierofnode[source], _eventtrees[source].Total());
+                }
             }
-            return carrier;
+            return;
+        }
+        
+        void KMCCalculator::MoveCarrier(Chargecarrier* carrier, GNode* newnode){
+            GNode* oldnode=carrier->getCurrentNode();
+            const int index=_carrierofnode[oldnode->id];
+            _carrierofnode[oldnode->id]=-1;
+            carrier->jumpfromCurrentNodetoNode(newnode);
+            _carrierofnode[newnode->id]=index;
+            if (_eventtrees.empty()) {
+                return;
+            }
+            UpdateIncomingEvents(oldnode);
+            UpdateIncomingEvents(newnode);
+            _carriertree.setRate(index, _eventtrees[newnode->id].Total());
+            return;
+        }
+        
+        GLink* KMCCalculator::ChooseHoppingDest(GNode* node){
+            const RateTree& tree=_eventtrees[node->id];
+            double u = _RandomVariable->rand_uniform()*tree.Total();
+            return &(node->events[tree.Choose(u)]);
+        }
+        
+        Chargecarrier* KMCCalculator::ChooseAffectedCarrier(){
+            double u = _RandomVariable->rand_uniform()*_carriertree.Total();
+            return _carriers[_carriertree.Choose(u)];
         }
         
         void KMCCalculator::AddtoJumplengthdistro(const GLink* event,double dt){
@@ -417,6 +413,74 @@ namespace votca {
             }
             return;
         }
+        
+        void KMCCalculator::InitReplica(){
+            _RandomVariable = new tools::Random2();
+            _RandomVariable->init(rand(), rand(), rand(), rand());
+            _carriers.clear();
+            _jumplengthdistro=std::vector<long unsigned>(_jumplengthdistro.size(),0);
+            _jumplengthdistro_weighted=std::vector<double>(_jumplengthdistro_weighted.size(),0);
+            return;
+        }
+        
+        void KMCCalculator::ReleaseReplica(){
+            // the graph belongs to the calculator the replica was copied from,
+            // carriers and random numbers were created by InitReplica
+            _nodes.clear();
+            for(auto& carrier:_carriers){
+                delete carrier;
+            }
+            _carriers.clear();
+            delete _RandomVariable;
+            _RandomVariable=NULL;
+            return;
+        }
+        
+        void KMCCalculator::MeanAndError(const std::vector<double>& values, double& mean, double& error){
+            mean=0.0;
+            for(unsigned i=0;i<values.size();++i){
+                mean+=values[i];
+            }
+            mean/=double(values.size());
+            error=0.0;
+            if(values.size()>1){
+                for(unsigned i=0;i<values.size();++i){
+                    error+=(values[i]-mean)*(values[i]-mean);
+                }
+                error=std::sqrt(error/double(values.size()*(values.size()-1)));
+            }
+            return;
+        }
+        
+        void KMCCalculator::PrintJumplengthdistro(const std::vector<KMCCalculator*>& replicas){
+            if(dolengthdistributon){
+            std::vector< std::vector<double> > percents(_jumplengthdistro.size(),std::vector<double>(replicas.size(),0.0));
+            for(unsigned r=0;r<replicas.size();++r){
+                long unsigned noofjumps=0;
+                for(unsigned i=0;i<_jumplengthdistro.size();++i){
+                    _jumplengthdistro[i]+=replicas[r]->_jumplengthdistro[i];
+                    _jumplengthdistro_weighted[i]+=replicas[r]->_jumplengthdistro_weighted[i];
+                    noofjumps+=replicas[r]->_jumplengthdistro[i];
+                }
+                for(unsigned i=0;i<_jumplengthdistro.size();++i){
+                    percents[i][r]=(noofjumps>0) ? replicas[r]->_jumplengthdistro[i]/double(noofjumps) : 0.0;
+                }
+            }
+            PrintJumplengthdistro();
+            cout<<" distance[nm] | # of jumps [%] |  error [%]  (over "<<replicas.size()<<" replicas)"<<endl;
+            cout<<"------------------------------------------------------------------------------------"<<endl;
+            for(unsigned i=0;i<_jumplengthdistro.size();++i){
+                double dist=lengthresolution*(i+0.5)+minlength;
+                double percent=0.0;
+                double error=0.0;
+                MeanAndError(percents[i],percent,error);
+                cout<<(boost::format("    %4.3f    |    %04.2f    |    %04.2f")
+                            % (dist) % (percent*100) % (error*100)).str()<<endl;
+            }
+            cout<<"------------------------------------------------------------------------------------"<<endl;
+            }
+            return;
+        }
  
         
     }
@@ -492,6 +492,87 @@ namespace votca {
         
         
         
+        double NumericalIntegration::IntegrateVXCBox(const GridBox& box, const ub::matrix<double>& DMAT_here, ub::matrix<double>& Vxc_here){
+                
+                double EXC_box=0.0;
+                
+                const std::vector<tools::vec>& points=box.getGridPoints();
+                const std::vector<double>& weights=box.getGridWeights();
+                const std::vector<ub::range>& aoranges=box.getAOranges();
+                const std::vector<const AOShell* >& shells=box.getShells();
+                const unsigned npoints=box.size();
+                const unsigned nao=box.Matrixsize();
+                
+                // AO values of all points in the box (one row per point) and
+                // their gradients (three consecutive rows per point)
+                std::vector<double> px(npoints);
+                std::vector<double> py(npoints);
+                std::vector<double> pz(npoints);
+                for(unsigned p=0;p<npoints;p++){
+                    px[p]=points[p].getX();
+                    py[p]=points[p].getY();
+                    pz[p]=points[p].getZ();
+                }
+                ub::matrix<double> ao=ub::zero_matrix<double>(npoints,nao);
+                ub::matrix<double> ao_grad=ub::zero_matrix<double>(3*npoints,nao);
+                ub::range all=ub::range(0,npoints);
+                ub::range all3=ub::range(0,3*npoints);
+                for(unsigned j=0;j<box.Shellsize();++j){
+                    ub::matrix_range< ub::matrix<double> > aoshell=ub::project(ao,all,aoranges[j]);
+                    ub::matrix_range< ub::matrix<double> > ao_grad_shell=ub::project(ao_grad,all3,aoranges[j]);
+                    shells[j]->EvalAOspace(aoshell,ao_grad_shell,px,py,pz);
+                }
+                
+                // densities for the whole box with a single product, DMAT is
+                // symmetric so grad rho = 2 * (ao*DMAT) . grad ao
+                const ub::matrix<double> _temp=ub::prod(ao,DMAT_here);
+                
+                // rows of _addXC are the per point contributions to Vxc
+                ub::matrix<double> _addXC=ub::zero_matrix<double>(npoints,nao);
+                ub::matrix<double> rho_grad=ub::matrix<double>(1,3);
+                for(unsigned p=0;p<npoints;p++){
+                    double rho=0.0;
+                    double gx=0.0;
+                    double gy=0.0;
+                    double gz=0.0;
+                    for(unsigned k=0;k<nao;k++){
+                        const double t=_temp(p,k);
+                        rho+=t*ao(p,k);
+                        gx+=t*ao_grad(3*p,k);
+                        gy+=t*ao_grad(3*p+1,k);
+                        gz+=t*ao_grad(3*p+2,k);
+                    }
+                    
+		    if ( rho < 1.e-15 ) continue; // skip the rest, if density is very small
+                    rho_grad(0,0)=2.0*gx;
+                    rho_grad(0,1)=2.0*gy;
+                    rho_grad(0,2)=2.0*gz;
+                    
+                    double f_xc;      // E_xc[n] = int{n(r)*eps_xc[n(r)] d3r} = int{ f_xc(r) d3r }
+                    double df_drho;   // v_xc_rho(r) = df/drho
+                    double df_dsigma; // df/dsigma ( df/dgrad(rho) = df/dsigma * dsigma/dgrad(rho) = df/dsigma * 2*grad(rho))
+                    EvaluateXC( rho,rho_grad,f_xc, df_drho, df_dsigma);
+                    
+                    const double weight=weights[p];
+                    const double frho=0.5*weight*df_drho;
+                    const double fx=2.0*df_dsigma*weight*rho_grad(0,0);
+                    const double fy=2.0*df_dsigma*weight*rho_grad(0,1);
+                    const double fz=2.0*df_dsigma*weight*rho_grad(0,2);
+                    for(unsigned k=0;k<nao;k++){
+                        _addXC(p,k)=frho*ao(p,k)+fx*ao_grad(3*p,k)+fy*ao_grad(3*p+1,k)+fz*ao_grad(3*p+2,k);
+                    }
+
+                    // Exchange correlation energy
+                    EXC_box += weight  * rho * f_xc;
+                }
+                
+                // accumulate the whole box at once
+                Vxc_here=ub::prod(ub::trans(_addXC),ao);
+                
+                return EXC_box;
+        }
+        
+        
         ub::matrix<double> NumericalIntegration::IntegrateVXC(const ub::matrix<double>& _density_matrix){
             ub::matrix<double> Vxc=ub::zero_matrix<double>(_density_matrix.size1());
             EXC = 0;
@@ -512,78 +593,227 @@ namespace votca {
              for (unsigned thread=0;thread<nthreads;++thread){
                 for (unsigned i = thread_start[thread]; i < thread_stop[thread]; ++i) {
                 
-                double EXC_box=0.0;
+                GridBox& box = _grid_boxes[i];
+               
+                const ub::matrix<double>  DMAT_here=box.ReadFromBigMatrix(_density_matrix);
+                ub::matrix<double> Vxc_here;
+                Exc_thread[thread]+=IntegrateVXCBox(box,DMAT_here,Vxc_here);
+                
+                box.AddtoBigMatrix(vxc_thread[thread],Vxc_here);
+                
+            }
+                
+            }   
+            for(unsigned i=0;i<nthreads;++i){
+                Vxc+=vxc_thread[i];
+                EXC+=Exc_thread[i];
+               }   
+            Vxc+=ub::trans(Vxc);
+            
+            return Vxc;
+        }
+        
+        
+        /*
+         * Each box keeps the density block and the contribution of its last
+         * evaluation. A box is evaluated again only if an element of its density
+         * block moved by more than tolerance since then, so the error stays
+         * bounded however many iterations reuse a box.
+         */
+        ub::matrix<double> NumericalIntegration::IntegrateVXC_incremental(const ub::matrix<double>& _density_matrix, double tolerance){
+            ub::matrix<double> Vxc=ub::zero_matrix<double>(_density_matrix.size1());
+            EXC = 0;
+            
+            if(_box_dmat.size()!=_grid_boxes.size()){
+                _box_dmat=std::vector< ub::matrix<double> >(_grid_boxes.size());
+                _box_vxc=std::vector< ub::matrix<double> >(_grid_boxes.size());
+                _box_exc=std::vector<double>(_grid_boxes.size(),0.0);
+            }
+            
+            unsigned nthreads = 1;
+            #ifdef _OPENMP
+               nthreads = omp_get_max_threads();
+            #endif
+               std::vector<ub::matrix<double> >vxc_thread;
+               std::vector<double> Exc_thread=std::vector<double>(nthreads,0.0);
+               std::vector<unsigned> evaluated_thread=std::vector<unsigned>(nthreads,0);
+               for(unsigned i=0;i<nthreads;++i){
+                   ub::matrix<double> Vxc_thread=ub::zero_matrix<double>(_density_matrix.size1());
+                   vxc_thread.push_back(Vxc_thread);
+               }
+               
+            #pragma omp parallel for
+             for (unsigned thread=0;thread<nthreads;++thread){
+                for (unsigned i = thread_start[thread]; i < thread_stop[thread]; ++i) {
+                
+                GridBox& box = _grid_boxes[i];
+                const ub::matrix<double>  DMAT_here=box.ReadFromBigMatrix(_density_matrix);
+                
+                bool reuse=(tolerance>0.0 && _box_dmat[i].size1()==DMAT_here.size1());
+                if(reuse){
+                    const ub::unbounded_array<double>& now=DMAT_here.data();
+                    const ub::unbounded_array<double>& last=_box_dmat[i].data();
+                    for(unsigned k=0;k<now.size();k++){
+                        if(std::abs(now[k]-last[k])>tolerance){
+                            reuse=false;
+                            break;
+                        }
+                    }
+                }
+                if(!reuse){
+                    _box_exc[i]=IntegrateVXCBox(box,DMAT_here,_box_vxc[i]);
+                    _box_dmat[i]=DMAT_here;
+                    evaluated_thread[thread]++;
+                }
+                Exc_thread[thread]+=_box_exc[i];
+                box.AddtoBigMatrix(vxc_thread[thread],_box_vxc[i]);
+            }
+            }
+            _evaluated_boxes=0;
+            for(unsigned i=0;i<nthreads;++i){
+                Vxc+=vxc_thread[i];
+                EXC+=Exc_thread[i];
+                _evaluated_boxes+=evaluated_thread[i];
+               }   
+            Vxc+=ub::trans(Vxc);
+            
+            return Vxc;
+        }
+        
+        /*
+         * E_xc = sum_p w_p f_p with f_p = rho eps_xc at the point. Moving atom A moves
+         * its basis functions, d chi/dA_k = -d_k chi. With T = ao*D and G_j = (d_j ao)*D
+         * per point this gives
+         * -2 sum_p w sum_{mu on A} [ v_rho d_k chi T + 2 v_sigma grad rho . (d_k chi G + grad d_k chi T) ].
+         * The points of A move with it, which adds the same sum over all mu with the
+         * opposite sign, and the partition weights add sum_p f_p dw_p/dA_k.
+         */
+        ub::matrix<double> NumericalIntegration::IntegrateVXCGradient(const ub::matrix<double>& _density_matrix, int natoms){
+            
+            unsigned nthreads = 1;
+            #ifdef _OPENMP
+               nthreads = omp_get_max_threads();
+            #endif
+               std::vector<ub::matrix<double> >gradient_thread;
+               for(unsigned i=0;i<nthreads;++i){
+                   ub::matrix<double> Gradient_thread=ub::zero_matrix<double>(natoms,3);
+                   gradient_thread.push_back(Gradient_thread);
+               }
+               
+            #pragma omp parallel for
+             for (unsigned thread=0;thread<nthreads;++thread){
+                for (unsigned i = thread_start[thread]; i < thread_stop[thread]; ++i) {
+                
                 GridBox& box = _grid_boxes[i];
                
                 const ub::matrix<double>  DMAT_here=box.ReadFromBigMatrix(_density_matrix);
                 
-                ub::matrix<double> Vxc_here=ub::zero_matrix<double>(DMAT_here.size1());
                 const std::vector<tools::vec>& points=box.getGridPoints();
                 const std::vector<double>& weights=box.getGridWeights();
+                const std::vector<int>& owners=box.getGridAtoms();
+                const std::vector<ub::range>& aoranges=box.getAOranges();
+                const std::vector<const AOShell* >& shells=box.getShells();
+                const unsigned npoints=box.size();
+                const unsigned nao=box.Matrixsize();
                 
-                ub::range one=ub::range(0,1);
-                ub::range three=ub::range(0,3);
-                ub::matrix<double> _temp     = ub::matrix<double>(1,box.Matrixsize());
-                ub::matrix<double> _tempgrad = ub::matrix<double>(3,box.Matrixsize());
-                ub::matrix<double> ao=ub::matrix<double>(1,box.Matrixsize());
-                ub::matrix<double> ao_grad=ub::matrix<double>(3,box.Matrixsize());
-               
-                //iterate over gridpoints
-                for(unsigned p=0;p<box.size();p++){
-                    ao=ub::zero_matrix<double>(1,box.Matrixsize());
-                    ao_grad=ub::zero_matrix<double>(3,box.Matrixsize());
-                    const std::vector<ub::range>& aoranges=box.getAOranges();
-                    const std::vector<const AOShell* >& shells=box.getShells();
-                   
-                    for(unsigned j=0;j<box.Shellsize();++j){
-                        
-                        ub::matrix_range< ub::matrix<double> > aoshell=ub::project(ao,one,aoranges[j]);
-                        ub::matrix_range< ub::matrix<double> > ao_grad_shell=ub::project(ao_grad,three,aoranges[j]);
-                        shells[j]->EvalAOspace(aoshell,ao_grad_shell,points[p]);
-                       
+                std::vector<double> px(npoints);
+                std::vector<double> py(npoints);
+                std::vector<double> pz(npoints);
+                for(unsigned p=0;p<npoints;p++){
+                    px[p]=points[p].getX();
+                    py[p]=points[p].getY();
+                    pz[p]=points[p].getZ();
+                }
+                ub::matrix<double> ao=ub::zero_matrix<double>(npoints,nao);
+                ub::matrix<double> ao_grad=ub::zero_matrix<double>(3*npoints,nao);
+                ub::range all=ub::range(0,npoints);
+                ub::range all3=ub::range(0,3*npoints);
+                for(unsigned j=0;j<box.Shellsize();++j){
+                    ub::matrix_range< ub::matrix<double> > aoshell=ub::project(ao,all,aoranges[j]);
+                    ub::matrix_range< ub::matrix<double> > ao_grad_shell=ub::project(ao_grad,all3,aoranges[j]);
+                    shells[j]->EvalAOspace(aoshell,ao_grad_shell,px,py,pz);
+                }
+                
+                // ao_hess[k] row 3p+j is d_j d_k ao at point p
+                std::vector< ub::matrix<double> > ao_hess(3,ub::zero_matrix<double>(3*npoints,nao));
+                for(unsigned j=0;j<box.Shellsize();++j){
+                    ub::matrix_range< ub::matrix<double> > hessx=ub::project(ao_hess[0],all3,aoranges[j]);
+                    ub::matrix_range< ub::matrix<double> > hessy=ub::project(ao_hess[1],all3,aoranges[j]);
+                    ub::matrix_range< ub::matrix<double> > hessz=ub::project(ao_hess[2],all3,aoranges[j]);
+                    shells[j]->EvalAOhessian(hessx,hessy,hessz,px,py,pz);
+                }
+                
+                const ub::matrix<double> _temp=ub::prod(ao,DMAT_here);
+                const ub::matrix<double> _temp_grad=ub::prod(ao_grad,DMAT_here);
+                
+                // per basis function of the box, the three components
+                ub::matrix<double> _addGrad=ub::zero_matrix<double>(nao,3);
+                ub::matrix<double> rho_grad=ub::matrix<double>(1,3);
+                for(unsigned p=0;p<npoints;p++){
+                    double rho=0.0;
+                    double gx=0.0;
+                    double gy=0.0;
+                    double gz=0.0;
+                    for(unsigned k=0;k<nao;k++){
+                        const double t=_temp(p,k);
+                        rho+=t*ao(p,k);
+                        gx+=t*ao_grad(3*p,k);
+                        gy+=t*ao_grad(3*p+1,k);
+                        gz+=t*ao_grad(3*p+2,k);
                     }
                     
-                    _temp=ub::prod( ao, DMAT_here);
-                   
-                    _tempgrad=ub::prod(ao_grad,DMAT_here);
-                    
-                    double rho=ub::prod(_temp, ub::trans( ao) )(0,0);
-                    
-                    ub::matrix<double> rho_grad=ub::prod(_temp, ub::trans(ao_grad))+ub::prod(ao,ub::trans(_tempgrad));
-                   
-		    if ( rho < 1.e-15 ) continue; // skip the rest, if density is very small
+                    if ( rho < 1.e-15 ) continue;
+                    rho_grad(0,0)=2.0*gx;
+                    rho_grad(0,1)=2.0*gy;
+                    rho_grad(0,2)=2.0*gz;
                     
-                    double f_xc;      // E_xc[n] = int{n(r)*eps_xc[n(r)] d3r} = int{ f_xc(r) d3r }
-                    double df_drho;   // v_xc_rho(r) = df/drho
-                    double df_dsigma; // df/dsigma ( df/dgrad(rho) = df/dsigma * dsigma/dgrad(rho) = df/dsigma * 2*grad(rho))
+                    double f_xc;
+                    double df_drho;
+                    double df_dsigma;
                     EvaluateXC( rho,rho_grad,f_xc, df_drho, df_dsigma);
                     
-                    double weight=weights[p];
-                    ub::matrix<double> _addXC = weight * df_drho * ao *0.5;
+                    const double weight=weights[p];
+                    const int owner=owners[p];
+                    for(unsigned k=0;k<3;k++){
+                        double point_term=0.0;
+                        for(unsigned mu=0;mu<nao;mu++){
+                            const double dchi=ao_grad(3*p+k,mu);
+                            double sigma_term=0.0;
+                            for(unsigned j=0;j<3;j++){
+                                sigma_term+=rho_grad(0,j)*(dchi*_temp_grad(3*p+j,mu)+ao_hess[k](3*p+j,mu)*_temp(p,mu));
+                            }
+                            const double term=2.0*weight*(df_drho*dchi*_temp(p,mu)+2.0*df_dsigma*sigma_term);
+                            _addGrad(mu,k)-=term;
+                            point_term+=term;
+                        }
+                        gradient_thread[thread](owner,k)+=point_term;
+                    }
                     
-                    _addXC+=  2.0*df_dsigma * weight * ub::prod(rho_grad,ao_grad);
-
-                    // Exchange correlation energy
-                    EXC_box += weight  * rho * f_xc;
-                  
-                    Vxc_here+=ub::prod( ub::trans(_addXC), ao);
-                  
+                    const std::vector<vec> dweight=SSWpartitionGradient(points[p],owner);
+                    const double energy=weight*rho*f_xc;
+                    for(unsigned atom=0;atom<dweight.size();atom++){
+                        gradient_thread[thread](atom,0)+=energy*dweight[atom].getX();
+                        gradient_thread[thread](atom,1)+=energy*dweight[atom].getY();
+                        gradient_thread[thread](atom,2)+=energy*dweight[atom].getZ();
+                    }
                 }
                 
-                box.AddtoBigMatrix(vxc_thread[thread],Vxc_here);
-              
-                Exc_thread[thread]+=EXC_box;
-                
+                // basis functions of a shell belong to its atom
+                for(unsigned j=0;j<box.Shellsize();++j){
+                    const int atom=shells[j]->getIndex();
+                    for(unsigned mu=aoranges[j].start();mu<aoranges[j].start()+aoranges[j].size();mu++){
+                        for(unsigned k=0;k<3;k++){
+                            gradient_thread[thread](atom,k)+=_addGrad(mu,k);
+                        }
+                    }
+                }
             }
-                
-            }   
+            }
+            ub::matrix<double> gradient=ub::zero_matrix<double>(natoms,3);
             for(unsigned i=0;i<nthreads;++i){
-                Vxc+=vxc_thread[i];
-                EXC+=Exc_thread[i];
-               }   
-            Vxc+=ub::trans(Vxc);
-            
-            return Vxc;
+                gradient+=gradient_thread[i];
+            }
+            return gradient;
         }
         
         double NumericalIntegration::IntegrateDensity(const ub::matrix<double>& _density_matrix){
@@ -831,6 +1061,10 @@ namespace votca {
                
         void NumericalIntegration::GridSetup(string type, BasisSet* bs, vector<ctp::QMAtom*> _atoms,AOBasis* basis) {
             _basis=basis;
+            // box contributions belong to the previous grid
+            _box_dmat.clear();
+            _box_vxc.clear();
+            _box_exc.clear();
             std::vector< std::vector< GridContainers::integration_grid > > grid;
             const double pi = boost::math::constants::pi<double>();
             // get GridContainer
@@ -853,7 +1087,12 @@ namespace votca {
             
             // for the partitioning, we need all inter-center distances later, stored in one-directional list
             int ij = 0;
+            Rij.clear();
             Rij.push_back(0.0); // 1st center "self-distance"
+            _atom_pos.clear();
+            for (const ctp::QMAtom* atom : _atoms) {
+                _atom_pos.push_back(atom->getPos() * tools::conv::ang2bohr);
+            }
             
             vector< ctp::QMAtom* > ::iterator ait;
             vector< ctp::QMAtom* > ::iterator bit;
@@ -968,6 +1207,7 @@ namespace votca {
                         _gridpoint.grid_pos = atomA_pos+r*s;
 
                         _gridpoint.grid_weight = _radial_grid.weight[_i_rad] * ws;
+                        _gridpoint.grid_atom = i_atom;
 
                         _atomgrid.push_back(_gridpoint);
 
@@ -1101,7 +1341,7 @@ namespace votca {
                             
                             double sk;
                             if (std::abs(mu) < leps ) {
-                                sk = -1.88603178008*mu + 0.5;
+                                sk = -1.88603178008*std::abs(mu) + 0.5;
                             } else {
                                 sk = erf1c(mu); 
                             }
@@ -1133,6 +1373,112 @@ namespace votca {
             -1.13520398*pow(tau,6) + 1.48851587*pow(tau,7)  -0.82215223*pow(tau,8) 
             + 0.17087277*pow(tau,9));   
         }
+        
+        double NumericalIntegration::derf1c(double x){
+            const static double alpha_erf1=1.0/0.30;
+            const double dy_dx=alpha_erf1*(1.0+x*x)/((1.0-x*x)*(1.0-x*x));
+            return 0.5*derfcc((x/(1.0-x*x))*alpha_erf1)*dy_dx;
+        }
+        
+        // derivative of the fit in erfcc, tau depends on |x|
+        double NumericalIntegration::derfcc(double x){
+            const double tau = 1.0/(1.0+0.5*std::abs(x));
+            const double dtau_dx = (x<0.0) ? 0.5*tau*tau : -0.5*tau*tau;
+            const double dpoly_dtau = 1.00002368 + 2.0*0.37409196*tau + 3.0*0.09678418*pow(tau,2)
+            - 4.0*0.18628806*pow(tau,3) + 5.0*0.27886807*pow(tau,4) - 6.0*1.13520398*pow(tau,5)
+            + 7.0*1.48851587*pow(tau,6) - 8.0*0.82215223*pow(tau,7) + 9.0*0.17087277*pow(tau,8);
+            return erfcc(x)*(dtau_dx/tau - 2.0*x + dpoly_dtau*dtau_dx);
+        }
+        
+        /*
+         * The weight of a point of atom A is w0 P_A/Z with Z = sum_B P_B and P_B the
+         * product of the SSW factors s(mu_BC), mu_BC = (|r-R_B|-|r-R_C|)/R_BC. At fixed r
+         * d mu_BC/dR_B = -u_B/R_BC - mu_BC e_BC/R_BC and d mu_BC/dR_C = u_C/R_BC + mu_BC e_BC/R_BC
+         * with the unit vectors u_B = (r-R_B)/|r-R_B| and e_BC = (R_B-R_C)/R_BC. The point moves
+         * with A, so the weight is invariant under translations and A gets minus the sum of the others.
+         */
+        std::vector<vec> NumericalIntegration::SSWpartitionGradient(const vec& point, int owner){
+            const double ass = 0.725;
+            const double leps = 1e-6;
+            const unsigned ncenters = _atom_pos.size();
+            std::vector<vec> gradient(ncenters, vec(0.0));
+            
+            std::vector<double> dist(ncenters);
+            std::vector<vec> unit(ncenters);
+            for (unsigned i = 0; i < ncenters; i++) {
+                const vec d = point - _atom_pos[i];
+                dist[i] = abs(d);
+                unit[i] = (dist[i] > 0.0) ? d / dist[i] : vec(0.0);
+            }
+            
+            // s(B,C) is the factor of P_B from the pair B,C, ds(B,C) its derivative
+            // with respect to mu_ij of the pair with i > j as in SSWpartition
+            ub::matrix<double> s = ub::scalar_matrix<double>(ncenters, ncenters, 1.0);
+            ub::matrix<double> ds = ub::zero_matrix<double>(ncenters, ncenters);
+            for (unsigned i = 1; i < ncenters; i++) {
+                for (unsigned j = 0; j < i; j++) {
+                    const double mu = (dist[i] - dist[j]) / abs(_atom_pos[i] - _atom_pos[j]);
+                    double sk;
+                    double dsk;
+                    if (mu > ass) {
+                        sk = 1.0;
+                        dsk = 0.0;
+                    } else if (mu < -ass) {
+                        sk = 0.0;
+                        dsk = 0.0;
+                    } else if (std::abs(mu) < leps) {
+                        sk = 1.88603178008 * mu + 0.5;
+                        dsk = 1.88603178008;
+                    } else {
+                        sk = erf1c(mu);
+                        dsk = derf1c(mu);
+                        if (mu > 0.0) {
+                            sk = 1.0 - sk;
+                            dsk = -dsk;
+                        }
+                    }
+                    s(j, i) = sk;
+                    ds(j, i) = dsk;
+                    s(i, j) = 1.0 - sk;
+                    ds(i, j) = -dsk;
+                }
+            }
+            
+            std::vector<double> P(ncenters, 1.0);
+            double Z = 0.0;
+            for (unsigned b = 0; b < ncenters; b++) {
+                for (unsigned c = 0; c < ncenters; c++) {
+                    P[b] *= s(b, c);
+                }
+                Z += P[b];
+            }
+            if (P[owner] == 0.0) return gradient;
+            
+            // d ln w = d ln P_A - sum_B P_B/Z d ln P_B
+            for (unsigned b = 0; b < ncenters; b++) {
+                if (P[b] == 0.0) continue;
+                const double coeff = ((int(b) == owner) ? 1.0 : 0.0) - P[b] / Z;
+                for (unsigned c = 0; c < ncenters; c++) {
+                    if (ds(b, c) == 0.0) continue;
+                    const double t = coeff * ds(b, c) / s(b, c);
+                    const unsigned i = std::max(b, c);
+                    const unsigned j = std::min(b, c);
+                    const double R = abs(_atom_pos[i] - _atom_pos[j]);
+                    const double mu = (dist[i] - dist[j]) / R;
+                    const vec e = (_atom_pos[i] - _atom_pos[j]) / R;
+                    gradient[i] += t * (-1.0 * unit[i] / R - mu / R * e);
+                    gradient[j] += t * (unit[j] / R + mu / R * e);
+                }
+            }
+            
+            gradient[owner] = vec(0.0);
+            vec sum = vec(0.0);
+            for (unsigned b = 0; b < ncenters; b++) {
+                sum += gradient[b];
+            }
+            gradient[owner] = -1.0 * sum;
+            return gradient;
+        }
                                                                                                 
     }
 }
@@ -632,12 +632,14 @@ namespace votca {
 
             double _dft_energy = getQMEnergy();
 
-            if (_spintype == "singlet") {
+            if (_spintype == "ground") {
+                _omega = 0.0;
+            } else if (_spintype == "singlet") {
                 _omega = BSESingletEnergies()[_opt_state - 1];
             } else if (_spintype == "triplet") {
                 _omega = BSETripletEnergies()[_opt_state - 1];
             } else {
-                throw std::runtime_error("GetTotalEnergy only knows spintypes:singlet,triplet");
+                throw std::runtime_error("GetTotalEnergy only knows spintypes:ground,singlet,triplet");
             }
 
 
@@ -193,9 +193,9 @@ bool QMAPEMachine::Iterate(string jobFolder, int iterCnt) {
     else
         CTP_LOG(ctp::logWARNING,*_log) << "Could not create directory " << runFolder << flush;
     
-    Orbitals orb_iter_input;
-    
-    qminterface.GenerateQMAtomsFromPolarSegs(_job->getPolarTop(), orb_iter_input);
+    // the DFT engine keeps pointers to these atoms and its integrals
+    // for all iterations, so the QM0 atoms are only generated once
+    if (iterCnt == 0) qminterface.GenerateQMAtomsFromPolarSegs(_job->getPolarTop(), orb_iter_input);
     
     
     
@@ -274,13 +274,12 @@ namespace votca {
              * DFT engine, this function sets logger and runs DFTENGINE's
              * Prepare() function. ONLY the first iteration, this will
              * initialize the atoms, basissets, ecps, etc. In all
-             * subsequent iterations it will recalculate all the "static"
-             * AOmatrices (overlap, kinetic energy, nuc/ecp) which is
-             * strictly unnecessary but at the same time also those
-             * for external point charges, dipoles, and quadrupoles.
-             * Since in polarized calculations, the dipoles can change
-             * this recalculation is required. Should be split off the
-             * Prepare() function for efficiency.
+             * subsequent iterations it reuses the "static" AOmatrices
+             * (overlap, kinetic energy, nuc/ecp, RI integrals) as long
+             * as the QM geometry is unchanged and only recalculates
+             * those for external point charges, dipoles, and quadrupoles,
+             * since in polarized calculations the dipoles can change.
+             * The SCF restarts from the orbitals of the last iteration.
              */
             CTP_LOG(ctp::logDEBUG, *_log) << "Writing input file " << runFolder << flush;
             _qmpack->WriteInputFile(empty, &orb_iter_input, MultipolesBackground);
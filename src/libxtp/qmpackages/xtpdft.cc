@@ -125,6 +125,17 @@ namespace votca {
 
         }
 
+        /**
+         * Gradient of the last Run, from the DFTENGINE integrals
+         */
+        bool XTPDFT::Gradient(Orbitals* _orbitals, ub::matrix<double>& gradient) {
+
+            CTP_LOG(ctp::logDEBUG, *_pLog) << "Running XTP DFT gradient " << flush;
+            gradient = _xtpdft.EvaluateGradient( _orbitals );
+
+            return true;
+        }
+
         /**
          * Clean up dummy, may be required if use of scratch will be added
          */
@@ -60,6 +60,14 @@ namespace votca {
             
             bool setMultipoleBackground( std::vector<ctp::PolarSeg*> multipoles);
 
+            bool Gradient(Orbitals* _orbitals, ub::matrix<double>& gradient);
+
+            // the DFTENGINE runs in-process, call after Initialize
+            void setThreads(const int threads) {
+                _threads = threads;
+                _xtpdft.setThreads(threads);
+            }
+
         private:
 
             DFTENGINE _xtpdft;
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2009-2017 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <votca/xtp/ratetree.h>
+#include <stdexcept>
+
+namespace votca {
+namespace xtp {
+
+void RateTree::Resize(unsigned n) {
+  _rates.assign(n, 0.0);
+  _highbit = 1;
+  while (2 * _highbit <= n) {
+    _highbit *= 2;
+  }
+  Rebuild();
+  return;
+}
+
+void RateTree::Rebuild() {
+  const unsigned n = _rates.size();
+  _tree.assign(n + 1, 0.0);
+  _total = 0.0;
+  for (unsigned k = 1; k <= n; k++) {
+    _tree[k] += _rates[k - 1];
+    _total += _rates[k - 1];
+    const unsigned parent = k + (k & (-k));
+    if (parent <= n) _tree[parent] += _tree[k];
+  }
+  _maxtotal = _total;
+  _updates = 0;
+  return;
+}
+
+void RateTree::setRate(unsigned i, double rate) {
+  const double diff = rate - _rates[i];
+  if (diff == 0.0) return;
+  _rates[i] = rate;
+  const unsigned n = _rates.size();
+  for (unsigned k = i + 1; k <= n; k += (k & (-k))) {
+    _tree[k] += diff;
+  }
+  _total += diff;
+  if (_total > _maxtotal) _maxtotal = _total;
+  // amortised O(1), keeps the partial sums exact enough over 10^9 steps;
+  // a total which dropped to round-off level must become exactly 0 when
+  // all rates are 0, callers test Total() <= 0
+  _updates++;
+  if (_updates > 64 * (unsigned long)n + 1024 || _total <= 1e-12 * _maxtotal) {
+    Rebuild();
+  }
+  return;
+}
+
+unsigned RateTree::Choose(double u) const {
+  const unsigned n = _rates.size();
+  unsigned pos = 0;
+  for (unsigned step = _highbit; step > 0; step /= 2) {
+    if (pos + step <= n && _tree[pos + step] <= u) {
+      pos += step;
+      u -= _tree[pos];
+    }
+  }
+  // u at the upper end after round-off, or a partial sum not exactly
+  // zero for blocked entries: take the closest entry with a rate
+  if (pos >= n || _rates[pos] == 0.0) {
+    unsigned down = (pos >= n) ? n : pos;
+    while (down > 0) {
+      down--;
+      if (_rates[down] > 0.0) return down;
+    }
+    for (unsigned up = pos; up < n; up++) {
+      if (_rates[up] > 0.0) return up;
+    }
+    throw std::runtime_error("RateTree::Choose: no entry with a rate above 0");
+  }
+  return pos;
+}
+}
+}
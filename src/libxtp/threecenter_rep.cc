@@ -213,25 +213,24 @@ namespace votca {
             double amb0=amb.getX();
             double amb1=amb.getY();
             double amb2=amb.getZ();
-            double _dist3 = amb * amb;
          
 
 
             
 
-            for ( AOShell::GaussianIterator italpha = _shell_alpha->firstGaussian(); italpha != _shell_alpha->lastGaussian(); ++italpha){
-                const double _decay_alpha = italpha->getDecay();
-            
-                for ( AOShell::GaussianIterator itbeta = _shell_beta->firstGaussian(); itbeta != _shell_beta->lastGaussian(); ++itbeta){
-                    const double _decay_beta = itbeta->getDecay();
-                    double rzeta = 0.5 / (_decay_alpha+_decay_beta);
-                    vec _P = 2.0 * (_decay_alpha*_pos_alpha+_decay_beta*_pos_beta) * rzeta;
+            // primitive pairs of alpha and beta which survive the screening, precomputed per basis
+            const AOShellPair _shellpair(_shell_alpha, _shell_beta);
+            for (AOShellPair::PrimitiveIterator itp = _shellpair.begin(); itp != _shellpair.end(); ++itp) {
+                    const double _decay_alpha = itp->decay_row;
+                    const double _decay_beta = itp->decay_col;
+                    double rzeta = itp->fak;
+                    const vec& _P = itp->P;
                     vec pma = _P - _pos_alpha;
                     double pma0 = pma.getX();
                     double pma1 = pma.getY();
                     double pma2 = pma.getZ();
                     double xi = 2.0 * _decay_alpha * _decay_beta * rzeta;
-                    double fact_alpha_beta = 16.0 * xi * pow(pi / (_decay_alpha * _decay_beta), 0.25) * exp(-xi * _dist3);
+                    double fact_alpha_beta = 16.0 * xi * pow(pi / (_decay_alpha * _decay_beta), 0.25) * exp(-itp->exparg);
                     
                     for ( AOShell::GaussianIterator itgamma = _shell_gamma->firstGaussian(); itgamma != _shell_gamma->lastGaussian(); ++itgamma){
                         const double _decay_gamma = itgamma->getDecay();
@@ -1207,6 +1206,13 @@ if (_lmax_beta > 3) {
 
             int istart[] = {0, 1, 1, 1, 4, 4, 4, 4, 4, 10, 10, 10, 10, 10, 10, 10, 20, 20, 20, 20, 20, 20, 20, 20, 20 };
             int istop[] =  {0, 3, 3, 3, 9, 9, 9, 9, 9, 19, 19, 19, 19, 19, 19, 19, 34, 34, 34, 34, 34, 34, 34, 34, 34 };
+            // the derivative of a function with l has cartesian components of l-1 and l+1
+            int dstart[] = {1, 0, 0, 0, 1, 1, 1, 1, 1, 4, 4, 4, 4, 4, 4, 4, 10, 10, 10, 10, 10, 10, 10, 10, 10 };
+            int dstop[] =  {3, 9, 9, 9, 19, 19, 19, 19, 19, 34, 34, 34, 34, 34, 34, 34, 55, 55, 55, 55, 55, 55, 55, 55, 55 };
+            const int* _start_alpha = ( _shell_alpha->getDerivative() < 0 ) ? istart : dstart;
+            const int* _stop_alpha = ( _shell_alpha->getDerivative() < 0 ) ? istop : dstop;
+            const int* _start_beta = ( _shell_beta->getDerivative() < 0 ) ? istart : dstart;
+            const int* _stop_beta = ( _shell_beta->getDerivative() < 0 ) ? istop : dstop;
 
             // ub::vector<ub::matrix<double> >& _subvector
             // which ones do we want to store
@@ -1223,8 +1229,8 @@ if (_lmax_beta > 3) {
 
             
             
-            const ub::matrix<double> _trafo_beta=AOSuperMatrix::getTrafo(*itbeta);
-            const ub::matrix<double> _trafo_alpha=AOSuperMatrix::getTrafo(*italpha);
+            const ub::matrix<double>& _trafo_beta=*itp->trafo_col;
+            const ub::matrix<double>& _trafo_alpha=*itp->trafo_row;
             
        
             ma_type R_sph;
@@ -1236,8 +1242,8 @@ if (_lmax_beta > 3) {
 
                         R_sph[ _i_alpha ][ _i_beta ][ _i_gamma ] = 0.0;
 
-                        for (int _i_beta_t = istart[ _i_beta ]; _i_beta_t <= istop[ _i_beta ]; _i_beta_t++) {
-                            for (int _i_alpha_t = istart[ _i_alpha ]; _i_alpha_t <= istop[ _i_alpha ]; _i_alpha_t++) {
+                        for (int _i_beta_t = _start_beta[ _i_beta ]; _i_beta_t <= _stop_beta[ _i_beta ]; _i_beta_t++) {
+                            for (int _i_alpha_t = _start_alpha[ _i_alpha ]; _i_alpha_t <= _stop_alpha[ _i_alpha ]; _i_alpha_t++) {
 
                                     R_sph[ _i_alpha ][ _i_beta ][ _i_gamma ] += R[ _i_alpha_t ][ _i_beta_t][ _i_gamma]
                                             * _trafo_alpha(_i_alpha, _i_alpha_t) * _trafo_beta(_i_beta, _i_beta_t);
@@ -1296,7 +1302,6 @@ if (_lmax_beta > 3) {
 
                 }
             }
-        }
 
  
     
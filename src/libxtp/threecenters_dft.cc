@@ -34,42 +34,64 @@ namespace votca {
          */
         void TCMatrix_dft::Cleanup() {
 
-            for (unsigned _i = 0; _i < _matrix.size(); _i++) {
-                _matrix[ _i ].resize(0, 0, false);
-            }
-            _matrix.clear();
+            _matrix.resize(0, 0, false);
+            _pairs.clear();
             return;
         } // TCMatrix_dft::Cleanup
 
+
+        bool TCMatrix_dft::SignificantPair(const AOShell* _shell_row, const AOShell* _shell_col) {
+            if (_shell_row->getIndex() == _shell_col->getIndex()) return true;
+            const double _decay_row = _shell_row->getMinDecay();
+            const double _decay_col = _shell_col->getMinDecay();
+            const vec _dist = _shell_row->getPos() - _shell_col->getPos();
+            // Gaussian product prefactor exp(-a*b/(a+b) R^2), -ln(1e-10)=23.0
+            return (_decay_row * _decay_col / (_decay_row + _decay_col) * (_dist * _dist) < 23.0);
+        }
+
       
   
         void TCMatrix_dft::Fill(AOBasis& _auxbasis, AOBasis& _dftbasis) {
 
-            for (unsigned int i=0; i< _auxbasis.AOBasisSize(); i++){
-                 try{
-                _matrix.push_back(ub::symmetric_matrix<double>(_dftbasis.AOBasisSize()));   
-                }
-                catch(std::bad_alloc& ba){
-                    std::cerr << "Basisset/aux basis too large for 3c calculation. Not enough RAM. Caught bad alloc: " << ba.what() << endl;
-                    exit(0);
-                }
-                
-              
-                for(unsigned k=0;k<_matrix[i].size1();k++){
-                    for(unsigned j=0;j<_matrix[i].size2();j++){
-                
-                    _matrix[i](k,j)=0.0;
-                }
+            // significant shell pairs row>=col and the offset of their first function pair
+            std::vector< std::pair<const AOShell*, const AOShell*> > _shellpairs;
+            std::vector<unsigned> _offsets;
+            _pairs.clear();
+            for (AOBasis::AOShellIterator _row = _dftbasis.firstShell(); _row != _dftbasis.lastShell(); ++_row) {
+                const AOShell* _shell_row = _dftbasis.getShell(_row);
+                for (AOBasis::AOShellIterator _col = _dftbasis.firstShell(); _col <= _row; ++_col) {
+                    const AOShell* _shell_col = _dftbasis.getShell(_col);
+                    if (!SignificantPair(_shell_row, _shell_col)) continue;
+                    _shellpairs.push_back(std::make_pair(_shell_row, _shell_col));
+                    _offsets.push_back(_pairs.size());
+                    for (int _i = 0; _i < _shell_row->getNumFunc(); _i++) {
+                        for (int _j = 0; _j < _shell_col->getNumFunc(); _j++) {
+                            const unsigned _index_row = _shell_row->getStartIndex() + _i;
+                            const unsigned _index_col = _shell_col->getStartIndex() + _j;
+                            if (_index_col > _index_row) continue;
+                            _pairs.push_back(std::make_pair(_index_row, _index_col));
+                        }
+                    }
                 }
             }
-            // loop over all shells in the GW basis and get _Mmn for that shell
-            #pragma omp parallel for //private(_block)
+            _dftsize = _dftbasis.AOBasisSize();
+
+            try {
+                _matrix = ub::zero_matrix<double>(_auxbasis.AOBasisSize(), _pairs.size());
+            } catch (std::bad_alloc& ba) {
+                std::cerr << "Basisset/aux basis too large for 3c calculation. Not enough RAM. Caught bad alloc: " << ba.what() << endl;
+                exit(0);
+            }
+
+            // loop over all shells in the aux basis and get the rows of that shell
+            _dftbasis.PrepareShellPairs();
+            #pragma omp parallel for schedule(dynamic)
             for ( unsigned _is= 0; _is <  _auxbasis.getNumofShells() ; _is++ ){
           
                 const AOShell* _shell = _auxbasis.getShell(_is);
 
                 // Fill block for this shell (3-center overlap with _dft_basis )
-                FillBlock(_shell, _dftbasis);
+                FillBlock(_shell, _shellpairs, _offsets);
                
                 
             } // shells of aux basis set
@@ -81,57 +103,122 @@ namespace votca {
         /*
          * Determines the 3-center integrals for a given shell in the aux basis
          * by calculating the 3-center overlap integral of the functions in the
-         * aux shell with ALL functions in the DFT basis set (FillThreeCenterOLBlock)
+         * aux shell with the significant shell pairs of the DFT basis set
+         * (FillThreeCenterRepBlock)
          */
         
-        void TCMatrix_dft::FillBlock(const AOShell* _shell, const AOBasis& dftbasis) {
+        void TCMatrix_dft::FillBlock(const AOShell* _shell, const std::vector< std::pair<const AOShell*, const AOShell*> >& shellpairs,
+                const std::vector<unsigned>& offsets) {
 
 
             int _start = _shell->getStartIndex();
 
-            // alpha-loop over the "left" DFT basis function
-            for (AOBasis::AOShellIterator _row = dftbasis.firstShell(); _row != dftbasis.lastShell(); ++_row) {
-                const AOShell* _shell_row = dftbasis.getShell(_row);
+            for (unsigned _pair = 0; _pair < shellpairs.size(); _pair++) {
+                const AOShell* _shell_row = shellpairs[_pair].first;
+                const AOShell* _shell_col = shellpairs[_pair].second;
                 int _row_start = _shell_row->getStartIndex();
+                int _col_start = _shell_col->getStartIndex();
 
-                // gamma-loop over the "right" DFT basis function with symmetry
-                for (AOBasis::AOShellIterator _col = dftbasis.firstShell(); _col <= _row; ++_col) {
-                    const AOShell* _shell_col = dftbasis.getShell(_col);
-                    int _col_start = _shell_col->getStartIndex();
-
-                    // get 3-center overlap directly as _subvector
-                    ub::matrix<double> _subvector = ub::zero_matrix<double>(_shell_row->getNumFunc(), _shell->getNumFunc() * _shell_col->getNumFunc());
-
-                    bool nonzero = FillThreeCenterRepBlock(_subvector, _shell, _shell_row, _shell_col);
-
+                // get 3-center overlap directly as _subvector
+                ub::matrix<double> _subvector = ub::zero_matrix<double>(_shell_row->getNumFunc(), _shell->getNumFunc() * _shell_col->getNumFunc());
 
+                bool nonzero = FillThreeCenterRepBlock(_subvector, _shell, _shell_row, _shell_col);
 
-                    if (nonzero) {
-                        // and put it into the block it belongs to
-                        // functions in ONE AUXshell
-                        for (int _aux = 0; _aux < _shell->getNumFunc(); _aux++) {
-                            // column in ONE DFTshell
+                if (nonzero) {
+                    // and put it into the rows of the aux functions in ONE AUXshell,
+                    // function pairs in the order of Fill
+                    for (int _aux = 0; _aux < _shell->getNumFunc(); _aux++) {
+                        unsigned _index_pair = offsets[_pair];
+                        for (int _row = 0; _row < _shell_row->getNumFunc(); _row++) {
                             for (int _col = 0; _col < _shell_col->getNumFunc(); _col++) {
-                                int _index = _shell_col->getNumFunc() * _aux + _col;
-
-                                for (int _row = 0; _row < _shell_row->getNumFunc(); _row++) {
-                                    //symmetry
-                                    if ((_col_start + _col)>(_row_start + _row)) {
-                                        continue;
-                                    }
-                                   
-                                    _matrix[_start + _aux](_row_start + _row, _col_start + _col) = _subvector(_row, _index);
-
-                                } // ROW copy
+                                //symmetry
+                                if ((_col_start + _col)>(_row_start + _row)) {
+                                    continue;
+                                }
+                                _matrix(_start + _aux, _index_pair) = _subvector(_row, _shell_col->getNumFunc() * _aux + _col);
+                                _index_pair++;
                             } // COL copy
-                        } // AUX copy
-                    }
-                } // DFT col
-            } // DFT row
+                        } // ROW copy
+                    } // AUX copy
+                }
+            } // DFT shell pairs
             return;
         } // TCMatrix_dft::FillBlock
 
 
+        ub::matrix<double> TCMatrix_dft::getDatamatrix(int i) const {
+            ub::matrix<double> _full = ub::zero_matrix<double>(_dftsize, _dftsize);
+            for (unsigned _p = 0; _p < _pairs.size(); _p++) {
+                _full(_pairs[_p].first, _pairs[_p].second) = _matrix(i, _p);
+                _full(_pairs[_p].second, _pairs[_p].first) = _matrix(i, _p);
+            }
+            return _full;
+        }
+
+
+        double TCMatrix_dft::ContractBlock(const AOShell* _shell, const AOShell* _shell_row, const AOShell* _shell_col,
+                const ub::matrix<double>& D, const ub::vector<double>& c) {
+            ub::matrix<double> _subvector = ub::zero_matrix<double>(_shell_row->getNumFunc(), _shell->getNumFunc() * _shell_col->getNumFunc());
+            if (!FillThreeCenterRepBlock(_subvector, _shell, _shell_row, _shell_col)) return 0.0;
+            const int _start = _shell->getStartIndex();
+            const int _row_start = _shell_row->getStartIndex();
+            const int _col_start = _shell_col->getStartIndex();
+            double _trace = 0.0;
+            for (int _aux = 0; _aux < _shell->getNumFunc(); _aux++) {
+                for (int _col = 0; _col < _shell_col->getNumFunc(); _col++) {
+                    const int _index = _shell_col->getNumFunc() * _aux + _col;
+                    for (int _row = 0; _row < _shell_row->getNumFunc(); _row++) {
+                        _trace += c(_start + _aux) * D(_row_start + _row, _col_start + _col) * _subvector(_row, _index);
+                    }
+                }
+            }
+            return _trace;
+        }
+
+
+        ub::matrix<double> TCMatrix_dft::FillGradient(const AOBasis& _auxbasis, const AOBasis& _dftbasis,
+                const ub::matrix<double>& D, const ub::vector<double>& c, int natoms) {
+            ub::matrix<double> _gradient = ub::zero_matrix<double>(natoms, 3);
+            _dftbasis.PrepareShellPairs();
+            // derivatives of all DFT shells in x, y, z
+            AOBasis _derivatives;
+            std::vector<const AOShell*> _deriv;
+            for (unsigned _row = 0; _row < _dftbasis.getNumofShells(); _row++) {
+                for (int _k = 0; _k < 3; _k++) {
+                    _deriv.push_back(AOSuperMatrix::AddDerivativeShell(_derivatives, _dftbasis.getShell(_row), _k));
+                }
+            }
+            #pragma omp parallel for schedule(dynamic)
+            for (unsigned _is = 0; _is < _auxbasis.getNumofShells(); _is++) {
+                const AOShell* _shell = _auxbasis.getShell(_is);
+                ub::matrix<double> _gradient_shell = ub::zero_matrix<double>(natoms, 3);
+                for (unsigned _row = 0; _row < _dftbasis.getNumofShells(); _row++) {
+                    const AOShell* _shell_row = _dftbasis.getShell(_row);
+                    for (unsigned _col = 0; _col <= _row; _col++) {
+                        const AOShell* _shell_col = _dftbasis.getShell(_col);
+                        // pairs that are not stored do not contribute to the energy either
+                        if (!SignificantPair(_shell_row, _shell_col)) continue;
+                        // an integral on a single atom does not change
+                        if (_shell_row->getIndex() == _shell->getIndex() && _shell_col->getIndex() == _shell->getIndex()) continue;
+                        const double _weight = (_row == _col) ? 1.0 : 2.0;
+                        for (int _k = 0; _k < 3; _k++) {
+                            const double _drow = _weight * ContractBlock(_shell, _deriv[3 * _row + _k], _shell_col, D, c);
+                            const double _dcol = (_row == _col) ? _drow
+                                    : _weight * ContractBlock(_shell, _shell_row, _deriv[3 * _col + _k], D, c);
+                            _gradient_shell(_shell_row->getIndex(), _k) += _drow;
+                            _gradient_shell(_shell_col->getIndex(), _k) += _dcol;
+                            // the aux function follows from translational invariance
+                            _gradient_shell(_shell->getIndex(), _k) -= _drow + _dcol;
+                        }
+                    }
+                }
+                #pragma omp critical
+                {
+                    _gradient += _gradient_shell;
+                }
+            }
+            return _gradient;
+        }
         
  
 
@@ -21,6 +21,9 @@
 #include <votca/tools/linalg.h>
 
 #include <votca/xtp/threecenters.h>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <fstream>
 
 
 
@@ -39,34 +42,203 @@ namespace votca {
                 _matrix[ _i ].resize(0, 0, false);
             }
             _matrix.clear();
+            // the scratch file was already unlinked, unmapping frees it
+            _region.reset();
+            _outofcore = false;
             return;
         } // TCMatrix::Cleanup
 
         
+        void TCMatrix::Initialize(int _basissize, int mmin, int mmax, int nmin, int nmax) {
+
+            // here as storage indices starting from zero
+            set_mmin(mmin);
+            set_mmax(mmax);
+            set_nmin(nmin);
+            set_nmax(nmax);
+            set_mtot(mmax - mmin + 1);
+            set_ntot(nmax - nmin + 1);
+            basissize = _basissize;
+            _filecols = ntotal;
+            _loadcols = ntotal;
+
+            // vector has mtotal elements
+            _matrix.resize(this->get_mtot());
+
+            const size_t _bytes = sizeof (real_gwbse) * static_cast<size_t> (mtotal) * basissize * ntotal;
+            _outofcore = (_ram_budget > 0.0 && _bytes > _ram_budget * 1024 * 1024);
+            if (_outofcore) {
+                // a new file reads as zeros, levels are loaded on demand
+                boost::filesystem::path _path = boost::filesystem::path(_scratchdir)
+                        / boost::filesystem::unique_path("tcmatrix-%%%%-%%%%-%%%%.scratch");
+                {
+                    std::filebuf _fbuf;
+                    if (!_fbuf.open(_path.string().c_str(), std::ios_base::in | std::ios_base::out
+                            | std::ios_base::trunc | std::ios_base::binary)) {
+                        throw std::runtime_error("Cannot create scratch file " + _path.string());
+                    }
+                    _fbuf.pubseekoff(_bytes - 1, std::ios_base::beg);
+                    _fbuf.sputc(0);
+                }
+                boost::interprocess::file_mapping _mapping(_path.string().c_str(), boost::interprocess::read_write);
+                _region.reset(new boost::interprocess::mapped_region(_mapping, boost::interprocess::read_write));
+                // the mapping stays valid, no file is left behind
+                boost::interprocess::file_mapping::remove(_path.string().c_str());
+            } else {
+                // each element is a gwabasis-by-n matrix, initialize to zero
+                for (int i = 0; i < this->get_mtot(); i++) {
+                    _matrix[i] = ub::zero_matrix<real_gwbse>(basissize, ntotal);
+                }
+            }
+            return;
+        } // TCMatrix::Initialize
+
+        
+        int TCMatrix::TileSize() const {
+            if (!_outofcore) return mtotal;
+            const double _levelbytes = sizeof (real_gwbse) * static_cast<double> (basissize) * _loadcols;
+            const int _tile = static_cast<int> (_ram_budget * 1024 * 1024 / _levelbytes);
+            return std::max(1, std::min(_tile, mtotal));
+        }
+
+        
+        void TCMatrix::Load(int start, int end) const {
+            if (!_outofcore) return;
+            #pragma omp parallel for
+            for (int _i = start; _i < end; _i++) {
+                if (_matrix[_i].size1() != 0) continue;
+                _matrix[_i].resize(basissize, _loadcols, false);
+                const real_gwbse* _level = Level(_i);
+                for (int _i_gw = 0; _i_gw < basissize; _i_gw++) {
+                    std::copy(_level + _i_gw * _filecols, _level + _i_gw * _filecols + _loadcols, &_matrix[_i](_i_gw, 0));
+                }
+            }
+            return;
+        }
+
+        
+        void TCMatrix::Release(int start, int end) const {
+            if (!_outofcore) return;
+            for (int _i = start; _i < end; _i++) {
+                _matrix[_i].resize(0, 0, false);
+            }
+            return;
+        }
+
+        
+        void TCMatrix::Store(int start, int end) {
+            if (!_outofcore) return;
+            #pragma omp parallel for
+            for (int _i = start; _i < end; _i++) {
+                real_gwbse* _level = Level(_i);
+                for (int _i_gw = 0; _i_gw < basissize; _i_gw++) {
+                    std::copy(&_matrix[_i](_i_gw, 0), &_matrix[_i](_i_gw, 0) + _loadcols, _level + _i_gw * _filecols);
+                }
+                _matrix[_i].resize(0, 0, false);
+            }
+            return;
+        }
+
+        
         /*
          * Modify 3-center matrix elements consistent with use of symmetrized 
          * Coulomb interaction. 
          */
         void TCMatrix::Symmetrize(const ub::matrix<double>& _coulomb) {
 
-            #pragma omp parallel for
-            for (int _i_occ = 0; _i_occ < this->get_mtot(); _i_occ++) {
-	      // fist cast _matrix[_i_occ] to double for efficient prod() overloading
-	      ub::matrix<double> _matrix_double = _matrix[ _i_occ ];
-	      _matrix[ _i_occ ] = ub::prod(_coulomb, _matrix_double);
-	      
+            const int _tile = TileSize();
+            for (int _start = 0; _start < this->get_mtot(); _start += _tile) {
+                const int _end = std::min(_start + _tile, this->get_mtot());
+                Load(_start, _end);
+                #pragma omp parallel for
+                for (int _i_occ = _start; _i_occ < _end; _i_occ++) {
+                  // fist cast _matrix[_i_occ] to double for efficient prod() overloading
+                  ub::matrix<double> _matrix_double = _matrix[ _i_occ ];
+                  _matrix[ _i_occ ] = ub::prod(_coulomb, _matrix_double);
+
+                }
+                Store(_start, _end);
             }
             return;
         } // TCMatrix::Symmetrize
         
+        
+        void TCMatrix::Transform(const ub::matrix<double>& _transformation) {
+
+            const int _newsize = _transformation.size1();
+            if (_newsize > basissize) {
+                throw std::runtime_error("TCMatrix::Transform cannot enlarge the GW basis");
+            }
+            const int _tile = TileSize();
+            for (int _start = 0; _start < this->get_mtot(); _start += _tile) {
+                const int _end = std::min(_start + _tile, this->get_mtot());
+                Load(_start, _end);
+                #pragma omp parallel for
+                for (int _i_occ = _start; _i_occ < _end; _i_occ++) {
+                    ub::matrix<double> _matrix_double = _matrix[ _i_occ ];
+                    _matrix[ _i_occ ] = ub::prod(_transformation, _matrix_double);
+                }
+                if (_outofcore) {
+                    // levels are packed with the new size, level i never reaches
+                    // beyond the old start of level i+1, so no unread data is overwritten
+                    real_gwbse* _base = static_cast<real_gwbse*> (_region->get_address());
+                    for (int _i = _start; _i < _end; _i++) {
+                        real_gwbse* _level = _base + static_cast<size_t> (_i) * _newsize * _filecols;
+                        for (int _i_gw = 0; _i_gw < _newsize; _i_gw++) {
+                            std::copy(&_matrix[_i](_i_gw, 0), &_matrix[_i](_i_gw, 0) + _loadcols, _level + _i_gw * _filecols);
+                        }
+                        _matrix[_i].resize(0, 0, false);
+                    }
+                }
+            }
+            basissize = _newsize;
+            return;
+        } // TCMatrix::Transform
+
+        
+        ub::matrix<double> TCMatrix::GramMatrix() const {
+
+            unsigned nthreads = 1;
+            #ifdef _OPENMP
+                nthreads = omp_get_max_threads();
+            #endif
+            std::vector< ub::matrix<double> > _gram_thread;
+            for (unsigned thread = 0; thread < nthreads; ++thread) {
+                _gram_thread.push_back(ub::zero_matrix<double>(basissize));
+            }
+            const int _tile = TileSize();
+            for (int _start = 0; _start < this->get_mtot(); _start += _tile) {
+                const int _end = std::min(_start + _tile, this->get_mtot());
+                Load(_start, _end);
+                #pragma omp parallel for
+                for (int _i_occ = _start; _i_occ < _end; _i_occ++) {
+                    unsigned thread = 0;
+                    #ifdef _OPENMP
+                        thread = omp_get_thread_num();
+                    #endif
+                    const ub::matrix<double> _matrix_double = _matrix[ _i_occ ];
+                    ub::noalias(_gram_thread[thread]) += ub::prod(_matrix_double, ub::trans(_matrix_double));
+                }
+                Release(_start, _end);
+            }
+            ub::matrix<double> _gram = _gram_thread[0];
+            for (unsigned thread = 1; thread < nthreads; ++thread) {
+                _gram += _gram_thread[thread];
+            }
+            return _gram;
+        } // TCMatrix::GramMatrix
+
+        
            void TCMatrix::Print(string _ident) {
 	  //cout << "\n" << endl;
             for (int k = 0; k < this->mtotal; k++) {
-                for (unsigned i = 0; i < _matrix[1].size1(); i++) {
+                Load(k, k + 1);
+                for (int i = 0; i < basissize; i++) {
                     for (int j = 0; j< this->ntotal; j++) {
                         cout << _ident << "[" << i + 1 << ":" << k + 1 << ":" << j + 1 << "] " << this->_matrix[k](i, j) << endl;
                     }
                 }
+                Release(k, k + 1);
             }
             return;
         }
@@ -80,6 +252,7 @@ namespace votca {
          */
         void TCMatrix::Fill(const AOBasis& _gwbasis,const AOBasis& _dftbasis,const ub::matrix<double>& _dft_orbitals) {
 
+            _dftbasis.PrepareShellPairs();
             // loop over all shells in the GW basis and get _Mmn for that shell
             #pragma omp parallel for //private(_block)
             for ( unsigned _is= 0; _is <  _gwbasis.getNumofShells() ; _is++ ){ 
@@ -96,9 +269,11 @@ namespace votca {
                 // put into correct position
                 for (int _m_level = 0; _m_level < this->get_mtot(); _m_level++) {
                     for (int _i_gw = 0; _i_gw < _shell->getNumFunc(); _i_gw++) {
+                        // out of core the rows of this shell are written to the scratch file directly
+                        real_gwbse* _row = _outofcore ? Level(_m_level) + (_start + _i_gw) * _filecols : &_matrix[_m_level](_start + _i_gw, 0);
                         for (int _n_level = 0; _n_level < this->get_ntot(); _n_level++) {
 
-                            _matrix[_m_level](_start + _i_gw, _n_level) = _block[_m_level](_i_gw, _n_level);
+                            _row[_n_level] = _block[_m_level](_i_gw, _n_level);
 
                         } // n-th DFT orbital
                     } // GW basis function in shell
@@ -181,8 +356,45 @@ namespace votca {
         } // TCMatrix::FillBlock
 
         
+        void TCMatrix::Write(boost::archive::binary_oarchive& ar) const {
+            ar << basissize << mmin << mmax << nmin << nmax;
+            const int _tile = TileSize();
+            for (int _start = 0; _start < mtotal; _start += _tile) {
+                const int _end = std::min(_start + _tile, mtotal);
+                Load(_start, _end);
+                for (int _i = _start; _i < _end; _i++) {
+                    ar << _matrix[_i];
+                }
+                Release(_start, _end);
+            }
+            return;
+        }
+        
+        
+        void TCMatrix::Read(boost::archive::binary_iarchive& ar) {
+            int _basissize, _mmin, _mmax, _nmin, _nmax;
+            ar >> _basissize >> _mmin >> _mmax >> _nmin >> _nmax;
+            Initialize(_basissize, _mmin, _mmax, _nmin, _nmax);
+            const int _tile = TileSize();
+            for (int _start = 0; _start < mtotal; _start += _tile) {
+                const int _end = std::min(_start + _tile, mtotal);
+                for (int _i = _start; _i < _end; _i++) {
+                    ar >> _matrix[_i];
+                }
+                Store(_start, _end);
+            }
+            return;
+        }
+        
+        
         void TCMatrix::Prune ( int _basissize, int min, int max){
 
+            if (_outofcore) {
+                // levels stay in the scratch file, only the first max+1 columns are loaded from now on
+                _matrix.resize(max + 1);
+                _loadcols = std::min(max + 1, _filecols);
+                return;
+            }
             int size1 = _matrix[0].size1();           
             // vector needs only max entries
             _matrix.resize( max + 1 );
@@ -97,6 +97,7 @@ namespace votca {
                 // Run Geometry Optimization
                 GeometryOptimization _geoopt(_gwbse_engine,_qmpackage, _segments, &_orbitals);
                 _geoopt.setLog(&_log);
+                _geoopt.setPackageOptions(_package_options);
                 _geoopt.Initialize(&_geoopt_options);
                 _geoopt.Evaluate();
             } else {
@@ -57,6 +57,7 @@ namespace votca {
             
             void calculateCube();
             void subtractCubes();
+            bool LineNeedsShell(const AOShell& shell, double x, double y, const std::vector<double>& z);
             
             string _orbfile;
             string _output_file;
@@ -168,6 +169,19 @@ namespace votca {
         }
 
         
+        // true if the shell contributes more than 1e-10 at any point of a z line
+        bool GenCube::LineNeedsShell(const AOShell& shell, double x, double y, const std::vector<double>& z){
+            const double decay=shell.getMinDecay();
+            const tools::vec& shellpos=shell.getPos();
+            const double dxy=(shellpos.getX()-x)*(shellpos.getX()-x)+(shellpos.getY()-y)*(shellpos.getY()-y);
+            for (unsigned _iz = 0; _iz < z.size(); _iz++) {
+                const double dz=shellpos.getZ()-z[_iz];
+                if ( decay*(dxy+dz*dz) < 20.7 ) return true;
+            }
+            return false;
+        }
+        
+        
         void GenCube::calculateCube(){
             
                 CTP_LOG(ctp::logDEBUG, _log) << "Reading serialized QM data from " << _orbfile << flush;
@@ -341,32 +355,30 @@ namespace votca {
                         for (int _iy = 0; _iy <= _ysteps; _iy++) {
                             double _y = ystart + double(_iy) * yincr;
 
+                            // evaluate the orbitals along the whole z line at once
+                            const int nz = _zsteps + 1;
+                            std::vector<double> px(nz, _x);
+                            std::vector<double> py(nz, _y);
+                            std::vector<double> pz(nz);
+                            for (int _iz = 0; _iz < nz; _iz++) {
+                                pz[_iz] = zstart + double(_iz) * zincr;
+                            }
+                            ub::matrix<double> tmat = ub::zero_matrix<double>(nz, dftbasis.AOBasisSize());
+                            for (AOBasis::AOShellIterator _row = dftbasis.firstShell(); _row != dftbasis.lastShell(); _row++) {
+                                if (LineNeedsShell(*(*_row), _x, _y, pz)) {
+                                    ub::matrix_range< ub::matrix<double> > _submatrix = ub::subrange(tmat, 0, nz, (*_row)->getStartIndex(), (*_row)->getStartIndex()+(*_row)->getNumFunc());
+                                    (*_row)->EvalAOspace(_submatrix, px, py, pz);
+                                }
+                            }
+                            ub::matrix<double> _tempmat = ub::prod(tmat, DMAT_tot);
+
                             int Nrecord = 0;
                             for (int _iz = 0; _iz <= _zsteps; _iz++) {
-                                double _z = zstart + double(_iz) * zincr;
                                 Nrecord++;
-                                vec pos=vec(_x, _y, _z);
-                                // get value of orbitals at each gridpoint
-                                ub::matrix<double> tmat = ub::zero_matrix<double>( 1,dftbasis.AOBasisSize());
-
-                                for (AOBasis::AOShellIterator _row = dftbasis.firstShell(); _row != dftbasis.lastShell(); _row++) {
-                                    
-                                    const double decay=(*_row)->getMinDecay();
-                                    const tools::vec& shellpos=(*_row)->getPos();
-                      
-                      
-                                    tools::vec dist=shellpos-pos;
-                                    double distsq=dist*dist;
-                          // if contribution is smaller than -ln(1e-10), calc density
-                                    if ( (decay * distsq) < 20.7 ){
-                                    ub::matrix_range< ub::matrix<double> > _submatrix = ub::subrange(tmat,0,1, (*_row)->getStartIndex(), (*_row)->getStartIndex()+(*_row)->getNumFunc());
-                                    (*_row)->EvalAOspace(_submatrix, pos);
-                                    }
+                                double density_at_grid = 0.0;
+                                for (unsigned _i = 0; _i < tmat.size2(); _i++) {
+                                    density_at_grid += _tempmat(_iz, _i) * tmat(_iz, _i);
                                 }
-                                
-                                
-             		    ub::matrix<double> _tempmat = ub::prod( tmat,DMAT_tot); // tempmat can be reused for density gradient
-		            double density_at_grid = ub::prod(_tempmat,ub::trans(tmat))(0,0);
                           
                                 if (Nrecord == 6 || _iz == _zsteps) {
                                     fprintf(out, "%E \n", density_at_grid);
@@ -375,9 +387,6 @@ namespace votca {
                                     fprintf(out, "%E ", density_at_grid);
                             }
                         }// z-component
-
-
-                            
                         }// y-component
                         
                         ++progress;
@@ -416,31 +425,29 @@ namespace votca {
                         for (int _iy = 0; _iy <= _ysteps; _iy++) {
                             double _y = ystart + double(_iy) * yincr;
 
+                            // evaluate the orbitals along the whole z line at once
+                            const int nz = _zsteps + 1;
+                            std::vector<double> px(nz, _x);
+                            std::vector<double> py(nz, _y);
+                            std::vector<double> pz(nz);
+                            for (int _iz = 0; _iz < nz; _iz++) {
+                                pz[_iz] = zstart + double(_iz) * zincr;
+                            }
+                            ub::matrix<double> tmat = ub::zero_matrix<double>(nz, dftbasis.AOBasisSize());
+                            for (AOBasis::AOShellIterator _row = dftbasis.firstShell(); _row != dftbasis.lastShell(); _row++) {
+                                if (LineNeedsShell(*(*_row), _x, _y, pz)) {
+                                    ub::matrix_range< ub::matrix<double> > _submatrix = ub::subrange(tmat, 0, nz, (*_row)->getStartIndex(), (*_row)->getStartIndex()+(*_row)->getNumFunc());
+                                    (*_row)->EvalAOspace(_submatrix, px, py, pz);
+                                }
+                            }
+
                             int Nrecord = 0;
                             for (int _iz = 0; _iz <= _zsteps; _iz++) {
-                                double _z = zstart + double(_iz) * zincr;
                                 Nrecord++;
-                                // get value of orbitals at each gridpoint
-                                ub::matrix<double> tmat = ub::zero_matrix<double>(1,dftbasis.AOBasisSize());
-                                vec pos=vec(_x, _y, _z);
-                                for (AOBasis::AOShellIterator _row = dftbasis.firstShell(); _row != dftbasis.lastShell(); _row++) {
-                                    
-                                    const double decay=(*_row)->getMinDecay();
-                                    const tools::vec& shellpos=(*_row)->getPos();
-                      
-                      
-                                    tools::vec dist=shellpos-pos;
-                                    double distsq=dist*dist;
-                          // if contribution is smaller than -ln(1e-10), calc density
-                                    if ( (decay * distsq) < 20.7 ){
-                                    ub::matrix_range< ub::matrix<double> > _submatrix = ub::subrange(tmat,0,1, (*_row)->getStartIndex(), (*_row)->getStartIndex()+(*_row)->getNumFunc());
-                                    (*_row)->EvalAOspace(_submatrix, pos);
-                                    }
-                                }
 
                                 double QP_at_grid = 0.0;
                                 for (unsigned _i = 0; _i < Ftemp.size1(); _i++) {
-                                    QP_at_grid += Ftemp(_i,0) * tmat(0,_i);
+                                    QP_at_grid += Ftemp(_i,0) * tmat(_iz,_i);
                                 }
 
                                 if (Nrecord == 6 || _iz == _zsteps) {
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2009-2018 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define BOOST_TEST_MAIN
+
+#define BOOST_TEST_MODULE checkpoint_test
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <votca/xtp/gwbse.h>
+
+using namespace votca::xtp;
+namespace ub = boost::numeric::ublas;
+
+BOOST_AUTO_TEST_SUITE(checkpoint_test)
+
+BOOST_AUTO_TEST_CASE(truncated_test) {
+  const std::string filename =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("gwbse_%%%%-%%%%.chk"))
+          .string();
+  votca::ctp::Logger log;
+
+  TCMatrix Mmn;
+  Mmn.Initialize(5, 0, 2, 0, 3);
+  for (int m = 0; m < Mmn.get_mtot(); m++) {
+    for (int i = 0; i < Mmn.get_beta(); i++) {
+      for (int n = 0; n < Mmn.get_ntot(); n++) {
+        Mmn[m](i, n) = 0.1 * m + 0.01 * i + 0.001 * n;
+      }
+    }
+  }
+  const ub::matrix<double> overlap = ub::identity_matrix<double>(5);
+  const ub::matrix<double> cholesky_inverse = 2.0 * overlap;
+  GWBSE::WriteThreecenterFile(filename, Mmn, overlap, cholesky_inverse, &log);
+
+  TCMatrix read;
+  ub::matrix<double> read_overlap;
+  ub::matrix<double> read_inverse;
+  BOOST_REQUIRE(GWBSE::ReadThreecenterFile(filename, read, read_overlap,
+                                           read_inverse, &log));
+  BOOST_CHECK_EQUAL(read.get_mtot(), Mmn.get_mtot());
+  BOOST_CHECK_EQUAL(read_inverse(4, 4), 2.0);
+  BOOST_CHECK_EQUAL(read[2](4, 3), Mmn[2](4, 3));
+
+  // cut off in the middle of the levels
+  const boost::uintmax_t size = boost::filesystem::file_size(filename);
+  boost::filesystem::resize_file(filename, size / 2);
+  ub::matrix<double> untouched = ub::zero_matrix<double>(1, 1);
+  ub::matrix<double> untouched_inverse = ub::zero_matrix<double>(1, 1);
+  BOOST_CHECK(!GWBSE::ReadThreecenterFile(filename, read, untouched,
+                                          untouched_inverse, &log));
+  BOOST_CHECK_EQUAL(untouched.size1(), 1u);
+  BOOST_CHECK_EQUAL(untouched_inverse.size1(), 1u);
+
+  // and a file without a complete archive header
+  boost::filesystem::resize_file(filename, 8);
+  BOOST_CHECK(!GWBSE::ReadThreecenterFile(filename, read, untouched,
+                                          untouched_inverse, &log));
+
+  boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
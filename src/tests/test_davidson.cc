@@ -0,0 +1,102 @@
+/*
+ * Copyright 2009-2018 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define BOOST_TEST_MAIN
+
+#define BOOST_TEST_MODULE davidson_test
+#include <boost/numeric/ublas/operation.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <votca/tools/linalg.h>
+#include <votca/xtp/davidsonsolver.h>
+
+using namespace votca::xtp;
+namespace ub = boost::numeric::ublas;
+
+// explicit matrix behind the MatrixFreeOperator interface
+class DenseOperator : public MatrixFreeOperator {
+ public:
+  DenseOperator(const ub::matrix<double>& H) : _H(H){};
+  int size() const { return _H.size1(); }
+  ub::vector<double> diagonal() const {
+    ub::vector<double> diag(_H.size1());
+    for (unsigned i = 0; i < _H.size1(); i++) diag(i) = _H(i, i);
+    return diag;
+  }
+  ub::matrix<double> matmul(const ub::matrix<double>& X) const {
+    return ub::prod(_H, X);
+  }
+
+ private:
+  ub::matrix<double> _H;
+};
+
+// diagonally dominant like the TDA Hamiltonian: transition energies on the
+// diagonal and a weak symmetric coupling
+ub::matrix<double> TDAMatrix(int size) {
+  ub::matrix<double> H(size, size);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j <= i; j++) {
+      H(i, j) = 0.01 * std::sin(1.0 + i + 2.0 * j);
+      H(j, i) = H(i, j);
+    }
+    H(i, i) = 0.3 + 0.02 * i + 0.005 * std::cos(3.0 * i);
+  }
+  return H;
+}
+
+BOOST_AUTO_TEST_SUITE(davidson_test)
+
+BOOST_AUTO_TEST_CASE(tda_test) {
+  const int size = 80;
+  const int neigen = 4;
+  const ub::matrix<double> H = TDAMatrix(size);
+
+  ub::matrix<double> dense = H;
+  ub::vector<double> energies;
+  ub::matrix<double> vectors;
+  votca::tools::linalg_eigenvalues(dense, energies, vectors, neigen);
+
+  votca::ctp::Logger log;
+  DavidsonSolver davidson(&log);
+  davidson.setTolerance(1e-8);
+  davidson.setMaxIterations(100);
+  DenseOperator op(H);
+  BOOST_CHECK(davidson.Solve(op, neigen));
+  // the search space is smaller than the problem, so this is iterative
+  BOOST_CHECK(davidson.getIterations() > 0);
+
+  BOOST_REQUIRE_EQUAL(davidson.eigenvalues().size(), unsigned(neigen));
+  BOOST_REQUIRE_EQUAL(davidson.eigenvectors().size2(), unsigned(neigen));
+  for (int k = 0; k < neigen; k++) {
+    BOOST_CHECK_CLOSE(davidson.eigenvalues()(k), energies(k), 1e-8);
+    // eigenvectors agree up to their sign
+    const double overlap = ub::inner_prod(ub::column(davidson.eigenvectors(), k),
+                                          ub::column(vectors, k));
+    BOOST_CHECK_CLOSE(std::abs(overlap), 1.0, 1e-6);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(not_converged_test) {
+  const ub::matrix<double> H = TDAMatrix(80);
+  votca::ctp::Logger log;
+  DavidsonSolver davidson(&log);
+  davidson.setTolerance(1e-12);
+  davidson.setMaxIterations(1);
+  DenseOperator op(H);
+  BOOST_CHECK(!davidson.Solve(op, 4));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
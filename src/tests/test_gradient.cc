@@ -0,0 +1,310 @@
+/*
+ * Copyright 2009-2018 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define BOOST_TEST_MAIN
+
+#define BOOST_TEST_MODULE gradient_test
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <votca/xtp/votca_config.h>
+#include <votca/xtp/aomatrix.h>
+#include <votca/xtp/ERIs.h>
+#include <votca/xtp/numerical_integrations.h>
+
+using namespace votca::xtp;
+using votca::tools::vec;
+namespace ub = boost::numeric::ublas;
+
+// atoms of a bent triatomic molecule, positions in Angstrom
+class Molecule {
+ public:
+  Molecule(const std::vector<vec>& pos) {
+    const std::string names[3] = {"O", "H", "H"};
+    for (unsigned i = 0; i < pos.size(); i++) {
+      _atoms.push_back(new votca::ctp::QMAtom(names[i], pos[i].getX(), pos[i].getY(),
+                                              pos[i].getZ(), 0.0, false));
+    }
+  }
+  ~Molecule() {
+    for (votca::ctp::QMAtom* atom : _atoms) delete atom;
+  }
+  std::vector<votca::ctp::QMAtom*>& Atoms() { return _atoms; }
+
+ private:
+  std::vector<votca::ctp::QMAtom*> _atoms;
+};
+
+std::vector<vec> Geometry() {
+  std::vector<vec> pos;
+  pos.push_back(vec(0.0, 0.0, 0.1));
+  pos.push_back(vec(0.75, 0.1, -0.45));
+  pos.push_back(vec(-0.8, 0.05, -0.5));
+  return pos;
+}
+
+// uncontracted shell of angular momentum l
+void AddShell(Element* element, const std::string& type, int l, double decay) {
+  std::vector<double> contraction(l + 1, 0.0);
+  contraction[l] = 1.0;
+  element->addShell(type, 1.0)->addGaussian(decay, contraction);
+}
+
+BasisSet& DFTBasisSet() {
+  static BasisSet basis;
+  static bool filled = false;
+  if (!filled) {
+    Element* oxygen = basis.addElement("O");
+    Shell* s = oxygen->addShell("S", 1.0);
+    s->addGaussian(2.0, std::vector<double>(1, 0.6));
+    s->addGaussian(0.5, std::vector<double>(1, 0.5));
+    AddShell(oxygen, "S", 0, 0.25);
+    AddShell(oxygen, "P", 1, 0.4);
+    AddShell(oxygen, "D", 2, 0.3);
+    Element* hydrogen = basis.addElement("H");
+    AddShell(hydrogen, "S", 0, 0.6);
+    AddShell(hydrogen, "S", 0, 0.2);
+    AddShell(hydrogen, "P", 1, 0.3);
+    filled = true;
+  }
+  return basis;
+}
+
+BasisSet& AuxBasisSet() {
+  static BasisSet basis;
+  static bool filled = false;
+  if (!filled) {
+    Element* oxygen = basis.addElement("O");
+    AddShell(oxygen, "S", 0, 1.5);
+    AddShell(oxygen, "S", 0, 0.4);
+    AddShell(oxygen, "P", 1, 0.6);
+    AddShell(oxygen, "D", 2, 0.5);
+    Element* hydrogen = basis.addElement("H");
+    AddShell(hydrogen, "S", 0, 0.8);
+    AddShell(hydrogen, "P", 1, 0.5);
+    filled = true;
+  }
+  return basis;
+}
+
+// pseudopotential on the oxygen: a local part and S, P channels with r^2 terms
+BasisSet& ECPBasisSet() {
+  static BasisSet basis;
+  static bool filled = false;
+  if (!filled) {
+    Element* oxygen = basis.addElement("O", 2, 2);
+    oxygen->addShell("D", 1.0)->addGaussian(1, 2.0, std::vector<double>(1, -4.0));
+    Shell* s = oxygen->addShell("S", 1.0);
+    s->addGaussian(2, 1.5, std::vector<double>(1, 6.0));
+    s->addGaussian(0, 0.6, std::vector<double>(1, 2.0));
+    Shell* p = oxygen->addShell("P", 1.0);
+    p->addGaussian(2, 1.2, std::vector<double>(1, 4.0));
+    p->addGaussian(0, 0.5, std::vector<double>(1, -1.0));
+    filled = true;
+  }
+  return basis;
+}
+
+// symmetric and positive semidefinite like a ground state density matrix
+ub::matrix<double> Density(int size) {
+  ub::matrix<double> C(size, 3);
+  for (int i = 0; i < size; i++) {
+    for (int k = 0; k < 3; k++) {
+      C(i, k) = 0.4 * std::sin(1.3 + 0.7 * i + 2.1 * k);
+    }
+  }
+  return 2.0 * ub::prod(C, ub::trans(C));
+}
+
+// central differences of an energy with respect to the atom positions in Hartree/bohr
+template <class Energy>
+ub::matrix<double> NumericalGradient(Energy energy) {
+  const double h = 1e-4;  // Angstrom
+  const std::vector<vec> pos = Geometry();
+  ub::matrix<double> gradient(pos.size(), 3);
+  for (unsigned i = 0; i < pos.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      const vec step((k == 0) ? h : 0.0, (k == 1) ? h : 0.0, (k == 2) ? h : 0.0);
+      std::vector<vec> displaced = pos;
+      displaced[i] = pos[i] + step;
+      const double forward = energy(displaced);
+      displaced[i] = pos[i] - step;
+      const double backward = energy(displaced);
+      gradient(i, k) = (forward - backward) / (2.0 * h * votca::tools::conv::ang2bohr);
+    }
+  }
+  return gradient;
+}
+
+void CheckGradient(const ub::matrix<double>& analytic, const ub::matrix<double>& numerical,
+                   double tolerance) {
+  BOOST_REQUIRE_EQUAL(analytic.size1(), numerical.size1());
+  for (unsigned i = 0; i < analytic.size1(); i++) {
+    for (unsigned k = 0; k < 3; k++) {
+      BOOST_CHECK_SMALL(analytic(i, k) - numerical(i, k), tolerance);
+    }
+  }
+}
+
+double Trace(const ub::matrix<double>& D, const ub::matrix<double>& M) {
+  double trace = 0.0;
+  for (unsigned i = 0; i < D.size1(); i++) {
+    for (unsigned j = 0; j < D.size2(); j++) {
+      trace += D(i, j) * M(i, j);
+    }
+  }
+  return trace;
+}
+
+BOOST_AUTO_TEST_SUITE(gradient_test)
+
+BOOST_AUTO_TEST_CASE(overlap_kinetic_test) {
+  Molecule mol(Geometry());
+  AOBasis basis;
+  basis.AOBasisFill(&DFTBasisSet(), mol.Atoms());
+  const ub::matrix<double> D = Density(basis.AOBasisSize());
+
+  AOOverlap overlap;
+  CheckGradient(overlap.FillGradient(basis, D, 3),
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  AOOverlap o;
+                  return o.Contract(b, D);
+                }),
+                1e-7);
+
+  AOKinetic kinetic;
+  CheckGradient(kinetic.FillGradient(basis, D, 3),
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  AOKinetic t;
+                  return t.Contract(b, D);
+                }),
+                1e-7);
+}
+
+BOOST_AUTO_TEST_CASE(nuclear_test) {
+  Molecule mol(Geometry());
+  AOBasis basis;
+  basis.AOBasisFill(&DFTBasisSet(), mol.Atoms());
+  const ub::matrix<double> D = Density(basis.AOBasisSize());
+
+  AOESP esp;
+  CheckGradient(esp.NuclearGradient(basis, mol.Atoms(), D),
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  AOESP v;
+                  v.Fillnucpotential(b, displaced.Atoms());
+                  return Trace(D, v.getNuclearpotential());
+                }),
+                1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(ecp_test) {
+  Molecule mol(Geometry());
+  AOBasis basis;
+  basis.AOBasisFill(&DFTBasisSet(), mol.Atoms());
+  AOBasis ecp;
+  ecp.ECPFill(&ECPBasisSet(), mol.Atoms());
+  const ub::matrix<double> D = Density(basis.AOBasisSize());
+
+  AOECP pseudopotential;
+  CheckGradient(pseudopotential.FillECPGradient(basis, ecp, D, 3),
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  AOBasis e;
+                  e.ECPFill(&ECPBasisSet(), displaced.Atoms());
+                  AOECP v;
+                  return v.Contract(b, D, &e);
+                }),
+                1e-6);
+}
+
+void InitializeERIs(ERIs& eris, AOBasis& basis, AOBasis& auxbasis) {
+  AOCoulomb coulomb;
+  coulomb.Fill(auxbasis);
+  coulomb.Invert_DFT();
+  eris.Initialize(basis, auxbasis, coulomb.Matrix());
+}
+
+// the RI Coulomb energy is 1/2 tr(D J)
+BOOST_AUTO_TEST_CASE(coulomb_test) {
+  Molecule mol(Geometry());
+  AOBasis basis;
+  basis.AOBasisFill(&DFTBasisSet(), mol.Atoms());
+  AOBasis auxbasis;
+  auxbasis.AOBasisFill(&AuxBasisSet(), mol.Atoms());
+  const ub::matrix<double> D = Density(basis.AOBasisSize());
+
+  ERIs eris;
+  InitializeERIs(eris, basis, auxbasis);
+  CheckGradient(eris.CalculateGradient(basis, auxbasis, D, 3),
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  AOBasis aux;
+                  aux.AOBasisFill(&AuxBasisSet(), displaced.Atoms());
+                  ERIs e;
+                  InitializeERIs(e, b, aux);
+                  e.CalculateERIs(D);
+                  return 0.5 * Trace(D, e.getERIs());
+                }),
+                1e-6);
+}
+
+#ifdef LIBXC
+void SetupGrid(NumericalIntegration& grid, AOBasis& basis,
+               std::vector<votca::ctp::QMAtom*>& atoms) {
+  grid.GridSetup("coarse", &DFTBasisSet(), atoms, &basis);
+  grid.setXCfunctional("XC_GGA_X_PBE XC_GGA_C_PBE");
+}
+
+// the grid moves with the atoms, so this is the gradient of E_xc on the grid
+BOOST_AUTO_TEST_CASE(xc_test) {
+  Molecule mol(Geometry());
+  AOBasis basis;
+  basis.AOBasisFill(&DFTBasisSet(), mol.Atoms());
+  const ub::matrix<double> D = Density(basis.AOBasisSize());
+
+  NumericalIntegration grid;
+  SetupGrid(grid, basis, mol.Atoms());
+  const ub::matrix<double> gradient = grid.IntegrateVXCGradient(D, 3);
+  CheckGradient(gradient,
+                NumericalGradient([&](const std::vector<vec>& pos) {
+                  Molecule displaced(pos);
+                  AOBasis b;
+                  b.AOBasisFill(&DFTBasisSet(), displaced.Atoms());
+                  NumericalIntegration g;
+                  SetupGrid(g, b, displaced.Atoms());
+                  g.IntegrateVXC(D);
+                  return g.getTotEcontribution();
+                }),
+                1e-6);
+  // translationally invariant without any correction
+  for (unsigned k = 0; k < 3; k++) {
+    BOOST_CHECK_SMALL(gradient(0, k) + gradient(1, k) + gradient(2, k), 1e-10);
+  }
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2009-2018 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define BOOST_TEST_MAIN
+
+#define BOOST_TEST_MODULE ratetree_test
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <votca/xtp/ratetree.h>
+
+using namespace votca::xtp;
+
+BOOST_AUTO_TEST_SUITE(ratetree_test)
+
+BOOST_AUTO_TEST_CASE(sums_test) {
+  RateTree tree;
+  tree.Resize(13);
+  BOOST_CHECK_EQUAL(tree.Total(), 0.0);
+  for (unsigned i = 0; i < 13; i++) {
+    tree.setRate(i, 0.5 + i);
+  }
+  BOOST_CHECK_CLOSE(tree.Total(), 13 * 0.5 + 78.0, 1e-12);
+
+  // every entry is chosen for u in its own interval of the cumulated rates
+  double lower = 0.0;
+  for (unsigned i = 0; i < 13; i++) {
+    const double upper = lower + tree.getRate(i);
+    BOOST_CHECK_EQUAL(tree.Choose(lower), i);
+    BOOST_CHECK_EQUAL(tree.Choose(0.5 * (lower + upper)), i);
+    lower = upper;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(zeroed_entries_test) {
+  RateTree tree;
+  tree.Resize(8);
+  for (unsigned i = 0; i < 8; i++) {
+    tree.setRate(i, 1.0);
+  }
+  tree.setRate(3, 0.0);
+  tree.setRate(7, 0.0);
+  BOOST_CHECK_CLOSE(tree.Total(), 6.0, 1e-12);
+  for (unsigned k = 0; k < 600; k++) {
+    const unsigned i = tree.Choose(k * 0.01);
+    BOOST_CHECK(i != 3 && i != 7);
+  }
+
+  // u at the upper end gives the last entry with a rate
+  BOOST_CHECK_EQUAL(tree.Choose(tree.Total()), 6u);
+  BOOST_CHECK_EQUAL(tree.Choose(2.0 * tree.Total()), 6u);
+}
+
+BOOST_AUTO_TEST_CASE(all_zero_test) {
+  RateTree tree;
+  tree.Resize(5);
+  const double rates[] = {0.1, 1e-7, 3.3, 0.7, 1e5};
+  for (unsigned i = 0; i < 5; i++) {
+    tree.setRate(i, rates[i]);
+  }
+  for (unsigned i = 0; i < 5; i++) {
+    tree.setRate(i, 0.0);
+  }
+  // no round-off remainder, the KMC loops stop on Total() <= 0
+  BOOST_CHECK_EQUAL(tree.Total(), 0.0);
+  BOOST_CHECK_THROW(tree.Choose(0.0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2009-2018 The VOTCA Development Team (http://www.votca.org)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define BOOST_TEST_MAIN
+
+#define BOOST_TEST_MODULE rpa_test
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <votca/xtp/gwbse.h>
+
+using namespace votca::xtp;
+namespace ub = boost::numeric::ublas;
+
+// one purely imaginary and one purely real screening frequency
+ub::matrix<double> ScreeningFrequencies() {
+  ub::matrix<double> freq = ub::zero_matrix<double>(2, 2);
+  freq(0, 1) = 0.5;
+  freq(1, 0) = 0.1;
+  return freq;
+}
+
+std::vector<ub::matrix<double> > RPA(int threads, const ub::matrix<double>& Mstack,
+                                     const ub::vector<double>& deltaE) {
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  const ub::matrix<double> freq = ScreeningFrequencies();
+  std::vector<ub::matrix<double> > epsilon(
+      freq.size1(), ub::identity_matrix<double>(Mstack.size1()));
+  GWBSE::RPA_add_transitions(epsilon, Mstack, deltaE, freq);
+  return epsilon;
+}
+
+BOOST_AUTO_TEST_SUITE(rpa_test)
+
+BOOST_AUTO_TEST_CASE(threads_test) {
+  // gwbasis size not divisible by the number of threads
+  const int size = 23;
+  const int transitions = 40;
+  ub::matrix<double> Mstack(size, transitions);
+  ub::vector<double> deltaE(transitions);
+  for (int j = 0; j < transitions; j++) {
+    deltaE(j) = -0.3 - 0.01 * j;
+    for (int i = 0; i < size; i++) {
+      Mstack(i, j) = std::sin(1.0 + i + 0.7 * j);
+    }
+  }
+
+  const std::vector<ub::matrix<double> > serial = RPA(1, Mstack, deltaE);
+  const std::vector<ub::matrix<double> > threaded = RPA(4, Mstack, deltaE);
+
+  // an off-diagonal element at the imaginary frequency by hand
+  double sum = 0.0;
+  for (int j = 0; j < transitions; j++) {
+    const double factor = 4.0 * deltaE(j) / (deltaE(j) * deltaE(j) + 0.25);
+    sum += factor * Mstack(2, j) * Mstack(5, j);
+  }
+  BOOST_CHECK_CLOSE(serial[0](2, 5), sum, 1e-10);
+
+  BOOST_REQUIRE_EQUAL(threaded.size(), serial.size());
+  for (unsigned f = 0; f < serial.size(); f++) {
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        BOOST_CHECK_CLOSE(threaded[f](i, j), serial[f](i, j), 1e-10);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()